@@ -0,0 +1,963 @@
+#ifndef ART_MAP_H
+#define ART_MAP_H
+
+#include <stdexcept>
+#include <utility>
+#include <cstring>
+#include <type_traits>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "avlbst.h"
+
+/**
+* An adaptive radix tree (Leis et al., "The Adaptive Radix Tree: ARTful
+* Indexing for Main-Memory Databases") for integer keys, with the same
+* map interface and in-order iteration as AVLTree.
+*
+* Keys are split into bytes, most significant first (signed keys have
+* their sign bit flipped so byte order matches numeric order). Inner
+* nodes grow through Node4, Node16, Node48 and Node256 as children are
+* added and shrink back on removal, and each inner node stores the bytes
+* its single-child ancestors would have consumed (path compression), so
+* a lookup touches at most sizeof(Key) nodes however many keys there are.
+*
+* Child references are tagged pointers: the low bit is set for a leaf,
+* which is just the heap-allocated key/value pair.
+*/
+template <typename Key, typename Value>
+class ArtMap
+{
+    static_assert(std::is_integral<Key>::value && sizeof(Key) <= 8,
+                  "ArtMap keys must be integers of at most 64 bits");
+
+protected:
+    typedef typename std::make_unsigned<Key>::type Bits;
+    typedef std::pair<const Key, Value> Item;
+
+    static const int KEY_BYTES = sizeof(Key);
+
+    enum NodeType { NODE4, NODE16, NODE48, NODE256 };
+
+    /**
+    * Header shared by all inner node sizes.
+    */
+    struct Inner {
+        uint8_t type;
+        uint8_t prefixLen;
+        uint16_t count;
+        uint8_t prefix[8];
+
+        explicit Inner(uint8_t t) : type(t), prefixLen(0), count(0) { }
+    };
+
+    struct Node4 : Inner {
+        uint8_t keys[4];
+        uintptr_t children[4];
+        Node4() : Inner(NODE4) { }
+    };
+
+    struct Node16 : Inner {
+        uint8_t keys[16];
+        uintptr_t children[16];
+        Node16() : Inner(NODE16) { }
+    };
+
+    // index[b] is one more than the slot holding child b, or 0
+    struct Node48 : Inner {
+        uint8_t index[256];
+        uintptr_t children[48];
+        Node48() : Inner(NODE48) { std::memset(index, 0, sizeof(index)); }
+    };
+
+    struct Node256 : Inner {
+        uintptr_t children[256];
+        Node256() : Inner(NODE256) { std::memset(children, 0, sizeof(children)); }
+    };
+
+public:
+    ArtMap();
+    ~ArtMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+
+    /**
+    * An in-order iterator. It keeps the path from the root as an explicit
+    * stack of (node, byte) frames; iterators returned by find() start
+    * without one and rebuild it on the first increment.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ArtMap<Key, Value>;
+
+        struct Frame {
+            Inner* node;
+            int byte;
+        };
+
+        iterator(const ArtMap<Key, Value>* map, Item* leaf);
+        void descendLeftmost(uintptr_t ref);
+        void advance();
+
+        const ArtMap<Key, Value>* map_;
+        Item* current_;
+        Frame stack_[KEY_BYTES];
+        int depth_;
+        bool hasPath_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lowerBound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    template<typename Callback>
+    void scan(const Key& lo, const Key& hi, Callback callback) const;
+
+protected:
+    static Bits encode(const Key& key);
+    static uint8_t byteAt(Bits bits, int depth);
+    static bool isLeaf(uintptr_t ref);
+    static Item* leaf(uintptr_t ref);
+    static Inner* inner(uintptr_t ref);
+    static uintptr_t makeRef(Item* item);
+    static uintptr_t makeRef(Inner* node);
+
+    static int prefixMismatch(const Inner* node, Bits bits, int depth);
+    static uintptr_t* findChild(Inner* node, uint8_t byte);
+    static uintptr_t nextChild(const Inner* node, int from, int& byte);
+    static void addChild(uintptr_t* slot, Inner* node, uint8_t byte, uintptr_t child);
+    static void removeChild(uintptr_t* slot, Inner* node, uint8_t byte);
+    static void destroyInner(Inner* node);
+
+    Item* internalFind(const Key& key) const;
+
+    uintptr_t root_;
+
+private:
+    ArtMap(const ArtMap&);
+    ArtMap& operator=(const ArtMap&);
+};
+
+/**
+* Picks the ordered map implementation for a key type: ArtMap for
+* integer keys, AVLTree for everything else.
+*/
+template <typename Key, typename Value,
+          bool Radix = std::is_integral<Key>::value && !std::is_same<Key, bool>::value>
+struct OrderedMapFor {
+    typedef AVLTree<Key, Value> type;
+};
+
+template <typename Key, typename Value>
+struct OrderedMapFor<Key, Value, true> {
+    typedef ArtMap<Key, Value> type;
+};
+
+/*
+  ----------------------------------------------
+  Begin implementations for the ArtMap class.
+  ----------------------------------------------
+*/
+
+/**
+* Maps a key to unsigned bits whose byte order matches the key order.
+*/
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::Bits ArtMap<Key, Value>::encode(const Key& key)
+{
+    Bits bits = static_cast<Bits>(key);
+    if (std::is_signed<Key>::value) {
+        bits ^= static_cast<Bits>(Bits(1) << (8 * KEY_BYTES - 1));
+    }
+    return bits;
+}
+
+template<typename Key, typename Value>
+uint8_t ArtMap<Key, Value>::byteAt(Bits bits, int depth)
+{
+    return static_cast<uint8_t>(bits >> (8 * (KEY_BYTES - 1 - depth)));
+}
+
+template<typename Key, typename Value>
+bool ArtMap<Key, Value>::isLeaf(uintptr_t ref)
+{
+    return (ref & 1) != 0;
+}
+
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::Item* ArtMap<Key, Value>::leaf(uintptr_t ref)
+{
+    return reinterpret_cast<Item*>(ref & ~static_cast<uintptr_t>(1));
+}
+
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::Inner* ArtMap<Key, Value>::inner(uintptr_t ref)
+{
+    return reinterpret_cast<Inner*>(ref);
+}
+
+template<typename Key, typename Value>
+uintptr_t ArtMap<Key, Value>::makeRef(Item* item)
+{
+    return reinterpret_cast<uintptr_t>(item) | 1;
+}
+
+template<typename Key, typename Value>
+uintptr_t ArtMap<Key, Value>::makeRef(Inner* node)
+{
+    return reinterpret_cast<uintptr_t>(node);
+}
+
+/**
+* Returns the index of the first prefix byte of node that differs from
+* the key at depth, or the prefix length if they all match.
+*/
+template<typename Key, typename Value>
+int ArtMap<Key, Value>::prefixMismatch(const Inner* node, Bits bits, int depth)
+{
+    int i = 0;
+    while (i < node -> prefixLen && node -> prefix[i] == byteAt(bits, depth + i)) {
+        ++i;
+    }
+    return i;
+}
+
+/**
+* Returns the slot holding the child for byte, or NULL.
+*/
+template<typename Key, typename Value>
+uintptr_t* ArtMap<Key, Value>::findChild(Inner* node, uint8_t byte)
+{
+    switch (node -> type) {
+    case NODE4: {
+        Node4* n = static_cast<Node4*>(node);
+        for (int i = 0; i < n -> count; ++i) {
+            if (n -> keys[i] == byte) {
+                return &n -> children[i];
+            }
+        }
+        return NULL;
+    }
+    case NODE16: {
+        Node16* n = static_cast<Node16*>(node);
+#ifdef __SSE2__
+        __m128i match = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(byte)),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(n -> keys)));
+        int mask = _mm_movemask_epi8(match) & ((1 << n -> count) - 1);
+        return (mask != 0) ? &n -> children[__builtin_ctz(mask)] : NULL;
+#else
+        for (int i = 0; i < n -> count; ++i) {
+            if (n -> keys[i] == byte) {
+                return &n -> children[i];
+            }
+        }
+        return NULL;
+#endif
+    }
+    case NODE48: {
+        Node48* n = static_cast<Node48*>(node);
+        return (n -> index[byte] != 0) ? &n -> children[n -> index[byte] - 1] : NULL;
+    }
+    default: {
+        Node256* n = static_cast<Node256*>(node);
+        return (n -> children[byte] != 0) ? &n -> children[byte] : NULL;
+    }
+    }
+}
+
+/**
+* Returns the child with the smallest byte >= from (storing that byte),
+* or 0 if there is none.
+*/
+template<typename Key, typename Value>
+uintptr_t ArtMap<Key, Value>::nextChild(const Inner* node, int from, int& byte)
+{
+    switch (node -> type) {
+    case NODE4:
+    case NODE16: {
+        const uint8_t* keys;
+        const uintptr_t* children;
+        if (node -> type == NODE4) {
+            keys = static_cast<const Node4*>(node) -> keys;
+            children = static_cast<const Node4*>(node) -> children;
+        }
+        else {
+            keys = static_cast<const Node16*>(node) -> keys;
+            children = static_cast<const Node16*>(node) -> children;
+        }
+        for (int i = 0; i < node -> count; ++i) {
+            if (keys[i] >= from) {
+                byte = keys[i];
+                return children[i];
+            }
+        }
+        return 0;
+    }
+    case NODE48: {
+        const Node48* n = static_cast<const Node48*>(node);
+        for (int b = from; b < 256; ++b) {
+            if (n -> index[b] != 0) {
+                byte = b;
+                return n -> children[n -> index[b] - 1];
+            }
+        }
+        return 0;
+    }
+    default: {
+        const Node256* n = static_cast<const Node256*>(node);
+        for (int b = from; b < 256; ++b) {
+            if (n -> children[b] != 0) {
+                byte = b;
+                return n -> children[b];
+            }
+        }
+        return 0;
+    }
+    }
+}
+
+/**
+* Adds child under byte, first replacing node (stored in *slot) with the
+* next larger node type if it is full.
+*/
+template<typename Key, typename Value>
+void ArtMap<Key, Value>::addChild(uintptr_t* slot, Inner* node, uint8_t byte, uintptr_t child)
+{
+    if (node -> type == NODE4 || node -> type == NODE16) {
+        int capacity = (node -> type == NODE4) ? 4 : 16;
+        uint8_t* keys;
+        uintptr_t* children;
+        if (node -> count == capacity) {
+            if (node -> type == NODE4) {
+                Node4* n = static_cast<Node4*>(node);
+                Node16* grown = new Node16();
+                std::memcpy(grown -> prefix, n -> prefix, sizeof(n -> prefix));
+                grown -> prefixLen = n -> prefixLen;
+                grown -> count = n -> count;
+                std::memcpy(grown -> keys, n -> keys, sizeof(n -> keys));
+                std::memcpy(grown -> children, n -> children, sizeof(n -> children));
+                delete n;
+                *slot = makeRef(grown);
+                addChild(slot, grown, byte, child);
+            }
+            else {
+                Node16* n = static_cast<Node16*>(node);
+                Node48* grown = new Node48();
+                std::memcpy(grown -> prefix, n -> prefix, sizeof(n -> prefix));
+                grown -> prefixLen = n -> prefixLen;
+                grown -> count = n -> count;
+                for (int i = 0; i < n -> count; ++i) {
+                    grown -> children[i] = n -> children[i];
+                    grown -> index[n -> keys[i]] = static_cast<uint8_t>(i + 1);
+                }
+                delete n;
+                *slot = makeRef(grown);
+                addChild(slot, grown, byte, child);
+            }
+            return;
+        }
+
+        if (node -> type == NODE4) {
+            keys = static_cast<Node4*>(node) -> keys;
+            children = static_cast<Node4*>(node) -> children;
+        }
+        else {
+            keys = static_cast<Node16*>(node) -> keys;
+            children = static_cast<Node16*>(node) -> children;
+        }
+        // keep the keys sorted so that iteration can scan them in order
+        int pos = node -> count;
+        while (pos > 0 && keys[pos - 1] > byte) {
+            keys[pos] = keys[pos - 1];
+            children[pos] = children[pos - 1];
+            --pos;
+        }
+        keys[pos] = byte;
+        children[pos] = child;
+        node -> count++;
+    }
+    else if (node -> type == NODE48) {
+        Node48* n = static_cast<Node48*>(node);
+        if (n -> count == 48) {
+            Node256* grown = new Node256();
+            std::memcpy(grown -> prefix, n -> prefix, sizeof(n -> prefix));
+            grown -> prefixLen = n -> prefixLen;
+            grown -> count = n -> count;
+            for (int b = 0; b < 256; ++b) {
+                if (n -> index[b] != 0) {
+                    grown -> children[b] = n -> children[n -> index[b] - 1];
+                }
+            }
+            delete n;
+            *slot = makeRef(grown);
+            addChild(slot, grown, byte, child);
+            return;
+        }
+        n -> children[n -> count] = child;
+        n -> index[byte] = static_cast<uint8_t>(n -> count + 1);
+        n -> count++;
+    }
+    else {
+        Node256* n = static_cast<Node256*>(node);
+        n -> children[byte] = child;
+        n -> count++;
+    }
+}
+
+/**
+* Removes the child under byte, then replaces node (stored in *slot) with
+* a smaller node type once it is sparse enough. A Node4 left with a
+* single child is merged into that child.
+*/
+template<typename Key, typename Value>
+void ArtMap<Key, Value>::removeChild(uintptr_t* slot, Inner* node, uint8_t byte)
+{
+    if (node -> type == NODE4 || node -> type == NODE16) {
+        uint8_t* keys;
+        uintptr_t* children;
+        if (node -> type == NODE4) {
+            keys = static_cast<Node4*>(node) -> keys;
+            children = static_cast<Node4*>(node) -> children;
+        }
+        else {
+            keys = static_cast<Node16*>(node) -> keys;
+            children = static_cast<Node16*>(node) -> children;
+        }
+        int pos = 0;
+        while (keys[pos] != byte) {
+            ++pos;
+        }
+        for (int i = pos + 1; i < node -> count; ++i) {
+            keys[i - 1] = keys[i];
+            children[i - 1] = children[i];
+        }
+        node -> count--;
+
+        if (node -> type == NODE4 && node -> count == 1) {
+            uintptr_t only = children[0];
+            if (!isLeaf(only)) {
+                // fold this node's prefix and the edge byte into the child's prefix
+                Inner* c = inner(only);
+                uint8_t merged[8];
+                int len = node -> prefixLen;
+                std::memcpy(merged, node -> prefix, len);
+                merged[len++] = keys[0];
+                std::memcpy(merged + len, c -> prefix, c -> prefixLen);
+                len += c -> prefixLen;
+                std::memcpy(c -> prefix, merged, len);
+                c -> prefixLen = static_cast<uint8_t>(len);
+            }
+            delete static_cast<Node4*>(node);
+            *slot = only;
+        }
+        else if (node -> type == NODE16 && node -> count == 3) {
+            Node16* n = static_cast<Node16*>(node);
+            Node4* shrunk = new Node4();
+            std::memcpy(shrunk -> prefix, n -> prefix, sizeof(n -> prefix));
+            shrunk -> prefixLen = n -> prefixLen;
+            shrunk -> count = n -> count;
+            std::memcpy(shrunk -> keys, n -> keys, 3);
+            std::memcpy(shrunk -> children, n -> children, 3 * sizeof(uintptr_t));
+            delete n;
+            *slot = makeRef(shrunk);
+        }
+    }
+    else if (node -> type == NODE48) {
+        Node48* n = static_cast<Node48*>(node);
+        // move the last child into the freed slot to keep children dense
+        int pos = n -> index[byte] - 1;
+        int last = n -> count - 1;
+        n -> index[byte] = 0;
+        if (pos != last) {
+            n -> children[pos] = n -> children[last];
+            for (int b = 0; b < 256; ++b) {
+                if (n -> index[b] == last + 1) {
+                    n -> index[b] = static_cast<uint8_t>(pos + 1);
+                    break;
+                }
+            }
+        }
+        n -> count--;
+
+        if (n -> count == 12) {
+            Node16* shrunk = new Node16();
+            std::memcpy(shrunk -> prefix, n -> prefix, sizeof(n -> prefix));
+            shrunk -> prefixLen = n -> prefixLen;
+            int i = 0;
+            for (int b = 0; b < 256; ++b) {
+                if (n -> index[b] != 0) {
+                    shrunk -> keys[i] = static_cast<uint8_t>(b);
+                    shrunk -> children[i] = n -> children[n -> index[b] - 1];
+                    ++i;
+                }
+            }
+            shrunk -> count = static_cast<uint16_t>(i);
+            delete n;
+            *slot = makeRef(shrunk);
+        }
+    }
+    else {
+        Node256* n = static_cast<Node256*>(node);
+        n -> children[byte] = 0;
+        n -> count--;
+
+        if (n -> count == 37) {
+            Node48* shrunk = new Node48();
+            std::memcpy(shrunk -> prefix, n -> prefix, sizeof(n -> prefix));
+            shrunk -> prefixLen = n -> prefixLen;
+            int i = 0;
+            for (int b = 0; b < 256; ++b) {
+                if (n -> children[b] != 0) {
+                    shrunk -> children[i] = n -> children[b];
+                    shrunk -> index[b] = static_cast<uint8_t>(i + 1);
+                    ++i;
+                }
+            }
+            shrunk -> count = static_cast<uint16_t>(i);
+            delete n;
+            *slot = makeRef(shrunk);
+        }
+    }
+}
+
+template<typename Key, typename Value>
+void ArtMap<Key, Value>::destroyInner(Inner* node)
+{
+    switch (node -> type) {
+    case NODE4: delete static_cast<Node4*>(node); break;
+    case NODE16: delete static_cast<Node16*>(node); break;
+    case NODE48: delete static_cast<Node48*>(node); break;
+    default: delete static_cast<Node256*>(node); break;
+    }
+}
+
+/**
+* Default constructor for an ArtMap, which sets the root to NULL.
+*/
+template<typename Key, typename Value>
+ArtMap<Key, Value>::ArtMap() : root_(0)
+{
+
+}
+
+template<typename Key, typename Value>
+ArtMap<Key, Value>::~ArtMap()
+{
+    clear();
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+*/
+template<typename Key, typename Value>
+void ArtMap<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Bits bits = encode(keyValuePair.first);
+    uintptr_t* slot = &root_;
+    int depth = 0;
+
+    while (true) {
+        uintptr_t ref = *slot;
+        if (ref == 0) {
+            *slot = makeRef(new Item(keyValuePair));
+            return;
+        }
+
+        if (isLeaf(ref)) {
+            Item* existing = leaf(ref);
+            if (existing -> first == keyValuePair.first) {
+                existing -> second = keyValuePair.second;
+                return;
+            }
+            // split the leaf: a Node4 holding the bytes both keys share
+            Bits other = encode(existing -> first);
+            Node4* split = new Node4();
+            while (byteAt(other, depth + split -> prefixLen) == byteAt(bits, depth + split -> prefixLen)) {
+                split -> prefix[split -> prefixLen] = byteAt(bits, depth + split -> prefixLen);
+                split -> prefixLen++;
+            }
+            int at = depth + split -> prefixLen;
+            addChild(slot, split, byteAt(other, at), ref);
+            addChild(slot, split, byteAt(bits, at), makeRef(new Item(keyValuePair)));
+            *slot = makeRef(split);
+            return;
+        }
+
+        Inner* node = inner(ref);
+        int mismatch = prefixMismatch(node, bits, depth);
+        if (mismatch < node -> prefixLen) {
+            // split the compressed path above node
+            Node4* split = new Node4();
+            split -> prefixLen = static_cast<uint8_t>(mismatch);
+            std::memcpy(split -> prefix, node -> prefix, mismatch);
+            uint8_t edge = node -> prefix[mismatch];
+            node -> prefixLen = static_cast<uint8_t>(node -> prefixLen - mismatch - 1);
+            std::memmove(node -> prefix, node -> prefix + mismatch + 1, node -> prefixLen);
+            addChild(slot, split, edge, ref);
+            addChild(slot, split, byteAt(bits, depth + mismatch), makeRef(new Item(keyValuePair)));
+            *slot = makeRef(split);
+            return;
+        }
+
+        depth += node -> prefixLen;
+        uint8_t byte = byteAt(bits, depth);
+        uintptr_t* child = findChild(node, byte);
+        if (child == NULL) {
+            addChild(slot, node, byte, makeRef(new Item(keyValuePair)));
+            return;
+        }
+        slot = child;
+        depth++;
+    }
+}
+
+/**
+* Removes the key if it is present.
+*/
+template<typename Key, typename Value>
+void ArtMap<Key, Value>::remove(const Key& key)
+{
+    if (root_ == 0) {
+        return;
+    }
+    if (isLeaf(root_)) {
+        if (leaf(root_) -> first == key) {
+            delete leaf(root_);
+            root_ = 0;
+        }
+        return;
+    }
+
+    Bits bits = encode(key);
+    uintptr_t* slot = &root_;
+    int depth = 0;
+    while (true) {
+        Inner* node = inner(*slot);
+        if (prefixMismatch(node, bits, depth) < node -> prefixLen) {
+            return;
+        }
+        depth += node -> prefixLen;
+        uint8_t byte = byteAt(bits, depth);
+        uintptr_t* child = findChild(node, byte);
+        if (child == NULL) {
+            return;
+        }
+        if (isLeaf(*child)) {
+            if (leaf(*child) -> first != key) {
+                return;
+            }
+            delete leaf(*child);
+            removeChild(slot, node, byte);
+            return;
+        }
+        slot = child;
+        depth++;
+    }
+}
+
+/**
+* Deletes every node and item with an explicit stack.
+*/
+template<typename Key, typename Value>
+void ArtMap<Key, Value>::clear()
+{
+    std::vector<uintptr_t> pending;
+    if (root_ != 0) {
+        pending.push_back(root_);
+    }
+    while (!pending.empty()) {
+        uintptr_t ref = pending.back();
+        pending.pop_back();
+        if (isLeaf(ref)) {
+            delete leaf(ref);
+            continue;
+        }
+        Inner* node = inner(ref);
+        int byte = -1;
+        uintptr_t child;
+        while ((child = nextChild(node, byte + 1, byte)) != 0) {
+            pending.push_back(child);
+        }
+        destroyInner(node);
+    }
+    root_ = 0;
+}
+
+template<typename Key, typename Value>
+bool ArtMap<Key, Value>::empty() const
+{
+    return root_ == 0;
+}
+
+/**
+* Descends by key bytes, comparing the full key only at the leaf.
+*/
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::Item* ArtMap<Key, Value>::internalFind(const Key& key) const
+{
+    Bits bits = encode(key);
+    uintptr_t ref = root_;
+    int depth = 0;
+    while (ref != 0 && !isLeaf(ref)) {
+        Inner* node = inner(ref);
+        if (prefixMismatch(node, bits, depth) < node -> prefixLen) {
+            return NULL;
+        }
+        depth += node -> prefixLen;
+        uintptr_t* child = findChild(node, byteAt(bits, depth));
+        if (child == NULL) {
+            return NULL;
+        }
+        ref = *child;
+        depth++;
+    }
+    if (ref != 0 && leaf(ref) -> first == key) {
+        return leaf(ref);
+    }
+    return NULL;
+}
+
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::iterator ArtMap<Key, Value>::begin() const
+{
+    iterator it(this, NULL);
+    if (root_ != 0) {
+        it.descendLeftmost(root_);
+    }
+    return it;
+}
+
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::iterator ArtMap<Key, Value>::end() const
+{
+    return iterator(this, NULL);
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::iterator ArtMap<Key, Value>::find(const Key& key) const
+{
+    return iterator(this, internalFind(key));
+}
+
+/**
+* Returns an iterator to the first item whose key is >= key, or end().
+*/
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::iterator ArtMap<Key, Value>::lowerBound(const Key& key) const
+{
+    iterator it(this, NULL);
+    Bits bits = encode(key);
+    uintptr_t ref = root_;
+    int depth = 0;
+
+    while (ref != 0) {
+        if (isLeaf(ref)) {
+            if (!(leaf(ref) -> first < key)) {
+                it.current_ = leaf(ref);
+            }
+            else {
+                it.advance();
+            }
+            return it;
+        }
+
+        Inner* node = inner(ref);
+        int mismatch = prefixMismatch(node, bits, depth);
+        if (mismatch < node -> prefixLen) {
+            // the whole subtree lies on one side of key
+            if (node -> prefix[mismatch] > byteAt(bits, depth + mismatch)) {
+                it.descendLeftmost(ref);
+            }
+            else {
+                it.advance();
+            }
+            return it;
+        }
+
+        depth += node -> prefixLen;
+        uint8_t byte = byteAt(bits, depth);
+        uintptr_t* child = findChild(node, byte);
+        if (child != NULL) {
+            typename iterator::Frame frame = { node, byte };
+            it.stack_[it.depth_++] = frame;
+            ref = *child;
+            depth++;
+            continue;
+        }
+
+        int next;
+        uintptr_t larger = nextChild(node, byte + 1, next);
+        if (larger != 0) {
+            typename iterator::Frame frame = { node, next };
+            it.stack_[it.depth_++] = frame;
+            it.descendLeftmost(larger);
+        }
+        else {
+            it.advance();
+        }
+        return it;
+    }
+    return it;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+Value& ArtMap<Key, Value>::operator[](const Key& key)
+{
+    Item* item = internalFind(key);
+    if (item == NULL) throw std::out_of_range("Invalid key");
+    return item -> second;
+}
+
+template<typename Key, typename Value>
+Value const & ArtMap<Key, Value>::operator[](const Key& key) const
+{
+    Item* item = internalFind(key);
+    if (item == NULL) throw std::out_of_range("Invalid key");
+    return item -> second;
+}
+
+/**
+* Calls callback on every item with lo <= key <= hi, in order.
+*/
+template<typename Key, typename Value>
+template<typename Callback>
+void ArtMap<Key, Value>::scan(const Key& lo, const Key& hi, Callback callback) const
+{
+    for (iterator it = lowerBound(lo); it != end() && !(hi < it -> first); ++it) {
+        callback(*it);
+    }
+}
+
+/*
+  --------------------------------------------
+  End implementations for the ArtMap class.
+  --------------------------------------------
+*/
+
+/*
+  -------------------------------------------------------
+  Begin implementations for the ArtMap::iterator class.
+  -------------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to end().
+*/
+template<typename Key, typename Value>
+ArtMap<Key, Value>::iterator::iterator() :
+    map_(NULL), current_(NULL), depth_(0), hasPath_(true)
+{
+
+}
+
+template<typename Key, typename Value>
+ArtMap<Key, Value>::iterator::iterator(const ArtMap<Key, Value>* map, Item* leaf) :
+    map_(map), current_(leaf), depth_(0), hasPath_(leaf == NULL)
+{
+
+}
+
+/**
+* Pushes the path to the smallest leaf under ref and stops there.
+*/
+template<typename Key, typename Value>
+void ArtMap<Key, Value>::iterator::descendLeftmost(uintptr_t ref)
+{
+    while (!isLeaf(ref)) {
+        Frame frame = { inner(ref), 0 };
+        ref = nextChild(frame.node, 0, frame.byte);
+        stack_[depth_++] = frame;
+    }
+    current_ = leaf(ref);
+}
+
+/**
+* Moves to the leftmost leaf of the next sibling subtree, popping
+* exhausted frames, or to end() if there is none.
+*/
+template<typename Key, typename Value>
+void ArtMap<Key, Value>::iterator::advance()
+{
+    while (depth_ > 0) {
+        Frame& top = stack_[depth_ - 1];
+        uintptr_t next = nextChild(top.node, top.byte + 1, top.byte);
+        if (next != 0) {
+            descendLeftmost(next);
+            return;
+        }
+        --depth_;
+    }
+    current_ = NULL;
+}
+
+template<typename Key, typename Value>
+std::pair<const Key, Value>& ArtMap<Key, Value>::iterator::operator*() const
+{
+    return *current_;
+}
+
+template<typename Key, typename Value>
+std::pair<const Key, Value>* ArtMap<Key, Value>::iterator::operator->() const
+{
+    return current_;
+}
+
+template<typename Key, typename Value>
+bool ArtMap<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename Key, typename Value>
+bool ArtMap<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+/**
+* Advances to the next key in order.
+*/
+template<typename Key, typename Value>
+typename ArtMap<Key, Value>::iterator& ArtMap<Key, Value>::iterator::operator++()
+{
+    if (!hasPath_) {
+        // came from find(): rebuild the path down to the current leaf
+        *this = map_ -> lowerBound(current_ -> first);
+    }
+    advance();
+    return *this;
+}
+
+/*
+  -----------------------------------------------------
+  End implementations for the ArtMap::iterator class.
+  -----------------------------------------------------
+*/
+
+#endif
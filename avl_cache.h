@@ -0,0 +1,397 @@
+#ifndef AVL_CACHE_H
+#define AVL_CACHE_H
+
+#include <map>
+#include <stdint.h>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also carries the cache bookkeeping, so an entry is
+* still a single allocation: links in its recency list, its access
+* count, and the number of capacity units it is charged for.
+*/
+template <typename Key, typename Value>
+class CacheNode : public AVLNode<Key, Value>
+{
+public:
+    CacheNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+
+    CacheNode<Key, Value>* prev_;       // toward the most recently used end
+    CacheNode<Key, Value>* next_;       // toward the eviction end
+    uint64_t frequency_;
+    size_t charge_;
+};
+
+template<class Key, class Value>
+CacheNode<Key, Value>::CacheNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), prev_(NULL), next_(NULL), frequency_(1), charge_(0)
+{
+
+}
+
+/**
+* Default entry size for byte capacities: just the node itself. Supply
+* a functor that also counts memory the key or value owns (e.g. string
+* contents) for a tighter bound.
+*/
+template <typename Key, typename Value>
+struct NodeBytes {
+    size_t operator()(const Key&, const Value&) const
+    {
+        return sizeof(CacheNode<Key, Value>);
+    }
+};
+
+/**
+* Hit, miss and eviction counters since construction or resetStats().
+*/
+struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+/**
+* An AVLTree with a capacity, for use as an ordered cache. Every entry is
+* linked into an intrusive recency list (LRU) or into the list for its
+* access count (LFU); when an insert would exceed the capacity, the
+* victim is removed through the ordinary AVLTree::remove path in
+* O(log n). Iteration and scan() stay in key order.
+*
+* find() and operator[] count as uses; inserting a new key counts as its
+* first use and inserting an existing one as another.
+*/
+template <typename Key, typename Value, typename EntryBytes = NodeBytes<Key, Value> >
+class BoundedAVLCache : public AVLTree<Key, Value>
+{
+public:
+    enum Policy { LRU, LFU };
+    enum Unit { ENTRIES, BYTES };
+
+    typedef typename AVLTree<Key, Value>::iterator iterator;
+
+    BoundedAVLCache(size_t capacity, Unit unit = ENTRIES, Policy policy = LRU);
+    virtual ~BoundedAVLCache();
+
+    iterator find(const Key& key);
+    Value& operator[](const Key& key);
+    iterator peek(const Key& key) const;
+
+    size_t used() const;
+    size_t capacity() const;
+    CacheStats stats() const;
+    void resetStats();
+
+protected:
+    typedef CacheNode<Key, Value> Entry;
+
+    /**
+    * A doubly linked list of entries, most recent at the head.
+    */
+    struct List {
+        Entry* head;
+        Entry* tail;
+
+        List() : head(NULL), tail(NULL) { }
+    };
+
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) override;
+    virtual void destroyNode(Node<Key, Value>* node) override;
+    virtual std::pair<Node<Key, Value>*, bool> insertNode(const std::pair<const Key, Value>& keyValuePair, bool overwrite) override;
+    virtual bool tracksNodes() const override;
+
+    size_t chargeFor(const Key& key, const Value& value) const;
+    static void pushFront(List& list, Entry* entry);
+    static void unlinkFrom(List& list, Entry* entry);
+    void link(Entry* entry);
+    void unlink(Entry* entry);
+    void touch(Entry* entry);
+    Entry* victim() const;
+    void evictFor(size_t incoming, Entry* keep);
+
+    size_t capacity_;
+    Unit unit_;
+    Policy policy_;
+    size_t used_;
+    CacheStats stats_;
+    EntryBytes entryBytes_;
+
+    List recency_;                      // LRU order
+    std::map<uint64_t, List> buckets_;  // LFU: one list per access count
+
+private:
+    BoundedAVLCache(const BoundedAVLCache&);
+    BoundedAVLCache& operator=(const BoundedAVLCache&);
+};
+
+/*
+  -------------------------------------------------------
+  Begin implementations for the BoundedAVLCache class.
+  -------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename EntryBytes>
+BoundedAVLCache<Key, Value, EntryBytes>::BoundedAVLCache(size_t capacity, Unit unit, Policy policy) :
+    capacity_(capacity), unit_(unit), policy_(policy), used_(0)
+{
+    resetStats();
+}
+
+/**
+* Frees the entries here, while destroyNode still reaches this class.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+BoundedAVLCache<Key, Value, EntryBytes>::~BoundedAVLCache()
+{
+    this -> clear();
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+size_t BoundedAVLCache<Key, Value, EntryBytes>::chargeFor(const Key& key, const Value& value) const
+{
+    return (unit_ == ENTRIES) ? 1 : entryBytes_(key, value);
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+void BoundedAVLCache<Key, Value, EntryBytes>::pushFront(List& list, Entry* entry)
+{
+    entry -> prev_ = NULL;
+    entry -> next_ = list.head;
+    if (list.head != NULL) {
+        list.head -> prev_ = entry;
+    }
+    else {
+        list.tail = entry;
+    }
+    list.head = entry;
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+void BoundedAVLCache<Key, Value, EntryBytes>::unlinkFrom(List& list, Entry* entry)
+{
+    if (entry -> prev_ != NULL) {
+        entry -> prev_ -> next_ = entry -> next_;
+    }
+    else {
+        list.head = entry -> next_;
+    }
+    if (entry -> next_ != NULL) {
+        entry -> next_ -> prev_ = entry -> prev_;
+    }
+    else {
+        list.tail = entry -> prev_;
+    }
+    entry -> prev_ = entry -> next_ = NULL;
+}
+
+/**
+* Adds entry as the most recent one (of its access count, under LFU).
+*/
+template <typename Key, typename Value, typename EntryBytes>
+void BoundedAVLCache<Key, Value, EntryBytes>::link(Entry* entry)
+{
+    if (policy_ == LRU) {
+        pushFront(recency_, entry);
+    }
+    else {
+        pushFront(buckets_[entry -> frequency_], entry);
+    }
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+void BoundedAVLCache<Key, Value, EntryBytes>::unlink(Entry* entry)
+{
+    if (policy_ == LRU) {
+        unlinkFrom(recency_, entry);
+    }
+    else {
+        typename std::map<uint64_t, List>::iterator bucket = buckets_.find(entry -> frequency_);
+        unlinkFrom(bucket -> second, entry);
+        if (bucket -> second.head == NULL) {
+            buckets_.erase(bucket);
+        }
+    }
+}
+
+/**
+* Records a use of entry.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+void BoundedAVLCache<Key, Value, EntryBytes>::touch(Entry* entry)
+{
+    if (policy_ == LRU) {
+        if (recency_.head != entry) {
+            unlinkFrom(recency_, entry);
+            pushFront(recency_, entry);
+        }
+    }
+    else {
+        unlink(entry);
+        entry -> frequency_++;
+        link(entry);
+    }
+}
+
+/**
+* Returns the entry to evict next: the least recently used one, or under
+* LFU the least recently used of those with the lowest access count.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+typename BoundedAVLCache<Key, Value, EntryBytes>::Entry*
+BoundedAVLCache<Key, Value, EntryBytes>::victim() const
+{
+    if (policy_ == LRU) {
+        return recency_.tail;
+    }
+    return buckets_.empty() ? NULL : buckets_.begin() -> second.tail;
+}
+
+/**
+* Evicts entries (never keep) until incoming more units fit.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+void BoundedAVLCache<Key, Value, EntryBytes>::evictFor(size_t incoming, Entry* keep)
+{
+    while (used_ + incoming > capacity_) {
+        Entry* entry = victim();
+        if (entry == keep && entry != NULL) {
+            // keep is the only candidate left at the eviction end; look past it
+            entry = (entry -> prev_ != NULL) ? entry -> prev_ :
+                    (policy_ == LFU && buckets_.size() > 1) ? (++buckets_.begin()) -> second.tail : NULL;
+        }
+        if (entry == NULL) {
+            return;
+        }
+        this -> remove(entry -> getKey());
+        stats_.evictions++;
+    }
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+AVLNode<Key, Value>* BoundedAVLCache<Key, Value, EntryBytes>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    Entry* entry = new Entry(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+    entry -> charge_ = chargeFor(key, value);
+    used_ += entry -> charge_;
+    link(entry);
+    return entry;
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+void BoundedAVLCache<Key, Value, EntryBytes>::destroyNode(Node<Key, Value>* node)
+{
+    Entry* entry = static_cast<Entry*>(node);
+    unlink(entry);
+    used_ -= entry -> charge_;
+    AVLTree<Key, Value>::destroyNode(node);
+}
+
+/**
+* createNode and destroyNode keep the eviction lists and totals in sync.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+bool BoundedAVLCache<Key, Value, EntryBytes>::tracksNodes() const
+{
+    return true;
+}
+
+/**
+* The insertion core behind insert, insertOrAssign and tryInsert: counts
+* a use of an existing entry (overwriting it if asked), or first evicts
+* enough entries to keep the cache within its capacity.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+std::pair<Node<Key, Value>*, bool>
+BoundedAVLCache<Key, Value, EntryBytes>::insertNode(const std::pair<const Key, Value>& keyValuePair, bool overwrite)
+{
+    Entry* existing = static_cast<Entry*>(this -> internalFind(keyValuePair.first));
+    size_t charge = chargeFor(keyValuePair.first, keyValuePair.second);
+
+    if (existing != NULL) {
+        if (overwrite) {
+            existing -> setValue(keyValuePair.second);
+            used_ = used_ - existing -> charge_ + charge;
+            existing -> charge_ = charge;
+        }
+        touch(existing);
+        evictFor(0, existing);
+        return std::make_pair(static_cast<Node<Key, Value>*>(existing), false);
+    }
+
+    evictFor(charge, NULL);
+    return AVLTree<Key, Value>::insertNode(keyValuePair, overwrite);
+}
+
+/**
+* Looks up key, counting a hit (and a use of the entry) or a miss.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+typename BoundedAVLCache<Key, Value, EntryBytes>::iterator
+BoundedAVLCache<Key, Value, EntryBytes>::find(const Key& key)
+{
+    Entry* entry = static_cast<Entry*>(this -> internalFind(key));
+    if (entry == NULL) {
+        stats_.misses++;
+        return this -> end();
+    }
+    stats_.hits++;
+    touch(entry);
+    return this -> iteratorAt(entry);
+}
+
+/**
+ * @precondition The key exists in the cache
+ * Returns the value associated with the key and counts a use
+ */
+template <typename Key, typename Value, typename EntryBytes>
+Value& BoundedAVLCache<Key, Value, EntryBytes>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == this -> end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+/**
+* Looks up key without counting it as a use.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+typename BoundedAVLCache<Key, Value, EntryBytes>::iterator
+BoundedAVLCache<Key, Value, EntryBytes>::peek(const Key& key) const
+{
+    return AVLTree<Key, Value>::find(key);
+}
+
+/**
+* Returns the capacity units in use: entries, or bytes.
+*/
+template <typename Key, typename Value, typename EntryBytes>
+size_t BoundedAVLCache<Key, Value, EntryBytes>::used() const
+{
+    return used_;
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+size_t BoundedAVLCache<Key, Value, EntryBytes>::capacity() const
+{
+    return capacity_;
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+CacheStats BoundedAVLCache<Key, Value, EntryBytes>::stats() const
+{
+    return stats_;
+}
+
+template <typename Key, typename Value, typename EntryBytes>
+void BoundedAVLCache<Key, Value, EntryBytes>::resetStats()
+{
+    stats_.hits = stats_.misses = stats_.evictions = 0;
+}
+
+/*
+  -----------------------------------------------------
+  End implementations for the BoundedAVLCache class.
+  -----------------------------------------------------
+*/
+
+#endif
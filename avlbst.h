@@ -35,6 +35,13 @@ public:
     virtual AVLNode<Key, Value>* getLeft() const override;
     virtual AVLNode<Key, Value>* getRight() const override;
 
+    // Summaries a subclass keeps of the node's subtree, such as a hash of
+    // its items. AVLTree refreshes them as the shape changes; AVLNode
+    // itself keeps none.
+    virtual void refresh();
+    virtual bool isFresh() const;
+    virtual void copySummary(const AVLNode<Key, Value>* source);
+
 protected:
     int8_t balance_;    // effectively a signed char
 };
@@ -119,6 +126,35 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
     return static_cast<AVLNode<Key, Value>*>(this->right_);
 }
 
+/**
+* Recomputes the node's summary from its own item and its children's
+* summaries. Called whenever its children change, children first.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::refresh()
+{
+
+}
+
+/**
+* Returns true if the stored summary matches the children's, for
+* validation.
+*/
+template<class Key, class Value>
+bool AVLNode<Key, Value>::isFresh() const
+{
+    return true;
+}
+
+/**
+* Copies source's summary into this node when a tree is cloned.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::copySummary(const AVLNode<Key, Value>* source)
+{
+
+}
+
 
 /*
   -----------------------------------------------
@@ -131,21 +167,99 @@ template <class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
+    AVLTree();
+    AVLTree(const AVLTree<Key, Value>& other);
+    AVLTree(AVLTree<Key, Value>&& other);
+    AVLTree<Key, Value>& operator=(const AVLTree<Key, Value>& other);
+    AVLTree<Key, Value>& operator=(AVLTree<Key, Value>&& other);
     virtual void insert(const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key& key);  // TODO
+    virtual void eraseRange(const Key& lo, const Key& hi) override;
+    template<typename RandomIt>
+    void buildFromSorted(RandomIt first, RandomIt last);
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) override;
+    virtual std::pair<Node<Key, Value>*, bool> insertNode(const std::pair<const Key, Value>& new_item, bool overwrite) override;
+    virtual void removeNode(Node<Key, Value>* node) override;
+    virtual Node<Key, Value>* cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent) override;
+    virtual int computeHeight() const override;
+    virtual bool computeBalanced() const override;
+    virtual bool checkNode(const Node<Key, Value>* node, int leftHeight, int rightHeight) const override;
 
     // Add helper functions here
     void insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node, bool nIsLeftChild);
     void removeFix(AVLNode<Key, Value>* node, int diff);
     virtual void rotateRight(AVLNode<Key, Value>* node);
     virtual void rotateLeft(AVLNode<Key, Value>* node);
+    template<typename RandomIt>
+    AVLNode<Key, Value>* buildRange(RandomIt first, size_t count, AVLNode<Key, Value>* parent, int& height);
+    void refreshToRoot(AVLNode<Key, Value>* node);
 
+    // Split/join helpers for eraseRange. They work on detached subtrees
+    // whose heights are passed along, so nothing needs a full height walk.
+    static int heightOf(AVLNode<Key, Value>* node);
+    AVLNode<Key, Value>* rebalance(AVLNode<Key, Value>* node);
+    bool growFix(AVLNode<Key, Value>* node, bool rightGrew);
+    AVLNode<Key, Value>* join(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* pivot,
+                              AVLNode<Key, Value>* right, int rightHeight, int& height);
+    AVLNode<Key, Value>* split(AVLNode<Key, Value>* node, int height, const Key& key, bool keepEqualLeft,
+                               AVLNode<Key, Value>*& right, int& leftHeight, int& rightHeight);
 
 
 };
 
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree()
+{
+
+}
+
+/**
+* Copies other's shape and balances in O(n). The copy happens here rather
+* than in the base constructor so that cloneNode dispatches to AVLTree.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree(const AVLTree<Key, Value>& other) :
+    BinarySearchTree<Key, Value>()
+{
+    this -> cloneFrom(other);
+}
+
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree(AVLTree<Key, Value>&& other) :
+    BinarySearchTree<Key, Value>(std::move(other))
+{
+
+}
+
+template<class Key, class Value>
+AVLTree<Key, Value>& AVLTree<Key, Value>::operator=(const AVLTree<Key, Value>& other)
+{
+    BinarySearchTree<Key, Value>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value>
+AVLTree<Key, Value>& AVLTree<Key, Value>::operator=(AVLTree<Key, Value>&& other)
+{
+    BinarySearchTree<Key, Value>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* Copies a node together with its balance and summary.
+*/
+template<class Key, class Value>
+Node<Key, Value>* AVLTree<Key, Value>::cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent)
+{
+    const AVLNode<Key, Value>* original = static_cast<const AVLNode<Key, Value>*>(source);
+    AVLNode<Key, Value>* copy = createNode(source -> getKey(), source -> getValue(), parent);
+    copy -> setBalance(original -> getBalance());
+    copy -> copySummary(original);
+    return copy;
+}
+
 template<class Key, class Value>
 void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node) {
     // exit if rotation isn't possible
@@ -184,6 +298,9 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node) {
         grandchild -> setParent(node);
     }
 
+    // the demoted node first, since it is now the child's child
+    node -> refresh();
+    child -> refresh();
 }
 
 template<class Key, class Value>
@@ -225,6 +342,9 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node) {
         grandchild -> setParent(node);
     }
 
+    // the demoted node first, since it is now the child's child
+    node -> refresh();
+    child -> refresh();
 }
 
 /*
@@ -235,15 +355,30 @@ template<class Key, class Value>
 void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
 {
     // TODO
+    this -> insertNode(new_item, true);
+}
 
+/**
+* Inserts like BinarySearchTree::insertNode and then restores the AVL
+* balance. Rotations move nodes but never items, so the returned node
+* still holds the key afterwards. Rotations refresh the nodes they move;
+* the new node's ancestors are then refreshed with their final children.
+*/
+template<class Key, class Value>
+std::pair<Node<Key, Value>*, bool>
+AVLTree<Key, Value>::insertNode(const std::pair<const Key, Value>& new_item, bool overwrite)
+{
     const Key& key = new_item.first;
     const Value& value = new_item.second;
     AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    AVLNode<Key, Value>* inserted = NULL;
 
     // insert into empty tree
     if (this -> empty()) {
-        this -> root_ = new AVLNode<Key, Value>(key, value, NULL);
-        return;
+        this -> root_ = createNode(key, value, NULL);
+        ++this -> size_;
+        ++this -> version_;
+        return std::make_pair(this -> root_, true);
     }
 
     bool isLeftChild = false;
@@ -252,8 +387,10 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
     while (curr != NULL) {
         // update value if key already exists
         if (key == curr -> getKey()) {
-            curr -> setValue(value);
-            return;
+            if (overwrite) {
+                curr -> setValue(value);
+            }
+            return std::make_pair(static_cast<Node<Key, Value>*>(curr), false);
         }
         // traverse left if key is less than current node
         else if (key < curr -> getKey()) {
@@ -261,7 +398,8 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
                 curr = curr -> getLeft();
             }
             else {
-                curr -> setLeft(new AVLNode<Key, Value>(key, value, curr));
+                inserted = createNode(key, value, curr);
+                curr -> setLeft(inserted);
                 isLeftChild = true;
                 break;
             }
@@ -272,13 +410,17 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
                 curr = curr -> getRight();
             }
             else {
-                curr -> setRight(new AVLNode<Key, Value>(key, value, curr));
+                inserted = createNode(key, value, curr);
+                curr -> setRight(inserted);
                 isLeftChild = false;
                 break;
             }
         }
     }
 
+    ++this -> size_;
+    ++this -> version_;
+
     // fix balance if parent's initial balance was 0 
     if (curr -> getBalance() == 0) {
         if (isLeftChild) {
@@ -294,7 +436,8 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
         curr -> setBalance(0);
     }
 
-
+    refreshToRoot(inserted -> getParent());
+    return std::make_pair(static_cast<Node<Key, Value>*>(inserted), true);
 }
 
 template<class Key, class Value>
@@ -415,10 +558,21 @@ void AVLTree<Key, Value>:: remove(const Key& key)
     AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this -> internalFind(key));
 
     // doesn't continue if key doesn't exist
-    if (curr == NULL) {
-        return;
+    if (curr != NULL) {
+        removeNode(curr);
     }
-    
+}
+
+/**
+* Unlinks and frees a node, then retraces the balances and refreshes
+* from the node it was unlinked from up. Swapping with the predecessor
+* first changes no subtree's items above the predecessor's old place.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::removeNode(Node<Key, Value>* node)
+{
+    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(node);
+
     // swaps current node with its predecessor if current node has two children
     if (curr -> getLeft() != NULL && curr -> getRight() != NULL) {
         // find predecessor
@@ -465,11 +619,13 @@ void AVLTree<Key, Value>:: remove(const Key& key)
     }
 
     // delete current node after updating pointers
-    delete curr;
+    this -> destroyNode(curr);
+    --this -> size_;
+    ++this -> version_;
 
     // fix balance after removal
     removeFix(parent, diff);
-
+    refreshToRoot(parent);
 }
 
 template<class Key, class Value>
@@ -597,6 +753,15 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff) {
 }
 
 
+/**
+* Allocates an AVLNode so that every node in the tree carries a balance.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return new AVLNode<Key, Value>(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
 template<class Key, class Value>
 void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
@@ -606,5 +771,355 @@ void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>*
     n2->setBalance(tempB);
 }
 
+/**
+* Replaces the contents with the items in [first, last), which must be
+* sorted by strictly increasing key. Builds a perfectly balanced tree in
+* O(n) with no rotations.
+*/
+template<class Key, class Value>
+template<typename RandomIt>
+void AVLTree<Key, Value>::buildFromSorted(RandomIt first, RandomIt last)
+{
+    this -> clear();
+    int height;
+    this -> root_ = buildRange(first, static_cast<size_t>(last - first), NULL, height);
+    this -> size_ = static_cast<size_t>(last - first);
+    ++this -> version_;
+}
+
+/**
+* Builds the subtree for count items starting at first, rooted at the
+* middle item, and reports its height so that balances can be set on the
+* way back up.
+*/
+template<class Key, class Value>
+template<typename RandomIt>
+AVLNode<Key, Value>* AVLTree<Key, Value>::buildRange(RandomIt first, size_t count, AVLNode<Key, Value>* parent, int& height)
+{
+    if (count == 0) {
+        height = 0;
+        return NULL;
+    }
+
+    size_t mid = count / 2;
+    AVLNode<Key, Value>* node = createNode(first[mid].first, first[mid].second, parent);
+    int leftHeight, rightHeight;
+    node -> setLeft(buildRange(first, mid, node, leftHeight));
+    node -> setRight(buildRange(first + mid + 1, count - mid - 1, node, rightHeight));
+    node -> setBalance(static_cast<int8_t>(rightHeight - leftHeight));
+    node -> refresh();
+    height = std::max(leftHeight, rightHeight) + 1;
+    return node;
+}
+
+/**
+* Refreshes node's summary and every ancestor's, in O(depth).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::refreshToRoot(AVLNode<Key, Value>* node)
+{
+    while (node != NULL) {
+        node -> refresh();
+        node = node -> getParent();
+    }
+}
+
+/**
+* Removes every item with lo <= key <= hi in O(log n + k). The tree is
+* split into the parts below, inside and above the range; the root of
+* the middle part is kept as the pivot to join the outer parts back
+* together (it sorts between them), the rest of the middle part is freed
+* in bulk through destroyNode, and finally the pivot itself is unlinked.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::eraseRange(const Key& lo, const Key& hi)
+{
+    if (hi < lo) {
+        return;
+    }
+
+    // nothing to do (and nothing to split) if no key falls in the range
+    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    while (curr != NULL && (curr -> getKey() < lo || hi < curr -> getKey())) {
+        curr = (curr -> getKey() < lo) ? curr -> getRight() : curr -> getLeft();
+    }
+    if (curr == NULL) {
+        return;
+    }
+
+    AVLNode<Key, Value>* rest;
+    AVLNode<Key, Value>* above;
+    int belowHeight, restHeight, insideHeight, aboveHeight;
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    AVLNode<Key, Value>* below = split(root, heightOf(root), lo, false, rest, belowHeight, restHeight);
+    AVLNode<Key, Value>* inside = split(rest, restHeight, hi, true, above, insideHeight, aboveHeight);
+
+    AVLNode<Key, Value>* pivot = inside;
+    this -> size_ -= this -> destroySubtree(pivot -> getLeft());
+    this -> size_ -= this -> destroySubtree(pivot -> getRight());
+    ++this -> version_;
+    pivot -> setLeft(NULL);
+    pivot -> setRight(NULL);
+
+    int height;
+    this -> root_ = join(below, belowHeight, pivot, above, aboveHeight, height);
+    this -> root_ -> setParent(NULL);
+
+    removeNode(pivot);
+}
+
+/**
+* Follows the balances down the taller side, in O(log n).
+*/
+template<class Key, class Value>
+int AVLTree<Key, Value>::computeHeight() const
+{
+    return heightOf(static_cast<AVLNode<Key, Value>*>(this -> root_));
+}
+
+/**
+* Every insert and remove restores the AVL invariant, so the tree is
+* always balanced; nothing needs walking.
+*/
+template<class Key, class Value>
+bool AVLTree<Key, Value>::computeBalanced() const
+{
+    return true;
+}
+
+/**
+* A node's stored balance must match its subtree heights and be within
+* one, and its summary must match its children's.
+*/
+template<class Key, class Value>
+bool AVLTree<Key, Value>::checkNode(const Node<Key, Value>* node, int leftHeight, int rightHeight) const
+{
+    const AVLNode<Key, Value>* curr = static_cast<const AVLNode<Key, Value>*>(node);
+    int balance = curr -> getBalance();
+    return balance == rightHeight - leftHeight && balance >= -1 && balance <= 1 && curr -> isFresh();
+}
+
+/**
+* Computes a subtree's height from the balances along its taller side.
+*/
+template<class Key, class Value>
+int AVLTree<Key, Value>::heightOf(AVLNode<Key, Value>* node)
+{
+    int height = 0;
+    while (node != NULL) {
+        ++height;
+        node = (node -> getBalance() > 0) ? node -> getRight() : node -> getLeft();
+    }
+    return height;
+}
+
+/**
+* Restores a node whose balance has reached +2 or -2 with one or two
+* rotations, setting every affected balance (the child may be balanced,
+* which never happens after an insert but does after a join). Returns
+* the new root of the subtree.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::rebalance(AVLNode<Key, Value>* node)
+{
+    if (node -> getBalance() > 0) {
+        AVLNode<Key, Value>* child = node -> getRight();
+        if (child -> getBalance() >= 0) {
+            rotateLeft(node);
+            if (child -> getBalance() == 0) {
+                node -> setBalance(1);
+                child -> setBalance(-1);
+            }
+            else {
+                node -> setBalance(0);
+                child -> setBalance(0);
+            }
+            return child;
+        }
+        AVLNode<Key, Value>* grandchild = child -> getLeft();
+        rotateRight(child);
+        rotateLeft(node);
+        node -> setBalance(grandchild -> getBalance() > 0 ? -1 : 0);
+        child -> setBalance(grandchild -> getBalance() < 0 ? 1 : 0);
+        grandchild -> setBalance(0);
+        return grandchild;
+    }
+
+    AVLNode<Key, Value>* child = node -> getLeft();
+    if (child -> getBalance() <= 0) {
+        rotateRight(node);
+        if (child -> getBalance() == 0) {
+            node -> setBalance(-1);
+            child -> setBalance(1);
+        }
+        else {
+            node -> setBalance(0);
+            child -> setBalance(0);
+        }
+        return child;
+    }
+    AVLNode<Key, Value>* grandchild = child -> getRight();
+    rotateLeft(child);
+    rotateRight(node);
+    node -> setBalance(grandchild -> getBalance() < 0 ? 1 : 0);
+    child -> setBalance(grandchild -> getBalance() > 0 ? -1 : 0);
+    grandchild -> setBalance(0);
+    return grandchild;
+}
+
+/**
+* Retraces from node after one of its subtrees (the right one if
+* rightGrew) grew by one level. Returns true if the growth reached the
+* top of the (possibly detached) tree.
+*/
+template<class Key, class Value>
+bool AVLTree<Key, Value>::growFix(AVLNode<Key, Value>* node, bool rightGrew)
+{
+    while (node != NULL) {
+        node -> updateBalance(rightGrew ? 1 : -1);
+        if (node -> getBalance() == 0) {
+            return false;
+        }
+
+        AVLNode<Key, Value>* top = node;
+        if (node -> getBalance() == 2 || node -> getBalance() == -2) {
+            top = rebalance(node);
+            if (top -> getBalance() == 0) {
+                return false;
+            }
+        }
+
+        AVLNode<Key, Value>* parent = top -> getParent();
+        if (parent == NULL) {
+            return true;
+        }
+        rightGrew = (parent -> getRight() == top);
+        node = parent;
+    }
+    return true;
+}
+
+/**
+* Joins two detached trees and a pivot whose key lies between them into
+* one AVL tree, in O(|leftHeight - rightHeight|). The shorter tree is
+* attached (under the pivot) where the taller one's spine reaches its
+* height, then the taller tree is retraced as after an insert. Only the
+* pivot and its new ancestors gain children, so only they are refreshed
+* besides the nodes the rotations move.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::join(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* pivot,
+                                               AVLNode<Key, Value>* right, int rightHeight, int& height)
+{
+    if (leftHeight <= rightHeight + 1 && rightHeight <= leftHeight + 1) {
+        pivot -> setParent(NULL);
+        pivot -> setLeft(left);
+        pivot -> setRight(right);
+        if (left != NULL) {
+            left -> setParent(pivot);
+        }
+        if (right != NULL) {
+            right -> setParent(pivot);
+        }
+        pivot -> setBalance(static_cast<int8_t>(rightHeight - leftHeight));
+        pivot -> refresh();
+        height = std::max(leftHeight, rightHeight) + 1;
+        return pivot;
+    }
+
+    bool leftTaller = leftHeight > rightHeight;
+    AVLNode<Key, Value>* taller = leftTaller ? left : right;
+    AVLNode<Key, Value>* shorter = leftTaller ? right : left;
+    int tallHeight = leftTaller ? leftHeight : rightHeight;
+    int shortHeight = leftTaller ? rightHeight : leftHeight;
+
+    // walk down the inner spine of the taller tree to the first subtree
+    // no more than one level taller than the shorter tree
+    AVLNode<Key, Value>* parent = NULL;
+    AVLNode<Key, Value>* spine = taller;
+    int spineHeight = tallHeight;
+    while (spineHeight > shortHeight + 1) {
+        parent = spine;
+        if (leftTaller) {
+            spineHeight -= (spine -> getBalance() < 0) ? 2 : 1;
+            spine = spine -> getRight();
+        }
+        else {
+            spineHeight -= (spine -> getBalance() > 0) ? 2 : 1;
+            spine = spine -> getLeft();
+        }
+    }
+
+    pivot -> setLeft(leftTaller ? spine : shorter);
+    pivot -> setRight(leftTaller ? shorter : spine);
+    if (spine != NULL) {
+        spine -> setParent(pivot);
+    }
+    if (shorter != NULL) {
+        shorter -> setParent(pivot);
+    }
+    pivot -> setBalance(static_cast<int8_t>(leftTaller ? shortHeight - spineHeight : spineHeight - shortHeight));
+    pivot -> setParent(parent);
+    if (leftTaller) {
+        parent -> setRight(pivot);
+    }
+    else {
+        parent -> setLeft(pivot);
+    }
+
+    // the pivot's subtree is one level taller than the spine it replaced
+    bool grew = growFix(parent, leftTaller);
+    height = tallHeight + (grew ? 1 : 0);
+    refreshToRoot(pivot);
+
+    AVLNode<Key, Value>* top = pivot;
+    while (top -> getParent() != NULL) {
+        top = top -> getParent();
+    }
+    return top;
+}
+
+/**
+* Splits the detached subtree under node (of the given height) into the
+* keys less than key (or no greater than key, if keepEqualLeft), which
+* are returned, and the rest, stored in right. Each node on the search
+* path becomes the pivot that joins its off-path subtree back onto the
+* side it belongs to, so the whole split costs O(height).
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::split(AVLNode<Key, Value>* node, int height, const Key& key, bool keepEqualLeft,
+                                                AVLNode<Key, Value>*& right, int& leftHeight, int& rightHeight)
+{
+    if (node == NULL) {
+        right = NULL;
+        leftHeight = rightHeight = 0;
+        return NULL;
+    }
+
+    AVLNode<Key, Value>* left = node -> getLeft();
+    AVLNode<Key, Value>* r = node -> getRight();
+    int heightLeft = height - ((node -> getBalance() > 0) ? 2 : 1);
+    int heightRight = height - ((node -> getBalance() < 0) ? 2 : 1);
+    if (left != NULL) {
+        left -> setParent(NULL);
+    }
+    if (r != NULL) {
+        r -> setParent(NULL);
+    }
+
+    bool goesLeft = keepEqualLeft ? !(key < node -> getKey()) : (node -> getKey() < key);
+    if (goesLeft) {
+        int innerHeight;
+        AVLNode<Key, Value>* inner = split(r, heightRight, key, keepEqualLeft, right, innerHeight, rightHeight);
+        return join(left, heightLeft, node, inner, innerHeight, leftHeight);
+    }
+
+    AVLNode<Key, Value>* inner;
+    int innerHeight;
+    AVLNode<Key, Value>* outer = split(left, heightLeft, key, keepEqualLeft, inner, leftHeight, innerHeight);
+    right = join(inner, innerHeight, node, r, heightRight, rightHeight);
+    return outer;
+}
+
 
-#endif
\ No newline at end of file
+#endif
@@ -2,6 +2,15 @@
 #include <map>
 #include "bst.h"
 #include "avlbst.h"
+#include "art_map.h"
+#include "small_avl.h"
+#include "hashed_avl.h"
+#include "avl_cache.h"
+#include "leaf_depth_avl.h"
+#include "export_bst.h"
+#include "merkle_avl.h"
+#include "lsm_store.h"
+#include "trace_recorder.h"
 
 using namespace std;
 
@@ -23,8 +32,17 @@ int main(int argc, char *argv[])
     else {
         cout << "Did not find b" << endl;
     }
+    cout << "Scanning a..b" << endl;
+    bt.scan('a', 'b', [](const std::pair<const char, int>& item) {
+        cout << item.first << " " << item.second << endl;
+    });
+    std::pair<char, int> exported[2];
+    cout << "Exported " << bt.exportTo(exported, 2) << " items" << endl;
     cout << "Erasing b" << endl;
     bt.remove('b');
+    cout << "tryInsert a inserted: " << bt.tryInsert(std::make_pair('a',5)).second << endl;
+    BinarySearchTree<char,int>::iterator next = bt.erase(bt.begin());
+    cout << "Erased first item, next is end: " << (next == bt.end()) << endl;
 
     // AVL Tree Tests
     AVLTree<char,int> at;
@@ -41,8 +59,139 @@ int main(int argc, char *argv[])
     else {
         cout << "Did not find b" << endl;
     }
+    cout << "Size " << at.size() << ", height " << at.height() << ", valid " << at.validate() << endl;
+    AVLTree<char,int> copy(at);
+    AVLTree<char,int> moved(std::move(copy));
+    cout << "Copy moved, has b: " << (moved.find('b') != moved.end()) << endl;
     cout << "Erasing b" << endl;
     at.remove('b');
+    moved.clearAsync();
+    cout << "Moved copy empty after clearAsync: " << moved.empty() << endl;
+    cout << "Erasing range a..z" << endl;
+    at.eraseRange('a', 'z');
+    cout << "AVLTree empty: " << at.empty() << endl;
+
+    // Integer keys select the radix tree
+    OrderedMapFor<uint64_t,int>::type rt;
+    rt.insert(std::make_pair(300,3));
+    rt.insert(std::make_pair(1,1));
+    rt.insert(std::make_pair(2,2));
+
+    cout << "\nArtMap contents:" << endl;
+    for(OrderedMapFor<uint64_t,int>::type::iterator it = rt.begin(); it != rt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "First key >= 3: " << rt.lowerBound(3)->first << endl;
+    cout << "Erasing 2" << endl;
+    rt.remove(2);
+
+    // Small maps stay inline until they outgrow N items
+    SmallAVLMap<char,int,2> st;
+    st.insert(std::make_pair('b',2));
+    st.insert(std::make_pair('a',1));
+    cout << "\nSmallAVLMap inline: " << st.isInline() << endl;
+    st.insert(std::make_pair('c',3));
+    cout << "SmallAVLMap inline after growth: " << st.isInline() << endl;
+    for(SmallAVLMap<char,int,2>::iterator it = st.begin(); it != st.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+
+    // Point lookups through the side hash index
+    HashedAVLTree<char,int> ht;
+    ht.insert(std::make_pair('a',1));
+    ht.insert(std::make_pair('b',2));
+    cout << "\nHashedAVLTree b: " << ht['b'] << endl;
+    ht.remove('b');
+    cout << "HashedAVLTree found b after erase: " << (ht.find('b') != ht.end()) << endl;
+
+    // A two-entry LRU cache evicts the least recently used key
+    BoundedAVLCache<char,int> cache(2);
+    cache.insert(std::make_pair('a',1));
+    cache.insert(std::make_pair('b',2));
+    cache.find('a');
+    cache.insert(std::make_pair('c',3));
+    cout << "\nBoundedAVLCache contents:" << endl;
+    for(BoundedAVLCache<char,int>::iterator it = cache.begin(); it != cache.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Evictions: " << cache.stats().evictions << endl;
+
+    // Leaf depths are kept per node, so equalPaths is a root check
+    LeafDepthAVLTree<char,int> lt;
+    lt.insert(std::make_pair('b',2));
+    lt.insert(std::make_pair('a',1));
+    lt.insert(std::make_pair('c',3));
+    cout << "\nLeafDepthAVLTree equal paths: " << equalPaths(lt) << endl;
+    lt.insert(std::make_pair('d',4));
+    cout << "Equal paths after inserting d: " << equalPaths(lt) << endl;
+
+    // Stream the shape out, one JSON object per node, down to depth 1
+    ExportOptions options;
+    options.maxDepth = 1;
+    cout << "\nLeafDepthAVLTree as JSON lines:" << endl;
+    exportJsonLines(lt, cout, options);
+
+    // Replicas built in different orders hash the same; diff finds edits
+    MerkleAVLTree<char,int> ra, rb;
+    ra.insert(std::make_pair('a',1));
+    ra.insert(std::make_pair('b',2));
+    ra.insert(std::make_pair('c',3));
+    rb.insert(std::make_pair('c',3));
+    rb.insert(std::make_pair('b',2));
+    rb.insert(std::make_pair('a',1));
+    cout << "\nReplica hashes match: " << (ra.rootHash() == rb.rootHash()) << endl;
+    rb.insert(std::make_pair('b',5));
+    rb.insert(std::make_pair('d',4));
+    std::vector<char> differences;
+    ra.diff(rb, differences);
+    cout << "Replicas differ at:";
+    for(size_t i = 0; i < differences.size(); ++i) {
+        cout << " " << differences[i];
+    }
+    cout << endl;
+
+    // The item (0, 0) must still count towards the root hash
+    MerkleAVLTree<int,int> za, zb;
+    za.insert(std::make_pair(5,1));
+    zb.insert(std::make_pair(5,1));
+    zb.insert(std::make_pair(0,0));
+    std::vector<int> zeroDifferences;
+    za.diff(zb, zeroDifferences);
+    cout << "Zero item seen: " << (za.rootHash() != zb.rootHash())
+         << ", differs at: " << (zeroDifferences.size() == 1 ? zeroDifferences[0] : -1) << endl;
+
+    // A tiny memtable so the writes reach sorted runs on disk
+    {
+        LSMOptions lsmOptions;
+        lsmOptions.memtableLimit = 2;
+        LSMStore<int,int> store("bst-test.lsm", lsmOptions);
+        for(int i = 1; i <= 5; ++i) {
+            store.insert(std::make_pair(i, i * 10));
+        }
+        store.remove(2);
+        store.flush();
+        cout << "\nLSMStore after removing 2:";
+        store.scan(1, 5, [](const std::pair<const int, int>& item) {
+            cout << " " << item.first << "=" << item.second;
+        });
+        cout << endl;
+    }
+
+    // Record a few operations for trace-replay
+    TracedTree<int,int> tt;
+    tt.startTrace("bst-test.trace");
+    tt.insert(std::make_pair(2,20));
+    tt.insert(std::make_pair(1,10));
+    tt.find(2);
+    for(TracedTree<int,int>::iterator it = tt.begin(); it != tt.end(); ++it) {
+        tt.remove(3);
+    }
+    TracedTree<int,int>::iterator kept = tt.begin();
+    cout << "\nTracedTree recorded " << tt.tracedOperations() << " operations" << endl;
+    tt.stopTrace();
+    // the trace is gone, so advancing an iterator from it records nothing
+    ++kept;
+    cout << "Stale traced iterator moved to " << kept->first << endl;
 
     return 0;
 }
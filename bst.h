@@ -5,6 +5,20 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include "reclaimer.h"
+
+// Hint the CPU to start loading a node before it is dereferenced.
+#if defined(__GNUC__)
+#define BST_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define BST_PREFETCH(addr) ((void)(addr))
+#endif
+
+// Number of lookups findBatch() keeps in flight at once.
+#define BST_BATCH_WIDTH 8
 
 /**
  * A templated class for a Node in a search tree.
@@ -35,11 +49,18 @@ public:
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
 
+    int getHeight() const;
+    void setHeight(int height);
+    bool isSkewed() const;
+    void setSkewed(bool skewed);
+
 protected:
     std::pair<const Key, Value> item_;
     Node<Key, Value>* parent_;
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
+    int height_;    // levels in this subtree; kept by BinarySearchTree only
+    bool skewed_;   // subtree heights differ by more than one; likewise
 };
 
 /*
@@ -56,7 +77,9 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
     item_(key, value),
     parent_(parent),
     left_(NULL),
-    right_(NULL)
+    right_(NULL),
+    height_(1),
+    skewed_(false)
 {
 
 }
@@ -180,6 +203,38 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* Getter and setter for the height of the subtree under a node. Trees
+* that track balance another way, such as AVLTree, leave it alone.
+*/
+template<typename Key, typename Value>
+int Node<Key, Value>::getHeight() const
+{
+    return height_;
+}
+
+template<typename Key, typename Value>
+void Node<Key, Value>::setHeight(int height)
+{
+    height_ = height;
+}
+
+/**
+* Getter and setter for whether the node's subtree heights differ by
+* more than one, which BinarySearchTree counts to answer isBalanced().
+*/
+template<typename Key, typename Value>
+bool Node<Key, Value>::isSkewed() const
+{
+    return skewed_;
+}
+
+template<typename Key, typename Value>
+void Node<Key, Value>::setSkewed(bool skewed)
+{
+    skewed_ = skewed;
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
@@ -194,16 +249,29 @@ class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    BinarySearchTree(const BinarySearchTree<Key, Value>& other);
+    BinarySearchTree(BinarySearchTree<Key, Value>&& other);
+    BinarySearchTree<Key, Value>& operator=(const BinarySearchTree<Key, Value>& other);
+    BinarySearchTree<Key, Value>& operator=(BinarySearchTree<Key, Value>&& other);
     virtual ~BinarySearchTree(); //TODO
+    void cloneFrom(const BinarySearchTree<Key, Value>& other, unsigned threads = 1);
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
+    virtual void eraseRange(const Key& lo, const Key& hi);
     void clear(); //TODO
+    void clearAsync();
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    size_t size() const;
+    int height() const;
+    unsigned long version() const;
+    bool validate(unsigned threads = 1) const;
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename WKey, typename WValue>
+    friend class ShapeWalker;
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -227,6 +295,71 @@ public:
         Node<Key, Value> *current_;
     };
 
+public:
+    /**
+    * A resumable in-order cursor that copies items out in chunks.
+    * Uses an explicit stack instead of climbing parent pointers.
+    */
+    class exporter
+    {
+    public:
+        exporter();
+
+        size_t next(std::pair<Key, Value>* buffer, size_t maxItems);
+        bool done() const;
+
+    protected:
+        friend class BinarySearchTree<Key, Value>;
+        exporter(Node<Key, Value>* root);
+        void pushLeftSpine(Node<Key, Value>* node);
+        std::vector<Node<Key, Value>*> stack_;
+    };
+
+public:
+    /**
+    * A resumable structural check that visits a bounded number of nodes
+    * per step(), so it can run alongside normal use of the tree. It
+    * checks key order, parent pointers, per-node invariants (AVL
+    * balances) and the stored size. A pass that sees the tree change
+    * between steps starts over.
+    */
+    class validator
+    {
+    public:
+        validator();
+
+        bool step(size_t maxNodes);
+        bool valid() const;
+
+    protected:
+        friend class BinarySearchTree<Key, Value>;
+        validator(const BinarySearchTree<Key, Value>* tree, const Node<Key, Value>* root,
+                  const Node<Key, Value>* parent, const Node<Key, Value>* lo, const Node<Key, Value>* hi);
+        void restart();
+        void fail();
+
+        // a node on the current path; state counts the children already visited
+        struct Frame {
+            const Node<Key, Value>* node;
+            int leftHeight;
+            int state;
+        };
+
+        const BinarySearchTree<Key, Value>* tree_;
+        const Node<Key, Value>* root_;
+        const Node<Key, Value>* parent_;
+        const Node<Key, Value>* lo_;
+        const Node<Key, Value>* hi_;
+        std::vector<Frame> stack_;
+        const Node<Key, Value>* prev_;
+        int height_;
+        size_t count_;
+        unsigned long version_;
+        bool passValid_;
+        bool valid_;
+        bool finished_;
+    };
+
 public:
     iterator begin() const;
     iterator end() const;
@@ -234,9 +367,19 @@ public:
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
+    template<typename Callback>
+    void scan(const Key& lo, const Key& hi, Callback callback) const;
+    exporter beginExport() const;
+    validator beginValidate() const;
+    size_t exportTo(std::pair<Key, Value>* buffer, size_t maxItems) const;
+    void findBatch(const std::vector<Key>& keys, std::vector<iterator>& out) const;
+    std::pair<iterator, bool> insertOrAssign(const std::pair<const Key, Value>& keyValuePair);
+    std::pair<iterator, bool> tryInsert(const std::pair<const Key, Value>& keyValuePair);
+    iterator erase(iterator position);
+
 protected:
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    virtual Node<Key, Value>* internalFind(const Key& k) const; // TODO
     Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
@@ -247,14 +390,34 @@ protected:
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual std::pair<Node<Key, Value>*, bool> insertNode(const std::pair<const Key, Value>& keyValuePair, bool overwrite);
+    virtual void removeNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent);
+    virtual bool tracksNodes() const;
+    Node<Key, Value>* cloneTree(const Node<Key, Value>* source, Node<Key, Value>* parent, unsigned threads);
+    static iterator iteratorAt(Node<Key, Value>* node);
+    static void splitTree(Node<Key, Value>* root, const Key& key, bool keepEqualLeft,
+                          Node<Key, Value>*& left, Node<Key, Value>*& right);
+    size_t destroySubtree(Node<Key, Value>* node);
+    static void* reclaimChunk(void* state, size_t budget);
     static Node<Key, Value>* successor(Node<Key, Value>* current);
-    int isBalancedHelper(Node<Key, Value>* node) const;
-    void clearHelper(Node<Key, Value>* node);
+    void updateHeights(Node<Key, Value>* node, bool all);
+    virtual int computeHeight() const;
+    virtual bool computeBalanced() const;
+    virtual bool checkNode(const Node<Key, Value>* node, int leftHeight, int rightHeight) const;
+    bool validateSubtree(const Node<Key, Value>* node, const Node<Key, Value>* parent,
+                         const Node<Key, Value>* lo, const Node<Key, Value>* hi,
+                         unsigned threads, int& height, size_t& count) const;
 
 
 protected:
     Node<Key, Value>* root_;
     // You should not need other data members
+    size_t size_;
+    unsigned long version_;         // bumped by every change to the tree's shape
+    size_t unbalanced_;             // skewed nodes, kept by updateHeights
 };
 
 /*
@@ -366,6 +529,247 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+--------------------------------------------------------------
+Begin implementations for the BinarySearchTree::exporter class.
+--------------------------------------------------------------
+*/
+
+/**
+* A default constructor for an exporter with nothing left to emit.
+*/
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::exporter::exporter()
+{
+
+}
+
+/**
+* Explicit constructor that positions the exporter on the smallest
+* item of the subtree rooted at root.
+*/
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::exporter::exporter(Node<Key, Value>* root)
+{
+    pushLeftSpine(root);
+}
+
+/**
+* Pushes node and all of its left descendants, prefetching the right
+* subtrees that will be visited once each pushed node is popped.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::exporter::pushLeftSpine(Node<Key, Value>* node)
+{
+    while (node != NULL) {
+        BST_PREFETCH(node -> getRight());
+        stack_.push_back(node);
+        node = node -> getLeft();
+    }
+}
+
+/**
+* Copies up to maxItems of the remaining items, in order, into buffer.
+* Returns the number of items written; 0 means the export is finished.
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::exporter::next(std::pair<Key, Value>* buffer, size_t maxItems)
+{
+    size_t count = 0;
+
+    while (count < maxItems && !stack_.empty()) {
+        Node<Key, Value>* node = stack_.back();
+        stack_.pop_back();
+
+        buffer[count].first = node -> getKey();
+        buffer[count].second = node -> getValue();
+        ++count;
+
+        pushLeftSpine(node -> getRight());
+    }
+
+    return count;
+}
+
+/**
+* Returns true once every item has been emitted.
+*/
+template<class Key, class Value>
+bool BinarySearchTree<Key, Value>::exporter::done() const
+{
+    return stack_.empty();
+}
+
+/*
+------------------------------------------------------------
+End implementations for the BinarySearchTree::exporter class.
+------------------------------------------------------------
+*/
+
+/*
+--------------------------------------------------------------
+Begin implementations for the BinarySearchTree::validator class.
+--------------------------------------------------------------
+*/
+
+/**
+* A default constructor for a validator with nothing to check.
+*/
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::validator::validator() :
+    tree_(NULL), root_(NULL), parent_(NULL), lo_(NULL), hi_(NULL), prev_(NULL),
+    height_(0), count_(0), version_(0), passValid_(true), valid_(true), finished_(true)
+{
+
+}
+
+/**
+* Checks the subtree under root, whose parent pointer must be parent and
+* whose keys must lie strictly between lo and hi (either may be NULL).
+*/
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::validator::validator(const BinarySearchTree<Key, Value>* tree, const Node<Key, Value>* root,
+                                                   const Node<Key, Value>* parent, const Node<Key, Value>* lo, const Node<Key, Value>* hi) :
+    tree_(tree), root_(root), parent_(parent), lo_(lo), hi_(hi), prev_(NULL),
+    height_(0), count_(0), version_(0), passValid_(true), valid_(true), finished_(true)
+{
+    restart();
+}
+
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::validator::restart()
+{
+    stack_.clear();
+    prev_ = lo_;
+    height_ = 0;
+    count_ = 0;
+    version_ = tree_ -> version_;
+    passValid_ = true;
+    finished_ = false;
+    if (root_ != NULL) {
+        if (root_ -> getParent() != parent_) {
+            passValid_ = false;
+        }
+        Frame frame = { root_, 0, 0 };
+        stack_.push_back(frame);
+    }
+}
+
+/**
+* Ends the current pass as invalid.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::validator::fail()
+{
+    passValid_ = false;
+    stack_.clear();
+}
+
+/**
+* Visits up to maxNodes more nodes and returns true if that finished a
+* pass, whose result valid() then reports. Calling step() again starts
+* the next pass.
+*/
+template<class Key, class Value>
+bool BinarySearchTree<Key, Value>::validator::step(size_t maxNodes)
+{
+    if (tree_ == NULL) {
+        return true;
+    }
+    if (finished_ || version_ != tree_ -> version_) {
+        // a whole-tree check follows the root if it has changed
+        if (parent_ == NULL && lo_ == NULL && hi_ == NULL) {
+            root_ = tree_ -> root_;
+        }
+        restart();
+    }
+
+    // post-order walk; height_ carries a finished child's height up
+    while (!stack_.empty() && maxNodes > 0) {
+        Frame& frame = stack_.back();
+        const Node<Key, Value>* node = frame.node;
+
+        if (frame.state == 0) {
+            frame.state = 1;
+            const Node<Key, Value>* left = node -> getLeft();
+            if (left != NULL) {
+                if (left -> getParent() != node) {
+                    fail();
+                    break;
+                }
+                Frame child = { left, 0, 0 };
+                stack_.push_back(child);
+                continue;
+            }
+            height_ = 0;
+        }
+        else if (frame.state == 1) {
+            // back from the left subtree: this is the in-order visit
+            frame.leftHeight = height_;
+            frame.state = 2;
+            if (prev_ != NULL && !(prev_ -> getKey() < node -> getKey())) {
+                fail();
+                break;
+            }
+            prev_ = node;
+            ++count_;
+            --maxNodes;
+
+            const Node<Key, Value>* right = node -> getRight();
+            if (right != NULL) {
+                if (right -> getParent() != node) {
+                    fail();
+                    break;
+                }
+                Frame child = { right, 0, 0 };
+                stack_.push_back(child);
+                continue;
+            }
+            height_ = 0;
+        }
+        else {
+            if (!tree_ -> checkNode(node, frame.leftHeight, height_)) {
+                fail();
+                break;
+            }
+            height_ = std::max(frame.leftHeight, height_) + 1;
+            stack_.pop_back();
+        }
+    }
+
+    if (!stack_.empty()) {
+        return false;
+    }
+
+    if (passValid_) {
+        if (hi_ != NULL && prev_ != NULL && !(prev_ -> getKey() < hi_ -> getKey())) {
+            passValid_ = false;
+        }
+        // only a pass over the whole tree can be held against size()
+        if (root_ == tree_ -> root_ && count_ != tree_ -> size_) {
+            passValid_ = false;
+        }
+    }
+    valid_ = passValid_;
+    finished_ = true;
+    return true;
+}
+
+/**
+* Returns the result of the last finished pass (true before the first).
+*/
+template<class Key, class Value>
+bool BinarySearchTree<Key, Value>::validator::valid() const
+{
+    return valid_;
+}
+
+/*
+------------------------------------------------------------
+End implementations for the BinarySearchTree::validator class.
+------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -376,7 +780,8 @@ Begin implementations for the BinarySearchTree class.
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
 template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+BinarySearchTree<Key, Value>::BinarySearchTree() :
+    size_(0), version_(0), unbalanced_(0)
 {
     // TODO
     root_ = NULL;
@@ -389,6 +794,69 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
     clear();
 }
 
+/**
+* A copy constructor that clones other's shape node for node in O(n),
+* without comparing any keys.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(const BinarySearchTree<Key, Value>& other) :
+    root_(NULL), size_(0), version_(0), unbalanced_(0)
+{
+    cloneFrom(other);
+}
+
+/**
+* A move constructor that takes other's nodes in O(1) and leaves it empty.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(BinarySearchTree<Key, Value>&& other) :
+    root_(other.root_), size_(other.size_), version_(0), unbalanced_(other.unbalanced_)
+{
+    other.root_ = NULL;
+    other.size_ = 0;
+    other.unbalanced_ = 0;
+    ++other.version_;
+}
+
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(const BinarySearchTree<Key, Value>& other)
+{
+    if (this != &other) {
+        cloneFrom(other);
+    }
+    return *this;
+}
+
+/**
+* Move assignment swaps roots in O(1); this tree's old nodes are freed
+* when other is destroyed or cleared.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(BinarySearchTree<Key, Value>&& other)
+{
+    std::swap(root_, other.root_);
+    std::swap(size_, other.size_);
+    std::swap(unbalanced_, other.unbalanced_);
+    ++version_;
+    ++other.version_;
+    return *this;
+}
+
+/**
+* Replaces the contents with a structural copy of other, which must be
+* the same kind of tree. With threads > 1 the top levels of the tree are
+* split across that many threads, as long as createNode is safe to call
+* concurrently for this tree.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::cloneFrom(const BinarySearchTree<Key, Value>& other, unsigned threads)
+{
+    clear();
+    root_ = cloneTree(other.root_, NULL, tracksNodes() ? 1 : threads);
+    size_ = other.size_;
+    unbalanced_ = other.unbalanced_;
+}
+
 /**
      */
 template<class Key, class Value>
@@ -458,6 +926,145 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
     return curr->getValue();
 }
 
+/**
+* Calls callback on every item with lo <= key <= hi, in order.
+* The start position is found with a single descent and the rest
+* of the range is walked with an explicit stack, so no node is
+* visited twice and no parent pointers are followed.
+*/
+template<class Key, class Value>
+template<typename Callback>
+void BinarySearchTree<Key, Value>::scan(const Key& lo, const Key& hi, Callback callback) const
+{
+    std::vector<Node<Key, Value>*> stack;
+    Node<Key, Value>* curr = root_;
+
+    // descend towards lo, remembering every node that is still in range
+    while (curr != NULL) {
+        if (curr -> getKey() < lo) {
+            curr = curr -> getRight();
+        }
+        else {
+            BST_PREFETCH(curr -> getRight());
+            stack.push_back(curr);
+            curr = curr -> getLeft();
+        }
+    }
+
+    while (!stack.empty()) {
+        Node<Key, Value>* node = stack.back();
+        stack.pop_back();
+
+        if (hi < node -> getKey()) {
+            return;
+        }
+
+        // the next subtree is already being loaded while the callback runs
+        curr = node -> getRight();
+        if (!stack.empty()) {
+            BST_PREFETCH(stack.back());
+        }
+
+        callback(node -> getItem());
+
+        while (curr != NULL) {
+            BST_PREFETCH(curr -> getRight());
+            stack.push_back(curr);
+            curr = curr -> getLeft();
+        }
+    }
+}
+
+/**
+* Looks up every key in keys and stores the results, in the same order,
+* in out (end() for missing keys). Up to BST_BATCH_WIDTH descents are kept
+* in flight and stepped round-robin one level at a time; each step
+* prefetches the child the descent will visit next, so the cache misses
+* of independent lookups overlap instead of being paid one after another.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::findBatch(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    out.assign(keys.size(), end());
+    if (root_ == NULL) {
+        return;
+    }
+
+    // one in-flight descent: which key it is resolving and where it is
+    struct Descent {
+        size_t index;
+        Node<Key, Value>* node;
+    };
+    Descent lanes[BST_BATCH_WIDTH];
+    size_t active = 0;
+    size_t nextKey = 0;
+
+    while (active < BST_BATCH_WIDTH && nextKey < keys.size()) {
+        lanes[active].index = nextKey++;
+        lanes[active].node = root_;
+        ++active;
+    }
+
+    while (active > 0) {
+        for (size_t i = 0; i < active; ) {
+            Descent& lane = lanes[i];
+            const Key& key = keys[lane.index];
+            Node<Key, Value>* next;
+            bool finished = false;
+
+            if (lane.node -> getKey() == key) {
+                out[lane.index] = iterator(lane.node);
+                finished = true;
+            }
+            else {
+                next = (key < lane.node -> getKey()) ? lane.node -> getLeft() : lane.node -> getRight();
+                if (next == NULL) {
+                    finished = true;
+                }
+                else {
+                    BST_PREFETCH(next);
+                    lane.node = next;
+                }
+            }
+
+            if (!finished) {
+                ++i;
+            }
+            // restart a finished lane on the next key, or retire it
+            else if (nextKey < keys.size()) {
+                lane.index = nextKey++;
+                lane.node = root_;
+                ++i;
+            }
+            else {
+                lanes[i] = lanes[--active];
+            }
+        }
+    }
+}
+
+/**
+* Returns an exporter positioned on the smallest item in the tree.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::exporter
+BinarySearchTree<Key, Value>::beginExport() const
+{
+    return exporter(root_);
+}
+
+/**
+* Copies up to maxItems of the smallest items, in order, into buffer
+* and returns how many were written. Use beginExport() to export the
+* whole tree in several chunks.
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::exportTo(std::pair<Key, Value>* buffer, size_t maxItems) const
+{
+    exporter cursor(root_);
+    return cursor.next(buffer, maxItems);
+}
+
 /**
 * An insert method to insert into a Binary Search Tree.
 * The tree will not remain balanced when inserting.
@@ -468,23 +1075,63 @@ template<class Key, class Value>
 void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
     // TODO
+    insertNode(keyValuePair, true);
+}
+
+/**
+* Inserts the pair, or overwrites the value if the key is present.
+* Returns an iterator to the item and whether a new node was created.
+*/
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insertOrAssign(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::pair<Node<Key, Value>*, bool> result = insertNode(keyValuePair, true);
+    return std::make_pair(iterator(result.first), result.second);
+}
 
+/**
+* Inserts the pair only if the key is absent; an existing value is left
+* alone. Returns an iterator to the item for the key and whether it was
+* inserted.
+*/
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::tryInsert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::pair<Node<Key, Value>*, bool> result = insertNode(keyValuePair, false);
+    return std::make_pair(iterator(result.first), result.second);
+}
+
+/**
+* The insertion core shared by insert, insertOrAssign and tryInsert.
+* Returns the node holding the key and whether it was newly created;
+* an existing node's value is replaced only if overwrite is set.
+*/
+template<class Key, class Value>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value>::insertNode(const std::pair<const Key, Value>& keyValuePair, bool overwrite)
+{
     const Key& key = keyValuePair.first;
     const Value& value = keyValuePair.second;
     Node<Key, Value>* curr = root_;
     
     // insert into empty tree
     if (empty()) {
-        root_ = new Node<Key, Value>(key, value, NULL);
-        return;
+        root_ = createNode(key, value, NULL);
+        ++size_;
+        ++version_;
+        return std::make_pair(root_, true);
     }
 
     // traverse through tree until leaf node
-    while (curr != NULL) {
+    while (true) {
         // update value if key already exists
         if (key == curr -> getKey()) {
-            curr -> setValue(value);
-            break;
+            if (overwrite) {
+                curr -> setValue(value);
+            }
+            return std::make_pair(curr, false);
         }
         // traverse left if key is less than current node
         else if (key < curr -> getKey()) {
@@ -493,8 +1140,11 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
                 curr = curr -> getLeft();
             }
             else {
-                curr -> setLeft(new Node<Key, Value>(key, value, curr));
-                break;
+                curr -> setLeft(createNode(key, value, curr));
+                updateHeights(curr, false);
+                ++size_;
+                ++version_;
+                return std::make_pair(curr -> getLeft(), true);
             }
         }
         // traverse right if key is greater than current node
@@ -504,8 +1154,11 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
                 curr = curr -> getRight();
             }
             else {
-                curr -> setRight(new Node<Key, Value>(key, value, curr));
-                break;
+                curr -> setRight(createNode(key, value, curr));
+                updateHeights(curr, false);
+                ++size_;
+                ++version_;
+                return std::make_pair(curr -> getRight(), true);
             }
 
         }
@@ -526,10 +1179,36 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
     Node<Key, Value>* curr = internalFind(key);
 
     // doesn't continue if key doesn't exist
-    if (curr == NULL) {
-        return;
+    if (curr != NULL) {
+        removeNode(curr);
     }
-    
+}
+
+/**
+* Removes the item at position and returns an iterator to the next one,
+* without searching for the key again. The successor is taken before
+* unlinking; it stays valid because nodes keep their items when
+* nodeSwap moves them.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator position)
+{
+    Node<Key, Value>* node = position.current_;
+    if (node == NULL) {
+        return end();
+    }
+    Node<Key, Value>* next = successor(node);
+    removeNode(node);
+    return iterator(next);
+}
+
+/**
+* Unlinks and frees a node of this tree.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::removeNode(Node<Key, Value>* curr)
+{
     // swaps current node with its predecessor if current node has two children
     if (curr -> getLeft() != NULL && curr -> getRight() != NULL) {
         // find predecessor
@@ -571,10 +1250,15 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
     else if ((parent -> getRight() != NULL) && (parent -> getRight() -> getKey() == curr -> getKey())) {
         parent -> setRight(child);
     }
+    updateHeights(parent, false);
 
     // delete current node after updating pointers
-    delete curr;
-
+    if (curr -> isSkewed()) {
+        --unbalanced_;
+    }
+    destroyNode(curr);
+    --size_;
+    ++version_;
 }
 
 
@@ -598,9 +1282,9 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
         Node<Key, Value>* parent = current -> getParent();
         predecessor = current;
 
-        // loops while parent node has no right child or current node isn't a right child
-        // in otherwords, stops looping when current node is parent's right child
-        while (parent -> getRight() == NULL || parent -> getRight() -> getKey() != predecessor -> getKey()) {
+        // loops while current node isn't parent's right child (compared by address,
+        // so no keys are touched); stops looping when current node is parent's right child
+        while (parent -> getRight() != predecessor) {
             // breaks loop if traversed to root without finding the predecessor
             if (parent -> getParent() == NULL) {
                 parent = NULL;
@@ -635,9 +1319,9 @@ BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
         Node<Key, Value>* parent = current -> getParent();
         successor = current;
 
-        // loops while parent node has no left child or current node isn't a left child
-        // in otherwords, stops looping when current node is parent's left child
-        while (parent -> getLeft() == NULL || parent -> getLeft() -> getKey() != successor -> getKey()) {
+        // loops while current node isn't parent's left child (compared by address,
+        // so no keys are touched); stops looping when current node is parent's left child
+        while (parent -> getLeft() != successor) {
             // breaks loop if traversed to root without finding the predecessor
             if (parent -> getParent() == NULL) {
                 parent = NULL;
@@ -663,23 +1347,298 @@ void BinarySearchTree<Key, Value>::clear()
 {
     // TODO
 
-    clearHelper(root_);
+    destroySubtree(root_);
     root_ = NULL;
+    size_ = 0;
+    ++version_;
 }
 
+/**
+* Empties the tree in O(1) and leaves freeing the old nodes to the
+* background Reclaimer thread.
+*/
 template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clearHelper(Node<Key, Value>* node)
+void BinarySearchTree<Key, Value>::clearAsync()
 {
-    if (node == NULL) {
+    if (tracksNodes()) {
+        clear();
         return;
     }
+    Node<Key, Value>* root = root_;
+    root_ = NULL;
+    size_ = 0;
+    unbalanced_ = 0;
+    ++version_;
+    if (root != NULL) {
+        Reclaimer::defer(root, &reclaimChunk);
+    }
+}
 
-    clearHelper(node -> getLeft());
-    clearHelper(node -> getRight());
+/**
+* Allocates a node for a new key. Subclasses override this (and
+* destroyNode) to use their own node type or to track nodes elsewhere.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return new Node<Key, Value>(key, value, parent);
+}
 
+/**
+* Frees a node that has already been unlinked from the tree.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::destroyNode(Node<Key, Value>* node)
+{
     delete node;
 }
 
+/**
+* Removes every item with lo <= key <= hi. The tree is cut into the
+* parts below, inside and above the range with two splits, the middle
+* part is freed in bulk, and the upper part is hung off the largest
+* node of the lower part. This costs O(height + k) instead of k removes.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::eraseRange(const Key& lo, const Key& hi)
+{
+    if (hi < lo) {
+        return;
+    }
+
+    Node<Key, Value>* below;
+    Node<Key, Value>* rest;
+    Node<Key, Value>* inside;
+    Node<Key, Value>* above;
+    splitTree(root_, lo, false, below, rest);
+    splitTree(rest, hi, true, inside, above);
+    size_ -= destroySubtree(inside);
+    ++version_;
+
+    // the splits cut only the spines facing the range; refresh those
+    Node<Key, Value>* smallest = above;
+    while (smallest != NULL && smallest -> getLeft() != NULL) {
+        smallest = smallest -> getLeft();
+    }
+    updateHeights(smallest, true);
+
+    if (below == NULL) {
+        root_ = above;
+        return;
+    }
+    Node<Key, Value>* largest = below;
+    while (largest -> getRight() != NULL) {
+        largest = largest -> getRight();
+    }
+    largest -> setRight(above);
+    if (above != NULL) {
+        above -> setParent(largest);
+    }
+    updateHeights(largest, true);
+    root_ = below;
+}
+
+/**
+* Splits the tree under root into the keys less than key (or no greater
+* than key, if keepEqualLeft) and the rest, in one pass down the tree.
+* Each node keeps the subtree on its own side and is linked under the
+* last node added to that side.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::splitTree(Node<Key, Value>* root, const Key& key, bool keepEqualLeft,
+                                             Node<Key, Value>*& left, Node<Key, Value>*& right)
+{
+    left = right = NULL;
+    Node<Key, Value>* leftTail = NULL;
+    Node<Key, Value>* rightTail = NULL;
+    Node<Key, Value>* curr = root;
+
+    while (curr != NULL) {
+        bool goesLeft = keepEqualLeft ? !(key < curr -> getKey()) : (curr -> getKey() < key);
+        if (goesLeft) {
+            if (leftTail == NULL) {
+                left = curr;
+            }
+            else {
+                leftTail -> setRight(curr);
+            }
+            curr -> setParent(leftTail);
+            leftTail = curr;
+            curr = curr -> getRight();
+        }
+        else {
+            if (rightTail == NULL) {
+                right = curr;
+            }
+            else {
+                rightTail -> setLeft(curr);
+            }
+            curr -> setParent(rightTail);
+            rightTail = curr;
+            curr = curr -> getLeft();
+        }
+    }
+
+    if (leftTail != NULL) {
+        leftTail -> setRight(NULL);
+    }
+    if (rightTail != NULL) {
+        rightTail -> setLeft(NULL);
+    }
+}
+
+/**
+* Frees a detached subtree without recursion: left children are rotated
+* up until the current node has none, then it is freed and the walk
+* continues with its right child. Returns the number of nodes freed;
+* the caller adjusts size_. Freed skewed nodes leave unbalanced_.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::destroySubtree(Node<Key, Value>* node)
+{
+    size_t count = 0;
+    while (node != NULL) {
+        Node<Key, Value>* left = node -> getLeft();
+        if (left == NULL) {
+            Node<Key, Value>* right = node -> getRight();
+            if (node -> isSkewed()) {
+                --unbalanced_;
+            }
+            destroyNode(node);
+            node = right;
+            ++count;
+        }
+        else {
+            node -> setLeft(left -> getRight());
+            left -> setRight(node);
+            node = left;
+        }
+    }
+    return count;
+}
+
+/**
+* Reclaimer step for clearAsync: frees up to budget nodes of a detached
+* subtree by the same rotations as destroySubtree, and returns the node
+* to resume from. Nodes are deleted directly since the tree that owned
+* them is no longer involved.
+*/
+template<typename Key, typename Value>
+void* BinarySearchTree<Key, Value>::reclaimChunk(void* state, size_t budget)
+{
+    Node<Key, Value>* node = static_cast<Node<Key, Value>*>(state);
+    while (node != NULL && budget > 0) {
+        Node<Key, Value>* left = node -> getLeft();
+        if (left == NULL) {
+            Node<Key, Value>* right = node -> getRight();
+            delete node;
+            node = right;
+            --budget;
+        }
+        else {
+            node -> setLeft(left -> getRight());
+            left -> setRight(node);
+            node = left;
+        }
+    }
+    return node;
+}
+
+/**
+* Allocates a copy of source (key, value and any per-node balance data)
+* under parent. Children are linked by the caller.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent)
+{
+    Node<Key, Value>* node = createNode(source -> getKey(), source -> getValue(), parent);
+    node -> setHeight(source -> getHeight());
+    node -> setSkewed(source -> isSkewed());
+    return node;
+}
+
+/**
+* Whether createNode and destroyNode keep other per-tree state in sync
+* with the nodes. Such trees clone on one thread, and clearAsync frees
+* their nodes on the calling thread.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::tracksNodes() const
+{
+    return false;
+}
+
+/**
+* Copies the subtree under source. Up to threads threads split the work
+* at the top of the tree; below that each subtree is copied with an
+* explicit stack in pre-order, so each node is allocated right before
+* its left child and a subtree's nodes end up close together in memory.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::cloneTree(const Node<Key, Value>* source, Node<Key, Value>* parent, unsigned threads)
+{
+    if (source == NULL) {
+        return NULL;
+    }
+
+    Node<Key, Value>* copy = cloneNode(source, parent);
+
+    if (threads > 1) {
+        Node<Key, Value>* right = NULL;
+        std::thread worker([&]() {
+            right = cloneTree(source -> getRight(), copy, threads / 2);
+        });
+        Node<Key, Value>* left = cloneTree(source -> getLeft(), copy, threads - threads / 2);
+        worker.join();
+        copy -> setLeft(left);
+        copy -> setRight(right);
+        return copy;
+    }
+
+    // children still to copy: the source node and the copy to hang it under
+    struct Pending {
+        const Node<Key, Value>* source;
+        Node<Key, Value>* parent;
+        bool isLeft;
+    };
+    std::vector<Pending> stack;
+    Pending right = { source -> getRight(), copy, false };
+    Pending left = { source -> getLeft(), copy, true };
+    stack.push_back(right);
+    stack.push_back(left);
+
+    while (!stack.empty()) {
+        Pending next = stack.back();
+        stack.pop_back();
+        if (next.source == NULL) {
+            continue;
+        }
+
+        Node<Key, Value>* node = cloneNode(next.source, next.parent);
+        if (next.isLeft) {
+            next.parent -> setLeft(node);
+        }
+        else {
+            next.parent -> setRight(node);
+        }
+        Pending nextRight = { next.source -> getRight(), node, false };
+        Pending nextLeft = { next.source -> getLeft(), node, true };
+        stack.push_back(nextRight);
+        stack.push_back(nextLeft);
+    }
+    return copy;
+}
+
+/**
+* Lets subclasses hand out an iterator to a node they already hold.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::iteratorAt(Node<Key, Value>* node)
+{
+    return iterator(node);
+}
+
 
 /**
 * A helper function to find the smallest node in the tree.
@@ -739,53 +1698,166 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
 }
 
 /**
- * Return true iff the BST is balanced.
- */
+* Returns the number of items in O(1).
+*/
 template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+size_t BinarySearchTree<Key, Value>::size() const
 {
-    // TODO
-    if (isBalancedHelper(root_) == -1) {
-        return false;
-    }
+    return size_;
+}
 
-    return true;    
+/**
+* Returns the number of levels (0 when empty).
+*/
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::height() const
+{
+    return computeHeight();
 }
 
+/**
+* Returns a counter that changes whenever nodes are added, removed or
+* rearranged, so callers can tell whether the tree changed since they
+* last looked.
+*/
 template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::isBalancedHelper(Node<Key, Value>* node) const
+unsigned long BinarySearchTree<Key, Value>::version() const
 {
-    // base case: traversed to a leaf node
-    if (node == NULL) {
-        // returns that height is 0
-        return 0;
-    }
+    return version_;
+}
 
-    // store left and right subtree's max height
-    int leftHeight = isBalancedHelper(node -> getLeft());
-    int rightHeight = isBalancedHelper(node -> getRight());
+/**
+* Reads the root's stored height in O(1).
+*/
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::computeHeight() const
+{
+    return (root_ == NULL) ? 0 : root_ -> getHeight();
+}
 
-    // if either subtrees are unbalanced, return -1
-    if (leftHeight == -1 || rightHeight == -1) {
-        return -1;
+/**
+* Recomputes the stored heights and skew flags from node up to the root,
+* keeping unbalanced_ in step. Unless all is set the walk stops at the
+* first node whose height did not change, since nothing above it changed
+* either; all is for callers that relinked subtrees on the way up.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::updateHeights(Node<Key, Value>* node, bool all)
+{
+    while (node != NULL) {
+        int left = (node -> getLeft() == NULL) ? 0 : node -> getLeft() -> getHeight();
+        int right = (node -> getRight() == NULL) ? 0 : node -> getRight() -> getHeight();
+        bool skewed = left - right > 1 || right - left > 1;
+        if (skewed != node -> isSkewed()) {
+            if (skewed) {
+                ++unbalanced_;
+            }
+            else {
+                --unbalanced_;
+            }
+            node -> setSkewed(skewed);
+        }
+        int height = std::max(left, right) + 1;
+        if (height == node -> getHeight() && !all) {
+            return;
+        }
+        node -> setHeight(height);
+        node = node -> getParent();
     }
+}
 
-    // return if subtree heights are unbalanced or max subtree height
-    if (leftHeight > rightHeight) {
-        if (leftHeight - rightHeight > 1) {
-            return -1;
-        }
-        
-        return leftHeight + 1;
+/**
+* Per-node invariant checked by the validator once both subtree heights
+* are known. A plain BST's nodes must hold their subtree heights and
+* whether those differ by more than one.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::checkNode(const Node<Key, Value>* node, int leftHeight, int rightHeight) const
+{
+    bool skewed = leftHeight - rightHeight > 1 || rightHeight - leftHeight > 1;
+    return node -> getHeight() == std::max(leftHeight, rightHeight) + 1 && node -> isSkewed() == skewed;
+}
+
+/**
+* Returns a validator for incremental checks of the whole tree.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::validator
+BinarySearchTree<Key, Value>::beginValidate() const
+{
+    return validator(this, root_, NULL, NULL, NULL);
+}
+
+/**
+* Checks every structural invariant in one go. With threads > 1 the top
+* levels of the tree are split across that many threads.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::validate(unsigned threads) const
+{
+    int height;
+    size_t count;
+    return validateSubtree(root_, NULL, NULL, NULL, std::max(threads, 1u), height, count) &&
+           count == size_;
+}
+
+/**
+* Validates the subtree under node, reporting its height and node count.
+* Subtrees handed to a single thread are checked by a validator in one
+* unbounded step.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::validateSubtree(const Node<Key, Value>* node, const Node<Key, Value>* parent,
+                                                   const Node<Key, Value>* lo, const Node<Key, Value>* hi,
+                                                   unsigned threads, int& height, size_t& count) const
+{
+    if (threads <= 1 || node == NULL) {
+        validator check(this, node, parent, lo, hi);
+        check.step(static_cast<size_t>(-1));
+        height = check.height_;
+        count = check.count_;
+        return check.valid();
     }
-    else {
-        if (rightHeight - leftHeight > 1) {
-            return -1;
-        }
-        
-        return rightHeight + 1;    
+
+    if (node -> getParent() != parent ||
+        (lo != NULL && !(lo -> getKey() < node -> getKey())) ||
+        (hi != NULL && !(node -> getKey() < hi -> getKey()))) {
+        return false;
     }
 
+    bool rightValid = false;
+    int rightHeight = 0;
+    size_t rightCount = 0;
+    std::thread worker([&]() {
+        rightValid = validateSubtree(node -> getRight(), node, node, hi, threads / 2, rightHeight, rightCount);
+    });
+    int leftHeight;
+    size_t leftCount;
+    bool leftValid = validateSubtree(node -> getLeft(), node, lo, node, threads - threads / 2, leftHeight, leftCount);
+    worker.join();
+
+    height = std::max(leftHeight, rightHeight) + 1;
+    count = leftCount + rightCount + 1;
+    return leftValid && rightValid && checkNode(node, leftHeight, rightHeight);
+}
+
+/**
+ * Return true iff the BST is balanced, in O(1).
+ */
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::isBalanced() const
+{
+    // TODO
+    return computeBalanced();
+}
+
+/**
+* Balanced when no node is skewed; updateHeights keeps the count.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::computeBalanced() const
+{
+    return unbalanced_ == 0;
 }
 
 
@@ -871,6 +1943,13 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
         this->root_ = n1;
     }
 
+    // a stored height and skew belong to the position, not the item
+    int height = n1->getHeight();
+    n1->setHeight(n2->getHeight());
+    n2->setHeight(height);
+    bool skewed = n1->isSkewed();
+    n1->setSkewed(n2->isSkewed());
+    n2->setSkewed(skewed);
 }
 
 /**
@@ -0,0 +1,330 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <stdint.h>
+#include "avlbst.h"
+#include "sharded_avl.h"
+#include "concurrent_avl.h"
+#include "concurrent_skiplist.h"
+
+using namespace std;
+
+// Thread counts exercised by both the stress test and the benchmark.
+static const int THREAD_COUNTS[] = { 1, 2, 4, 8, 16, 32, 64 };
+static const int NUM_THREAD_COUNTS = sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]);
+
+/**
+* A small xorshift generator so every thread has its own cheap RNG.
+*/
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) { }
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+/**
+* AVLTree behind one global mutex: the baseline the other maps replace.
+*/
+struct LockedAVL {
+    std::mutex lock;
+    AVLTree<int, int> tree;
+
+    void insert(int key, int value)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tree.insert(std::make_pair(key, value));
+    }
+    void remove(int key)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tree.remove(key);
+    }
+    bool find(int key, int& value)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        AVLTree<int, int>::iterator it = tree.find(key);
+        if (it == tree.end()) {
+            return false;
+        }
+        value = it -> second;
+        return true;
+    }
+};
+
+struct ShardedAVL {
+    ShardedAVLMap<int, int> map;
+
+    ShardedAVL() : map(64) { }
+
+    void insert(int key, int value) { map.insert(std::make_pair(key, value)); }
+    void remove(int key) { map.remove(key); }
+    bool find(int key, int& value) { return map.find(key, value); }
+};
+
+struct OptimisticAVL {
+    ConcurrentAVLTree<int, int> tree;
+
+    void insert(int key, int value) { tree.insert(std::make_pair(key, value)); }
+    void remove(int key) { tree.remove(key); }
+    bool find(int key, int& value) { return tree.find(key, value); }
+    bool valid() { return tree.isValid(); }
+    void contents(std::map<int, int>& out)
+    {
+        tree.forEach([&out](const int& key, const int& value) { out[key] = value; });
+    }
+};
+
+struct SkipList {
+    ConcurrentSkipListMap<int, int> map;
+
+    void insert(int key, int value) { map.insert(std::make_pair(key, value)); }
+    void remove(int key) { map.remove(key); }
+    bool find(int key, int& value)
+    {
+        EpochGuard guard;
+        ConcurrentSkipListMap<int, int>::iterator it = map.find(key);
+        if (it == map.end()) {
+            return false;
+        }
+        value = it -> second;
+        return true;
+    }
+    bool valid() { return map.isValid(); }
+    void contents(std::map<int, int>& out)
+    {
+        for (ConcurrentSkipListMap<int, int>::iterator it = map.begin(); it != map.end(); ++it) {
+            out[it -> first] = it -> second;
+        }
+    }
+};
+
+/**
+* Every thread hammers a shared key range, but only inserts and removes
+* the keys it owns (key % threads == id) so the final contents can be
+* checked against per-thread reference maps. Reads cover all keys.
+*/
+template<typename Map>
+bool stressTest(int threads, int opsPerThread, int keyRange)
+{
+    Map map;
+    std::vector<std::map<int, int> > expected(threads);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&, t]() {
+            Rng rng(t + 1);
+            std::map<int, int>& mine = expected[t];
+            for (int i = 0; i < opsPerThread; ++i) {
+                int key = static_cast<int>(rng.next() % keyRange);
+                int op = static_cast<int>(rng.next() % 10);
+                int value;
+                if (op < 4) {
+                    map.find(key, value);
+                    continue;
+                }
+                key = key - (key % threads) + t;
+                if (op < 8) {
+                    map.insert(key, i);
+                    mine[key] = i;
+                }
+                else {
+                    map.remove(key);
+                    mine.erase(key);
+                }
+            }
+            Epoch::flush();
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+
+    std::map<int, int> all;
+    for (int t = 0; t < threads; ++t) {
+        all.insert(expected[t].begin(), expected[t].end());
+    }
+
+    std::map<int, int> actual;
+    map.contents(actual);
+    return map.valid() && actual == all;
+}
+
+/**
+* Returns the process's resident set size in MB.
+*/
+static double residentMB()
+{
+    long pages = 0, resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1048576.0);
+}
+
+/**
+* Churns insert/remove pairs on a small key range for several rounds,
+* never calling Epoch::flush(), the way ordinary callers use a map.
+* Retired nodes must be freed along the way, so resident memory should
+* stop growing after the first round. Reports the growth after it.
+*/
+template<typename Map>
+bool boundedMemoryTest(int threads, int rounds, int pairsPerRound, int keyRange, double& growthMB)
+{
+    Map map;
+    double afterFirst = 0;
+    for (int round = 0; round < rounds; ++round) {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.push_back(std::thread([&, t]() {
+                Rng rng(round * threads + t + 1);
+                for (int i = 0; i < pairsPerRound / threads; ++i) {
+                    int key = static_cast<int>(rng.next() % keyRange);
+                    map.insert(key, i);
+                    map.remove(key);
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); ++t) {
+            workers[t].join();
+        }
+        if (round == 0) {
+            afterFirst = residentMB();
+        }
+    }
+    growthMB = residentMB() - afterFirst;
+    return growthMB < 16;
+}
+
+/**
+* Runs a read/write mix (readPercent finds, the rest split evenly between
+* inserts and removes) on map with the given number of threads for
+* durationMs and returns millions of operations per second.
+*/
+template<typename Map>
+double throughput(int threads, int keyRange, int durationMs, int readPercent)
+{
+    Map map;
+    Rng fill(12345);
+    for (int i = 0; i < keyRange / 2; ++i) {
+        map.insert(static_cast<int>(fill.next() % keyRange), i);
+    }
+
+    std::atomic<bool> start(false), stop(false);
+    std::atomic<uint64_t> total(0);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&, t]() {
+            Rng rng(1000 + t);
+            uint64_t ops = 0;
+            int value;
+            while (!start.load()) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 64; ++i) {
+                    uint64_t r = rng.next();
+                    int key = static_cast<int>((r >> 8) % keyRange);
+                    int op = static_cast<int>(r % 100);
+                    if (op < readPercent) {
+                        map.find(key, value);
+                    }
+                    else if ((op - readPercent) % 2 == 0) {
+                        map.insert(key, i);
+                    }
+                    else {
+                        map.remove(key);
+                    }
+                }
+                ops += 64;
+            }
+            total += ops;
+            Epoch::flush();
+        }));
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    start.store(true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
+    stop.store(true);
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    return total.load() / seconds / 1e6;
+}
+
+/**
+* Prints one throughput table with a column per map type.
+*/
+void throughputTable(int keyRange, int durationMs, int readPercent)
+{
+    cout << "\n" << readPercent << "/" << (100 - readPercent) << " find/update throughput, "
+         << keyRange << " keys (Mops/s):" << endl;
+    cout << "threads   mutex+AVLTree   ShardedAVLMap   ConcurrentAVLTree   ConcurrentSkipListMap" << endl;
+    for (int i = 0; i < NUM_THREAD_COUNTS; ++i) {
+        int threads = THREAD_COUNTS[i];
+        cout << setw(7) << threads << fixed << setprecision(2)
+             << setw(16) << throughput<LockedAVL>(threads, keyRange, durationMs, readPercent)
+             << setw(16) << throughput<ShardedAVL>(threads, keyRange, durationMs, readPercent)
+             << setw(20) << throughput<OptimisticAVL>(threads, keyRange, durationMs, readPercent)
+             << setw(24) << throughput<SkipList>(threads, keyRange, durationMs, readPercent) << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int durationMs = (argc > 1) ? atoi(argv[1]) : 300;
+    int keyRange = (argc > 2) ? atoi(argv[2]) : 1000000;
+    int stressOps = (argc > 3) ? atoi(argv[3]) : 20000;
+
+    cout << "Stress test (" << stressOps << " ops/thread):" << endl;
+    cout << "threads   ConcurrentAVLTree   ConcurrentSkipListMap" << endl;
+    bool allPassed = true;
+    for (int i = 0; i < NUM_THREAD_COUNTS; ++i) {
+        bool avlPassed = stressTest<OptimisticAVL>(THREAD_COUNTS[i], stressOps, 4096);
+        bool skipPassed = stressTest<SkipList>(THREAD_COUNTS[i], stressOps, 4096);
+        allPassed = allPassed && avlPassed && skipPassed;
+        cout << setw(7) << THREAD_COUNTS[i]
+             << setw(20) << (avlPassed ? "ok" : "FAILED")
+             << setw(24) << (skipPassed ? "ok" : "FAILED") << endl;
+    }
+
+    const int memoryRounds = 5, memoryPairs = 250000;
+    double avlGrowth, skipGrowth;
+    bool avlBounded = boundedMemoryTest<OptimisticAVL>(4, memoryRounds, memoryPairs, 1000, avlGrowth);
+    bool skipBounded = boundedMemoryTest<SkipList>(4, memoryRounds, memoryPairs, 1000, skipGrowth);
+    allPassed = allPassed && avlBounded && skipBounded;
+    cout << "\nMemory growth over " << memoryRounds << " rounds of " << memoryPairs
+         << " insert/remove pairs without Epoch::flush():" << endl;
+    cout << fixed << setprecision(1) << "ConcurrentAVLTree " << avlGrowth << " MB "
+         << (avlBounded ? "ok" : "FAILED") << endl;
+    cout << "ConcurrentSkipListMap " << skipGrowth << " MB "
+         << (skipBounded ? "ok" : "FAILED") << endl;
+
+    throughputTable(keyRange, durationMs, 80);
+    throughputTable(keyRange, durationMs, 20);
+
+    return allPassed ? 0 : 1;
+}
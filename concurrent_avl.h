@@ -0,0 +1,1188 @@
+#ifndef CONCURRENT_AVL_H
+#define CONCURRENT_AVL_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <stdint.h>
+#include "epoch.h"
+
+/**
+* A node of a ConcurrentAVLTree. Every field that is read without a lock
+* is atomic. The value is held through a pointer so that readers can copy
+* it safely while a writer replaces it; a NULL value marks a routing node
+* (a removed key whose node is still needed because it has two children).
+*
+* version_ implements the optimistic validation of Bronson et al.: bit 0
+* is set once the node is unlinked, bit 1 while the node is being rotated
+* downwards (its key range is shrinking), and the remaining bits count
+* completed shrinks. A reader that saw a version and later sees a
+* different one must retry.
+*/
+template <typename Key, typename Value>
+class ConcurrentAVLNode
+{
+public:
+    ConcurrentAVLNode(const Key& key, Value* value, ConcurrentAVLNode<Key, Value>* parent);
+    ~ConcurrentAVLNode();
+
+    const Key& getKey() const;
+
+    ConcurrentAVLNode<Key, Value>* getParent() const;
+    ConcurrentAVLNode<Key, Value>* getLeft() const;
+    ConcurrentAVLNode<Key, Value>* getRight() const;
+    ConcurrentAVLNode<Key, Value>* getChild(int dir) const;
+
+    void setParent(ConcurrentAVLNode<Key, Value>* parent);
+    void setLeft(ConcurrentAVLNode<Key, Value>* left);
+    void setRight(ConcurrentAVLNode<Key, Value>* right);
+    void setChild(int dir, ConcurrentAVLNode<Key, Value>* child);
+
+    const Key key_;
+    std::atomic<Value*> value_;
+    std::atomic<uint64_t> version_;
+    std::atomic<int> height_;
+    std::mutex lock_;
+
+protected:
+    std::atomic<ConcurrentAVLNode<Key, Value>*> parent_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> left_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> right_;
+};
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the ConcurrentAVLNode class.
+  -----------------------------------------------------
+*/
+
+/**
+* Creates a leaf (height 1) owning value.
+*/
+template<typename Key, typename Value>
+ConcurrentAVLNode<Key, Value>::ConcurrentAVLNode(const Key& key, Value* value, ConcurrentAVLNode<Key, Value>* parent) :
+    key_(key), value_(value), version_(0), height_(1), parent_(parent), left_(NULL), right_(NULL)
+{
+
+}
+
+/**
+* Frees the value, if any. Children are freed by the tree.
+*/
+template<typename Key, typename Value>
+ConcurrentAVLNode<Key, Value>::~ConcurrentAVLNode()
+{
+    delete value_.load(std::memory_order_relaxed);
+}
+
+template<typename Key, typename Value>
+const Key& ConcurrentAVLNode<Key, Value>::getKey() const
+{
+    return key_;
+}
+
+template<typename Key, typename Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getParent() const
+{
+    return parent_.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getLeft() const
+{
+    return left_.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getRight() const
+{
+    return right_.load(std::memory_order_acquire);
+}
+
+/**
+* Returns the left child for a negative dir and the right child otherwise.
+*/
+template<typename Key, typename Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getChild(int dir) const
+{
+    return dir < 0 ? getLeft() : getRight();
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLNode<Key, Value>::setParent(ConcurrentAVLNode<Key, Value>* parent)
+{
+    parent_.store(parent, std::memory_order_release);
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLNode<Key, Value>::setLeft(ConcurrentAVLNode<Key, Value>* left)
+{
+    left_.store(left, std::memory_order_release);
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLNode<Key, Value>::setRight(ConcurrentAVLNode<Key, Value>* right)
+{
+    right_.store(right, std::memory_order_release);
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLNode<Key, Value>::setChild(int dir, ConcurrentAVLNode<Key, Value>* child)
+{
+    if (dir < 0) {
+        setLeft(child);
+    }
+    else {
+        setRight(child);
+    }
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the ConcurrentAVLNode class.
+  ---------------------------------------------------
+*/
+
+/**
+* A concurrent relaxed-balance AVL tree after Bronson, Casper, Chafi and
+* Olukotun, "A Practical Concurrent Binary Search Tree" (PPoPP 2010).
+*
+* Lookups take no locks: they descend optimistically and validate each
+* step against the node versions, retrying from the parent if a rotation
+* moved the node they were reading. Writers lock the node they change,
+* plus the parent when a node is unlinked; rebalancing locks only the
+* nodes a rotation touches as it retraces towards the root. Removing a
+* key whose node has two children leaves a routing node behind, which is
+* unlinked later once it has at most one child. Unlinked nodes and
+* replaced values are freed through Epoch.
+*
+* Key must be default constructible (for the root holder) and support
+* operator< and operator==.
+*/
+template <typename Key, typename Value>
+class ConcurrentAVLTree
+{
+public:
+    ConcurrentAVLTree();
+    ~ConcurrentAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value get(const Key& key) const;
+    bool empty() const;
+
+    template<typename Callback>
+    void forEach(Callback callback) const;
+    bool isValid() const;
+
+protected:
+    typedef ConcurrentAVLNode<Key, Value> CNode;
+
+    // results of the attempt* helpers
+    enum Attempt { RETRY, FOUND, NOT_FOUND };
+
+    // nodeCondition() results; any other value is the repaired height
+    static const int UNLINK_REQUIRED = -1;
+    static const int REBALANCE_REQUIRED = -2;
+    static const int NOTHING_REQUIRED = -3;
+
+    static const uint64_t UNLINKED = 1;
+    static const uint64_t SHRINKING = 2;
+    static const uint64_t SHRINK_COUNT_INCR = 4;
+
+    static int compare(const Key& a, const Key& b);
+    static int height(CNode* node);
+    static bool isUnlinked(uint64_t version);
+    static bool isShrinkingOrUnlinked(uint64_t version);
+    static void waitUntilNotChanging(CNode* node);
+
+    Attempt attemptGet(const Key& key, CNode* node, int dirToChild, uint64_t nodeVersion, Value& value) const;
+    void update(const Key& key, Value* newValue);
+    Attempt attemptUpdate(const Key& key, Value* newValue, CNode* parent, CNode* node, uint64_t nodeVersion);
+    Attempt attemptNodeUpdate(Value* newValue, CNode* parent, CNode* node);
+    bool attemptInsertIntoEmpty(const Key& key, Value* newValue);
+    bool attemptUnlink(CNode* parent, CNode* node);
+
+    int nodeCondition(CNode* node);
+    void fixHeightAndRebalance(CNode* node);
+    CNode* fixHeight(CNode* node);
+    CNode* rebalance(CNode* nParent, CNode* n);
+    CNode* rebalanceToRight(CNode* nParent, CNode* n, CNode* nL, int hR0);
+    CNode* rebalanceToLeft(CNode* nParent, CNode* n, CNode* nR, int hL0);
+    CNode* rotateRight(CNode* nParent, CNode* n, CNode* nL, int hR, int hLL, CNode* nLR, int hLR);
+    CNode* rotateLeft(CNode* nParent, CNode* n, int hL, CNode* nR, CNode* nRL, int hRL, int hRR);
+    CNode* rotateRightOverLeft(CNode* nParent, CNode* n, CNode* nL, int hR, int hLL, CNode* nLR, int hLRL);
+    CNode* rotateLeftOverRight(CNode* nParent, CNode* n, int hL, CNode* nR, CNode* nRL, int hRR, int hRLR);
+
+    int validateHelper(CNode* node, const Key* lo, const Key* hi) const;
+
+    // sentinel whose right child is the root, so every node has a parent to lock
+    CNode* holder_;
+};
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  -----------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+ConcurrentAVLTree<Key, Value>::ConcurrentAVLTree() :
+    holder_(new CNode(Key(), NULL, NULL))
+{
+
+}
+
+/**
+* Frees every node. No other thread may be using the tree.
+*/
+template<typename Key, typename Value>
+ConcurrentAVLTree<Key, Value>::~ConcurrentAVLTree()
+{
+    std::vector<CNode*> stack;
+    stack.push_back(holder_);
+    while (!stack.empty()) {
+        CNode* node = stack.back();
+        stack.pop_back();
+        if (node -> getLeft() != NULL) {
+            stack.push_back(node -> getLeft());
+        }
+        if (node -> getRight() != NULL) {
+            stack.push_back(node -> getRight());
+        }
+        delete node;
+    }
+}
+
+template<typename Key, typename Value>
+int ConcurrentAVLTree<Key, Value>::compare(const Key& a, const Key& b)
+{
+    if (a == b) {
+        return 0;
+    }
+    return (a < b) ? -1 : 1;
+}
+
+template<typename Key, typename Value>
+int ConcurrentAVLTree<Key, Value>::height(CNode* node)
+{
+    return node == NULL ? 0 : node -> height_.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::isUnlinked(uint64_t version)
+{
+    return (version & UNLINKED) != 0;
+}
+
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::isShrinkingOrUnlinked(uint64_t version)
+{
+    return (version & (UNLINKED | SHRINKING)) != 0;
+}
+
+/**
+* Waits for a rotation of node to finish: spin, then yield, and as a last
+* resort take the node's lock, which the rotating thread holds.
+*/
+template<typename Key, typename Value>
+void ConcurrentAVLTree<Key, Value>::waitUntilNotChanging(CNode* node)
+{
+    uint64_t version = node -> version_.load(std::memory_order_acquire);
+    if ((version & SHRINKING) == 0) {
+        return;
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        if (node -> version_.load(std::memory_order_acquire) != version) {
+            return;
+        }
+    }
+    for (int i = 0; i < 10; ++i) {
+        std::this_thread::yield();
+        if (node -> version_.load(std::memory_order_acquire) != version) {
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> guard(node -> lock_);
+}
+
+/**
+* Copies the value for key into value and returns true, or returns
+* false if key is not present. Takes no locks.
+*/
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::find(const Key& key, Value& value) const
+{
+    EpochGuard guard;
+
+    while (true) {
+        CNode* right = holder_ -> getRight();
+        if (right == NULL) {
+            return false;
+        }
+
+        int rightCmp = compare(key, right -> getKey());
+        if (rightCmp == 0) {
+            Value* found = right -> value_.load(std::memory_order_acquire);
+            if (found == NULL) {
+                return false;
+            }
+            value = *found;
+            return true;
+        }
+
+        uint64_t version = right -> version_.load(std::memory_order_acquire);
+        if (isShrinkingOrUnlinked(version)) {
+            waitUntilNotChanging(right);
+        }
+        else if (right == holder_ -> getRight()) {
+            Attempt result = attemptGet(key, right, rightCmp, version, value);
+            if (result != RETRY) {
+                return result == FOUND;
+            }
+        }
+    }
+}
+
+/**
+* Continues a lookup below node, which was reached while its version was
+* nodeVersion. Returns RETRY if node has since been rotated or unlinked,
+* so that the caller can re-read its own child pointer.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::Attempt
+ConcurrentAVLTree<Key, Value>::attemptGet(const Key& key, CNode* node, int dirToChild, uint64_t nodeVersion, Value& value) const
+{
+    while (true) {
+        CNode* child = node -> getChild(dirToChild);
+
+        if (child == NULL) {
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion) {
+                return RETRY;
+            }
+            return NOT_FOUND;
+        }
+
+        int childCmp = compare(key, child -> getKey());
+        if (childCmp == 0) {
+            Value* found = child -> value_.load(std::memory_order_acquire);
+            if (found == NULL) {
+                return NOT_FOUND;
+            }
+            value = *found;
+            return FOUND;
+        }
+
+        uint64_t childVersion = child -> version_.load(std::memory_order_acquire);
+        if (isShrinkingOrUnlinked(childVersion)) {
+            waitUntilNotChanging(child);
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion) {
+                return RETRY;
+            }
+        }
+        else if (child != node -> getChild(dirToChild)) {
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion) {
+                return RETRY;
+            }
+        }
+        else {
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion) {
+                return RETRY;
+            }
+            // the step from node to child was valid, so node no longer matters
+            Attempt result = attemptGet(key, child, childCmp, childVersion, value);
+            if (result != RETRY) {
+                return result;
+            }
+        }
+    }
+}
+
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::contains(const Key& key) const
+{
+    Value value;
+    return find(key, value);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns a copy of the value associated with the key
+ */
+template<typename Key, typename Value>
+Value ConcurrentAVLTree<Key, Value>::get(const Key& key) const
+{
+    Value value;
+    if (!find(key, value)) throw std::out_of_range("Invalid key");
+    return value;
+}
+
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::empty() const
+{
+    bool isEmpty = true;
+    forEach([&isEmpty](const Key&, const Value&) { isEmpty = false; });
+    return isEmpty;
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+*/
+template<typename Key, typename Value>
+void ConcurrentAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    update(keyValuePair.first, new Value(keyValuePair.second));
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLTree<Key, Value>::remove(const Key& key)
+{
+    update(key, NULL);
+}
+
+/**
+* Sets the value of key to newValue (taking ownership of it), or removes
+* key if newValue is NULL.
+*/
+template<typename Key, typename Value>
+void ConcurrentAVLTree<Key, Value>::update(const Key& key, Value* newValue)
+{
+    EpochGuard guard;
+
+    while (true) {
+        CNode* right = holder_ -> getRight();
+        if (right == NULL) {
+            if (newValue == NULL || attemptInsertIntoEmpty(key, newValue)) {
+                return;
+            }
+        }
+        else {
+            uint64_t version = right -> version_.load(std::memory_order_acquire);
+            if (isShrinkingOrUnlinked(version)) {
+                waitUntilNotChanging(right);
+            }
+            else if (right == holder_ -> getRight()) {
+                if (attemptUpdate(key, newValue, holder_, right, version) != RETRY) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::attemptInsertIntoEmpty(const Key& key, Value* newValue)
+{
+    std::lock_guard<std::mutex> guard(holder_ -> lock_);
+    if (holder_ -> getRight() != NULL) {
+        return false;
+    }
+    holder_ -> setRight(new CNode(key, newValue, holder_));
+    holder_ -> height_.store(2, std::memory_order_release);
+    return true;
+}
+
+/**
+* Continues an update below node, which was reached from parent while
+* node's version was nodeVersion. An insert locks only the node that
+* gets the new leaf.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::Attempt
+ConcurrentAVLTree<Key, Value>::attemptUpdate(const Key& key, Value* newValue, CNode* parent, CNode* node, uint64_t nodeVersion)
+{
+    int cmp = compare(key, node -> getKey());
+    if (cmp == 0) {
+        return attemptNodeUpdate(newValue, parent, node);
+    }
+
+    while (true) {
+        CNode* child = node -> getChild(cmp);
+        if (node -> version_.load(std::memory_order_acquire) != nodeVersion) {
+            return RETRY;
+        }
+
+        if (child == NULL) {
+            // key is not present
+            if (newValue == NULL) {
+                return NOT_FOUND;
+            }
+
+            CNode* damaged = NULL;
+            bool inserted = false;
+            {
+                std::lock_guard<std::mutex> guard(node -> lock_);
+                // with node locked no further rotation can invalidate the descent
+                if (node -> version_.load(std::memory_order_acquire) != nodeVersion) {
+                    return RETRY;
+                }
+                // otherwise a concurrent insert won the race; retry from node
+                if (node -> getChild(cmp) == NULL) {
+                    node -> setChild(cmp, new CNode(key, newValue, node));
+                    inserted = true;
+                    damaged = fixHeight(node);
+                }
+            }
+            if (inserted) {
+                fixHeightAndRebalance(damaged != NULL ? damaged : node);
+                return FOUND;
+            }
+        }
+        else {
+            uint64_t childVersion = child -> version_.load(std::memory_order_acquire);
+            if (isShrinkingOrUnlinked(childVersion)) {
+                waitUntilNotChanging(child);
+            }
+            else if (child != node -> getChild(cmp)) {
+                // the re-read is protected by childVersion; retry from node
+            }
+            else {
+                if (node -> version_.load(std::memory_order_acquire) != nodeVersion) {
+                    return RETRY;
+                }
+                Attempt result = attemptUpdate(key, newValue, node, child, childVersion);
+                if (result != RETRY) {
+                    return result;
+                }
+            }
+        }
+    }
+}
+
+/**
+* Updates or removes the value of node, which holds the key. A removal
+* unlinks the node if it has at most one child (locking the parent and
+* then the node); otherwise the node is kept as a routing node.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::Attempt
+ConcurrentAVLTree<Key, Value>::attemptNodeUpdate(Value* newValue, CNode* parent, CNode* node)
+{
+    if (newValue == NULL && node -> value_.load(std::memory_order_acquire) == NULL) {
+        return NOT_FOUND;
+    }
+
+    if (newValue == NULL && (node -> getLeft() == NULL || node -> getRight() == NULL)) {
+        CNode* damaged;
+        {
+            std::lock_guard<std::mutex> parentGuard(parent -> lock_);
+            if (isUnlinked(parent -> version_.load(std::memory_order_acquire)) || node -> getParent() != parent) {
+                return RETRY;
+            }
+            {
+                std::lock_guard<std::mutex> nodeGuard(node -> lock_);
+                if (node -> value_.load(std::memory_order_acquire) == NULL) {
+                    return NOT_FOUND;
+                }
+                if (!attemptUnlink(parent, node)) {
+                    return RETRY;
+                }
+            }
+            damaged = fixHeight(parent);
+        }
+        fixHeightAndRebalance(damaged != NULL ? damaged : parent);
+        return FOUND;
+    }
+
+    std::lock_guard<std::mutex> guard(node -> lock_);
+    if (isUnlinked(node -> version_.load(std::memory_order_acquire))) {
+        return RETRY;
+    }
+
+    Value* previous = node -> value_.load(std::memory_order_acquire);
+    if (newValue == NULL) {
+        if (previous == NULL) {
+            return NOT_FOUND;
+        }
+        // a child was removed since the check above, so the node can be unlinked
+        if (node -> getLeft() == NULL || node -> getRight() == NULL) {
+            return RETRY;
+        }
+    }
+
+    node -> value_.store(newValue, std::memory_order_release);
+    if (previous != NULL) {
+        Epoch::retire(previous);
+    }
+    return FOUND;
+}
+
+/**
+* Splices node (which has at most one child) out from under parent.
+* Both must be locked. The node and its value are retired.
+*/
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::attemptUnlink(CNode* parent, CNode* node)
+{
+    CNode* parentL = parent -> getLeft();
+    CNode* parentR = parent -> getRight();
+    if (parentL != node && parentR != node) {
+        return false;
+    }
+
+    CNode* left = node -> getLeft();
+    CNode* right = node -> getRight();
+    if (left != NULL && right != NULL) {
+        return false;
+    }
+
+    CNode* splice = (left != NULL) ? left : right;
+    if (parentL == node) {
+        parent -> setLeft(splice);
+    }
+    else {
+        parent -> setRight(splice);
+    }
+    if (splice != NULL) {
+        splice -> setParent(parent);
+    }
+
+    node -> version_.store(UNLINKED, std::memory_order_release);
+    Value* previous = node -> value_.exchange(NULL);
+    if (previous != NULL) {
+        Epoch::retire(previous);
+    }
+    Epoch::retire(node);
+    return true;
+}
+
+/**
+* Classifies node from an unlocked snapshot of its children: it needs
+* unlinking, a rotation, a new height (returned), or nothing at all.
+*/
+template<typename Key, typename Value>
+int ConcurrentAVLTree<Key, Value>::nodeCondition(CNode* node)
+{
+    CNode* nL = node -> getLeft();
+    CNode* nR = node -> getRight();
+
+    if ((nL == NULL || nR == NULL) && node -> value_.load(std::memory_order_acquire) == NULL) {
+        return UNLINK_REQUIRED;
+    }
+
+    int hN = height(node);
+    int hL0 = height(nL);
+    int hR0 = height(nR);
+    int hNRepl = 1 + std::max(hL0, hR0);
+    int bal = hL0 - hR0;
+
+    if (bal < -1 || bal > 1) {
+        return REBALANCE_REQUIRED;
+    }
+    return (hN != hNRepl) ? hNRepl : NOTHING_REQUIRED;
+}
+
+/**
+* Retraces from node towards the root, repairing heights and rotating
+* where needed. Each step locks only the node (or the node and its
+* parent, for a rotation or unlink). The retrace keeps climbing past
+* nodes that need nothing, so damage that a rotation left above the
+* node it returned is still seen and the tree is strictly balanced
+* once all updates have finished.
+*/
+template<typename Key, typename Value>
+void ConcurrentAVLTree<Key, Value>::fixHeightAndRebalance(CNode* node)
+{
+    while (node != NULL && node -> getParent() != NULL) {
+        if (isUnlinked(node -> version_.load(std::memory_order_acquire))) {
+            // whoever unlinked node repairs its old parent
+            return;
+        }
+
+        int condition = nodeCondition(node);
+        if (condition == NOTHING_REQUIRED) {
+            node = node -> getParent();
+            continue;
+        }
+
+        if (condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED) {
+            std::lock_guard<std::mutex> guard(node -> lock_);
+            CNode* damaged = fixHeight(node);
+            node = (damaged != NULL) ? damaged : node -> getParent();
+        }
+        else {
+            CNode* nParent = node -> getParent();
+            std::lock_guard<std::mutex> parentGuard(nParent -> lock_);
+            if (!isUnlinked(nParent -> version_.load(std::memory_order_acquire)) && node -> getParent() == nParent) {
+                std::lock_guard<std::mutex> nodeGuard(node -> lock_);
+                CNode* damaged = rebalance(nParent, node);
+                node = (damaged != NULL) ? damaged : nParent;
+            }
+        }
+    }
+}
+
+/**
+* Repairs the height of the locked node and returns the next node to
+* repair: the node itself if it needs a rotation or unlink, its parent if
+* the height changed, or NULL if nothing more is needed.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::fixHeight(CNode* node)
+{
+    int condition = nodeCondition(node);
+    switch (condition) {
+        case REBALANCE_REQUIRED:
+        case UNLINK_REQUIRED:
+            return node;
+        case NOTHING_REQUIRED:
+            return NULL;
+        default:
+            node -> height_.store(condition, std::memory_order_release);
+            return node -> getParent();
+    }
+}
+
+/**
+* Unlinks or rotates n, with both n and nParent locked. Returns the next
+* damaged node, or NULL.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rebalance(CNode* nParent, CNode* n)
+{
+    CNode* nL = n -> getLeft();
+    CNode* nR = n -> getRight();
+
+    if ((nL == NULL || nR == NULL) && n -> value_.load(std::memory_order_acquire) == NULL) {
+        if (attemptUnlink(nParent, n)) {
+            return fixHeight(nParent);
+        }
+        return n;
+    }
+
+    int hN = height(n);
+    int hL0 = height(nL);
+    int hR0 = height(nR);
+    int hNRepl = 1 + std::max(hL0, hR0);
+    int bal = hL0 - hR0;
+
+    if (bal > 1) {
+        return rebalanceToRight(nParent, n, nL, hR0);
+    }
+    else if (bal < -1) {
+        return rebalanceToLeft(nParent, n, nR, hL0);
+    }
+    else if (hNRepl != hN) {
+        n -> height_.store(hNRepl, std::memory_order_release);
+        return fixHeight(nParent);
+    }
+    return NULL;
+}
+
+/**
+* n's left side is too tall: rotate right, first rotating nL left if its
+* right side is the taller one.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rebalanceToRight(CNode* nParent, CNode* n, CNode* nL, int hR0)
+{
+    std::lock_guard<std::mutex> leftGuard(nL -> lock_);
+
+    int hL = height(nL);
+    if (hL - hR0 <= 1) {
+        return n;
+    }
+
+    CNode* nLR = nL -> getRight();
+    int hLL0 = height(nL -> getLeft());
+    int hLR0 = height(nLR);
+    if (hLL0 >= hLR0) {
+        return rotateRight(nParent, n, nL, hR0, hLL0, nLR, hLR0);
+    }
+
+    {
+        std::lock_guard<std::mutex> leftRightGuard(nLR -> lock_);
+
+        int hLR = height(nLR);
+        if (hLL0 >= hLR) {
+            return rotateRight(nParent, n, nL, hR0, hLL0, nLR, hLR);
+        }
+
+        // only do the double rotation if it will not leave nL unbalanced
+        int hLRL = height(nLR -> getLeft());
+        int b = hLL0 - hLRL;
+        if (b >= -1 && b <= 1) {
+            if (nL -> value_.load(std::memory_order_acquire) != NULL || (hLL0 != 0 && hLRL != 0)) {
+                return rotateRightOverLeft(nParent, n, nL, hR0, hLL0, nLR, hLRL);
+            }
+            if (hLL0 == 0) {
+                // nL is a routing node with one child; unlink it first
+                return nL;
+            }
+            // nL would be left as a routing node with one child; it is
+            // still locked, so splice it out of its new parent right away
+            rotateRightOverLeft(nParent, n, nL, hR0, hLL0, nLR, hLRL);
+            attemptUnlink(nLR, nL);
+            nLR -> height_.store(1 + std::max(height(nLR -> getLeft()), height(n)), std::memory_order_release);
+            return n;
+        }
+    }
+
+    // fix nL on its own first; n is rebalanced on a later pass if still needed
+    return rebalanceToLeft(n, nL, nLR, hLL0);
+}
+
+/**
+* Mirror image of rebalanceToRight().
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rebalanceToLeft(CNode* nParent, CNode* n, CNode* nR, int hL0)
+{
+    std::lock_guard<std::mutex> rightGuard(nR -> lock_);
+
+    int hR = height(nR);
+    if (hL0 - hR >= -1) {
+        return n;
+    }
+
+    CNode* nRL = nR -> getLeft();
+    int hRL0 = height(nRL);
+    int hRR0 = height(nR -> getRight());
+    if (hRR0 >= hRL0) {
+        return rotateLeft(nParent, n, hL0, nR, nRL, hRL0, hRR0);
+    }
+
+    {
+        std::lock_guard<std::mutex> rightLeftGuard(nRL -> lock_);
+
+        int hRL = height(nRL);
+        if (hRR0 >= hRL) {
+            return rotateLeft(nParent, n, hL0, nR, nRL, hRL, hRR0);
+        }
+
+        int hRLR = height(nRL -> getRight());
+        int b = hRR0 - hRLR;
+        if (b >= -1 && b <= 1) {
+            if (nR -> value_.load(std::memory_order_acquire) != NULL || (hRR0 != 0 && hRLR != 0)) {
+                return rotateLeftOverRight(nParent, n, hL0, nR, nRL, hRR0, hRLR);
+            }
+            if (hRR0 == 0) {
+                return nR;
+            }
+            rotateLeftOverRight(nParent, n, hL0, nR, nRL, hRR0, hRLR);
+            attemptUnlink(nRL, nR);
+            nRL -> height_.store(1 + std::max(height(n), height(nRL -> getRight())), std::memory_order_release);
+            return n;
+        }
+    }
+
+    return rebalanceToRight(n, nR, nRL, hRR0);
+}
+
+/**
+* Rotates n (locked, as are nParent and nL) to the right. n's version is
+* marked as shrinking while the links change so optimistic readers that
+* passed through n retry. Returns the next damaged node, or NULL.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rotateRight(CNode* nParent, CNode* n, CNode* nL, int hR, int hLL, CNode* nLR, int hLR)
+{
+    uint64_t nodeVersion = n -> version_.load(std::memory_order_acquire);
+    CNode* nPL = nParent -> getLeft();
+
+    n -> version_.store(nodeVersion | SHRINKING, std::memory_order_release);
+
+    // link order keeps every node but n reachable for concurrent readers
+    n -> setLeft(nLR);
+    if (nLR != NULL) {
+        nLR -> setParent(n);
+    }
+    nL -> setRight(n);
+    n -> setParent(nL);
+    if (nPL == n) {
+        nParent -> setLeft(nL);
+    }
+    else {
+        nParent -> setRight(nL);
+    }
+    nL -> setParent(nParent);
+
+    int hNRepl = 1 + std::max(hLR, hR);
+    n -> height_.store(hNRepl, std::memory_order_release);
+    nL -> height_.store(1 + std::max(hLL, hNRepl), std::memory_order_release);
+
+    n -> version_.store(nodeVersion + SHRINK_COUNT_INCR, std::memory_order_release);
+
+    // n is the deepest damaged node, then nL, then nParent
+    int balN = hLR - hR;
+    if (balN < -1 || balN > 1) {
+        return n;
+    }
+    if ((nLR == NULL || hR == 0) && n -> value_.load(std::memory_order_acquire) == NULL) {
+        return n;
+    }
+    int balL = hLL - hNRepl;
+    if (balL < -1 || balL > 1) {
+        return nL;
+    }
+    if (hLL == 0 && nL -> value_.load(std::memory_order_acquire) == NULL) {
+        return nL;
+    }
+    return fixHeight(nParent);
+}
+
+/**
+* Mirror image of rotateRight().
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rotateLeft(CNode* nParent, CNode* n, int hL, CNode* nR, CNode* nRL, int hRL, int hRR)
+{
+    uint64_t nodeVersion = n -> version_.load(std::memory_order_acquire);
+    CNode* nPL = nParent -> getLeft();
+
+    n -> version_.store(nodeVersion | SHRINKING, std::memory_order_release);
+
+    n -> setRight(nRL);
+    if (nRL != NULL) {
+        nRL -> setParent(n);
+    }
+    nR -> setLeft(n);
+    n -> setParent(nR);
+    if (nPL == n) {
+        nParent -> setLeft(nR);
+    }
+    else {
+        nParent -> setRight(nR);
+    }
+    nR -> setParent(nParent);
+
+    int hNRepl = 1 + std::max(hL, hRL);
+    n -> height_.store(hNRepl, std::memory_order_release);
+    nR -> height_.store(1 + std::max(hNRepl, hRR), std::memory_order_release);
+
+    n -> version_.store(nodeVersion + SHRINK_COUNT_INCR, std::memory_order_release);
+
+    int balN = hRL - hL;
+    if (balN < -1 || balN > 1) {
+        return n;
+    }
+    if ((nRL == NULL || hL == 0) && n -> value_.load(std::memory_order_acquire) == NULL) {
+        return n;
+    }
+    int balR = hRR - hNRepl;
+    if (balR < -1 || balR > 1) {
+        return nR;
+    }
+    if (hRR == 0 && nR -> value_.load(std::memory_order_acquire) == NULL) {
+        return nR;
+    }
+    return fixHeight(nParent);
+}
+
+/**
+* Double rotation: nLR (locked) becomes the subtree root with nL on its
+* left and n on its right. Both n and nL shrink.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rotateRightOverLeft(CNode* nParent, CNode* n, CNode* nL, int hR, int hLL, CNode* nLR, int hLRL)
+{
+    uint64_t nodeVersion = n -> version_.load(std::memory_order_acquire);
+    uint64_t leftVersion = nL -> version_.load(std::memory_order_acquire);
+    CNode* nPL = nParent -> getLeft();
+    CNode* nLRL = nLR -> getLeft();
+    CNode* nLRR = nLR -> getRight();
+    int hLRR = height(nLRR);
+
+    n -> version_.store(nodeVersion | SHRINKING, std::memory_order_release);
+    nL -> version_.store(leftVersion | SHRINKING, std::memory_order_release);
+
+    n -> setLeft(nLRR);
+    if (nLRR != NULL) {
+        nLRR -> setParent(n);
+    }
+    nL -> setRight(nLRL);
+    if (nLRL != NULL) {
+        nLRL -> setParent(nL);
+    }
+    nLR -> setLeft(nL);
+    nL -> setParent(nLR);
+    nLR -> setRight(n);
+    n -> setParent(nLR);
+    if (nPL == n) {
+        nParent -> setLeft(nLR);
+    }
+    else {
+        nParent -> setRight(nLR);
+    }
+    nLR -> setParent(nParent);
+
+    int hNRepl = 1 + std::max(hLRR, hR);
+    n -> height_.store(hNRepl, std::memory_order_release);
+    int hLRepl = 1 + std::max(hLL, hLRL);
+    nL -> height_.store(hLRepl, std::memory_order_release);
+    nLR -> height_.store(1 + std::max(hLRepl, hNRepl), std::memory_order_release);
+
+    n -> version_.store(nodeVersion + SHRINK_COUNT_INCR, std::memory_order_release);
+    nL -> version_.store(leftVersion + SHRINK_COUNT_INCR, std::memory_order_release);
+
+    int balN = hLRR - hR;
+    if (balN < -1 || balN > 1) {
+        return n;
+    }
+    if ((nLRR == NULL || hR == 0) && n -> value_.load(std::memory_order_acquire) == NULL) {
+        return n;
+    }
+    int balLR = hLRepl - hNRepl;
+    if (balLR < -1 || balLR > 1) {
+        return nLR;
+    }
+    return fixHeight(nParent);
+}
+
+/**
+* Mirror image of rotateRightOverLeft().
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rotateLeftOverRight(CNode* nParent, CNode* n, int hL, CNode* nR, CNode* nRL, int hRR, int hRLR)
+{
+    uint64_t nodeVersion = n -> version_.load(std::memory_order_acquire);
+    uint64_t rightVersion = nR -> version_.load(std::memory_order_acquire);
+    CNode* nPL = nParent -> getLeft();
+    CNode* nRLL = nRL -> getLeft();
+    CNode* nRLR = nRL -> getRight();
+    int hRLL = height(nRLL);
+
+    n -> version_.store(nodeVersion | SHRINKING, std::memory_order_release);
+    nR -> version_.store(rightVersion | SHRINKING, std::memory_order_release);
+
+    n -> setRight(nRLL);
+    if (nRLL != NULL) {
+        nRLL -> setParent(n);
+    }
+    nR -> setLeft(nRLR);
+    if (nRLR != NULL) {
+        nRLR -> setParent(nR);
+    }
+    nRL -> setRight(nR);
+    nR -> setParent(nRL);
+    nRL -> setLeft(n);
+    n -> setParent(nRL);
+    if (nPL == n) {
+        nParent -> setLeft(nRL);
+    }
+    else {
+        nParent -> setRight(nRL);
+    }
+    nRL -> setParent(nParent);
+
+    int hNRepl = 1 + std::max(hL, hRLL);
+    n -> height_.store(hNRepl, std::memory_order_release);
+    int hRRepl = 1 + std::max(hRLR, hRR);
+    nR -> height_.store(hRRepl, std::memory_order_release);
+    nRL -> height_.store(1 + std::max(hNRepl, hRRepl), std::memory_order_release);
+
+    n -> version_.store(nodeVersion + SHRINK_COUNT_INCR, std::memory_order_release);
+    nR -> version_.store(rightVersion + SHRINK_COUNT_INCR, std::memory_order_release);
+
+    int balN = hRLL - hL;
+    if (balN < -1 || balN > 1) {
+        return n;
+    }
+    if ((nRLL == NULL || hL == 0) && n -> value_.load(std::memory_order_acquire) == NULL) {
+        return n;
+    }
+    int balRL = hRRepl - hNRepl;
+    if (balRL < -1 || balRL > 1) {
+        return nRL;
+    }
+    return fixHeight(nParent);
+}
+
+/**
+* Calls callback(key, value) for every present key in order. The walk is
+* weakly consistent: concurrent updates may or may not be observed.
+*/
+template<typename Key, typename Value>
+template<typename Callback>
+void ConcurrentAVLTree<Key, Value>::forEach(Callback callback) const
+{
+    EpochGuard guard;
+    std::vector<CNode*> stack;
+    CNode* curr = holder_ -> getRight();
+
+    while (curr != NULL || !stack.empty()) {
+        while (curr != NULL) {
+            stack.push_back(curr);
+            curr = curr -> getLeft();
+        }
+        CNode* node = stack.back();
+        stack.pop_back();
+
+        Value* value = node -> value_.load(std::memory_order_acquire);
+        if (value != NULL) {
+            callback(node -> getKey(), *value);
+        }
+        curr = node -> getRight();
+    }
+}
+
+/**
+* Checks ordering, parent links, stored heights and AVL balance. Only
+* meaningful while no other thread is updating the tree; once all
+* updates have finished the tree is strictly balanced and contains no
+* unlinkable routing nodes.
+*/
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::isValid() const
+{
+    CNode* root = holder_ -> getRight();
+    if (root != NULL && root -> getParent() != holder_) {
+        return false;
+    }
+    return validateHelper(root, NULL, NULL) >= 0;
+}
+
+/**
+* Returns the height of the subtree at node, or -1 if it is invalid.
+*/
+template<typename Key, typename Value>
+int ConcurrentAVLTree<Key, Value>::validateHelper(CNode* node, const Key* lo, const Key* hi) const
+{
+    if (node == NULL) {
+        return 0;
+    }
+    if ((lo != NULL && !(*lo < node -> getKey())) || (hi != NULL && !(node -> getKey() < *hi))) {
+        return -1;
+    }
+
+    CNode* left = node -> getLeft();
+    CNode* right = node -> getRight();
+    if ((left != NULL && left -> getParent() != node) || (right != NULL && right -> getParent() != node)) {
+        return -1;
+    }
+    if ((left == NULL || right == NULL) && node -> value_.load() == NULL) {
+        return -1;
+    }
+
+    int leftHeight = validateHelper(left, lo, &node -> getKey());
+    int rightHeight = validateHelper(right, &node -> getKey(), hi);
+    if (leftHeight < 0 || rightHeight < 0 || std::abs(leftHeight - rightHeight) > 1) {
+        return -1;
+    }
+
+    int h = 1 + std::max(leftHeight, rightHeight);
+    return (h == height(node)) ? h : -1;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  ---------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,599 @@
+#ifndef CONCURRENT_SKIPLIST_H
+#define CONCURRENT_SKIPLIST_H
+
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <stdint.h>
+#include "epoch.h"
+
+/**
+* A lock-free ordered map built on a skip list of CAS-linked towers
+* (Fraser; Herlihy and Shavit, "The Art of Multiprocessor Programming",
+* ch. 14), with the same insert/remove/find/operator[]/iterator surface as
+* BinarySearchTree so that it can stand in for a mutex-protected AVLTree.
+*
+* Every next pointer carries a mark bit in its low bit. A removal marks
+* the victim's tower top-down; the bottom-level mark is the linearization
+* point. Marked nodes are snipped out by any traversal that meets them,
+* and a node is retired through Epoch once both its inserter has finished
+* linking it and its remover has marked it, so no late link can make a
+* freed tower reachable again.
+*
+* Items are held through a pointer that is swapped (and the old item
+* retired) when a key is overwritten, so readers never see a torn value.
+* Pointers and references obtained from find(), operator[] or an iterator
+* stay valid while the calling thread holds an EpochGuard.
+*
+* Key must be default constructible (for the head tower) and support
+* operator< and operator==.
+*/
+template <typename Key, typename Value>
+class ConcurrentSkipListMap
+{
+protected:
+    struct Tower;
+
+public:
+    ConcurrentSkipListMap();
+    ~ConcurrentSkipListMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    bool isValid() const;
+
+    /**
+    * An iterator over the bottom level that skips removed towers. It is
+    * weakly consistent under concurrent updates.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ConcurrentSkipListMap<Key, Value>;
+        iterator(Tower* tower, std::pair<const Key, Value>* item);
+        void skipRemoved();
+
+        Tower* current_;
+        std::pair<const Key, Value>* item_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    typedef std::pair<const Key, Value> Item;
+
+    // maximum tower height; enough for 2^MAX_LEVEL keys
+    static const int MAX_LEVEL = 24;
+
+    /**
+    * A node with a tower of next pointers. Towers are allocated with
+    * exactly height next slots; next is declared with one slot and
+    * over-allocated.
+    */
+    struct Tower {
+        const Key key;
+        std::atomic<Item*> item;
+        std::atomic<int> owners;    // inserter and remover; the last one out retires
+        int height;
+        std::atomic<uintptr_t> next[1];
+
+        Tower(const Key& k, Item* i, int h);
+    };
+
+    static Tower* createTower(const Key& key, Item* item, int height);
+    static void destroyTower(void* ptr);
+    static Tower* pointer(uintptr_t link);
+    static bool isMarked(uintptr_t link);
+    static uintptr_t link(Tower* tower, bool marked);
+    static int randomLevel();
+
+    bool findPosition(const Key& key, Tower** preds, Tower** succs) const;
+    Tower* findTower(const Key& key) const;
+    void release(Tower* tower);
+
+    Tower* head_;
+};
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the ConcurrentSkipListMap class.
+  -------------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+ConcurrentSkipListMap<Key, Value>::Tower::Tower(const Key& k, Item* i, int h) :
+    key(k), item(i), owners(2), height(h)
+{
+
+}
+
+/**
+* Allocates a tower with height next slots, all NULL.
+*/
+template<typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::Tower*
+ConcurrentSkipListMap<Key, Value>::createTower(const Key& key, Item* item, int height)
+{
+    size_t bytes = sizeof(Tower) + (height - 1) * sizeof(std::atomic<uintptr_t>);
+    void* memory = ::operator new(bytes);
+    Tower* tower = new (memory) Tower(key, item, height);
+    for (int i = 1; i < height; ++i) {
+        new (&tower -> next[i]) std::atomic<uintptr_t>(0);
+    }
+    tower -> next[0].store(0);
+    return tower;
+}
+
+/**
+* Frees a tower and its item. Used directly and as the Epoch deleter.
+*/
+template<typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::destroyTower(void* ptr)
+{
+    Tower* tower = static_cast<Tower*>(ptr);
+    delete tower -> item.load();
+    tower -> ~Tower();
+    ::operator delete(ptr);
+}
+
+template<typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::Tower*
+ConcurrentSkipListMap<Key, Value>::pointer(uintptr_t link)
+{
+    return reinterpret_cast<Tower*>(link & ~static_cast<uintptr_t>(1));
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipListMap<Key, Value>::isMarked(uintptr_t link)
+{
+    return (link & 1) != 0;
+}
+
+template<typename Key, typename Value>
+uintptr_t ConcurrentSkipListMap<Key, Value>::link(Tower* tower, bool marked)
+{
+    return reinterpret_cast<uintptr_t>(tower) | (marked ? 1 : 0);
+}
+
+/**
+* Picks a tower height with P(h) = 2^-h, using a per-thread xorshift.
+*/
+template<typename Key, typename Value>
+int ConcurrentSkipListMap<Key, Value>::randomLevel()
+{
+    static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL ^ reinterpret_cast<uintptr_t>(&state);
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    int level = 1;
+    uint64_t bits = state;
+    while ((bits & 1) != 0 && level < MAX_LEVEL) {
+        ++level;
+        bits >>= 1;
+    }
+    return level;
+}
+
+template<typename Key, typename Value>
+ConcurrentSkipListMap<Key, Value>::ConcurrentSkipListMap() :
+    head_(createTower(Key(), NULL, MAX_LEVEL))
+{
+
+}
+
+/**
+* Frees every tower. No other thread may be using the map.
+*/
+template<typename Key, typename Value>
+ConcurrentSkipListMap<Key, Value>::~ConcurrentSkipListMap()
+{
+    clear();
+    destroyTower(head_);
+}
+
+/**
+* Removes every item. No other thread may be using the map.
+*/
+template<typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::clear()
+{
+    Tower* curr = pointer(head_ -> next[0].load());
+    while (curr != NULL) {
+        Tower* next = pointer(curr -> next[0].load());
+        destroyTower(curr);
+        curr = next;
+    }
+    for (int i = 0; i < MAX_LEVEL; ++i) {
+        head_ -> next[i].store(0);
+    }
+}
+
+/**
+* Fills preds/succs with the towers on either side of key at every
+* level, snipping out marked towers on the way. Returns true if an
+* unmarked tower with key is linked at the bottom level (it is succs[0]).
+*/
+template<typename Key, typename Value>
+bool ConcurrentSkipListMap<Key, Value>::findPosition(const Key& key, Tower** preds, Tower** succs) const
+{
+retry:
+    Tower* pred = head_;
+    for (int level = MAX_LEVEL - 1; level >= 0; --level) {
+        Tower* curr = pointer(pred -> next[level].load(std::memory_order_acquire));
+        while (curr != NULL) {
+            uintptr_t succLink = curr -> next[level].load(std::memory_order_acquire);
+            while (isMarked(succLink)) {
+                // curr is being removed: unlink it at this level and move on
+                uintptr_t expected = link(curr, false);
+                if (!pred -> next[level].compare_exchange_strong(expected, link(pointer(succLink), false))) {
+                    goto retry;
+                }
+                curr = pointer(succLink);
+                if (curr == NULL) {
+                    break;
+                }
+                succLink = curr -> next[level].load(std::memory_order_acquire);
+            }
+            if (curr == NULL || !(curr -> key < key)) {
+                break;
+            }
+            pred = curr;
+            curr = pointer(succLink);
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return succs[0] != NULL && succs[0] -> key == key;
+}
+
+/**
+* Lock-free lookup that does not help unlink: it steps over marked
+* towers and returns the unmarked tower holding key, or NULL.
+*/
+template<typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::Tower*
+ConcurrentSkipListMap<Key, Value>::findTower(const Key& key) const
+{
+    Tower* pred = head_;
+    Tower* curr = NULL;
+    for (int level = MAX_LEVEL - 1; level >= 0; --level) {
+        curr = pointer(pred -> next[level].load(std::memory_order_acquire));
+        while (curr != NULL) {
+            uintptr_t succLink = curr -> next[level].load(std::memory_order_acquire);
+            if (isMarked(succLink)) {
+                curr = pointer(succLink);
+                continue;
+            }
+            if (!(curr -> key < key)) {
+                break;
+            }
+            pred = curr;
+            curr = pointer(succLink);
+        }
+    }
+
+    if (curr != NULL && curr -> key == key && !isMarked(curr -> next[0].load(std::memory_order_acquire))) {
+        return curr;
+    }
+    return NULL;
+}
+
+/**
+* Drops one of the two claims on tower (inserter's or remover's). The
+* last claimant makes sure the tower is unlinked everywhere and retires it.
+*/
+template<typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::release(Tower* tower)
+{
+    if (tower -> owners.fetch_sub(1) == 1) {
+        Tower* preds[MAX_LEVEL];
+        Tower* succs[MAX_LEVEL];
+        findPosition(tower -> key, preds, succs);
+        Epoch::retire(static_cast<void*>(tower), &destroyTower);
+    }
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+*/
+template<typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    EpochGuard guard;
+    const Key& key = keyValuePair.first;
+    Item* item = new Item(keyValuePair);
+    Tower* preds[MAX_LEVEL];
+    Tower* succs[MAX_LEVEL];
+    Tower* tower = NULL;
+
+    while (true) {
+        if (findPosition(key, preds, succs)) {
+            // overwrite in place; if the tower is removed meanwhile, try again
+            Tower* found = succs[0];
+            Item* previous = found -> item.load(std::memory_order_acquire);
+            if (!isMarked(found -> next[0].load(std::memory_order_acquire)) &&
+                found -> item.compare_exchange_strong(previous, item)) {
+                Epoch::retire(previous);
+                if (tower != NULL) {
+                    tower -> item.store(NULL);
+                    destroyTower(tower);
+                }
+                return;
+            }
+            continue;
+        }
+
+        if (tower == NULL) {
+            tower = createTower(key, item, randomLevel());
+        }
+        for (int level = 0; level < tower -> height; ++level) {
+            tower -> next[level].store(link(succs[level], false), std::memory_order_relaxed);
+        }
+
+        // linking the bottom level publishes the tower
+        uintptr_t expected = link(succs[0], false);
+        if (preds[0] -> next[0].compare_exchange_strong(expected, link(tower, false))) {
+            break;
+        }
+    }
+
+    for (int level = 1; level < tower -> height; ++level) {
+        while (true) {
+            // point the tower at its successor, unless a remover has marked it
+            uintptr_t own = tower -> next[level].load(std::memory_order_acquire);
+            if (isMarked(own)) {
+                release(tower);
+                return;
+            }
+            if (pointer(own) != succs[level] &&
+                !tower -> next[level].compare_exchange_strong(own, link(succs[level], false))) {
+                continue;
+            }
+
+            uintptr_t expected = link(succs[level], false);
+            if (preds[level] -> next[level].compare_exchange_strong(expected, link(tower, false))) {
+                break;
+            }
+            findPosition(key, preds, succs);
+            if (succs[0] != tower) {
+                // the tower was removed (or a removal is unlinking it)
+                release(tower);
+                return;
+            }
+        }
+    }
+    release(tower);
+}
+
+/**
+* Removes key if present. Marking the bottom-level link decides which
+* of several concurrent removers wins.
+*/
+template<typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::remove(const Key& key)
+{
+    EpochGuard guard;
+    Tower* preds[MAX_LEVEL];
+    Tower* succs[MAX_LEVEL];
+
+    if (!findPosition(key, preds, succs)) {
+        return;
+    }
+    Tower* victim = succs[0];
+
+    for (int level = victim -> height - 1; level >= 1; --level) {
+        uintptr_t succ = victim -> next[level].load(std::memory_order_acquire);
+        while (!isMarked(succ)) {
+            victim -> next[level].compare_exchange_weak(succ, succ | 1);
+        }
+    }
+
+    uintptr_t succ = victim -> next[0].load(std::memory_order_acquire);
+    while (true) {
+        if (isMarked(succ)) {
+            // another thread removed it first
+            return;
+        }
+        if (victim -> next[0].compare_exchange_weak(succ, succ | 1)) {
+            release(victim);
+            return;
+        }
+    }
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipListMap<Key, Value>::empty() const
+{
+    return begin() == end();
+}
+
+/**
+* Checks that every level is sorted, that each level's towers also
+* appear on the level below, and that no removed tower is still linked.
+* Only meaningful while no other thread is updating the map.
+*/
+template<typename Key, typename Value>
+bool ConcurrentSkipListMap<Key, Value>::isValid() const
+{
+    for (int level = 0; level < MAX_LEVEL; ++level) {
+        Tower* below = (level > 0) ? pointer(head_ -> next[level - 1].load()) : NULL;
+        Tower* prev = NULL;
+        for (Tower* curr = pointer(head_ -> next[level].load()); curr != NULL; curr = pointer(curr -> next[level].load())) {
+            if (isMarked(curr -> next[level].load()) || curr -> height <= level) {
+                return false;
+            }
+            if (prev != NULL && !(prev -> key < curr -> key)) {
+                return false;
+            }
+            if (level > 0) {
+                while (below != NULL && below != curr) {
+                    below = pointer(below -> next[level - 1].load());
+                }
+                if (below == NULL) {
+                    return false;
+                }
+            }
+            prev = curr;
+        }
+    }
+    return true;
+}
+
+template<typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::iterator
+ConcurrentSkipListMap<Key, Value>::begin() const
+{
+    EpochGuard guard;
+    iterator it(pointer(head_ -> next[0].load(std::memory_order_acquire)), NULL);
+    it.skipRemoved();
+    return it;
+}
+
+template<typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::iterator
+ConcurrentSkipListMap<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::iterator
+ConcurrentSkipListMap<Key, Value>::find(const Key& key) const
+{
+    EpochGuard guard;
+    Tower* tower = findTower(key);
+    if (tower == NULL) {
+        return end();
+    }
+    return iterator(tower, tower -> item.load(std::memory_order_acquire));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+Value& ConcurrentSkipListMap<Key, Value>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+template<typename Key, typename Value>
+Value const & ConcurrentSkipListMap<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the ConcurrentSkipListMap class.
+  -----------------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------------------------------
+  Begin implementations for the ConcurrentSkipListMap::iterator class.
+  ----------------------------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to end().
+*/
+template<typename Key, typename Value>
+ConcurrentSkipListMap<Key, Value>::iterator::iterator() :
+    current_(NULL), item_(NULL)
+{
+
+}
+
+template<typename Key, typename Value>
+ConcurrentSkipListMap<Key, Value>::iterator::iterator(Tower* tower, Item* item) :
+    current_(tower), item_(item)
+{
+
+}
+
+/**
+* Moves forward past removed towers and snapshots the item pointer.
+*/
+template<typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::iterator::skipRemoved()
+{
+    while (current_ != NULL && isMarked(current_ -> next[0].load(std::memory_order_acquire))) {
+        current_ = pointer(current_ -> next[0].load(std::memory_order_acquire));
+    }
+    item_ = (current_ != NULL) ? current_ -> item.load(std::memory_order_acquire) : NULL;
+}
+
+template<typename Key, typename Value>
+std::pair<const Key, Value>&
+ConcurrentSkipListMap<Key, Value>::iterator::operator*() const
+{
+    return *item_;
+}
+
+template<typename Key, typename Value>
+std::pair<const Key, Value>*
+ConcurrentSkipListMap<Key, Value>::iterator::operator->() const
+{
+    return item_;
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipListMap<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipListMap<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+/**
+* Advances along the bottom level in key order.
+*/
+template<typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::iterator&
+ConcurrentSkipListMap<Key, Value>::iterator::operator++()
+{
+    EpochGuard guard;
+    current_ = pointer(current_ -> next[0].load(std::memory_order_acquire));
+    skipRemoved();
+    return *this;
+}
+
+/*
+  --------------------------------------------------------------------
+  End implementations for the ConcurrentSkipListMap::iterator class.
+  --------------------------------------------------------------------
+*/
+
+#endif
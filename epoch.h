@@ -0,0 +1,334 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+/**
+* Epoch-based memory reclamation shared by the concurrent containers.
+*
+* A thread that reads shared nodes first enters the current epoch with an
+* EpochGuard. A node that has been unlinked is handed to Epoch::retire()
+* instead of being deleted; it is freed once the global epoch has moved
+* two steps past the epoch it was retired in, because by then every
+* thread that could still hold a pointer to it has left its guard.
+*
+* Guards nest, so a container method can take one even if the caller
+* already holds a guard (for example while iterating). A thread frees
+* its retired pointers as it goes, inside a guard or not, since its own
+* announced epoch holds back the advance like any other thread's.
+*/
+class Epoch
+{
+public:
+    typedef void (*Deleter)(void*);
+
+    static void enter();
+    static void exit();
+    static void retire(void* ptr, Deleter deleter);
+    template<typename T>
+    static void retire(T* ptr);
+    static void flush();
+
+private:
+    /**
+    * A retired pointer waiting for two epoch advances.
+    */
+    struct Retired {
+        void* ptr;
+        Deleter deleter;
+        unsigned long epoch;
+    };
+
+    /**
+    * Per-thread announcement record. Records are linked into a global
+    * list that is only ever pushed to; a record is reused by a later
+    * thread once its owner exits.
+    */
+    struct Record {
+        std::atomic<bool> inUse;
+        std::atomic<bool> active;
+        std::atomic<unsigned long> epoch;
+        unsigned nesting;
+        std::vector<Retired> limbo;
+        size_t reclaimAt;           // limbo size that triggers the next reclaim
+        Record* next;
+
+        Record() : inUse(true), active(false), epoch(0), nesting(0), reclaimAt(RECLAIM_THRESHOLD), next(NULL) { }
+    };
+
+    /**
+    * The orphan list, freeing whatever is left in it at process exit.
+    */
+    struct OrphanList {
+        std::vector<Retired> items;
+
+        ~OrphanList();
+    };
+
+    /**
+    * Owns the calling thread's record and hands it back on thread exit.
+    */
+    struct Handle {
+        Record* record;
+
+        Handle();
+        ~Handle();
+    };
+
+    template<typename T>
+    static void deleteObject(void* ptr);
+
+    static Record* self();
+    static Record* acquireRecord();
+    static bool tryAdvance();
+    static void reclaim(Record* record);
+
+    static std::atomic<unsigned long>& globalEpoch();
+    static std::atomic<Record*>& records();
+    static std::mutex& orphanLock();
+    static std::vector<Retired>& orphans();
+
+    // retirements between attempts to advance the epoch
+    static const size_t RECLAIM_THRESHOLD = 128;
+};
+
+/**
+* RAII wrapper that keeps the calling thread inside an epoch.
+*/
+class EpochGuard
+{
+public:
+    EpochGuard() { Epoch::enter(); }
+    ~EpochGuard() { Epoch::exit(); }
+
+private:
+    EpochGuard(const EpochGuard&);
+    EpochGuard& operator=(const EpochGuard&);
+};
+
+/*
+  -----------------------------------------
+  Begin implementations for the Epoch class.
+  -----------------------------------------
+*/
+
+inline std::atomic<unsigned long>& Epoch::globalEpoch()
+{
+    static std::atomic<unsigned long> epoch(0);
+    return epoch;
+}
+
+inline std::atomic<Epoch::Record*>& Epoch::records()
+{
+    static std::atomic<Record*> head(NULL);
+    return head;
+}
+
+inline std::mutex& Epoch::orphanLock()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+/**
+* Retired pointers left behind by threads that have exited.
+*/
+inline std::vector<Epoch::Retired>& Epoch::orphans()
+{
+    static OrphanList list;
+    return list.items;
+}
+
+/**
+* Runs after every thread_local Handle has handed its limbo over, when
+* no thread is reading shared nodes any more.
+*/
+inline Epoch::OrphanList::~OrphanList()
+{
+    for (size_t i = 0; i < items.size(); ++i) {
+        items[i].deleter(items[i].ptr);
+    }
+}
+
+inline Epoch::Handle::Handle() : record(acquireRecord())
+{
+
+}
+
+/**
+* Gives the record back for reuse, moving anything still waiting to be
+* freed onto the shared orphan list.
+*/
+inline Epoch::Handle::~Handle()
+{
+    {
+        std::lock_guard<std::mutex> guard(orphanLock());
+        orphans().insert(orphans().end(), record -> limbo.begin(), record -> limbo.end());
+    }
+    record -> limbo.clear();
+    record -> active.store(false);
+    record -> inUse.store(false);
+}
+
+inline Epoch::Record* Epoch::self()
+{
+    static thread_local Handle handle;
+    return handle.record;
+}
+
+/**
+* Claims an unused record, or pushes a new one onto the global list.
+*/
+inline Epoch::Record* Epoch::acquireRecord()
+{
+    for (Record* r = records().load(); r != NULL; r = r -> next) {
+        bool expected = false;
+        if (!r -> inUse.load() && r -> inUse.compare_exchange_strong(expected, true)) {
+            return r;
+        }
+    }
+
+    Record* r = new Record();
+    Record* head = records().load();
+    do {
+        r -> next = head;
+    } while (!records().compare_exchange_weak(head, r));
+    return r;
+}
+
+/**
+* Announces that the calling thread is about to read shared nodes.
+*/
+inline void Epoch::enter()
+{
+    Record* r = self();
+    if (r -> nesting++ == 0) {
+        r -> active.store(true);
+        r -> epoch.store(globalEpoch().load());
+    }
+}
+
+/**
+* Leaves the epoch once the outermost guard is released, then frees what
+* it can if enough has been retired meanwhile.
+*/
+inline void Epoch::exit()
+{
+    Record* r = self();
+    if (--r -> nesting == 0) {
+        r -> active.store(false);
+        if (r -> limbo.size() >= r -> reclaimAt) {
+            reclaim(r);
+        }
+    }
+}
+
+/**
+* Advances the global epoch if every active thread has observed it.
+*/
+inline bool Epoch::tryAdvance()
+{
+    unsigned long current = globalEpoch().load();
+
+    for (Record* r = records().load(); r != NULL; r = r -> next) {
+        if (r -> inUse.load() && r -> active.load() && r -> epoch.load() != current) {
+            return false;
+        }
+    }
+
+    return globalEpoch().compare_exchange_strong(current, current + 1);
+}
+
+/**
+* Frees every pointer in record's limbo list (and the orphan list) that
+* was retired at least two epochs ago.
+*/
+inline void Epoch::reclaim(Record* record)
+{
+    tryAdvance();
+    unsigned long current = globalEpoch().load();
+
+    std::vector<Retired>& limbo = record -> limbo;
+    size_t kept = 0;
+    for (size_t i = 0; i < limbo.size(); ++i) {
+        if (limbo[i].epoch + 2 <= current) {
+            limbo[i].deleter(limbo[i].ptr);
+        }
+        else {
+            limbo[kept++] = limbo[i];
+        }
+    }
+    limbo.resize(kept);
+    // pointers that could not be freed yet wait for another threshold's worth
+    record -> reclaimAt = kept + RECLAIM_THRESHOLD;
+
+    std::unique_lock<std::mutex> guard(orphanLock(), std::try_to_lock);
+    if (guard.owns_lock() && !orphans().empty()) {
+        std::vector<Retired>& list = orphans();
+        kept = 0;
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (list[i].epoch + 2 <= current) {
+                list[i].deleter(list[i].ptr);
+            }
+            else {
+                list[kept++] = list[i];
+            }
+        }
+        list.resize(kept);
+    }
+}
+
+/**
+* Schedules ptr to be freed with deleter once no thread can reach it.
+* ptr must already be unreachable for threads entering a new epoch.
+*/
+inline void Epoch::retire(void* ptr, Deleter deleter)
+{
+    Record* r = self();
+    Retired item = { ptr, deleter, globalEpoch().load() };
+    r -> limbo.push_back(item);
+
+    if (r -> limbo.size() >= r -> reclaimAt) {
+        reclaim(r);
+    }
+}
+
+template<typename T>
+void Epoch::deleteObject(void* ptr)
+{
+    delete static_cast<T*>(ptr);
+}
+
+/**
+* Schedules an object allocated with new to be deleted.
+*/
+template<typename T>
+void Epoch::retire(T* ptr)
+{
+    retire(static_cast<void*>(ptr), &deleteObject<T>);
+}
+
+/**
+* Frees whatever the calling thread can free right now. Called when a
+* thread is done with a container, e.g. at the end of a benchmark run.
+*/
+inline void Epoch::flush()
+{
+    Record* r = self();
+    if (r -> nesting == 0) {
+        for (int i = 0; i < 3; ++i) {
+            reclaim(r);
+        }
+    }
+}
+
+/*
+  ---------------------------------------
+  End implementations for the Epoch class.
+  ---------------------------------------
+*/
+
+#endif
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <stdint.h>
+#include "equal-paths.h"
+#include "equal-paths-forest.h"
+using namespace std;
+
+/**
+ * A small xorshift generator, so every run builds the same trees.
+ */
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) { }
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/**
+ * Builds a tree of count random keys by BST insertion, taking its nodes
+ * from pool, which must have room for them. Returns the root.
+ */
+static Node* randomTree(vector<Node>& pool, int count, Rng& rng)
+{
+    Node* root = NULL;
+    for (int i = 0; i < count; ++i) {
+        pool.push_back(Node(static_cast<int>(rng.next() % 1000)));
+        Node* node = &pool.back();
+        Node** slot = &root;
+        while (*slot != NULL) {
+            slot = (node -> key < (*slot) -> key) ? &(*slot) -> left : &(*slot) -> right;
+        }
+        *slot = node;
+    }
+    return root;
+}
+
+int main(int argc, char* argv[])
+{
+    int trees = (argc > 1) ? atoi(argv[1]) : 1000000;
+    int maxNodes = (argc > 2) ? atoi(argv[2]) : 12;
+
+    Rng rng(5);
+    vector<Node> pool;
+    pool.reserve(static_cast<size_t>(trees) * maxNodes);
+    vector<Node*> roots(trees);
+    for (int t = 0; t < trees; ++t) {
+        roots[t] = randomTree(pool, 1 + static_cast<int>(rng.next() % maxNodes), rng);
+    }
+    Forest forest;
+    for (int t = 0; t < trees; ++t) {
+        appendTree(forest, roots[t]);
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    vector<bool> single(trees);
+    for (int t = 0; t < trees; ++t) {
+        single[t] = equalPaths(roots[t]);
+    }
+    double singleSeconds = secondsSince(begin);
+
+    begin = std::chrono::steady_clock::now();
+    vector<bool> batch;
+    equalPathsBatch(forest, batch);
+    double batchSeconds = secondsSince(begin);
+
+    int equal = 0;
+    for (int t = 0; t < trees; ++t) {
+        if (single[t] != batch[t]) {
+            cout << "equalPathsBatch disagrees on tree " << t << endl;
+            return 1;
+        }
+        equal += single[t];
+    }
+
+    cout << trees << " random trees of 1 to " << maxNodes << " nodes, " << equal << " with equal paths" << endl;
+    cout << fixed << setprecision(1)
+         << "equalPaths       " << setw(8) << singleSeconds * 1e9 / trees << " ns per tree" << endl
+         << "equalPathsBatch  " << setw(8) << batchSeconds * 1e9 / trees << " ns per tree ("
+         << setprecision(2) << singleSeconds / batchSeconds << "x)" << endl;
+    return 0;
+}
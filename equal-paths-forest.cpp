@@ -0,0 +1,82 @@
+#include "equal-paths-forest.h"
+using namespace std;
+
+void appendTree(Forest& forest, Node * root)
+{
+    size_t start = forest.nodes.size();
+    if (root != nullptr) {
+        // breadth-first: the nodes already appended double as the queue,
+        // and sources remembers which Node each record came from
+        vector<Node*> sources(1, root);
+        FlatNode first = { root -> key, -1, -1 };
+        forest.nodes.push_back(first);
+
+        for (size_t i = 0; i < sources.size(); ++i) {
+            Node* node = sources[i];
+            if (node -> left != nullptr) {
+                forest.nodes[start + i].left = static_cast<int32_t>(sources.size());
+                FlatNode child = { node -> left -> key, -1, -1 };
+                forest.nodes.push_back(child);
+                sources.push_back(node -> left);
+            }
+            if (node -> right != nullptr) {
+                forest.nodes[start + i].right = static_cast<int32_t>(sources.size());
+                FlatNode child = { node -> right -> key, -1, -1 };
+                forest.nodes.push_back(child);
+                sources.push_back(node -> right);
+            }
+        }
+    }
+    forest.starts.push_back(forest.nodes.size());
+}
+
+void equalPathsBatch(const Forest& forest, vector<bool>& results)
+{
+    size_t trees = forest.treeCount();
+    results.assign(trees, true);
+
+    // depth of each node of the current tree, filled in by its parent;
+    // trees are small, so this stays in cache from one tree to the next
+    vector<int> depth;
+
+    for (size_t t = 0; t < trees; ++t) {
+        const FlatNode* nodes = forest.nodes.data() + forest.starts[t];
+        size_t count = forest.starts[t + 1] - forest.starts[t];
+        if (count == 0) {
+            continue;
+        }
+        if (count > depth.size()) {
+            depth.resize(count);
+        }
+
+        int leafDepth = -1;
+        depth[0] = 0;
+        for (size_t i = 0; i < count; ++i) {
+            int d = depth[i];
+            int32_t left = nodes[i].left;
+            int32_t right = nodes[i].right;
+
+            if (left < 0 && right < 0) {
+                if (leafDepth == -1) {
+                    leafDepth = d;
+                }
+                else if (d != leafDepth) {
+                    results[t] = false;
+                    break;
+                }
+            }
+            // a non-leaf at or below a leaf's depth leads to a deeper leaf;
+            // in level order this stops at the first level that disagrees
+            else if (leafDepth != -1 && d >= leafDepth) {
+                results[t] = false;
+                break;
+            }
+            if (left >= 0) {
+                depth[left] = d + 1;
+            }
+            if (right >= 0) {
+                depth[right] = d + 1;
+            }
+        }
+    }
+}
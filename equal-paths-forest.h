@@ -0,0 +1,48 @@
+#ifndef EQUAL_PATHS_FOREST_H
+#define EQUAL_PATHS_FOREST_H
+
+#include <cstdint>
+#include <vector>
+#include "equal-paths.h"
+
+/**
+ * One node of a flattened tree. Child indices are relative to the start of
+ * the node's tree, and -1 means no child.
+ */
+struct FlatNode {
+    int key;
+    int32_t left, right;
+};
+
+/**
+ * Many trees stored back to back in one array. Tree t occupies
+ * nodes[starts[t]] up to nodes[starts[t + 1]], root first; an empty tree
+ * occupies nothing. Within a tree every node comes after its parent.
+ */
+struct Forest {
+    std::vector<FlatNode> nodes;
+    std::vector<size_t> starts;
+
+    Forest() : starts(1, 0) {}
+
+    size_t treeCount() const { return starts.size() - 1; }
+};
+
+/**
+ * @brief Appends a copy of the tree under root to the forest, in level order
+ *
+ * @param forest Forest to add the tree to
+ * @param root Pointer to the root of the tree, which may be empty
+ */
+void appendTree(Forest& forest, Node * root);
+
+/**
+ * @brief Runs equalPaths() on every tree of the forest in one pass over its
+ *        node array
+ *
+ * @param forest Forest to check
+ * @param results Set to one result per tree, in order
+ */
+void equalPathsBatch(const Forest& forest, std::vector<bool>& results);
+
+#endif
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "equal-paths-parallel.h"
+using namespace std;
+
+// Nodes a task visits between checks for cancellation.
+static const unsigned POLL_INTERVAL = 1024;
+
+/**
+ * A subtree still to be checked, and the depth of its root.
+ */
+struct PathTask {
+    Node* node;
+    int depth;
+};
+
+/**
+ * One worker's tasks. The owner pushes and pops at the back (newest and
+ * smallest subtrees), thieves take from the front (oldest and largest).
+ */
+struct TaskQueue {
+    mutex lock;
+    deque<PathTask> tasks;
+};
+
+/**
+ * State shared by every worker of one equalPathsParallel() call.
+ */
+struct PathSearch {
+    vector<TaskQueue> queues;
+    atomic<long> pending;       // tasks queued or still running
+    atomic<bool> cancelled;
+    atomic<int> minLeaf;        // shallowest and deepest leaf reported so far
+    atomic<int> maxLeaf;
+    int cutoffDepth;
+
+    PathSearch(unsigned threads, int cutoff) :
+        queues(threads), pending(0), cancelled(false), minLeaf(INT_MAX), maxLeaf(-1), cutoffDepth(cutoff)
+    {}
+};
+
+// Helper prototypes
+static void reportLeafDepths(PathSearch& search, int minDepth, int maxDepth);
+static void checkSubtree(PathSearch& search, Node* root, int rootDepth);
+static void runTask(PathSearch& search, TaskQueue& own, PathTask task);
+static bool takeTask(PathSearch& search, unsigned self, PathTask& task);
+static void worker(PathSearch& search, unsigned self);
+
+bool equalPathsParallel(Node * root, unsigned threads, int cutoffDepth)
+{
+    if (root == nullptr) {
+        return true;
+    }
+    if (threads == 0) {
+        threads = max(thread::hardware_concurrency(), 1u);
+    }
+    // aim for about eight tasks per thread so stealing can even out the load
+    if (cutoffDepth < 0) {
+        cutoffDepth = 3;
+        while ((1u << cutoffDepth) < threads * 8 && cutoffDepth < 30) {
+            ++cutoffDepth;
+        }
+    }
+
+    PathSearch search(threads, cutoffDepth);
+    PathTask first = { root, 0 };
+    search.queues[0].tasks.push_back(first);
+    search.pending = 1;
+
+    vector<thread> helpers;
+    for (unsigned i = 1; i < threads; ++i) {
+        helpers.push_back(thread(worker, ref(search), i));
+    }
+    worker(search, 0);
+    for (size_t i = 0; i < helpers.size(); ++i) {
+        helpers[i].join();
+    }
+
+    return !search.cancelled && search.minLeaf == search.maxLeaf;
+}
+
+/**
+ * Folds one task's leaf depth range into the shared range, and cancels the
+ * search if the shared range now holds two different depths.
+ */
+static void reportLeafDepths(PathSearch& search, int minDepth, int maxDepth)
+{
+    int seen = search.minLeaf.load();
+    while (minDepth < seen && !search.minLeaf.compare_exchange_weak(seen, minDepth)) {
+    }
+    seen = search.maxLeaf.load();
+    while (maxDepth > seen && !search.maxLeaf.compare_exchange_weak(seen, maxDepth)) {
+    }
+    if (search.minLeaf.load() != search.maxLeaf.load()) {
+        search.cancelled = true;
+    }
+}
+
+/**
+ * Walks a subtree like equalPaths() does, stopping at its own first mismatch
+ * and, every POLL_INTERVAL nodes, when another task has found one.
+ */
+static void checkSubtree(PathSearch& search, Node* root, int rootDepth)
+{
+    vector<pair<Node*, int> > pending;
+    int minDepth = INT_MAX;
+    int maxDepth = -1;
+    unsigned visited = 0;
+    Node* node = root;
+    int depth = rootDepth;
+
+    while (true) {
+        while (node != nullptr) {
+            if (++visited == POLL_INTERVAL) {
+                visited = 0;
+                if (search.cancelled) {
+                    return;
+                }
+            }
+
+            if (node -> left == nullptr && node -> right == nullptr) {
+                // share the first leaf depth right away so other tasks compare against it
+                if (maxDepth == -1) {
+                    reportLeafDepths(search, depth, depth);
+                }
+                minDepth = min(minDepth, depth);
+                maxDepth = max(maxDepth, depth);
+                if (minDepth != maxDepth) {
+                    reportLeafDepths(search, minDepth, maxDepth);
+                    return;
+                }
+                break;
+            }
+
+            // a non-leaf at the leaf level only leads to deeper leaves
+            if (maxDepth != -1 && depth >= maxDepth) {
+                reportLeafDepths(search, minDepth, depth + 1);
+                return;
+            }
+
+            if (node -> left != nullptr && node -> right != nullptr) {
+                pending.push_back(make_pair(node -> right, depth + 1));
+            }
+            node = (node -> left != nullptr) ? node -> left : node -> right;
+            ++depth;
+        }
+
+        if (pending.empty()) {
+            break;
+        }
+        node = pending.back().first;
+        depth = pending.back().second;
+        pending.pop_back();
+    }
+
+    if (maxDepth != -1) {
+        reportLeafDepths(search, minDepth, maxDepth);
+    }
+}
+
+/**
+ * Forks off the right subtree of every two-child node above the cutoff
+ * depth onto the worker's own queue, then checks what is left itself.
+ */
+static void runTask(PathSearch& search, TaskQueue& own, PathTask task)
+{
+    Node* node = task.node;
+    int depth = task.depth;
+
+    while (depth < search.cutoffDepth && node -> left != nullptr && node -> right != nullptr) {
+        PathTask fork = { node -> right, depth + 1 };
+        ++search.pending;
+        {
+            lock_guard<mutex> guard(own.lock);
+            own.tasks.push_back(fork);
+        }
+        node = node -> left;
+        ++depth;
+    }
+    checkSubtree(search, node, depth);
+}
+
+/**
+ * Pops the worker's newest task, or steals the oldest task of another worker.
+ */
+static bool takeTask(PathSearch& search, unsigned self, PathTask& task)
+{
+    {
+        TaskQueue& own = search.queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    unsigned count = static_cast<unsigned>(search.queues.size());
+    for (unsigned i = 1; i < count; ++i) {
+        TaskQueue& victim = search.queues[(self + i) % count];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Runs tasks until every task has finished or the search is cancelled.
+ */
+static void worker(PathSearch& search, unsigned self)
+{
+    while (!search.cancelled) {
+        PathTask task;
+        if (takeTask(search, self, task)) {
+            runTask(search, search.queues[self], task);
+            --search.pending;
+        }
+        else if (search.pending == 0) {
+            break;
+        }
+        else {
+            this_thread::yield();
+        }
+    }
+}
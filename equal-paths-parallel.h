@@ -0,0 +1,21 @@
+#ifndef EQUAL_PATHS_PARALLEL_H
+#define EQUAL_PATHS_PARALLEL_H
+
+#include "equal-paths.h"
+
+/**
+ * @brief Parallel version of equalPaths() for very large trees
+ *
+ *        The top of the tree is split into subtree tasks, down to cutoffDepth,
+ *        and the tasks are run by a pool of work-stealing threads. Each task
+ *        finds the shallowest and deepest leaf of its subtree, and the first
+ *        task to see unequal depths cancels all the others.
+ *
+ * @param root Pointer to the root of the tree to check for equal paths
+ * @param threads Number of worker threads; 0 uses every hardware thread
+ * @param cutoffDepth Deepest level at which subtrees are split into tasks;
+ *        -1 picks a depth that gives each thread several tasks
+ */
+bool equalPathsParallel(Node * root, unsigned threads = 0, int cutoffDepth = -1);
+
+#endif
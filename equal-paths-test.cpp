@@ -1,6 +1,8 @@
 #include <iostream>
 #include <cstdlib>
 #include "equal-paths.h"
+#include "equal-paths-parallel.h"
+#include "equal-paths-forest.h"
 using namespace std;
 
 
@@ -67,6 +69,16 @@ int main()
   test3("Test3");
   test4("Test4");
   test5("Test5");
+  cout << "Parallel Test5: " << equalPathsParallel(a, 2) << endl;
+
+  // Check two trees at once: Test5's shape and its left child alone
+  Forest forest;
+  appendTree(forest, a);
+  appendTree(forest, b);
+  vector<bool> results;
+  equalPathsBatch(forest, results);
+  cout << "Batch Test5: " << results[0] << endl;
+  cout << "Batch Test5 left subtree: " << results[1] << endl;
  
   delete a;
   delete b;
@@ -1,6 +1,7 @@
 #ifndef RECCHECK
 //if you want to add any #includes like <iostream> you must do them here (before the next endif)
-
+#include <utility>
+#include <vector>
 #endif
 
 #include "equal-paths.h"
@@ -8,38 +9,49 @@ using namespace std;
 
 
 // You may add any prototypes of helper functions here
-bool equalPathsHelper(Node* node, int currHeight, int* leafHeight);
 
 bool equalPaths(Node * root)
 {
     // Add your code below
-    int temp = -1;
-    return equalPathsHelper(root, 0, &temp);   
-}
-
-bool equalPathsHelper(Node* node, int currHeight, int* leafHeight) {
-    // first base case: traversed past nodes
-    if (node == nullptr) {
-        return true;
-    }
 
-    // second base case: traversed to leaf node
-    if (node -> left == nullptr && node -> right == nullptr) {
-        // set leafHeight to first traversed leaf's height
-        if (*leafHeight == -1) {
-            *leafHeight = currHeight;
-            return true;
+    // walks depth-first without recursion; the stack only holds the right
+    // child of a node whose left child is taken first, so it keeps at most
+    // one entry per level
+    vector<pair<Node*, int> > pending;
+    int leafHeight = -1;
+    Node* node = root;
+    int currHeight = 0;
+
+    while (true) {
+        while (node != nullptr) {
+            // leaf node: the first one fixes the height all others must match
+            if (node -> left == nullptr && node -> right == nullptr) {
+                if (leafHeight == -1) {
+                    leafHeight = currHeight;
+                }
+                else if (currHeight != leafHeight) {
+                    return false;
+                }
+                break;
+            }
+
+            // a non-leaf at the leaf level only leads to deeper leaves
+            if (leafHeight != -1 && currHeight >= leafHeight) {
+                return false;
+            }
+
+            if (node -> left != nullptr && node -> right != nullptr) {
+                pending.push_back(make_pair(node -> right, currHeight + 1));
+            }
+            node = (node -> left != nullptr) ? node -> left : node -> right;
+            ++currHeight;
         }
-        
-        // return true if current leaf's height matches first leaf's height
-        if (currHeight == *leafHeight) {
+
+        if (pending.empty()) {
             return true;
         }
-
-        // return false if leaf heights dont match
-        return false;
+        node = pending.back().first;
+        currHeight = pending.back().second;
+        pending.pop_back();
     }
-
-    // recursive case: traverse to left and/or right child node
-    return equalPathsHelper(node -> left, currHeight + 1, leafHeight) && equalPathsHelper(node -> right, currHeight + 1, leafHeight);
 }
@@ -0,0 +1,561 @@
+#ifndef EXPORT_BST_H
+#define EXPORT_BST_H
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "bst.h"
+
+/**
+* Streaming exporters for BinarySearchTree and its subclasses: Graphviz
+* DOT, one JSON object per line, and a compact binary shape dump. Unlike
+* printRoot() they have no height limit. The tree is walked iteratively
+* in pre-order with O(height) memory, and output goes through a fixed
+* buffer straight to the stream.
+*
+* Each node gets its pre-order number as an id. Large trees can be cut
+* down with ExportOptions: maxDepth drops everything below a depth, and
+* sampleRate keeps only that fraction of the subtrees rooted at
+* sampleDepth (chosen by a seeded hash, so repeated dumps match).
+*/
+
+/**
+* Limits on what part of the tree is exported.
+*/
+struct ExportOptions {
+    int maxDepth;           // deepest depth exported (the root is 0); -1 for no limit
+    int sampleDepth;        // depth of the subtrees that sampling keeps or drops
+    double sampleRate;      // fraction of those subtrees kept
+    uint64_t seed;
+    bool includeValues;     // DOT and JSON only
+    bool includeKeys;       // binary only; keys are written if trivially copyable
+
+    ExportOptions() :
+        maxDepth(-1), sampleDepth(10), sampleRate(1.0), seed(0), includeValues(false), includeKeys(false)
+    {}
+};
+
+/**
+* A fixed-size write buffer in front of an ostream, so formatting millions
+* of small fields does not go through the stream one at a time.
+*/
+class OutputSink
+{
+public:
+    explicit OutputSink(std::ostream& out, size_t capacity = 1 << 16);
+    ~OutputSink();
+
+    void write(const char* data, size_t length);
+    template<size_t N>
+    void write(const char (&text)[N]);
+    void put(char c);
+    void writeUnsigned(uint64_t value);
+    void writeSigned(int64_t value);
+    void flush();
+
+private:
+    std::ostream& out_;
+    std::vector<char> buffer_;
+    size_t used_;
+
+    OutputSink(const OutputSink&);
+    OutputSink& operator=(const OutputSink&);
+};
+
+/**
+* One node as the walk reaches it.
+*/
+template <typename Key, typename Value>
+struct ShapeStep {
+    const Node<Key, Value>* node;
+    uint64_t id;
+    uint64_t parent;        // id of the parent; unused for the root
+    int depth;
+    char side;              // 'L' or 'R' below the parent, 0 for the root
+    bool leftCut;           // a child exists but was dropped by the options
+    bool rightCut;
+};
+
+/**
+* Iterative pre-order walk over a tree that applies ExportOptions. The
+* stack holds at most one pending right child per level.
+*/
+template <typename Key, typename Value>
+class ShapeWalker
+{
+public:
+    ShapeWalker(const BinarySearchTree<Key, Value>& tree, const ExportOptions& options);
+
+    bool next(ShapeStep<Key, Value>& step);
+
+protected:
+    struct Frame {
+        const Node<Key, Value>* node;
+        uint64_t parent;
+        int depth;
+        char side;
+    };
+
+    bool keep(int depth);
+
+    ExportOptions options_;
+    std::vector<Frame> stack_;
+    uint64_t nextId_;
+    uint64_t draws_;
+};
+
+template <typename Key, typename Value>
+size_t exportDot(const BinarySearchTree<Key, Value>& tree, std::ostream& out, const ExportOptions& options = ExportOptions());
+template <typename Key, typename Value>
+size_t exportJsonLines(const BinarySearchTree<Key, Value>& tree, std::ostream& out, const ExportOptions& options = ExportOptions());
+template <typename Key, typename Value>
+size_t exportShape(const BinarySearchTree<Key, Value>& tree, std::ostream& out, const ExportOptions& options = ExportOptions());
+
+/*
+  ----------------------------------------------
+  Begin implementations for the OutputSink class.
+  ----------------------------------------------
+*/
+
+inline OutputSink::OutputSink(std::ostream& out, size_t capacity) :
+    out_(out), buffer_(capacity < 32 ? 32 : capacity), used_(0)
+{
+
+}
+
+inline OutputSink::~OutputSink()
+{
+    flush();
+}
+
+inline void OutputSink::write(const char* data, size_t length)
+{
+    if (used_ + length > buffer_.size()) {
+        flush();
+        if (length > buffer_.size()) {
+            out_.write(data, static_cast<std::streamsize>(length));
+            return;
+        }
+    }
+    std::memcpy(&buffer_[used_], data, length);
+    used_ += length;
+}
+
+/**
+* Writes a string literal, without its terminating NUL.
+*/
+template<size_t N>
+void OutputSink::write(const char (&text)[N])
+{
+    write(text, N - 1);
+}
+
+inline void OutputSink::put(char c)
+{
+    if (used_ == buffer_.size()) {
+        flush();
+    }
+    buffer_[used_++] = c;
+}
+
+/**
+* Formats a number in place, without a stream or a temporary string.
+*/
+inline void OutputSink::writeUnsigned(uint64_t value)
+{
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    if (used_ + count > buffer_.size()) {
+        flush();
+    }
+    while (count > 0) {
+        buffer_[used_++] = digits[--count];
+    }
+}
+
+inline void OutputSink::writeSigned(int64_t value)
+{
+    if (value < 0) {
+        put('-');
+        writeUnsigned(0 - static_cast<uint64_t>(value));
+    }
+    else {
+        writeUnsigned(static_cast<uint64_t>(value));
+    }
+}
+
+inline void OutputSink::flush()
+{
+    if (used_ > 0) {
+        out_.write(&buffer_[0], static_cast<std::streamsize>(used_));
+        used_ = 0;
+    }
+}
+
+/*
+  --------------------------------------------
+  End implementations for the OutputSink class.
+  --------------------------------------------
+*/
+
+/**
+* Writes text as a quoted string with JSON escapes. DOT accepts the same
+* quoting for labels.
+*/
+inline void writeQuoted(OutputSink& sink, const std::string& text)
+{
+    sink.put('"');
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '"' || c == '\\') {
+            sink.put('\\');
+            sink.put(c);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            char escape[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf] };
+            sink.write(escape, sizeof(escape));
+        }
+        else {
+            sink.put(c);
+        }
+    }
+    sink.put('"');
+}
+
+/**
+* Writes a key or value as a JSON scalar: numbers directly, anything else
+* through operator<< as a quoted string.
+*/
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+writeScalar(OutputSink& sink, const T& value)
+{
+    sink.writeSigned(static_cast<int64_t>(value));
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+writeScalar(OutputSink& sink, const T& value)
+{
+    sink.writeUnsigned(static_cast<uint64_t>(value));
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+writeScalar(OutputSink& sink, const T& value)
+{
+    std::ostringstream text;
+    text.precision(std::numeric_limits<T>::max_digits10);
+    text << value;
+    // JSON has no literal for infinities or NaN
+    if (value == value && value - value == 0) {
+        sink.write(text.str().data(), text.str().size());
+    }
+    else {
+        writeQuoted(sink, text.str());
+    }
+}
+
+template <typename T>
+typename std::enable_if<!std::is_integral<T>::value && !std::is_floating_point<T>::value>::type
+writeScalar(OutputSink& sink, const T& value)
+{
+    std::ostringstream text;
+    text << value;
+    writeQuoted(sink, text.str());
+}
+
+inline void writeScalar(OutputSink& sink, const std::string& value)
+{
+    writeQuoted(sink, value);
+}
+
+inline void writeScalar(OutputSink& sink, char value)
+{
+    writeQuoted(sink, std::string(1, value));
+}
+
+inline void writeScalar(OutputSink& sink, bool value)
+{
+    if (value) {
+        sink.write("true");
+    }
+    else {
+        sink.write("false");
+    }
+}
+
+/**
+* Copies a key's bytes into the binary dump when the key type allows it.
+*/
+template <typename Key, bool Raw = std::is_trivially_copyable<Key>::value>
+struct RawKey {
+    static const bool enabled = false;
+    static void write(OutputSink&, const Key&) { }
+};
+
+template <typename Key>
+struct RawKey<Key, true> {
+    static const bool enabled = true;
+    static void write(OutputSink& sink, const Key& key)
+    {
+        sink.write(reinterpret_cast<const char*>(&key), sizeof(Key));
+    }
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the ShapeWalker class.
+  -----------------------------------------------
+*/
+
+template <typename Key, typename Value>
+ShapeWalker<Key, Value>::ShapeWalker(const BinarySearchTree<Key, Value>& tree, const ExportOptions& options) :
+    options_(options), nextId_(0), draws_(0)
+{
+    if (tree.root_ != NULL && keep(0)) {
+        Frame frame = { tree.root_, 0, 0, 0 };
+        stack_.push_back(frame);
+    }
+}
+
+/**
+* Decides whether a node at depth is exported. Sampling draws come from a
+* splitmix64 sequence seeded by options.seed.
+*/
+template <typename Key, typename Value>
+bool ShapeWalker<Key, Value>::keep(int depth)
+{
+    if (options_.maxDepth >= 0 && depth > options_.maxDepth) {
+        return false;
+    }
+    if (depth != options_.sampleDepth || options_.sampleRate >= 1.0) {
+        return true;
+    }
+
+    uint64_t z = options_.seed + (++draws_) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return static_cast<double>(z >> 11) * (1.0 / 9007199254740992.0) < options_.sampleRate;
+}
+
+/**
+* Moves to the next exported node. Returns false once the walk is done.
+*/
+template <typename Key, typename Value>
+bool ShapeWalker<Key, Value>::next(ShapeStep<Key, Value>& step)
+{
+    if (stack_.empty()) {
+        return false;
+    }
+
+    Frame frame = stack_.back();
+    stack_.pop_back();
+
+    step.node = frame.node;
+    step.id = nextId_++;
+    step.parent = frame.parent;
+    step.depth = frame.depth;
+    step.side = frame.side;
+    step.leftCut = false;
+    step.rightCut = false;
+
+    const Node<Key, Value>* left = frame.node -> getLeft();
+    const Node<Key, Value>* right = frame.node -> getRight();
+    bool keepLeft = (left != NULL) && keep(frame.depth + 1);
+    bool keepRight = (right != NULL) && keep(frame.depth + 1);
+    step.leftCut = (left != NULL) && !keepLeft;
+    step.rightCut = (right != NULL) && !keepRight;
+
+    if (keepRight) {
+        Frame child = { right, step.id, frame.depth + 1, 'R' };
+        stack_.push_back(child);
+    }
+    if (keepLeft) {
+        Frame child = { left, step.id, frame.depth + 1, 'L' };
+        stack_.push_back(child);
+    }
+    return true;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ShapeWalker class.
+  ---------------------------------------------
+*/
+
+/**
+* Writes the tree as a Graphviz digraph. Dropped subtrees show up as a
+* dashed edge to an empty point. Returns the number of nodes written.
+*/
+template <typename Key, typename Value>
+size_t exportDot(const BinarySearchTree<Key, Value>& tree, std::ostream& out, const ExportOptions& options)
+{
+    OutputSink sink(out);
+    ShapeWalker<Key, Value> walker(tree, options);
+    ShapeStep<Key, Value> step;
+    size_t count = 0;
+
+    sink.write("digraph bst {\n  node [shape=box];\n");
+
+    while (walker.next(step)) {
+        ++count;
+        sink.write("  n");
+        sink.writeUnsigned(step.id);
+        sink.write(" [label=");
+        if (options.includeValues) {
+            std::ostringstream text;
+            text << step.node -> getKey() << ": " << step.node -> getValue();
+            writeQuoted(sink, text.str());
+        }
+        else {
+            writeScalar(sink, step.node -> getKey());
+        }
+        sink.write("];\n");
+
+        if (step.side != 0) {
+            sink.write("  n");
+            sink.writeUnsigned(step.parent);
+            sink.write(" -> n");
+            sink.writeUnsigned(step.id);
+            sink.write(" [label=");
+            sink.put(step.side);
+            sink.write("];\n");
+        }
+        for (int side = 0; side < 2; ++side) {
+            if (side == 0 ? step.leftCut : step.rightCut) {
+                sink.write("  c");
+                sink.writeUnsigned(step.id);
+                sink.put(side == 0 ? 'L' : 'R');
+                sink.write(" [shape=point];\n  n");
+                sink.writeUnsigned(step.id);
+                sink.write(" -> c");
+                sink.writeUnsigned(step.id);
+                sink.put(side == 0 ? 'L' : 'R');
+                sink.write(" [style=dashed];\n");
+            }
+        }
+    }
+
+    sink.write("}\n");
+    return count;
+}
+
+/**
+* Writes one JSON object per node, in pre-order:
+*   {"id":1,"parent":0,"side":"L","depth":1,"key":5,"cut":""}
+* "parent" and "side" are null for the root, "cut" lists the sides whose
+* subtrees were dropped, and "value" is added if requested. Returns the
+* number of nodes written.
+*/
+template <typename Key, typename Value>
+size_t exportJsonLines(const BinarySearchTree<Key, Value>& tree, std::ostream& out, const ExportOptions& options)
+{
+    OutputSink sink(out);
+    ShapeWalker<Key, Value> walker(tree, options);
+    ShapeStep<Key, Value> step;
+    size_t count = 0;
+
+    while (walker.next(step)) {
+        ++count;
+        sink.write("{\"id\":");
+        sink.writeUnsigned(step.id);
+        if (step.side == 0) {
+            sink.write(",\"parent\":null,\"side\":null");
+        }
+        else {
+            sink.write(",\"parent\":");
+            sink.writeUnsigned(step.parent);
+            sink.write(",\"side\":\"");
+            sink.put(step.side);
+            sink.put('"');
+        }
+        sink.write(",\"depth\":");
+        sink.writeUnsigned(static_cast<uint64_t>(step.depth));
+        sink.write(",\"key\":");
+        writeScalar(sink, step.node -> getKey());
+        if (options.includeValues) {
+            sink.write(",\"value\":");
+            writeScalar(sink, step.node -> getValue());
+        }
+        sink.write(",\"cut\":\"");
+        if (step.leftCut) {
+            sink.put('L');
+        }
+        if (step.rightCut) {
+            sink.put('R');
+        }
+        sink.write("\"}\n");
+    }
+    return count;
+}
+
+/**
+* Writes the shape as one byte per node in pre-order, enough to rebuild
+* the tree's structure:
+*   bit 0: has an exported left child
+*   bit 1: has an exported right child
+*   bit 2: a left subtree was dropped
+*   bit 3: a right subtree was dropped
+* If keys are requested and trivially copyable, each byte is followed by
+* the key's raw bytes. The stream starts with "BSTS", a format version
+* and a flags byte (bit 0: keys present, followed by one byte of key size),
+* and ends with the node count as 8 little-endian bytes. Returns the
+* number of nodes written.
+*/
+template <typename Key, typename Value>
+size_t exportShape(const BinarySearchTree<Key, Value>& tree, std::ostream& out, const ExportOptions& options)
+{
+    OutputSink sink(out);
+    ShapeWalker<Key, Value> walker(tree, options);
+    ShapeStep<Key, Value> step;
+    uint64_t count = 0;
+    bool keys = options.includeKeys && RawKey<Key>::enabled;
+
+    sink.write("BSTS\x01");
+    sink.put(keys ? 1 : 0);
+    if (keys) {
+        sink.put(static_cast<char>(sizeof(Key)));
+    }
+
+    while (walker.next(step)) {
+        ++count;
+        const Node<Key, Value>* node = step.node;
+        char bits = 0;
+        if (node -> getLeft() != NULL && !step.leftCut) {
+            bits |= 1;
+        }
+        if (node -> getRight() != NULL && !step.rightCut) {
+            bits |= 2;
+        }
+        if (step.leftCut) {
+            bits |= 4;
+        }
+        if (step.rightCut) {
+            bits |= 8;
+        }
+        sink.put(bits);
+        if (keys) {
+            RawKey<Key>::write(sink, node -> getKey());
+        }
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        sink.put(static_cast<char>((count >> (8 * i)) & 0xff));
+    }
+    return static_cast<size_t>(count);
+}
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef HASHED_AVL_H
+#define HASHED_AVL_H
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+#include "avlbst.h"
+
+/**
+* An AVLTree that also keeps an open-addressing hash table from key to
+* node, so find() and operator[] cost one expected O(1) probe sequence
+* instead of a root-to-leaf walk. Iteration, scan() and everything else
+* that needs order still use the tree.
+*
+* The table is kept in sync through the createNode/destroyNode hooks,
+* which every insert, remove, clear and bulk build goes through.
+* Rotations and nodeSwap move nodes around the tree but never move an
+* item to a different node, so they need no table updates.
+*/
+template <typename Key, typename Value, typename Hash = std::hash<Key> >
+class HashedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    HashedAVLTree();
+    HashedAVLTree(const HashedAVLTree& other);
+    HashedAVLTree(HashedAVLTree&& other);
+    HashedAVLTree& operator=(const HashedAVLTree& other);
+    HashedAVLTree& operator=(HashedAVLTree&& other);
+    virtual ~HashedAVLTree();
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) override;
+    virtual void destroyNode(Node<Key, Value>* node) override;
+    virtual Node<Key, Value>* internalFind(const Key& key) const override;
+    virtual bool tracksNodes() const override;
+
+    size_t slotOf(const Key& key) const;
+    void indexInsert(Node<Key, Value>* node);
+    void indexErase(Node<Key, Value>* node);
+    void grow();
+
+    // linear probing with backward-shift deletion, so there are no tombstones
+    std::vector<Node<Key, Value>*> table_;
+    size_t count_;
+    Hash hash_;
+
+    static const size_t INITIAL_CAPACITY = 16;
+};
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the HashedAVLTree class.
+  -----------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Hash>
+HashedAVLTree<Key, Value, Hash>::HashedAVLTree() :
+    table_(INITIAL_CAPACITY, static_cast<Node<Key, Value>*>(NULL)), count_(0)
+{
+
+}
+
+/**
+* Clones the tree in this body, once createNode reaches this class, so
+* that every copied node is entered into the new table.
+*/
+template <typename Key, typename Value, typename Hash>
+HashedAVLTree<Key, Value, Hash>::HashedAVLTree(const HashedAVLTree& other) :
+    AVLTree<Key, Value>(),
+    table_(INITIAL_CAPACITY, static_cast<Node<Key, Value>*>(NULL)), count_(0), hash_(other.hash_)
+{
+    this -> cloneFrom(other);
+}
+
+/**
+* Takes other's nodes and table in O(1) and leaves it empty.
+*/
+template <typename Key, typename Value, typename Hash>
+HashedAVLTree<Key, Value, Hash>::HashedAVLTree(HashedAVLTree&& other) :
+    AVLTree<Key, Value>(std::move(other)),
+    table_(INITIAL_CAPACITY, static_cast<Node<Key, Value>*>(NULL)), count_(other.count_), hash_(other.hash_)
+{
+    table_.swap(other.table_);
+    other.count_ = 0;
+}
+
+template <typename Key, typename Value, typename Hash>
+HashedAVLTree<Key, Value, Hash>& HashedAVLTree<Key, Value, Hash>::operator=(const HashedAVLTree& other)
+{
+    if (this != &other) {
+        this -> clear();
+        hash_ = other.hash_;
+        this -> cloneFrom(other);
+    }
+    return *this;
+}
+
+/**
+* Swaps nodes and tables with other, so its old nodes stay indexed until
+* other frees them.
+*/
+template <typename Key, typename Value, typename Hash>
+HashedAVLTree<Key, Value, Hash>& HashedAVLTree<Key, Value, Hash>::operator=(HashedAVLTree&& other)
+{
+    AVLTree<Key, Value>::operator=(std::move(other));
+    table_.swap(other.table_);
+    std::swap(count_, other.count_);
+    std::swap(hash_, other.hash_);
+    return *this;
+}
+
+/**
+* Frees the nodes here, while destroyNode still reaches this class.
+*/
+template <typename Key, typename Value, typename Hash>
+HashedAVLTree<Key, Value, Hash>::~HashedAVLTree()
+{
+    this -> clear();
+}
+
+/**
+* Returns the home slot of key. The hash is mixed so that identity
+* hashes of sequential keys do not fill one run of slots.
+*/
+template <typename Key, typename Value, typename Hash>
+size_t HashedAVLTree<Key, Value, Hash>::slotOf(const Key& key) const
+{
+    uint64_t h = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(h >> 32) & (table_.size() - 1);
+}
+
+template <typename Key, typename Value, typename Hash>
+void HashedAVLTree<Key, Value, Hash>::indexInsert(Node<Key, Value>* node)
+{
+    // keep the load factor at or below 3/4
+    if ((count_ + 1) * 4 > table_.size() * 3) {
+        grow();
+    }
+    size_t mask = table_.size() - 1;
+    size_t i = slotOf(node -> getKey());
+    while (table_[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    table_[i] = node;
+    ++count_;
+}
+
+/**
+* Removes node's entry and shifts later entries of the same probe run
+* back so that lookups never stop early at the hole.
+*/
+template <typename Key, typename Value, typename Hash>
+void HashedAVLTree<Key, Value, Hash>::indexErase(Node<Key, Value>* node)
+{
+    size_t mask = table_.size() - 1;
+    size_t hole = slotOf(node -> getKey());
+    while (table_[hole] != node) {
+        hole = (hole + 1) & mask;
+    }
+
+    size_t i = hole;
+    while (true) {
+        i = (i + 1) & mask;
+        if (table_[i] == NULL) {
+            break;
+        }
+        // move the entry back unless its home slot lies in (hole, i]
+        size_t home = slotOf(table_[i] -> getKey());
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table_[hole] = table_[i];
+            hole = i;
+        }
+    }
+    table_[hole] = NULL;
+    --count_;
+}
+
+/**
+* Doubles the table and reinserts every node.
+*/
+template <typename Key, typename Value, typename Hash>
+void HashedAVLTree<Key, Value, Hash>::grow()
+{
+    std::vector<Node<Key, Value>*> old(table_.size() * 2, static_cast<Node<Key, Value>*>(NULL));
+    old.swap(table_);
+    size_t mask = table_.size() - 1;
+    for (size_t j = 0; j < old.size(); ++j) {
+        if (old[j] != NULL) {
+            size_t i = slotOf(old[j] -> getKey());
+            while (table_[i] != NULL) {
+                i = (i + 1) & mask;
+            }
+            table_[i] = old[j];
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+AVLNode<Key, Value>* HashedAVLTree<Key, Value, Hash>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    AVLNode<Key, Value>* node = AVLTree<Key, Value>::createNode(key, value, parent);
+    indexInsert(node);
+    return node;
+}
+
+template <typename Key, typename Value, typename Hash>
+void HashedAVLTree<Key, Value, Hash>::destroyNode(Node<Key, Value>* node)
+{
+    indexErase(node);
+    AVLTree<Key, Value>::destroyNode(node);
+}
+
+/**
+* Looks the key up in the hash table instead of walking the tree.
+*/
+template <typename Key, typename Value, typename Hash>
+Node<Key, Value>* HashedAVLTree<Key, Value, Hash>::internalFind(const Key& key) const
+{
+    size_t mask = table_.size() - 1;
+    size_t i = slotOf(key);
+    while (table_[i] != NULL) {
+        if (table_[i] -> getKey() == key) {
+            return table_[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+* Every createNode and destroyNode updates the table.
+*/
+template <typename Key, typename Value, typename Hash>
+bool HashedAVLTree<Key, Value, Hash>::tracksNodes() const
+{
+    return true;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the HashedAVLTree class.
+  ---------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,186 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include "kv_server.h"
+
+using namespace std;
+
+// Requests each connection keeps in flight, compared row by row.
+static const int PIPELINE_DEPTHS[] = { 1, 8, 64 };
+static const int NUM_PIPELINE_DEPTHS = sizeof(PIPELINE_DEPTHS) / sizeof(PIPELINE_DEPTHS[0]);
+
+/**
+* A small xorshift generator so every connection has its own cheap RNG.
+*/
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) { }
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+static string keyOf(uint64_t i)
+{
+    char key[32];
+    snprintf(key, sizeof(key), "key%012llu", static_cast<unsigned long long>(i));
+    return key;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/**
+* Sends requests on one connection, keeping depth of them in flight, and
+* records each one's latency in microseconds from send to response.
+*/
+static void connectionLoad(const string& socketPath, int id, int requests, int depth,
+                           int getPercent, int keys, vector<double>& latencies)
+{
+    KVClient<string, string> client(socketPath);
+    Rng rng(id + 1);
+    vector<std::chrono::steady_clock::time_point> sentAt(depth);
+    string value(16, 'v');
+    latencies.reserve(requests);
+
+    int sent = 0, received = 0;
+    while (received < requests) {
+        while (sent < requests && sent - received < depth) {
+            uint64_t key = rng.next() % keys;
+            if (static_cast<int>(rng.next() % 100) < getPercent) {
+                client.sendGet(keyOf(key));
+            }
+            else {
+                client.sendPut(keyOf(key), value);
+            }
+            sentAt[sent % depth] = std::chrono::steady_clock::now();
+            ++sent;
+        }
+        client.flush();
+        client.receive(NULL);
+        latencies.push_back(secondsSince(sentAt[received % depth]) * 1e6);
+        ++received;
+    }
+}
+
+/**
+* Opens connections connections, pipelines gets totalling exactly one
+* server read chunk (64 KiB) on each and shuts down its sending side,
+* then reads the responses. The server often sees the EOF in the same
+* read as the requests. Sets requests to how many were sent and returns
+* how many came back before the server closed the connections.
+*/
+static int halfClose(const string& socketPath, int connections, int keys, int& requests)
+{
+    // a get frame is a 4 byte length, the op, a 4 byte key length and the key
+    const size_t frame = 4 + 1 + 4 + keyOf(0).size();
+    const size_t chunk = 64 << 10;
+    vector<unique_ptr<KVClient<string, string> > > clients;
+    requests = 0;
+    for (int c = 0; c < connections; ++c) {
+        clients.push_back(unique_ptr<KVClient<string, string> >(new KVClient<string, string>(socketPath)));
+        for (size_t sent = 0; sent + frame <= chunk; sent += frame) {
+            clients[c] -> sendGet(keyOf(requests++ % keys));
+        }
+        // one short key fills the chunk exactly
+        clients[c] -> sendGet(string(chunk % frame - 9, 'k'));
+        ++requests;
+        clients[c] -> finish();
+    }
+
+    int received = 0;
+    for (int c = 0; c < connections; ++c) {
+        try {
+            while (true) {
+                clients[c] -> receive(NULL);
+                ++received;
+            }
+        }
+        catch (const std::runtime_error&) {
+            // the server closes once it has answered everything
+        }
+    }
+    return received;
+}
+
+int main(int argc, char* argv[])
+{
+    string socketPath = (argc > 1) ? argv[1] : "kv-server.sock";
+    int connections = (argc > 2) ? atoi(argv[2]) : 16;
+    int requests = (argc > 3) ? atoi(argv[3]) : 50000;
+    int getPercent = (argc > 4) ? atoi(argv[4]) : 90;
+    int keys = (argc > 5) ? atoi(argv[5]) : 100000;
+
+    try {
+        // load every key once, pipelined on one connection
+        KVClient<string, string> loader(socketPath);
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < keys; ++i) {
+            loader.sendPut(keyOf(i), string(16, 'v'));
+            if (i % 1024 == 1023 || i == keys - 1) {
+                loader.flush();
+                for (int j = i - i % 1024; j <= i; ++j) {
+                    loader.receive(NULL);
+                }
+            }
+        }
+        cout << "Loaded " << keys << " keys in " << fixed << setprecision(2) << secondsSince(begin) << " s" << endl;
+
+        cout << "\n" << connections << " connections, " << requests << " requests each, "
+             << getPercent << "% gets:" << endl;
+        cout << "depth   Kops/s    p50 (us)    p99 (us)   p99.9 (us)" << endl;
+        for (int d = 0; d < NUM_PIPELINE_DEPTHS; ++d) {
+            vector<vector<double> > latencies(connections);
+            vector<thread> threads;
+            begin = std::chrono::steady_clock::now();
+            for (int c = 0; c < connections; ++c) {
+                threads.push_back(thread(connectionLoad, socketPath, c, requests, PIPELINE_DEPTHS[d],
+                                         getPercent, keys, std::ref(latencies[c])));
+            }
+            for (size_t i = 0; i < threads.size(); ++i) {
+                threads[i].join();
+            }
+            double seconds = secondsSince(begin);
+
+            vector<double> all;
+            for (int c = 0; c < connections; ++c) {
+                all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+            }
+            sort(all.begin(), all.end());
+            cout << setw(5) << PIPELINE_DEPTHS[d] << fixed << setprecision(1)
+                 << setw(9) << all.size() / seconds / 1e3
+                 << setw(12) << all[all.size() / 2]
+                 << setw(12) << all[all.size() * 99 / 100]
+                 << setw(13) << all[all.size() * 999 / 1000] << endl;
+        }
+
+        int halfCloseRequests = 0;
+        int answered = halfClose(socketPath, connections, keys, halfCloseRequests);
+        cout << "\n" << connections << " half-closed connections: " << answered << " of "
+             << halfCloseRequests << " responses" << endl;
+        if (answered != halfCloseRequests) {
+            return 1;
+        }
+    }
+    catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
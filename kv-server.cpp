@@ -0,0 +1,41 @@
+#include <iostream>
+#include <string>
+#include <csignal>
+#include <cstdlib>
+#include "kv_server.h"
+
+using namespace std;
+
+static KVServer<string, string>* server = NULL;
+
+static void stopServer(int)
+{
+    if (server != NULL) {
+        server -> stop();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    string socketPath = (argc > 1) ? argv[1] : "kv-server.sock";
+    int shards = (argc > 2) ? atoi(argv[2]) : 16;
+
+    try {
+        KVServer<string, string> kv(socketPath, shards);
+        server = &kv;
+        signal(SIGINT, stopServer);
+        signal(SIGTERM, stopServer);
+        cout << "Serving " << shards << " shards on " << socketPath << endl;
+        kv.run();
+        server = NULL;
+
+        KVServerStats stats = kv.stats();
+        cout << "Served " << stats.requests << " requests over " << stats.connections
+             << " connections in " << stats.batches << " map calls" << endl;
+    }
+    catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
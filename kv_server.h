@@ -0,0 +1,818 @@
+#ifndef KV_SERVER_H
+#define KV_SERVER_H
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "sharded_avl.h"
+#include "run_codec.h"
+
+/**
+* The wire protocol shared by KVServer and KVClient.
+*
+* Every message is a frame: a u32 length, then that many bytes. A request
+* body is an op byte, the key and, for KV_PUT, the value. A response body
+* is a status byte and, for a KV_GET that found the key, the value. Keys
+* and values use RunCodec, so strings are length prefixed and trivially
+* copyable types are raw bytes in host order; both ends run on one
+* machine. A connection may send many requests without waiting, and its
+* responses come back in request order.
+*/
+enum KVOp { KV_GET = 1, KV_PUT = 2, KV_REMOVE = 3 };
+enum KVStatus { KV_OK = 0, KV_NOT_FOUND = 1 };
+
+// frames longer than this end the connection
+static const uint32_t KV_MAX_FRAME = 64 << 20;
+
+/**
+* Counters for a KVServer.
+*/
+struct KVServerStats {
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t batches;       // map calls; fewer than requests when requests are batched
+};
+
+/**
+* Serves a ShardedAVLMap over a Unix domain socket.
+*
+* run() is a single-threaded epoll loop. Each time round it reads
+* whatever every ready connection has sent and parses all the complete
+* requests into one list, so pipelined requests and requests from many
+* clients are handled together. The list is executed in arrival order,
+* with each run of same-op requests passed to one insertBatch, removeBatch
+* or findBatch call, which takes each shard's lock once. The responses
+* are appended to their connections' output and written back.
+*
+* A connection whose unsent output passes a limit is not read from until
+* it drains, so a client that stops reading cannot grow the server
+* without bound. A malformed frame closes its connection. A client that
+* shuts down its sending side still gets the responses to everything it
+* sent; the connection is closed once they are written.
+*
+* The map stays usable from other threads in the same process through
+* map().
+*/
+template <typename Key, typename Value>
+class KVServer
+{
+public:
+    explicit KVServer(const std::string& socketPath, size_t numShards = 16);
+    ~KVServer();
+
+    void run();
+    void stop();
+
+    ShardedAVLMap<Key, Value>& map();
+    KVServerStats stats() const;
+
+private:
+    KVServer(const KVServer&);
+    KVServer& operator=(const KVServer&);
+
+    struct Connection {
+        int fd;
+        std::string in;         // received bytes; parsing resumes at inStart
+        size_t inStart;
+        std::string out;        // responses; sending resumes at outStart
+        size_t outStart;
+        uint32_t events;        // what epoll watches for
+        bool touched;           // on touched_
+        bool inputClosed;       // the client sent EOF; close once out is written
+        bool closed;
+    };
+
+    struct Request {
+        Connection* conn;
+        char op;
+        Key key;
+        Value value;
+    };
+
+    static const size_t READ_CHUNK = 64 << 10;
+    static const size_t OUTPUT_LIMIT = 4 << 20;
+
+    static void removeStaleSocket(const std::string& path, const struct sockaddr_un& address);
+
+    void acceptAll();
+    void readFrom(Connection* conn);
+    void parse(Connection* conn);
+    void execute();
+    void writeTo(Connection* conn);
+    void watch(Connection* conn);
+    void close(Connection* conn);
+
+    std::string socketPath_;
+    ShardedAVLMap<Key, Value> map_;
+    int listenFd_;
+    int epollFd_;
+    int wakeFd_;
+    dev_t socketDevice_;        // the socket file this server bound, so only it is removed
+    ino_t socketInode_;
+    std::map<int, Connection*> connections_;
+    std::vector<Request> batch_;
+    std::vector<Connection*> touched_;      // connections with new output
+    KVServerStats stats_;
+};
+
+/**
+* A blocking client for KVServer.
+*
+* get, put and remove make one round trip each. For pipelining, queue
+* any number of requests with the send functions, flush them in one
+* write, then receive the responses in order.
+*/
+template <typename Key, typename Value>
+class KVClient
+{
+public:
+    explicit KVClient(const std::string& socketPath);
+    ~KVClient();
+
+    bool get(const Key& key, Value& value);
+    void put(const Key& key, const Value& value);
+    void remove(const Key& key);
+
+    void sendGet(const Key& key);
+    void sendPut(const Key& key, const Value& value);
+    void sendRemove(const Key& key);
+    void flush();
+    void finish();
+    KVStatus receive(Value* value);
+
+private:
+    KVClient(const KVClient&);
+    KVClient& operator=(const KVClient&);
+
+    void beginFrame(KVOp op);
+    void endFrame(size_t start);
+
+    int fd_;
+    std::string out_;
+    std::string in_;
+    size_t inStart_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the KVServer class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value>
+const size_t KVServer<Key, Value>::READ_CHUNK;
+
+template<class Key, class Value>
+const size_t KVServer<Key, Value>::OUTPUT_LIMIT;
+
+/**
+* Removes the socket file at path if no server is listening on it any
+* more. Throws if path is something else or a server still answers.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::removeStaleSocket(const std::string& path, const struct sockaddr_un& address)
+{
+    struct stat info;
+    if (::lstat(path.c_str(), &info) != 0) {
+        if (errno == ENOENT) {
+            return;
+        }
+        throw std::runtime_error("Cannot inspect " + path + ": " + std::strerror(errno));
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        throw std::runtime_error(path + " exists and is not a socket");
+    }
+
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        throw std::runtime_error("Cannot create socket: " + std::string(std::strerror(errno)));
+    }
+    int result = ::connect(probe, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address));
+    int error = errno;
+    ::close(probe);
+    if (result == 0) {
+        throw std::runtime_error("A server is already listening on " + path);
+    }
+    if (error != ECONNREFUSED) {
+        throw std::runtime_error("Cannot probe " + path + ": " + std::strerror(error));
+    }
+    ::unlink(path.c_str());
+}
+
+/**
+* Binds and listens on socketPath. A socket file left by a server that
+* has exited is replaced; any other file there, or a live server, makes
+* the constructor throw.
+*/
+template<class Key, class Value>
+KVServer<Key, Value>::KVServer(const std::string& socketPath, size_t numShards) :
+    socketPath_(socketPath), map_(numShards), listenFd_(-1), epollFd_(-1), wakeFd_(-1),
+    socketDevice_(0), socketInode_(0)
+{
+    KVServerStats zero = { 0, 0, 0 };
+    stats_ = zero;
+
+    struct sockaddr_un address;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + socketPath);
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    removeStaleSocket(socketPath, address);
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listenFd_ < 0 || epollFd_ < 0 || wakeFd_ < 0 ||
+        ::bind(listenFd_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd_, SOMAXCONN) != 0) {
+        int error = errno;
+        if (listenFd_ >= 0) ::close(listenFd_);
+        if (epollFd_ >= 0) ::close(epollFd_);
+        if (wakeFd_ >= 0) ::close(wakeFd_);
+        throw std::runtime_error("Cannot listen on " + socketPath + ": " + std::strerror(error));
+    }
+    struct stat info;
+    if (::lstat(socketPath.c_str(), &info) == 0) {
+        socketDevice_ = info.st_dev;
+        socketInode_ = info.st_ino;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &event);
+    event.data.ptr = &wakeFd_;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+}
+
+template<class Key, class Value>
+KVServer<Key, Value>::~KVServer()
+{
+    for (typename std::map<int, Connection*>::iterator it = connections_.begin(); it != connections_.end(); ++it) {
+        ::close(it -> second -> fd);
+        delete it -> second;
+    }
+    ::close(listenFd_);
+    ::close(epollFd_);
+    ::close(wakeFd_);
+
+    // another server may have replaced the file since
+    struct stat info;
+    if (::lstat(socketPath_.c_str(), &info) == 0 && S_ISSOCK(info.st_mode) &&
+        info.st_dev == socketDevice_ && info.st_ino == socketInode_) {
+        ::unlink(socketPath_.c_str());
+    }
+}
+
+/**
+* Makes run() return. Safe to call from another thread or from a signal
+* handler.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::stop()
+{
+    uint64_t one = 1;
+    ssize_t wrote = ::write(wakeFd_, &one, sizeof(one));
+    (void) wrote;
+}
+
+template<class Key, class Value>
+ShardedAVLMap<Key, Value>& KVServer<Key, Value>::map()
+{
+    return map_;
+}
+
+template<class Key, class Value>
+KVServerStats KVServer<Key, Value>::stats() const
+{
+    return stats_;
+}
+
+/**
+* Serves connections until stop() is called.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::run()
+{
+    struct epoll_event events[256];
+    while (true) {
+        int ready = ::epoll_wait(epollFd_, events, 256, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("epoll_wait failed");
+        }
+
+        std::vector<Connection*> closing;
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.ptr == &wakeFd_) {
+                uint64_t count;
+                ssize_t got = ::read(wakeFd_, &count, sizeof(count));
+                (void) got;
+                return;
+            }
+            if (events[i].data.ptr == NULL) {
+                acceptAll();
+                continue;
+            }
+            Connection* conn = static_cast<Connection*>(events[i].data.ptr);
+            if (events[i].events & EPOLLOUT) {
+                writeTo(conn);
+            }
+            if (!conn -> closed && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                readFrom(conn);
+            }
+            if (conn -> closed) {
+                closing.push_back(conn);
+            }
+        }
+
+        execute();
+        for (size_t i = 0; i < touched_.size(); ++i) {
+            touched_[i] -> touched = false;
+            if (!touched_[i] -> closed) {
+                writeTo(touched_[i]);
+            }
+            if (touched_[i] -> closed) {
+                closing.push_back(touched_[i]);
+            }
+        }
+        touched_.clear();
+
+        // freed only now, since batch_ and touched_ may point at them
+        for (size_t i = 0; i < closing.size(); ++i) {
+            if (connections_.erase(closing[i] -> fd) > 0) {
+                ::close(closing[i] -> fd);
+                delete closing[i];
+            }
+        }
+    }
+}
+
+template<class Key, class Value>
+void KVServer<Key, Value>::acceptAll()
+{
+    while (true) {
+        int fd = ::accept4(listenFd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        Connection* conn = new Connection();
+        conn -> fd = fd;
+        conn -> inStart = 0;
+        conn -> outStart = 0;
+        conn -> events = EPOLLIN;
+        conn -> touched = false;
+        conn -> inputClosed = false;
+        conn -> closed = false;
+
+        struct epoll_event event;
+        event.events = conn -> events;
+        event.data.ptr = conn;
+        if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            ::close(fd);
+            delete conn;
+            continue;
+        }
+        connections_[fd] = conn;
+        ++stats_.connections;
+    }
+}
+
+/**
+* Reads what the connection has sent, up to a few chunks so one busy
+* client cannot starve the rest, and parses the complete requests. At
+* EOF the requests already received are still parsed, and the
+* connection is put on touched_ so that run() closes it once their
+* responses are written.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::readFrom(Connection* conn)
+{
+    // no longer watched for input, so only a hangup or error gets here
+    if (conn -> inputClosed) {
+        close(conn);
+        return;
+    }
+    for (int chunk = 0; chunk < 4; ++chunk) {
+        size_t used = conn -> in.size();
+        conn -> in.resize(used + READ_CHUNK);
+        ssize_t got = ::read(conn -> fd, &conn -> in[used], READ_CHUNK);
+        conn -> in.resize(used + (got > 0 ? got : 0));
+        if (got == 0) {
+            conn -> inputClosed = true;
+            break;
+        }
+        if (got < 0 && errno != EAGAIN && errno != EINTR) {
+            close(conn);
+            return;
+        }
+        if (got < static_cast<ssize_t>(READ_CHUNK)) {
+            break;
+        }
+    }
+    parse(conn);
+    if (conn -> inputClosed && !conn -> closed && !conn -> touched) {
+        conn -> touched = true;
+        touched_.push_back(conn);
+    }
+}
+
+/**
+* Moves every complete request in the connection's input onto the batch.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::parse(Connection* conn)
+{
+    const char* base = conn -> in.data();
+    const char* end = base + conn -> in.size();
+    const char* p = base + conn -> inStart;
+    while (static_cast<size_t>(end - p) >= sizeof(uint32_t)) {
+        uint32_t length;
+        std::memcpy(&length, p, sizeof(length));
+        if (length == 0 || length > KV_MAX_FRAME) {
+            close(conn);
+            return;
+        }
+        if (static_cast<size_t>(end - p) - sizeof(length) < length) {
+            break;
+        }
+        const char* body = p + sizeof(length);
+        const char* bodyEnd = body + length;
+        Request request;
+        request.conn = conn;
+        request.op = *body++;
+        try {
+            body = RunCodec<Key>::decode(body, bodyEnd, request.key);
+            if (request.op == KV_PUT) {
+                body = RunCodec<Value>::decode(body, bodyEnd, request.value);
+            }
+        }
+        catch (const std::runtime_error&) {
+            body = NULL;
+        }
+        if (body != bodyEnd || request.op < KV_GET || request.op > KV_REMOVE) {
+            close(conn);
+            return;
+        }
+        batch_.push_back(request);
+        p = bodyEnd;
+    }
+
+    conn -> inStart = p - base;
+    if (conn -> inStart == conn -> in.size()) {
+        conn -> in.clear();
+        conn -> inStart = 0;
+    }
+    else if (conn -> inStart >= READ_CHUNK) {
+        conn -> in.erase(0, conn -> inStart);
+        conn -> inStart = 0;
+    }
+}
+
+/**
+* Runs the batch in arrival order, one map call per run of requests with
+* the same op, and queues each response on its connection.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::execute()
+{
+    std::vector<Key> keys;
+    std::vector<std::pair<Key, Value> > items;
+    std::vector<Value> values;
+    std::vector<bool> found;
+
+    for (size_t first = 0; first < batch_.size(); ) {
+        char op = batch_[first].op;
+        size_t last = first;
+        while (last < batch_.size() && batch_[last].op == op) {
+            ++last;
+        }
+
+        keys.clear();
+        items.clear();
+        for (size_t i = first; i < last; ++i) {
+            if (op == KV_PUT) {
+                items.push_back(std::make_pair(batch_[i].key, batch_[i].value));
+            }
+            else {
+                keys.push_back(batch_[i].key);
+            }
+        }
+        if (op == KV_PUT) {
+            map_.insertBatch(items);
+        }
+        else if (op == KV_REMOVE) {
+            map_.removeBatch(keys);
+        }
+        else {
+            map_.findBatch(keys, values, found);
+        }
+        ++stats_.batches;
+
+        for (size_t i = first; i < last; ++i) {
+            Connection* conn = batch_[i].conn;
+            if (conn -> closed) {
+                continue;
+            }
+            if (!conn -> touched) {
+                conn -> touched = true;
+                touched_.push_back(conn);
+            }
+            std::string& out = conn -> out;
+            size_t start = out.size();
+            RunCodec<uint32_t>::encode(out, 0);
+            if (op == KV_GET && found[i - first]) {
+                out.push_back(static_cast<char>(KV_OK));
+                RunCodec<Value>::encode(out, values[i - first]);
+            }
+            else {
+                out.push_back(static_cast<char>(op == KV_GET ? KV_NOT_FOUND : KV_OK));
+            }
+            uint32_t length = static_cast<uint32_t>(out.size() - start - sizeof(length));
+            std::memcpy(&out[start], &length, sizeof(length));
+        }
+        first = last;
+    }
+    stats_.requests += batch_.size();
+    batch_.clear();
+}
+
+/**
+* Writes as much queued output as the socket takes, then updates what
+* epoll watches for. A connection whose client has sent EOF is closed
+* once its output is all written.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::writeTo(Connection* conn)
+{
+    while (conn -> outStart < conn -> out.size()) {
+        ssize_t wrote = ::send(conn -> fd, conn -> out.data() + conn -> outStart,
+                               conn -> out.size() - conn -> outStart, MSG_NOSIGNAL);
+        if (wrote < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                close(conn);
+                return;
+            }
+            break;
+        }
+        conn -> outStart += wrote;
+    }
+    if (conn -> outStart == conn -> out.size()) {
+        conn -> out.clear();
+        conn -> outStart = 0;
+        if (conn -> inputClosed) {
+            close(conn);
+            return;
+        }
+    }
+    else if (conn -> outStart >= OUTPUT_LIMIT) {
+        conn -> out.erase(0, conn -> outStart);
+        conn -> outStart = 0;
+    }
+    watch(conn);
+}
+
+/**
+* Watches for output space while output is queued, and for input unless
+* too much output is queued or the client has sent EOF.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::watch(Connection* conn)
+{
+    size_t queued = conn -> out.size() - conn -> outStart;
+    bool reading = !conn -> inputClosed && queued < OUTPUT_LIMIT;
+    uint32_t events = (reading ? EPOLLIN : 0) | (queued > 0 ? EPOLLOUT : 0);
+    if (events != conn -> events) {
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = conn;
+        ::epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn -> fd, &event);
+        conn -> events = events;
+    }
+}
+
+/**
+* Stops watching the connection; run() frees it after the batch.
+*/
+template<class Key, class Value>
+void KVServer<Key, Value>::close(Connection* conn)
+{
+    if (!conn -> closed) {
+        ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, conn -> fd, NULL);
+        ::shutdown(conn -> fd, SHUT_RDWR);
+        conn -> closed = true;
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the KVServer class.
+  ---------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the KVClient class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value>
+KVClient<Key, Value>::KVClient(const std::string& socketPath) :
+    fd_(-1), inStart_(0)
+{
+    struct sockaddr_un address;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + socketPath);
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || ::connect(fd_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        if (fd_ >= 0) ::close(fd_);
+        throw std::runtime_error("Cannot connect to " + socketPath + ": " + std::strerror(error));
+    }
+}
+
+template<class Key, class Value>
+KVClient<Key, Value>::~KVClient()
+{
+    ::close(fd_);
+}
+
+template<class Key, class Value>
+void KVClient<Key, Value>::beginFrame(KVOp op)
+{
+    RunCodec<uint32_t>::encode(out_, 0);
+    out_.push_back(static_cast<char>(op));
+}
+
+template<class Key, class Value>
+void KVClient<Key, Value>::endFrame(size_t start)
+{
+    uint32_t length = static_cast<uint32_t>(out_.size() - start - sizeof(length));
+    std::memcpy(&out_[start], &length, sizeof(length));
+}
+
+template<class Key, class Value>
+void KVClient<Key, Value>::sendGet(const Key& key)
+{
+    size_t start = out_.size();
+    beginFrame(KV_GET);
+    RunCodec<Key>::encode(out_, key);
+    endFrame(start);
+}
+
+template<class Key, class Value>
+void KVClient<Key, Value>::sendPut(const Key& key, const Value& value)
+{
+    size_t start = out_.size();
+    beginFrame(KV_PUT);
+    RunCodec<Key>::encode(out_, key);
+    RunCodec<Value>::encode(out_, value);
+    endFrame(start);
+}
+
+template<class Key, class Value>
+void KVClient<Key, Value>::sendRemove(const Key& key)
+{
+    size_t start = out_.size();
+    beginFrame(KV_REMOVE);
+    RunCodec<Key>::encode(out_, key);
+    endFrame(start);
+}
+
+/**
+* Writes every queued request.
+*/
+template<class Key, class Value>
+void KVClient<Key, Value>::flush()
+{
+    size_t sent = 0;
+    while (sent < out_.size()) {
+        ssize_t wrote = ::send(fd_, out_.data() + sent, out_.size() - sent, MSG_NOSIGNAL);
+        if (wrote < 0 && errno == EINTR) {
+            continue;
+        }
+        if (wrote <= 0) {
+            throw std::runtime_error("Connection to server lost");
+        }
+        sent += wrote;
+    }
+    out_.clear();
+}
+
+/**
+* Writes every queued request, then shuts down the sending side. The
+* server still answers everything sent before, then closes.
+*/
+template<class Key, class Value>
+void KVClient<Key, Value>::finish()
+{
+    flush();
+    ::shutdown(fd_, SHUT_WR);
+}
+
+/**
+* Waits for the next response. Stores the value of a found KV_GET in
+* *value when value is not NULL.
+*/
+template<class Key, class Value>
+KVStatus KVClient<Key, Value>::receive(Value* value)
+{
+    while (true) {
+        size_t available = in_.size() - inStart_;
+        uint32_t length = 0;
+        if (available >= sizeof(length)) {
+            std::memcpy(&length, in_.data() + inStart_, sizeof(length));
+            if (length == 0 || length > KV_MAX_FRAME) {
+                throw std::runtime_error("Corrupt response");
+            }
+        }
+        if (available >= sizeof(length) && available - sizeof(length) >= length) {
+            const char* body = in_.data() + inStart_ + sizeof(length);
+            const char* bodyEnd = body + length;
+            KVStatus status = static_cast<KVStatus>(*body++);
+            if (body != bodyEnd && value != NULL) {
+                RunCodec<Value>::decode(body, bodyEnd, *value);
+            }
+            inStart_ += sizeof(length) + length;
+            if (inStart_ == in_.size()) {
+                in_.clear();
+                inStart_ = 0;
+            }
+            return status;
+        }
+
+        if (inStart_ > 0) {
+            in_.erase(0, inStart_);
+            inStart_ = 0;
+        }
+        size_t used = in_.size();
+        in_.resize(used + (64 << 10));
+        ssize_t got = ::read(fd_, &in_[used], 64 << 10);
+        in_.resize(used + (got > 0 ? got : 0));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            throw std::runtime_error("Connection to server lost");
+        }
+    }
+}
+
+/**
+* Looks up key. Returns false if it is not in the map.
+*/
+template<class Key, class Value>
+bool KVClient<Key, Value>::get(const Key& key, Value& value)
+{
+    sendGet(key);
+    flush();
+    return receive(&value) == KV_OK;
+}
+
+template<class Key, class Value>
+void KVClient<Key, Value>::put(const Key& key, const Value& value)
+{
+    sendPut(key, value);
+    flush();
+    receive(NULL);
+}
+
+template<class Key, class Value>
+void KVClient<Key, Value>::remove(const Key& key)
+{
+    sendRemove(key);
+    flush();
+    receive(NULL);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the KVClient class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,303 @@
+#ifndef LEAF_DEPTH_AVL_H
+#define LEAF_DEPTH_AVL_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also records how far below it its nearest and farthest
+* leaves are (0 and 0 for a leaf). A missing child does not count as a
+* leaf, matching equalPaths().
+*/
+template <typename Key, typename Value>
+class LeafDepthNode : public AVLNode<Key, Value>
+{
+public:
+    LeafDepthNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~LeafDepthNode();
+
+    int getMinLeaf() const;
+    int getMaxLeaf() const;
+    void setLeafDepths(int minLeaf, int maxLeaf);
+    virtual void refresh() override;
+    virtual bool isFresh() const override;
+    virtual void copySummary(const AVLNode<Key, Value>* source) override;
+
+protected:
+    void computeLeafDepths(int& minLeaf, int& maxLeaf) const;
+
+    int minLeaf_;
+    int maxLeaf_;
+};
+
+/**
+* An AVLTree that keeps the leaf distances of every subtree up to date,
+* so asking whether all leaves are at the same depth is an O(1) check of
+* the root instead of an O(n) walk.
+*
+* AVLTree refreshes the summaries as it changes the shape: insert and
+* remove refresh every node from the change up to the root, adding
+* O(log n) to each update, and eraseRange touches only the split spines.
+*/
+template <typename Key, typename Value>
+class LeafDepthAVLTree : public AVLTree<Key, Value>
+{
+public:
+    LeafDepthAVLTree();
+    LeafDepthAVLTree(const LeafDepthAVLTree<Key, Value>& other);
+    LeafDepthAVLTree(LeafDepthAVLTree<Key, Value>&& other);
+    LeafDepthAVLTree<Key, Value>& operator=(const LeafDepthAVLTree<Key, Value>& other);
+    LeafDepthAVLTree<Key, Value>& operator=(LeafDepthAVLTree<Key, Value>&& other);
+
+    bool equalPaths() const;
+    int minLeafDepth() const;
+    int maxLeafDepth() const;
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) override;
+
+    LeafDepthNode<Key, Value>* root() const;
+};
+
+/**
+* Returns true if every leaf under root is at the same depth, like
+* equalPaths() from equal-paths.h but for the nodes of a
+* BinarySearchTree or AVLTree. Iterative, and O(n).
+*/
+template <typename Key, typename Value>
+bool equalPaths(const Node<Key, Value>* root)
+{
+    std::vector<std::pair<const Node<Key, Value>*, int> > pending;
+    int leafDepth = -1;
+    const Node<Key, Value>* node = root;
+    int depth = 0;
+
+    while (true) {
+        while (node != NULL) {
+            if (node -> getLeft() == NULL && node -> getRight() == NULL) {
+                if (leafDepth == -1) {
+                    leafDepth = depth;
+                }
+                else if (depth != leafDepth) {
+                    return false;
+                }
+                break;
+            }
+            // a non-leaf at the leaf level only leads to deeper leaves
+            if (leafDepth != -1 && depth >= leafDepth) {
+                return false;
+            }
+            if (node -> getLeft() != NULL && node -> getRight() != NULL) {
+                pending.push_back(std::make_pair(node -> getRight(), depth + 1));
+            }
+            node = (node -> getLeft() != NULL) ? node -> getLeft() : node -> getRight();
+            ++depth;
+        }
+
+        if (pending.empty()) {
+            return true;
+        }
+        node = pending.back().first;
+        depth = pending.back().second;
+        pending.pop_back();
+    }
+}
+
+/**
+* The O(1) answer for a tree that keeps leaf-depth summaries.
+*/
+template <typename Key, typename Value>
+bool equalPaths(const LeafDepthAVLTree<Key, Value>& tree)
+{
+    return tree.equalPaths();
+}
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the LeafDepthNode class.
+  -----------------------------------------------------
+*/
+
+template<class Key, class Value>
+LeafDepthNode<Key, Value>::LeafDepthNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), minLeaf_(0), maxLeaf_(0)
+{
+
+}
+
+template<class Key, class Value>
+LeafDepthNode<Key, Value>::~LeafDepthNode()
+{
+
+}
+
+template<class Key, class Value>
+int LeafDepthNode<Key, Value>::getMinLeaf() const
+{
+    return minLeaf_;
+}
+
+template<class Key, class Value>
+int LeafDepthNode<Key, Value>::getMaxLeaf() const
+{
+    return maxLeaf_;
+}
+
+template<class Key, class Value>
+void LeafDepthNode<Key, Value>::setLeafDepths(int minLeaf, int maxLeaf)
+{
+    minLeaf_ = minLeaf;
+    maxLeaf_ = maxLeaf;
+}
+
+/**
+* Derives this node's leaf distances from its children's.
+*/
+template<class Key, class Value>
+void LeafDepthNode<Key, Value>::computeLeafDepths(int& minLeaf, int& maxLeaf) const
+{
+    const LeafDepthNode<Key, Value>* left = static_cast<const LeafDepthNode<Key, Value>*>(this -> getLeft());
+    const LeafDepthNode<Key, Value>* right = static_cast<const LeafDepthNode<Key, Value>*>(this -> getRight());
+
+    if (left == NULL && right == NULL) {
+        minLeaf = 0;
+        maxLeaf = 0;
+    }
+    else if (left == NULL) {
+        minLeaf = right -> minLeaf_ + 1;
+        maxLeaf = right -> maxLeaf_ + 1;
+    }
+    else if (right == NULL) {
+        minLeaf = left -> minLeaf_ + 1;
+        maxLeaf = left -> maxLeaf_ + 1;
+    }
+    else {
+        minLeaf = std::min(left -> minLeaf_, right -> minLeaf_) + 1;
+        maxLeaf = std::max(left -> maxLeaf_, right -> maxLeaf_) + 1;
+    }
+}
+
+/**
+* Recomputes this node's leaf distances from its children's.
+*/
+template<class Key, class Value>
+void LeafDepthNode<Key, Value>::refresh()
+{
+    computeLeafDepths(minLeaf_, maxLeaf_);
+}
+
+/**
+* Returns true if the stored leaf distances match the children's.
+*/
+template<class Key, class Value>
+bool LeafDepthNode<Key, Value>::isFresh() const
+{
+    int minLeaf, maxLeaf;
+    computeLeafDepths(minLeaf, maxLeaf);
+    return minLeaf == minLeaf_ && maxLeaf == maxLeaf_;
+}
+
+template<class Key, class Value>
+void LeafDepthNode<Key, Value>::copySummary(const AVLNode<Key, Value>* source)
+{
+    const LeafDepthNode<Key, Value>* original = static_cast<const LeafDepthNode<Key, Value>*>(source);
+    setLeafDepths(original -> minLeaf_, original -> maxLeaf_);
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the LeafDepthNode class.
+  ---------------------------------------------------
+*/
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the LeafDepthAVLTree class.
+  --------------------------------------------------------
+*/
+
+template<class Key, class Value>
+LeafDepthAVLTree<Key, Value>::LeafDepthAVLTree()
+{
+
+}
+
+/**
+* Clones in the body so that cloneNode reaches this class.
+*/
+template<class Key, class Value>
+LeafDepthAVLTree<Key, Value>::LeafDepthAVLTree(const LeafDepthAVLTree<Key, Value>& other) :
+    AVLTree<Key, Value>()
+{
+    this -> cloneFrom(other);
+}
+
+template<class Key, class Value>
+LeafDepthAVLTree<Key, Value>::LeafDepthAVLTree(LeafDepthAVLTree<Key, Value>&& other) :
+    AVLTree<Key, Value>(std::move(other))
+{
+
+}
+
+template<class Key, class Value>
+LeafDepthAVLTree<Key, Value>& LeafDepthAVLTree<Key, Value>::operator=(const LeafDepthAVLTree<Key, Value>& other)
+{
+    AVLTree<Key, Value>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value>
+LeafDepthAVLTree<Key, Value>& LeafDepthAVLTree<Key, Value>::operator=(LeafDepthAVLTree<Key, Value>&& other)
+{
+    AVLTree<Key, Value>::operator=(std::move(other));
+    return *this;
+}
+
+template<class Key, class Value>
+LeafDepthNode<Key, Value>* LeafDepthAVLTree<Key, Value>::root() const
+{
+    return static_cast<LeafDepthNode<Key, Value>*>(this -> root_);
+}
+
+/**
+* Returns true if every leaf is at the same depth, in O(1).
+*/
+template<class Key, class Value>
+bool LeafDepthAVLTree<Key, Value>::equalPaths() const
+{
+    return root() == NULL || root() -> getMinLeaf() == root() -> getMaxLeaf();
+}
+
+/**
+* Returns the depth of the shallowest leaf, or -1 if the tree is empty.
+*/
+template<class Key, class Value>
+int LeafDepthAVLTree<Key, Value>::minLeafDepth() const
+{
+    return root() == NULL ? -1 : root() -> getMinLeaf();
+}
+
+/**
+* Returns the depth of the deepest leaf, or -1 if the tree is empty.
+*/
+template<class Key, class Value>
+int LeafDepthAVLTree<Key, Value>::maxLeafDepth() const
+{
+    return root() == NULL ? -1 : root() -> getMaxLeaf();
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* LeafDepthAVLTree<Key, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return new LeafDepthNode<Key, Value>(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the LeafDepthAVLTree class.
+  ------------------------------------------------------
+*/
+
+#endif
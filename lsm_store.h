@@ -0,0 +1,1516 @@
+#ifndef LSM_STORE_H
+#define LSM_STORE_H
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+#include "run_codec.h"
+
+/**
+* Tuning knobs for an LSMStore.
+*/
+struct LSMOptions {
+    size_t memtableLimit;       // entries a memtable takes before it is flushed to a run
+    size_t compactionFanIn;     // runs of one size tier that are merged together
+    unsigned compactionThreads;
+    unsigned bloomBitsPerKey;
+    size_t indexInterval;       // records between sparse index entries
+
+    LSMOptions() :
+        memtableLimit(1 << 16), compactionFanIn(4), compactionThreads(1), bloomBitsPerKey(10), indexInterval(64)
+    {}
+};
+
+/**
+* A value, or a tombstone left by remove() that hides older values of the
+* same key until compaction drops it.
+*/
+template <typename Value>
+struct LSMEntry {
+    Value value;
+    bool live;
+};
+
+// The memtable's iterators compare values, and its printRoot prints them.
+template <typename Value>
+bool operator==(const LSMEntry<Value>& a, const LSMEntry<Value>& b)
+{
+    return a.live == b.live && (!a.live || a.value == b.value);
+}
+
+template <typename Value>
+bool operator!=(const LSMEntry<Value>& a, const LSMEntry<Value>& b)
+{
+    return !(a == b);
+}
+
+template <typename Value>
+std::ostream& operator<<(std::ostream& out, const LSMEntry<Value>& entry)
+{
+    if (entry.live) {
+        return out << entry.value;
+    }
+    return out << "<deleted>";
+}
+
+/**
+* Spreads a std::hash result over all 64 bits (splitmix64's finalizer);
+* std::hash is the identity for integers.
+*/
+inline uint64_t lsmMix(uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
+/**
+* A Bloom filter over 64-bit key hashes, probed by double hashing.
+*/
+class BloomFilter
+{
+public:
+    BloomFilter();
+
+    void reset(size_t keys, unsigned bitsPerKey);
+    void add(uint64_t hash);
+    bool mayContain(uint64_t hash) const;
+
+    void encode(std::string& out) const;
+    const char* decode(const char* p, const char* end);
+
+private:
+    std::vector<uint64_t> words_;
+    uint32_t probes_;
+};
+
+/**
+* An immutable sorted run file. The file holds a header, the records in
+* key order, and a footer with the Bloom filter and a sparse index of
+* every indexInterval-th record; only the footer is kept in memory.
+*
+* A run covers the flush sequence numbers firstSeq..lastSeq: a flushed
+* memtable gets one number, and a merged run covers everything its
+* inputs covered. Higher numbers are newer.
+*/
+template <typename Key, typename Value>
+class SortedRun
+{
+public:
+    typedef LSMEntry<Value> Entry;
+
+    /**
+    * Reads records in order from a run, a buffer at a time.
+    */
+    class Cursor
+    {
+    public:
+        Cursor(const std::shared_ptr<const SortedRun>& run, uint64_t offset);
+
+        bool valid() const;
+        const Key& key() const;
+        const Entry& entry() const;
+        void next();
+
+    private:
+        bool fill(size_t needed);
+
+        std::shared_ptr<const SortedRun> run_;
+        std::vector<char> buffer_;
+        size_t begin_;
+        size_t end_;
+        uint64_t fileOffset_;
+        bool valid_;
+        Key key_;
+        Entry entry_;
+    };
+
+    ~SortedRun();
+
+    static std::shared_ptr<SortedRun> open(const std::string& path, uint64_t firstSeq, uint64_t lastSeq);
+    static std::string fileName(uint64_t firstSeq, uint64_t lastSeq);
+    static bool parseFileName(const char* name, uint64_t& firstSeq, uint64_t& lastSeq);
+
+    bool find(const Key& key, uint64_t hash, Entry& entry) const;
+    uint64_t seekOffset(const Key& key) const;
+    uint64_t count() const;
+    uint64_t firstSeq() const;
+    uint64_t lastSeq() const;
+    const std::string& path() const;
+
+    static const char* decodeRecord(const char* p, const char* end, Key& key, Entry& entry);
+    static void encodeRecord(std::string& out, const Key& key, const Entry& entry);
+    static void readAt(int fd, char* data, size_t length, uint64_t offset);
+
+    static const char MAGIC[8];
+    static const size_t HEADER_SIZE = 8;
+    static const size_t TRAILER_SIZE = 24;
+
+private:
+    template<typename K, typename V, typename H> friend class LSMStore;
+
+    SortedRun();
+    SortedRun(const SortedRun&);
+    SortedRun& operator=(const SortedRun&);
+
+    size_t indexBlock(const Key& key) const;
+
+    int fd_;
+    std::string path_;
+    uint64_t firstSeq_;
+    uint64_t lastSeq_;
+    uint64_t count_;
+    uint64_t dataEnd_;
+    BloomFilter bloom_;
+    std::vector<std::pair<Key, uint64_t> > index_;
+    bool compacting_;   // guarded by the owning store's lock
+};
+
+/**
+* Writes one run file from records given in key order. The file is
+* written under a temporary name and only renamed into place, after an
+* fsync, by finish(); a writer destroyed before that removes it.
+*/
+template <typename Key, typename Value>
+class RunWriter
+{
+public:
+    typedef LSMEntry<Value> Entry;
+
+    RunWriter(const std::string& path, size_t expected, const LSMOptions& options);
+    ~RunWriter();
+
+    void add(const Key& key, const Entry& entry, uint64_t hash);
+    uint64_t count() const;
+    void finish(const std::string& finalPath);
+
+private:
+    RunWriter(const RunWriter&);
+    RunWriter& operator=(const RunWriter&);
+
+    void flushBuffer();
+
+    int fd_;
+    std::string path_;
+    std::string buffer_;
+    uint64_t offset_;
+    uint64_t count_;
+    size_t interval_;
+    BloomFilter bloom_;
+    std::string index_;
+    uint64_t indexCount_;
+};
+
+/**
+* A log-structured key-value store for data that does not fit in memory.
+*
+* Writes go to an AVLTree memtable. Once it holds memtableLimit entries
+* it is frozen and a background thread writes it, in order, to a new
+* sorted run file in the store's directory, while writes continue in a
+* fresh memtable. A writer that fills the fresh one before the frozen one
+* is on disk waits for it, which bounds memory to two memtables plus the
+* runs' Bloom filters and sparse indexes.
+*
+* Lookups check the memtables and then the runs from newest to oldest,
+* skipping any run whose Bloom filter rules the key out. Range scans merge
+* all of them with a k-way merge iterator in which the newest version of
+* each key wins. Compaction threads merge compactionFanIn adjacent runs of
+* the same size tier into one, and drop tombstones once the merge reaches
+* the oldest run.
+*
+* Runs survive restarts: opening a directory picks up its run files.
+* What is still in the memtables is only written out by flush() and the
+* destructor, so a crash loses it.
+*/
+template <typename Key, typename Value, typename KeyHash = std::hash<Key> >
+class LSMStore
+{
+public:
+    typedef LSMEntry<Value> Entry;
+    typedef SortedRun<Key, Value> Run;
+    typedef AVLTree<Key, Entry> Memtable;
+
+    /**
+    * A k-way merge over a snapshot of the memtables and runs, in key
+    * order, newest version of each key only.
+    */
+    class MergeIterator
+    {
+    public:
+        bool valid() const;
+        const Key& key() const;
+        const Entry& entry() const;
+        void next();
+
+    private:
+        friend class LSMStore;
+
+        struct Source {
+            virtual ~Source() {}
+            virtual bool valid() const = 0;
+            virtual const Key& key() const = 0;
+            virtual const Entry& entry() const = 0;
+            virtual void next() = 0;
+            unsigned rank;      // higher is newer
+        };
+        struct TableSource;
+        struct RunSource;
+        struct Newer;
+
+        MergeIterator(bool skipTombstones, const Key* hi);
+        void add(Source* source);
+        void settle();
+
+        std::vector<std::shared_ptr<Source> > sources_;
+        std::vector<Source*> heap_;
+        bool skipTombstones_;
+        bool bounded_;
+        Key hi_;
+        bool valid_;
+        Key key_;
+        Entry entry_;
+    };
+
+    explicit LSMStore(const std::string& directory, const LSMOptions& options = LSMOptions());
+    ~LSMStore();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value get(const Key& key) const;
+
+    MergeIterator range(const Key& lo, const Key& hi) const;
+    template<typename Callback>
+    void scan(const Key& lo, const Key& hi, Callback callback) const;
+
+    void flush();
+    void waitForCompactions();
+    size_t runCount() const;
+
+private:
+    LSMStore(const LSMStore&);
+    LSMStore& operator=(const LSMStore&);
+
+    void recover();
+    void write(const Key& key, const Entry& entry);
+    void freeze(std::unique_lock<std::mutex>& guard);
+    void checkError() const;
+    bool pickCompaction(size_t& first) const;
+    unsigned tier(const Run& run) const;
+    std::string pathOf(const std::string& name) const;
+    std::shared_ptr<Run> writeMemtable(const Memtable& table, uint64_t seq);
+    std::shared_ptr<Run> mergeRuns(const std::vector<std::shared_ptr<Run> >& inputs, bool dropTombstones);
+    void syncDirectory() const;
+    void flushLoop();
+    void compactLoop();
+
+    std::string directory_;
+    LSMOptions options_;
+    mutable std::mutex lock_;
+    std::condition_variable flushWake_;     // a memtable was frozen, or stopping
+    std::condition_variable compactWake_;   // runs changed, or stopping
+    std::condition_variable changed_;       // a flush or compaction finished
+    std::shared_ptr<Memtable> memtable_;
+    std::shared_ptr<Memtable> frozen_;      // being written out by the flush thread
+    std::vector<std::shared_ptr<Run> > runs_;   // oldest first
+    uint64_t nextSeq_;
+    unsigned activeCompactions_;
+    std::atomic<bool> stopping_;
+    std::string error_;     // set if a background flush or compaction failed
+    std::thread flusher_;
+    std::vector<std::thread> compactors_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the BloomFilter class.
+  -----------------------------------------------
+*/
+
+inline BloomFilter::BloomFilter() :
+    probes_(1)
+{
+
+}
+
+/**
+* Sizes the filter for keys entries; about 0.69 probes per bit per key
+* minimizes the false positive rate.
+*/
+inline void BloomFilter::reset(size_t keys, unsigned bitsPerKey)
+{
+    size_t bits = std::max<size_t>(keys * bitsPerKey, 64);
+    words_.assign((bits + 63) / 64, 0);
+    probes_ = std::min<uint32_t>(std::max<uint32_t>(bitsPerKey * 69 / 100, 1), 30);
+}
+
+inline void BloomFilter::add(uint64_t hash)
+{
+    uint64_t bits = words_.size() * 64;
+    uint64_t delta = (hash >> 33) | (hash << 31) | 1;
+    for (uint32_t i = 0; i < probes_; ++i) {
+        uint64_t bit = hash % bits;
+        words_[bit / 64] |= uint64_t(1) << (bit % 64);
+        hash += delta;
+    }
+}
+
+inline bool BloomFilter::mayContain(uint64_t hash) const
+{
+    if (words_.empty()) {
+        return true;
+    }
+    uint64_t bits = words_.size() * 64;
+    uint64_t delta = (hash >> 33) | (hash << 31) | 1;
+    for (uint32_t i = 0; i < probes_; ++i) {
+        uint64_t bit = hash % bits;
+        if ((words_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0) {
+            return false;
+        }
+        hash += delta;
+    }
+    return true;
+}
+
+inline void BloomFilter::encode(std::string& out) const
+{
+    RunCodec<uint32_t>::encode(out, probes_);
+    RunCodec<uint64_t>::encode(out, static_cast<uint64_t>(words_.size()));
+    out.append(reinterpret_cast<const char*>(words_.data()), words_.size() * sizeof(uint64_t));
+}
+
+inline const char* BloomFilter::decode(const char* p, const char* end)
+{
+    uint64_t words;
+    p = RunCodec<uint32_t>::decode(p, end, probes_);
+    p = RunCodec<uint64_t>::decode(p, end, words);
+    if (static_cast<uint64_t>(end - p) / sizeof(uint64_t) < words) {
+        throw std::runtime_error("Corrupt run footer");
+    }
+    words_.resize(words);
+    std::memcpy(words_.data(), p, words * sizeof(uint64_t));
+    return p + words * sizeof(uint64_t);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BloomFilter class.
+  ---------------------------------------------
+*/
+
+/*
+  ----------------------------------------------
+  Begin implementations for the SortedRun class.
+  ----------------------------------------------
+*/
+
+template<class Key, class Value>
+const char SortedRun<Key, Value>::MAGIC[8] = { 'L', 'S', 'M', 'R', 'U', 'N', '0', '1' };
+
+template<class Key, class Value>
+const size_t SortedRun<Key, Value>::HEADER_SIZE;
+
+template<class Key, class Value>
+const size_t SortedRun<Key, Value>::TRAILER_SIZE;
+
+template<class Key, class Value>
+SortedRun<Key, Value>::SortedRun() :
+    fd_(-1), firstSeq_(0), lastSeq_(0), count_(0), dataEnd_(0), compacting_(false)
+{
+
+}
+
+template<class Key, class Value>
+SortedRun<Key, Value>::~SortedRun()
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+/**
+* Names a run file after the sequence numbers it covers.
+*/
+template<class Key, class Value>
+std::string SortedRun<Key, Value>::fileName(uint64_t firstSeq, uint64_t lastSeq)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "run-%020llu-%020llu.lsm",
+                  static_cast<unsigned long long>(firstSeq), static_cast<unsigned long long>(lastSeq));
+    return name;
+}
+
+template<class Key, class Value>
+bool SortedRun<Key, Value>::parseFileName(const char* name, uint64_t& firstSeq, uint64_t& lastSeq)
+{
+    unsigned long long first, last;
+    char tail;
+    if (std::sscanf(name, "run-%llu-%llu.ls%c", &first, &last, &tail) != 3 || tail != 'm' ||
+        std::strlen(name) != fileName(first, last).size()) {
+        return false;
+    }
+    firstSeq = first;
+    lastSeq = last;
+    return true;
+}
+
+/**
+* Reads exactly length bytes at offset, or throws.
+*/
+template<class Key, class Value>
+void SortedRun<Key, Value>::readAt(int fd, char* data, size_t length, uint64_t offset)
+{
+    while (length > 0) {
+        ssize_t got = ::pread(fd, data, length, static_cast<off_t>(offset));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            throw std::runtime_error("Short read from run file");
+        }
+        data += got;
+        length -= static_cast<size_t>(got);
+        offset += static_cast<uint64_t>(got);
+    }
+}
+
+/**
+* Opens a finished run file and loads its footer.
+*/
+template<class Key, class Value>
+std::shared_ptr<SortedRun<Key, Value> >
+SortedRun<Key, Value>::open(const std::string& path, uint64_t firstSeq, uint64_t lastSeq)
+{
+    std::shared_ptr<SortedRun> run(new SortedRun());
+    run -> path_ = path;
+    run -> firstSeq_ = firstSeq;
+    run -> lastSeq_ = lastSeq;
+    run -> fd_ = ::open(path.c_str(), O_RDONLY);
+    if (run -> fd_ < 0) {
+        throw std::runtime_error("Cannot open run file " + path);
+    }
+
+    struct stat info;
+    if (::fstat(run -> fd_, &info) != 0 || static_cast<uint64_t>(info.st_size) < HEADER_SIZE + TRAILER_SIZE) {
+        throw std::runtime_error("Truncated run file " + path);
+    }
+    uint64_t size = static_cast<uint64_t>(info.st_size);
+
+    char trailer[TRAILER_SIZE];
+    readAt(run -> fd_, trailer, TRAILER_SIZE, size - TRAILER_SIZE);
+    uint64_t footerOffset, footerLength;
+    const char* p = RunCodec<uint64_t>::decode(trailer, trailer + TRAILER_SIZE, footerOffset);
+    p = RunCodec<uint64_t>::decode(p, trailer + TRAILER_SIZE, footerLength);
+    if (std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0 || footerOffset < HEADER_SIZE ||
+        footerOffset + footerLength + TRAILER_SIZE != size) {
+        throw std::runtime_error("Corrupt run file " + path);
+    }
+
+    std::vector<char> footer(footerLength);
+    readAt(run -> fd_, footer.data(), footer.size(), footerOffset);
+    const char* end = footer.data() + footer.size();
+    uint64_t indexCount;
+    p = RunCodec<uint64_t>::decode(footer.data(), end, run -> count_);
+    p = run -> bloom_.decode(p, end);
+    p = RunCodec<uint64_t>::decode(p, end, indexCount);
+    run -> index_.resize(indexCount);
+    for (uint64_t i = 0; i < indexCount; ++i) {
+        p = RunCodec<uint64_t>::decode(p, end, run -> index_[i].second);
+        p = RunCodec<Key>::decode(p, end, run -> index_[i].first);
+    }
+    run -> dataEnd_ = footerOffset;
+    return run;
+}
+
+/**
+* A record is its length, a live flag, the key and, if live, the value.
+*/
+template<class Key, class Value>
+void SortedRun<Key, Value>::encodeRecord(std::string& out, const Key& key, const Entry& entry)
+{
+    size_t start = out.size();
+    RunCodec<uint32_t>::encode(out, 0);
+    out.push_back(entry.live ? 1 : 0);
+    RunCodec<Key>::encode(out, key);
+    if (entry.live) {
+        RunCodec<Value>::encode(out, entry.value);
+    }
+    uint32_t length = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t));
+    std::memcpy(&out[start], &length, sizeof(length));
+}
+
+/**
+* Decodes the record body between p and end, after its length.
+*/
+template<class Key, class Value>
+const char* SortedRun<Key, Value>::decodeRecord(const char* p, const char* end, Key& key, Entry& entry)
+{
+    if (p == end) {
+        throw std::runtime_error("Corrupt run record");
+    }
+    entry.live = (*p++ != 0);
+    p = RunCodec<Key>::decode(p, end, key);
+    if (entry.live) {
+        p = RunCodec<Value>::decode(p, end, entry.value);
+    }
+    return p;
+}
+
+/**
+* Returns the index block whose first key is the last one <= key, or
+* index_.size() if key is before the first record.
+*/
+template<class Key, class Value>
+size_t SortedRun<Key, Value>::indexBlock(const Key& key) const
+{
+    size_t lo = 0, hi = index_.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (key < index_[mid].first) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return (lo == 0) ? index_.size() : lo - 1;
+}
+
+/**
+* Looks key up with one read of the index block that could hold it.
+* Returns true if the run has the key, as a value or a tombstone.
+*/
+template<class Key, class Value>
+bool SortedRun<Key, Value>::find(const Key& key, uint64_t hash, Entry& entry) const
+{
+    if (!bloom_.mayContain(hash)) {
+        return false;
+    }
+    size_t block = indexBlock(key);
+    if (block == index_.size()) {
+        return false;
+    }
+    uint64_t start = index_[block].second;
+    uint64_t end = (block + 1 < index_.size()) ? index_[block + 1].second : dataEnd_;
+    std::vector<char> data(end - start);
+    readAt(fd_, data.data(), data.size(), start);
+
+    const char* p = data.data();
+    const char* last = p + data.size();
+    Key found;
+    while (p < last) {
+        uint32_t length;
+        p = RunCodec<uint32_t>::decode(p, last, length);
+        if (static_cast<size_t>(last - p) < length) {
+            throw std::runtime_error("Corrupt run record");
+        }
+        decodeRecord(p, p + length, found, entry);
+        if (!(found < key)) {
+            return !(key < found);
+        }
+        p += length;
+    }
+    return false;
+}
+
+/**
+* Returns the offset of the index block a scan starting at key begins in.
+*/
+template<class Key, class Value>
+uint64_t SortedRun<Key, Value>::seekOffset(const Key& key) const
+{
+    size_t block = indexBlock(key);
+    return (block == index_.size()) ? HEADER_SIZE : index_[block].second;
+}
+
+template<class Key, class Value>
+uint64_t SortedRun<Key, Value>::count() const
+{
+    return count_;
+}
+
+template<class Key, class Value>
+uint64_t SortedRun<Key, Value>::firstSeq() const
+{
+    return firstSeq_;
+}
+
+template<class Key, class Value>
+uint64_t SortedRun<Key, Value>::lastSeq() const
+{
+    return lastSeq_;
+}
+
+template<class Key, class Value>
+const std::string& SortedRun<Key, Value>::path() const
+{
+    return path_;
+}
+
+template<class Key, class Value>
+SortedRun<Key, Value>::Cursor::Cursor(const std::shared_ptr<const SortedRun>& run, uint64_t offset) :
+    run_(run), buffer_(1 << 16), begin_(0), end_(0), fileOffset_(offset), valid_(true), key_(), entry_()
+{
+    next();
+}
+
+template<class Key, class Value>
+bool SortedRun<Key, Value>::Cursor::valid() const
+{
+    return valid_;
+}
+
+template<class Key, class Value>
+const Key& SortedRun<Key, Value>::Cursor::key() const
+{
+    return key_;
+}
+
+template<class Key, class Value>
+const LSMEntry<Value>& SortedRun<Key, Value>::Cursor::entry() const
+{
+    return entry_;
+}
+
+/**
+* Makes sure the buffer holds at least needed unread bytes, reading more
+* of the file if it can. Returns false at the end of the records.
+*/
+template<class Key, class Value>
+bool SortedRun<Key, Value>::Cursor::fill(size_t needed)
+{
+    if (end_ - begin_ >= needed) {
+        return true;
+    }
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+    if (buffer_.size() < needed) {
+        buffer_.resize(needed);
+    }
+    uint64_t left = run_ -> dataEnd_ - fileOffset_;
+    size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer_.size() - end_, left));
+    readAt(run_ -> fd_, buffer_.data() + end_, chunk, fileOffset_);
+    end_ += chunk;
+    fileOffset_ += chunk;
+    return end_ - begin_ >= needed;
+}
+
+template<class Key, class Value>
+void SortedRun<Key, Value>::Cursor::next()
+{
+    uint32_t length;
+    if (!fill(sizeof(length))) {
+        valid_ = false;
+        return;
+    }
+    std::memcpy(&length, buffer_.data() + begin_, sizeof(length));
+    if (!fill(sizeof(length) + length)) {
+        throw std::runtime_error("Corrupt run record");
+    }
+    const char* body = buffer_.data() + begin_ + sizeof(length);
+    decodeRecord(body, body + length, key_, entry_);
+    begin_ += sizeof(length) + length;
+}
+
+/*
+  --------------------------------------------
+  End implementations for the SortedRun class.
+  --------------------------------------------
+*/
+
+/*
+  ----------------------------------------------
+  Begin implementations for the RunWriter class.
+  ----------------------------------------------
+*/
+
+template<class Key, class Value>
+RunWriter<Key, Value>::RunWriter(const std::string& path, size_t expected, const LSMOptions& options) :
+    fd_(-1), path_(path), offset_(0), count_(0), interval_(std::max<size_t>(options.indexInterval, 1)), indexCount_(0)
+{
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot create run file " + path);
+    }
+    bloom_.reset(expected, options.bloomBitsPerKey);
+    buffer_.append(SortedRun<Key, Value>::MAGIC, SortedRun<Key, Value>::HEADER_SIZE);
+}
+
+/**
+* Removes the file if finish() was never reached.
+*/
+template<class Key, class Value>
+RunWriter<Key, Value>::~RunWriter()
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+        ::unlink(path_.c_str());
+    }
+}
+
+template<class Key, class Value>
+void RunWriter<Key, Value>::flushBuffer()
+{
+    const char* data = buffer_.data();
+    size_t left = buffer_.size();
+    while (left > 0) {
+        ssize_t wrote = ::write(fd_, data, left);
+        if (wrote < 0 && errno == EINTR) {
+            continue;
+        }
+        if (wrote <= 0) {
+            throw std::runtime_error("Cannot write run file " + path_);
+        }
+        data += wrote;
+        left -= static_cast<size_t>(wrote);
+    }
+    offset_ += buffer_.size();
+    buffer_.clear();
+}
+
+/**
+* Appends a record. Keys must come in increasing order.
+*/
+template<class Key, class Value>
+void RunWriter<Key, Value>::add(const Key& key, const Entry& entry, uint64_t hash)
+{
+    if (count_ % interval_ == 0) {
+        RunCodec<uint64_t>::encode(index_, offset_ + buffer_.size());
+        RunCodec<Key>::encode(index_, key);
+        ++indexCount_;
+    }
+    SortedRun<Key, Value>::encodeRecord(buffer_, key, entry);
+    bloom_.add(hash);
+    ++count_;
+    if (buffer_.size() >= (1 << 20)) {
+        flushBuffer();
+    }
+}
+
+template<class Key, class Value>
+uint64_t RunWriter<Key, Value>::count() const
+{
+    return count_;
+}
+
+/**
+* Writes the footer and trailer, syncs the file and renames it to
+* finalPath.
+*/
+template<class Key, class Value>
+void RunWriter<Key, Value>::finish(const std::string& finalPath)
+{
+    uint64_t footerOffset = offset_ + buffer_.size();
+    std::string footer;
+    RunCodec<uint64_t>::encode(footer, count_);
+    bloom_.encode(footer);
+    RunCodec<uint64_t>::encode(footer, indexCount_);
+    footer.append(index_);
+
+    buffer_.append(footer);
+    RunCodec<uint64_t>::encode(buffer_, footerOffset);
+    RunCodec<uint64_t>::encode(buffer_, static_cast<uint64_t>(footer.size()));
+    buffer_.append(SortedRun<Key, Value>::MAGIC, sizeof(SortedRun<Key, Value>::MAGIC));
+    flushBuffer();
+
+    if (::fsync(fd_) != 0 || ::close(fd_) != 0) {
+        fd_ = -1;
+        ::unlink(path_.c_str());
+        throw std::runtime_error("Cannot sync run file " + path_);
+    }
+    fd_ = -1;
+    if (::rename(path_.c_str(), finalPath.c_str()) != 0) {
+        ::unlink(path_.c_str());
+        throw std::runtime_error("Cannot rename run file " + path_);
+    }
+}
+
+/*
+  --------------------------------------------
+  End implementations for the RunWriter class.
+  --------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LSMStore class.
+  ---------------------------------------------
+*/
+
+/**
+* A source over entries copied out of a memtable.
+*/
+template<class Key, class Value, class KeyHash>
+struct LSMStore<Key, Value, KeyHash>::MergeIterator::TableSource : public Source {
+    std::vector<std::pair<Key, Entry> > items;
+    size_t pos;
+
+    TableSource() : pos(0) {}
+    virtual bool valid() const { return pos < items.size(); }
+    virtual const Key& key() const { return items[pos].first; }
+    virtual const Entry& entry() const { return items[pos].second; }
+    virtual void next() { ++pos; }
+};
+
+/**
+* A source over one run, from the first record >= lo.
+*/
+template<class Key, class Value, class KeyHash>
+struct LSMStore<Key, Value, KeyHash>::MergeIterator::RunSource : public Source {
+    typename Run::Cursor cursor;
+
+    RunSource(const std::shared_ptr<const Run>& run, const Key* lo) :
+        cursor(run, lo == NULL ? Run::HEADER_SIZE : run -> seekOffset(*lo))
+    {
+        while (lo != NULL && cursor.valid() && cursor.key() < *lo) {
+            cursor.next();
+        }
+    }
+    virtual bool valid() const { return cursor.valid(); }
+    virtual const Key& key() const { return cursor.key(); }
+    virtual const Entry& entry() const { return cursor.entry(); }
+    virtual void next() { cursor.next(); }
+};
+
+/**
+* Heap order: smallest key on top, and the newest source among equal keys.
+*/
+template<class Key, class Value, class KeyHash>
+struct LSMStore<Key, Value, KeyHash>::MergeIterator::Newer {
+    bool operator()(const Source* a, const Source* b) const
+    {
+        if (b -> key() < a -> key()) {
+            return true;
+        }
+        if (a -> key() < b -> key()) {
+            return false;
+        }
+        return a -> rank < b -> rank;
+    }
+};
+
+template<class Key, class Value, class KeyHash>
+LSMStore<Key, Value, KeyHash>::MergeIterator::MergeIterator(bool skipTombstones, const Key* hi) :
+    skipTombstones_(skipTombstones), bounded_(hi != NULL), hi_(hi != NULL ? *hi : Key()), valid_(false), key_(), entry_()
+{
+
+}
+
+/**
+* Takes ownership of source, which must be added oldest first.
+*/
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::MergeIterator::add(Source* source)
+{
+    source -> rank = static_cast<unsigned>(sources_.size());
+    sources_.push_back(std::shared_ptr<Source>(source));
+    if (source -> valid()) {
+        heap_.push_back(source);
+        std::push_heap(heap_.begin(), heap_.end(), Newer());
+    }
+}
+
+/**
+* Moves to the next key in any source, takes its newest entry and steps
+* every source past it; repeats while that entry is a skipped tombstone.
+*/
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::MergeIterator::settle()
+{
+    while (!heap_.empty()) {
+        Source* top = heap_.front();
+        if (bounded_ && hi_ < top -> key()) {
+            heap_.clear();
+            break;
+        }
+        key_ = top -> key();
+        entry_ = top -> entry();
+
+        while (!heap_.empty() && !(key_ < heap_.front() -> key())) {
+            Source* source = heap_.front();
+            std::pop_heap(heap_.begin(), heap_.end(), Newer());
+            heap_.pop_back();
+            source -> next();
+            if (source -> valid()) {
+                heap_.push_back(source);
+                std::push_heap(heap_.begin(), heap_.end(), Newer());
+            }
+        }
+
+        if (entry_.live || !skipTombstones_) {
+            valid_ = true;
+            return;
+        }
+    }
+    valid_ = false;
+}
+
+template<class Key, class Value, class KeyHash>
+bool LSMStore<Key, Value, KeyHash>::MergeIterator::valid() const
+{
+    return valid_;
+}
+
+template<class Key, class Value, class KeyHash>
+const Key& LSMStore<Key, Value, KeyHash>::MergeIterator::key() const
+{
+    return key_;
+}
+
+template<class Key, class Value, class KeyHash>
+const LSMEntry<Value>& LSMStore<Key, Value, KeyHash>::MergeIterator::entry() const
+{
+    return entry_;
+}
+
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::MergeIterator::next()
+{
+    settle();
+}
+
+/**
+* Opens, or creates, the store in directory and starts its background
+* threads.
+*/
+template<class Key, class Value, class KeyHash>
+LSMStore<Key, Value, KeyHash>::LSMStore(const std::string& directory, const LSMOptions& options) :
+    directory_(directory), options_(options), memtable_(new Memtable()), nextSeq_(1),
+    activeCompactions_(0), stopping_(false)
+{
+    options_.memtableLimit = std::max<size_t>(options_.memtableLimit, 1);
+    options_.compactionFanIn = std::max<size_t>(options_.compactionFanIn, 2);
+    if (::mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Cannot create store directory " + directory_);
+    }
+    recover();
+
+    flusher_ = std::thread(&LSMStore::flushLoop, this);
+    for (unsigned i = 0; i < options_.compactionThreads; ++i) {
+        compactors_.push_back(std::thread(&LSMStore::compactLoop, this));
+    }
+}
+
+/**
+* Flushes the memtable, lets running compactions stop early, and joins
+* the background threads.
+*/
+template<class Key, class Value, class KeyHash>
+LSMStore<Key, Value, KeyHash>::~LSMStore()
+{
+    try {
+        flush();
+    }
+    catch (const std::exception&) {
+        // nothing to report to from a destructor; the runs on disk are intact
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stopping_ = true;
+    }
+    flushWake_.notify_all();
+    compactWake_.notify_all();
+    flusher_.join();
+    for (size_t i = 0; i < compactors_.size(); ++i) {
+        compactors_[i].join();
+    }
+}
+
+/**
+* Loads the run files in the directory. Leftover temporary files are
+* removed, and so are runs covered by a merged run whose inputs were not
+* all deleted before a crash.
+*/
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::recover()
+{
+    std::vector<std::pair<uint64_t, uint64_t> > found;
+    DIR* dir = ::opendir(directory_.c_str());
+    if (dir == NULL) {
+        throw std::runtime_error("Cannot read store directory " + directory_);
+    }
+    while (struct dirent* item = ::readdir(dir)) {
+        std::string name = item -> d_name;
+        uint64_t first, last;
+        if (Run::parseFileName(name.c_str(), first, last)) {
+            found.push_back(std::make_pair(first, last));
+        }
+        else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) {
+            ::unlink(pathOf(name).c_str());
+        }
+    }
+    ::closedir(dir);
+
+    // widest first among runs that start together, so covered runs come later
+    std::sort(found.begin(), found.end(),
+              [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+                  return a.first < b.first || (a.first == b.first && a.second > b.second);
+              });
+    uint64_t covered = 0;
+    for (size_t i = 0; i < found.size(); ++i) {
+        std::string path = pathOf(Run::fileName(found[i].first, found[i].second));
+        if (found[i].second <= covered) {
+            ::unlink(path.c_str());
+            continue;
+        }
+        runs_.push_back(Run::open(path, found[i].first, found[i].second));
+        covered = found[i].second;
+        nextSeq_ = covered + 1;
+    }
+}
+
+template<class Key, class Value, class KeyHash>
+std::string LSMStore<Key, Value, KeyHash>::pathOf(const std::string& name) const
+{
+    return directory_ + "/" + name;
+}
+
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::checkError() const
+{
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+}
+
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Entry entry = { keyValuePair.second, true };
+    write(keyValuePair.first, entry);
+}
+
+/**
+* Records a tombstone for key, whether or not the key exists.
+*/
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::remove(const Key& key)
+{
+    Entry entry = { Value(), false };
+    write(key, entry);
+}
+
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::write(const Key& key, const Entry& entry)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    checkError();
+    memtable_ -> insert(std::make_pair(key, entry));
+    if (memtable_ -> size() >= options_.memtableLimit) {
+        freeze(guard);
+    }
+}
+
+/**
+* Hands the memtable to the flush thread and starts a new one, first
+* waiting for the previous one to be written out.
+*/
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::freeze(std::unique_lock<std::mutex>& guard)
+{
+    changed_.wait(guard, [this]() { return !frozen_ || !error_.empty(); });
+    checkError();
+    if (memtable_ -> empty()) {
+        return;
+    }
+    frozen_ = memtable_;
+    memtable_.reset(new Memtable());
+    flushWake_.notify_one();
+}
+
+/**
+* Returns true and sets value if key has a live value.
+*/
+template<class Key, class Value, class KeyHash>
+bool LSMStore<Key, Value, KeyHash>::find(const Key& key, Value& value) const
+{
+    std::vector<std::shared_ptr<Run> > runs;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        const Memtable* tables[2] = { memtable_.get(), frozen_.get() };
+        for (int i = 0; i < 2; ++i) {
+            if (tables[i] == NULL) {
+                continue;
+            }
+            typename Memtable::iterator it = tables[i] -> find(key);
+            if (it != tables[i] -> end()) {
+                if (it -> second.live) {
+                    value = it -> second.value;
+                }
+                return it -> second.live;
+            }
+        }
+        runs = runs_;
+    }
+
+    // newest first; the files stay open while the snapshot holds them
+    uint64_t hash = lsmMix(static_cast<uint64_t>(KeyHash()(key)));
+    Entry entry;
+    for (size_t i = runs.size(); i-- > 0; ) {
+        if (runs[i] -> find(key, hash, entry)) {
+            if (entry.live) {
+                value = entry.value;
+            }
+            return entry.live;
+        }
+    }
+    return false;
+}
+
+template<class Key, class Value, class KeyHash>
+bool LSMStore<Key, Value, KeyHash>::contains(const Key& key) const
+{
+    Value value;
+    return find(key, value);
+}
+
+/**
+ * @precondition The key exists in the store
+ * Returns a copy of the value associated with the key
+ */
+template<class Key, class Value, class KeyHash>
+Value LSMStore<Key, Value, KeyHash>::get(const Key& key) const
+{
+    Value value;
+    if (!find(key, value)) throw std::out_of_range("Invalid key");
+    return value;
+}
+
+/**
+* Returns a merge iterator over the live entries with lo <= key <= hi.
+* The memtables' entries in range are copied, so the iterator sees the
+* store as it was when range() was called and holds no lock.
+*/
+template<class Key, class Value, class KeyHash>
+typename LSMStore<Key, Value, KeyHash>::MergeIterator
+LSMStore<Key, Value, KeyHash>::range(const Key& lo, const Key& hi) const
+{
+    typedef typename MergeIterator::TableSource TableSource;
+    MergeIterator merged(true, &hi);
+    std::vector<std::shared_ptr<Run> > runs;
+    std::unique_ptr<TableSource> tables[2] = {
+        std::unique_ptr<TableSource>(new TableSource()), std::unique_ptr<TableSource>(new TableSource())
+    };
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        runs = runs_;
+        const Memtable* sources[2] = { frozen_.get(), memtable_.get() };
+        for (int i = 0; i < 2; ++i) {
+            std::vector<std::pair<Key, Entry> >& items = tables[i] -> items;
+            if (sources[i] != NULL) {
+                sources[i] -> scan(lo, hi, [&items](const std::pair<const Key, Entry>& item) {
+                    items.push_back(item);
+                });
+            }
+        }
+    }
+
+    // oldest first, so that newer sources get higher ranks
+    for (size_t i = 0; i < runs.size(); ++i) {
+        merged.add(new typename MergeIterator::RunSource(runs[i], &lo));
+    }
+    merged.add(tables[0].release());
+    merged.add(tables[1].release());
+    merged.settle();
+    return merged;
+}
+
+/**
+* Calls callback on the item of every live entry with lo <= key <= hi, in
+* order, like the in-memory trees' scan().
+*/
+template<class Key, class Value, class KeyHash>
+template<typename Callback>
+void LSMStore<Key, Value, KeyHash>::scan(const Key& lo, const Key& hi, Callback callback) const
+{
+    for (MergeIterator it = range(lo, hi); it.valid(); it.next()) {
+        const std::pair<const Key, Value> item(it.key(), it.entry().value);
+        callback(item);
+    }
+}
+
+/**
+* Writes everything in the memtable to a run and waits until it is on
+* disk.
+*/
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::flush()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    checkError();
+    freeze(guard);
+    changed_.wait(guard, [this]() { return !frozen_ || !error_.empty(); });
+    checkError();
+}
+
+/**
+* Waits until no compaction is running or due.
+*/
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::waitForCompactions()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    size_t first;
+    changed_.wait(guard, [this, &first]() {
+        return !error_.empty() || (!frozen_ && activeCompactions_ == 0 && !pickCompaction(first));
+    });
+    checkError();
+}
+
+template<class Key, class Value, class KeyHash>
+size_t LSMStore<Key, Value, KeyHash>::runCount() const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return runs_.size();
+}
+
+/**
+* A run's size tier: 0 up to one memtable, and one more for every
+* compactionFanIn times that.
+*/
+template<class Key, class Value, class KeyHash>
+unsigned LSMStore<Key, Value, KeyHash>::tier(const Run& run) const
+{
+    unsigned level = 0;
+    uint64_t limit = options_.memtableLimit;
+    while (run.count() > limit && level < 32) {
+        limit *= options_.compactionFanIn;
+        ++level;
+    }
+    return level;
+}
+
+/**
+* Finds compactionFanIn adjacent runs of one tier that no other thread is
+* merging, preferring the newest. Overwrites and deletes can leave runs
+* of different tiers interleaved, so once there are more than
+* compactionFanIn squared runs the cheapest free window is merged
+* whatever its tiers. Called with the lock held.
+*/
+template<class Key, class Value, class KeyHash>
+bool LSMStore<Key, Value, KeyHash>::pickCompaction(size_t& first) const
+{
+    size_t width = options_.compactionFanIn;
+    if (options_.compactionThreads == 0 || runs_.size() < width) {
+        return false;
+    }
+    bool crowded = runs_.size() > width * width;
+    uint64_t cheapest = 0;
+    bool found = false;
+
+    for (size_t start = runs_.size() - width + 1; start-- > 0; ) {
+        unsigned level = tier(*runs_[start]);
+        bool free = true;
+        bool sameTier = true;
+        uint64_t cost = 0;
+        for (size_t i = start; i < start + width && free; ++i) {
+            free = !runs_[i] -> compacting_;
+            sameTier = sameTier && tier(*runs_[i]) == level;
+            cost += runs_[i] -> count();
+        }
+        if (free && sameTier) {
+            first = start;
+            return true;
+        }
+        if (free && crowded && (!found || cost < cheapest)) {
+            first = start;
+            cheapest = cost;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+* Writes a frozen memtable to a run file by walking it in order.
+*/
+template<class Key, class Value, class KeyHash>
+std::shared_ptr<SortedRun<Key, Value> >
+LSMStore<Key, Value, KeyHash>::writeMemtable(const Memtable& table, uint64_t seq)
+{
+    std::string name = Run::fileName(seq, seq);
+    RunWriter<Key, Value> writer(pathOf(name + ".tmp"), table.size(), options_);
+    for (typename Memtable::iterator it = table.begin(); it != table.end(); ++it) {
+        writer.add(it -> first, it -> second, lsmMix(static_cast<uint64_t>(KeyHash()(it -> first))));
+    }
+    writer.finish(pathOf(name));
+    syncDirectory();
+    return Run::open(pathOf(name), seq, seq);
+}
+
+/**
+* Merges adjacent runs, oldest first, into one covering all of them.
+* Returns NULL if nothing is left, or if the store is shutting down.
+*/
+template<class Key, class Value, class KeyHash>
+std::shared_ptr<SortedRun<Key, Value> >
+LSMStore<Key, Value, KeyHash>::mergeRuns(const std::vector<std::shared_ptr<Run> >& inputs, bool dropTombstones)
+{
+    uint64_t expected = 0;
+    MergeIterator merged(dropTombstones, NULL);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        expected += inputs[i] -> count();
+        merged.add(new typename MergeIterator::RunSource(inputs[i], NULL));
+    }
+    merged.settle();
+
+    std::string name = Run::fileName(inputs.front() -> firstSeq(), inputs.back() -> lastSeq());
+    RunWriter<Key, Value> writer(pathOf(name + ".tmp"), static_cast<size_t>(expected), options_);
+    for (unsigned steps = 0; merged.valid(); merged.next()) {
+        if (++steps % 4096 == 0 && stopping_) {
+            return std::shared_ptr<Run>();
+        }
+        writer.add(merged.key(), merged.entry(), lsmMix(static_cast<uint64_t>(KeyHash()(merged.key()))));
+    }
+    if (writer.count() == 0) {
+        return std::shared_ptr<Run>();
+    }
+    writer.finish(pathOf(name));
+    syncDirectory();
+    return Run::open(pathOf(name), inputs.front() -> firstSeq(), inputs.back() -> lastSeq());
+}
+
+/**
+* Makes renames and removals in the directory durable.
+*/
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::syncDirectory() const
+{
+    int fd = ::open(directory_.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::flushLoop()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    while (true) {
+        flushWake_.wait(guard, [this]() { return stopping_ || frozen_; });
+        if (!frozen_) {
+            break;
+        }
+        std::shared_ptr<Memtable> table = frozen_;
+        uint64_t seq = nextSeq_++;
+
+        // the frozen table is only read from here on, so readers can share it
+        guard.unlock();
+        std::shared_ptr<Run> run;
+        std::string failure;
+        try {
+            run = writeMemtable(*table, seq);
+        }
+        catch (const std::exception& e) {
+            failure = e.what();
+        }
+        guard.lock();
+
+        if (!failure.empty()) {
+            error_ = failure;
+            changed_.notify_all();
+            break;
+        }
+        runs_.push_back(run);
+        frozen_.reset();
+        changed_.notify_all();
+        compactWake_.notify_all();
+    }
+}
+
+template<class Key, class Value, class KeyHash>
+void LSMStore<Key, Value, KeyHash>::compactLoop()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    while (!stopping_ && error_.empty()) {
+        size_t first;
+        if (!pickCompaction(first)) {
+            compactWake_.wait(guard);
+            continue;
+        }
+        std::vector<std::shared_ptr<Run> > inputs(runs_.begin() + first,
+                                                  runs_.begin() + first + options_.compactionFanIn);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            inputs[i] -> compacting_ = true;
+        }
+        // nothing older can hold a value a tombstone still has to hide
+        bool bottom = (first == 0);
+        ++activeCompactions_;
+
+        guard.unlock();
+        std::shared_ptr<Run> output;
+        std::string failure;
+        try {
+            output = mergeRuns(inputs, bottom);
+        }
+        catch (const std::exception& e) {
+            failure = e.what();
+        }
+        guard.lock();
+
+        --activeCompactions_;
+        if (!failure.empty() || (stopping_ && !output)) {
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                inputs[i] -> compacting_ = false;
+            }
+            if (!failure.empty()) {
+                error_ = failure;
+            }
+            changed_.notify_all();
+            break;
+        }
+
+        // flushes only append and other merges replace their own runs, so
+        // the inputs are still adjacent
+        typename std::vector<std::shared_ptr<Run> >::iterator at =
+            std::find(runs_.begin(), runs_.end(), inputs.front());
+        at = runs_.erase(at, at + inputs.size());
+        if (output) {
+            runs_.insert(at, output);
+        }
+
+        // oldest first, so a crash part way leaves only newer inputs behind
+        guard.unlock();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            ::unlink(inputs[i] -> path().c_str());
+        }
+        syncDirectory();
+        guard.lock();
+
+        changed_.notify_all();
+        compactWake_.notify_all();
+    }
+}
+
+/*
+  -------------------------------------------
+  End implementations for the LSMStore class.
+  -------------------------------------------
+*/
+
+#endif
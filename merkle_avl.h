@@ -0,0 +1,419 @@
+#ifndef MERKLE_AVL_H
+#define MERKLE_AVL_H
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also records a hash of its own item and the combined
+* hash of every item in its subtree.
+*
+* The subtree hash is the wrapping sum of the item hashes under it, so it
+* depends only on which items a subtree holds and not on its shape. Two
+* replicas built in different orders still agree on the hash of any key
+* range, which is what lets diff() compare them range by range.
+*/
+template <typename Key, typename Value, typename KeyHash, typename ValueHash>
+class MerkleNode : public AVLNode<Key, Value>
+{
+public:
+    MerkleNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~MerkleNode();
+
+    uint64_t getItemHash() const;
+    uint64_t getSubtreeHash() const;
+    void setHashes(uint64_t itemHash, uint64_t subtreeHash);
+    void rehashItem();
+    virtual void refresh() override;
+    virtual bool isFresh() const override;
+    virtual void copySummary(const AVLNode<Key, Value>* source) override;
+
+protected:
+    static uint64_t mix(uint64_t h);
+    uint64_t computeSubtreeHash() const;
+
+    uint64_t itemHash_;
+    uint64_t subtreeHash_;
+};
+
+/**
+* An AVLTree that keeps a hash of every subtree up to date, so two
+* replicas can be compared by their root hashes in O(1) and reconciled
+* with diff() without walking the parts they agree on.
+*
+* AVLTree refreshes the hashes as it changes the shape: insert and remove
+* refresh every node from the change up to the root, adding O(log n) to
+* each update, and eraseRange touches only the split spines.
+*
+* Values changed in place through operator[] or an iterator are not seen;
+* call rehash(key) afterwards, or change them with insert/insertOrAssign.
+*/
+template <typename Key, typename Value,
+          typename KeyHash = std::hash<Key>, typename ValueHash = std::hash<Value> >
+class MerkleAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef MerkleNode<Key, Value, KeyHash, ValueHash> HashNode;
+
+    MerkleAVLTree();
+    MerkleAVLTree(const MerkleAVLTree& other);
+    MerkleAVLTree(MerkleAVLTree&& other);
+    MerkleAVLTree& operator=(const MerkleAVLTree& other);
+    MerkleAVLTree& operator=(MerkleAVLTree&& other);
+
+    uint64_t rootHash() const;
+    uint64_t rangeHash(const Key& lo, const Key& hi) const;
+    void rehash(const Key& key);
+    void diff(const MerkleAVLTree& other, std::vector<Key>& differences) const;
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) override;
+    virtual std::pair<Node<Key, Value>*, bool> insertNode(const std::pair<const Key, Value>& keyValuePair, bool overwrite) override;
+
+    HashNode* root() const;
+
+    uint64_t hashBelow(const Key* bound, bool inclusive) const;
+    uint64_t hashBetween(const Key* lo, const Key* hi) const;
+    void collectBetween(const HashNode* node, const Key* lo, const Key* hi, std::vector<Key>& keys) const;
+    void diffSubtree(const HashNode* node, const Key* lo, const Key* hi,
+                     const MerkleAVLTree& other, std::vector<Key>& differences) const;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the MerkleNode class.
+  --------------------------------------------------
+*/
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+MerkleNode<Key, Value, KeyHash, ValueHash>::MerkleNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), itemHash_(0), subtreeHash_(0)
+{
+    rehashItem();
+    subtreeHash_ = itemHash_;
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+MerkleNode<Key, Value, KeyHash, ValueHash>::~MerkleNode()
+{
+
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+uint64_t MerkleNode<Key, Value, KeyHash, ValueHash>::getItemHash() const
+{
+    return itemHash_;
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+uint64_t MerkleNode<Key, Value, KeyHash, ValueHash>::getSubtreeHash() const
+{
+    return subtreeHash_;
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+void MerkleNode<Key, Value, KeyHash, ValueHash>::setHashes(uint64_t itemHash, uint64_t subtreeHash)
+{
+    itemHash_ = itemHash;
+    subtreeHash_ = subtreeHash;
+}
+
+/**
+* Hashes the key and value together. std::hash is the identity for many
+* integer types, so each goes through a 64-bit finalizer (splitmix64) to
+* spread it before it is summed with its neighbours. The finalizer maps 0
+* to 0, so the golden-ratio step is added before each round; otherwise
+* the item (0, 0) would hash to 0 and vanish from every sum.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+void MerkleNode<Key, Value, KeyHash, ValueHash>::rehashItem()
+{
+    uint64_t h = mix(static_cast<uint64_t>(KeyHash()(this -> getKey())) + 0x9E3779B97F4A7C15ULL);
+    itemHash_ = mix(h + static_cast<uint64_t>(ValueHash()(this -> getValue())) + 0x9E3779B97F4A7C15ULL);
+}
+
+/**
+* The splitmix64 finalizer.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+uint64_t MerkleNode<Key, Value, KeyHash, ValueHash>::mix(uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+uint64_t MerkleNode<Key, Value, KeyHash, ValueHash>::computeSubtreeHash() const
+{
+    const MerkleNode* left = static_cast<const MerkleNode*>(this -> getLeft());
+    const MerkleNode* right = static_cast<const MerkleNode*>(this -> getRight());
+    uint64_t h = itemHash_;
+    if (left != NULL) {
+        h += left -> subtreeHash_;
+    }
+    if (right != NULL) {
+        h += right -> subtreeHash_;
+    }
+    return h;
+}
+
+/**
+* Recomputes this node's subtree hash from its children's.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+void MerkleNode<Key, Value, KeyHash, ValueHash>::refresh()
+{
+    subtreeHash_ = computeSubtreeHash();
+}
+
+/**
+* Returns true if the stored subtree hash matches the children's.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+bool MerkleNode<Key, Value, KeyHash, ValueHash>::isFresh() const
+{
+    return subtreeHash_ == computeSubtreeHash();
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+void MerkleNode<Key, Value, KeyHash, ValueHash>::copySummary(const AVLNode<Key, Value>* source)
+{
+    const MerkleNode* original = static_cast<const MerkleNode*>(source);
+    setHashes(original -> itemHash_, original -> subtreeHash_);
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the MerkleNode class.
+  ------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the MerkleAVLTree class.
+  -----------------------------------------------------
+*/
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>::MerkleAVLTree()
+{
+
+}
+
+/**
+* Clones in the body so that cloneNode reaches this class.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>::MerkleAVLTree(const MerkleAVLTree& other) :
+    AVLTree<Key, Value>()
+{
+    this -> cloneFrom(other);
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>::MerkleAVLTree(MerkleAVLTree&& other) :
+    AVLTree<Key, Value>(std::move(other))
+{
+
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>&
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>::operator=(const MerkleAVLTree& other)
+{
+    AVLTree<Key, Value>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>&
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>::operator=(MerkleAVLTree&& other)
+{
+    AVLTree<Key, Value>::operator=(std::move(other));
+    return *this;
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+typename MerkleAVLTree<Key, Value, KeyHash, ValueHash>::HashNode*
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>::root() const
+{
+    return static_cast<HashNode*>(this -> root_);
+}
+
+/**
+* Returns the hash of every item in the tree, or 0 if it is empty. Equal
+* contents give equal hashes whatever the shape.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+uint64_t MerkleAVLTree<Key, Value, KeyHash, ValueHash>::rootHash() const
+{
+    return root() == NULL ? 0 : root() -> getSubtreeHash();
+}
+
+/**
+* Returns the hash of the items with lo <= key <= hi, in O(log n). A
+* replica in another process can send these for halves of a key range to
+* narrow down where it disagrees without sending the items.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+uint64_t MerkleAVLTree<Key, Value, KeyHash, ValueHash>::rangeHash(const Key& lo, const Key& hi) const
+{
+    if (hi < lo) {
+        return 0;
+    }
+    return hashBelow(&hi, true) - hashBelow(&lo, false);
+}
+
+/**
+* Rehashes key's item after its value was changed in place.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+void MerkleAVLTree<Key, Value, KeyHash, ValueHash>::rehash(const Key& key)
+{
+    Node<Key, Value>* node = this -> internalFind(key);
+    if (node == NULL) {
+        throw std::out_of_range("Invalid key");
+    }
+    static_cast<HashNode*>(node) -> rehashItem();
+    this -> refreshToRoot(static_cast<HashNode*>(node));
+}
+
+/**
+* Appends to differences, in key order, every key that is in only one of
+* the two trees or has a different value in each. Subtrees of this tree
+* whose hash matches the same key range of other are skipped, so the cost
+* is O(d log^2 n) for d differences rather than O(n).
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+void MerkleAVLTree<Key, Value, KeyHash, ValueHash>::diff(const MerkleAVLTree& other, std::vector<Key>& differences) const
+{
+    diffSubtree(root(), NULL, NULL, other, differences);
+}
+
+/**
+* Sums the item hashes of the keys below bound (or up to it, if
+* inclusive). A NULL bound means no bound.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+uint64_t MerkleAVLTree<Key, Value, KeyHash, ValueHash>::hashBelow(const Key* bound, bool inclusive) const
+{
+    if (bound == NULL) {
+        return rootHash();
+    }
+    uint64_t h = 0;
+    const HashNode* node = root();
+    while (node != NULL) {
+        const HashNode* left = static_cast<const HashNode*>(node -> getLeft());
+        if (node -> getKey() < *bound || (inclusive && !(*bound < node -> getKey()))) {
+            // node and everything left of it count
+            h += node -> getItemHash();
+            if (left != NULL) {
+                h += left -> getSubtreeHash();
+            }
+            node = static_cast<const HashNode*>(node -> getRight());
+        }
+        else {
+            node = left;
+        }
+    }
+    return h;
+}
+
+/**
+* Sums the item hashes of the keys strictly between lo and hi, where a
+* NULL bound means no bound.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+uint64_t MerkleAVLTree<Key, Value, KeyHash, ValueHash>::hashBetween(const Key* lo, const Key* hi) const
+{
+    return hashBelow(hi, false) - (lo == NULL ? 0 : hashBelow(lo, true));
+}
+
+/**
+* Appends the keys strictly between lo and hi under node, in order.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+void MerkleAVLTree<Key, Value, KeyHash, ValueHash>::collectBetween(
+    const HashNode* node, const Key* lo, const Key* hi, std::vector<Key>& keys) const
+{
+    if (node == NULL) {
+        return;
+    }
+    bool aboveLo = (lo == NULL || *lo < node -> getKey());
+    bool belowHi = (hi == NULL || node -> getKey() < *hi);
+    if (aboveLo) {
+        collectBetween(static_cast<const HashNode*>(node -> getLeft()), lo, hi, keys);
+    }
+    if (aboveLo && belowHi) {
+        keys.push_back(node -> getKey());
+    }
+    if (belowHi) {
+        collectBetween(static_cast<const HashNode*>(node -> getRight()), lo, hi, keys);
+    }
+}
+
+/**
+* node's subtree holds exactly this tree's keys strictly between lo and
+* hi. If other hashes that range the same, the two agree on it; otherwise
+* split it at node's key and compare each side.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+void MerkleAVLTree<Key, Value, KeyHash, ValueHash>::diffSubtree(
+    const HashNode* node, const Key* lo, const Key* hi,
+    const MerkleAVLTree& other, std::vector<Key>& differences) const
+{
+    uint64_t mine = (node == NULL) ? 0 : node -> getSubtreeHash();
+    if (mine == other.hashBetween(lo, hi)) {
+        return;
+    }
+    // nothing here, so everything other has in the range is missing
+    if (node == NULL) {
+        other.collectBetween(other.root(), lo, hi, differences);
+        return;
+    }
+
+    diffSubtree(static_cast<const HashNode*>(node -> getLeft()), lo, &node -> getKey(), other, differences);
+    const Node<Key, Value>* match = other.internalFind(node -> getKey());
+    if (match == NULL || static_cast<const HashNode*>(match) -> getItemHash() != node -> getItemHash()) {
+        differences.push_back(node -> getKey());
+    }
+    diffSubtree(static_cast<const HashNode*>(node -> getRight()), &node -> getKey(), hi, other, differences);
+}
+
+template<class Key, class Value, class KeyHash, class ValueHash>
+AVLNode<Key, Value>* MerkleAVLTree<Key, Value, KeyHash, ValueHash>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return new HashNode(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+/**
+* Inserts through AVLTree, which refreshes a new node's ancestors. An
+* overwritten value changes no shape, so it is rehashed here and
+* refreshed from its own node up.
+*/
+template<class Key, class Value, class KeyHash, class ValueHash>
+std::pair<Node<Key, Value>*, bool>
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>::insertNode(const std::pair<const Key, Value>& keyValuePair, bool overwrite)
+{
+    std::pair<Node<Key, Value>*, bool> result = AVLTree<Key, Value>::insertNode(keyValuePair, overwrite);
+    if (!result.second && overwrite) {
+        static_cast<HashNode*>(result.first) -> rehashItem();
+        this -> refreshToRoot(static_cast<HashNode*>(result.first));
+    }
+    return result;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the MerkleAVLTree class.
+  ---------------------------------------------------
+*/
+
+#endif
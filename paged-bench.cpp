@@ -0,0 +1,185 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "avlbst.h"
+#include "paged_bptree.h"
+
+using namespace std;
+
+// Buffer pool sizes compared, in pages; the last one holds the whole tree.
+static const size_t POOL_PAGES[] = { 64, 1024, 65536 };
+static const int NUM_POOL_SIZES = sizeof(POOL_PAGES) / sizeof(POOL_PAGES[0]);
+
+/**
+* A small xorshift generator, seeded the same for every pass so each pass
+* looks up the same keys.
+*/
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) { }
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/**
+* Asks the kernel to drop the file's pages from its cache, so the next
+* pass reads from the device. Only clean pages are dropped, so call it
+* after the tree has been flushed.
+*/
+static void dropFileCache(const char* path)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd >= 0) {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+/**
+* Looks up keys with the same seed as the build, so every one is found.
+* Returns thousands of finds per second.
+*/
+template<typename Tree>
+double findPass(const Tree& tree, int keys, int lookups)
+{
+    Rng rng(7);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    uint64_t found = 0;
+    for (int i = 0; i < lookups; ++i) {
+        uint64_t key = (rng.next() % keys) * 2;
+        found += (tree.find(key) != tree.end());
+    }
+    double seconds = secondsSince(begin);
+    if (found != static_cast<uint64_t>(lookups)) {
+        cout << "lookup missed keys" << endl;
+        exit(1);
+    }
+    return lookups / seconds / 1e3;
+}
+
+/**
+* Looks up the same keys as findPass with one findBatch call. Returns
+* thousands of finds per second; generating the keys is not timed.
+*/
+template<typename Tree>
+double findBatchPass(const Tree& tree, int keys, int lookups)
+{
+    Rng rng(7);
+    vector<uint64_t> batch(lookups);
+    for (int i = 0; i < lookups; ++i) {
+        batch[i] = (rng.next() % keys) * 2;
+    }
+    vector<typename Tree::iterator> results;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    tree.findBatch(batch, results);
+    double seconds = secondsSince(begin);
+    for (int i = 0; i < lookups; ++i) {
+        if (results[i] == tree.end()) {
+            cout << "batch lookup missed keys" << endl;
+            exit(1);
+        }
+    }
+    return lookups / seconds / 1e3;
+}
+
+/**
+* Iterates over every item. Returns millions of items per second.
+*/
+template<typename Tree>
+double scanPass(const Tree& tree)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    uint64_t items = 0, sum = 0;
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        sum += it -> second;
+        ++items;
+    }
+    double seconds = secondsSince(begin);
+    if (sum == 0 && items > 1) {
+        cout << "scan read nothing" << endl;
+    }
+    return items / seconds / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    int keys = (argc > 1) ? atoi(argv[1]) : 1000000;
+    int lookups = (argc > 2) ? atoi(argv[2]) : 200000;
+    const char* path = (argc > 3) ? argv[3] : "paged-bench.db";
+
+    // build with keys in random order, through a small pool
+    ::unlink(path);
+    {
+        PagedBPlusTree<uint64_t, uint64_t> tree(path, 1024);
+        vector<uint64_t> order(keys);
+        for (int i = 0; i < keys; ++i) {
+            order[i] = static_cast<uint64_t>(i) * 2;
+        }
+        Rng shuffle(99);
+        for (int i = keys - 1; i > 0; --i) {
+            swap(order[i], order[shuffle.next() % (i + 1)]);
+        }
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < keys; ++i) {
+            tree.insert(std::make_pair(order[i], order[i] + 1));
+        }
+        tree.flush();
+        cout << "Built " << keys << " keys in " << fixed << setprecision(2) << secondsSince(begin)
+             << " s: height " << tree.height() << ", " << tree.poolStats().reads << " page reads, "
+             << tree.poolStats().writes << " page writes" << endl;
+    }
+
+    cout << "\nPagedBPlusTree, " << lookups << " random finds and a full scan per pass:" << endl;
+    cout << "pool pages   cold find (Kops/s)   warm find (Kops/s)   cold scan (M/s)   warm scan (M/s)" << endl;
+    for (int i = 0; i < NUM_POOL_SIZES; ++i) {
+        double coldFind, warmFind, coldScan, warmScan;
+        {
+            dropFileCache(path);
+            PagedBPlusTree<uint64_t, uint64_t> tree(path, POOL_PAGES[i]);
+            coldFind = findPass(tree, keys, lookups);
+            warmFind = findPass(tree, keys, lookups);
+        }
+        {
+            dropFileCache(path);
+            PagedBPlusTree<uint64_t, uint64_t> tree(path, POOL_PAGES[i]);
+            coldScan = scanPass(tree);
+            warmScan = scanPass(tree);
+        }
+        cout << setw(10) << POOL_PAGES[i] << fixed << setprecision(2)
+             << setw(21) << coldFind << setw(21) << warmFind
+             << setw(18) << coldScan << setw(18) << warmScan << endl;
+    }
+
+    // the in-memory tree the paged one stands in for
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (int i = 0; i < keys; ++i) {
+            tree.insert(std::make_pair(static_cast<uint64_t>(i) * 2, static_cast<uint64_t>(i) * 2 + 1));
+        }
+        double find = findPass(tree, keys, lookups);
+        double batch = findBatchPass(tree, keys, lookups);
+        cout << "\nAVLTree in memory: find " << fixed << setprecision(2) << find
+             << " Kops/s, findBatch " << batch << " Kops/s (" << batch / find
+             << "x), scan " << scanPass(tree) << " M/s" << endl;
+    }
+
+    ::unlink(path);
+    return 0;
+}
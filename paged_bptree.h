@@ -0,0 +1,1303 @@
+#ifndef PAGED_BPTREE_H
+#define PAGED_BPTREE_H
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+* A fixed number of page-sized frames caching pages of one file, read
+* and written with pread/pwrite. Frames are pinned while in use; when a
+* page is needed and no frame is free, the clock hand sweeps the frames,
+* giving each recently used one a second chance, and evicts the first
+* unpinned one it finds, writing it back first if it is dirty.
+*
+* Not thread-safe.
+*/
+class BufferPool
+{
+public:
+    static const size_t PAGE_SIZE = 4096;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t reads;
+        uint64_t writes;
+    };
+
+    BufferPool(int fd, size_t frames);
+
+    size_t pin(uint32_t page);
+    size_t pinNew(uint32_t page);
+    void unpin(size_t frame);
+    char* data(size_t frame);
+    void markDirty(size_t frame);
+    void flushAll();
+    void reset();
+
+    size_t frameCount() const;
+    const Stats& stats() const;
+
+private:
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    struct Frame {
+        uint32_t page;
+        int pins;
+        bool used;
+        bool dirty;
+        bool referenced;
+    };
+
+    size_t victim();
+    void writeBack(size_t frame);
+
+    int fd_;
+    std::vector<char> memory_;
+    std::vector<Frame> frames_;
+    std::unordered_map<uint32_t, size_t> table_;
+    size_t hand_;
+    Stats stats_;
+};
+
+/**
+* A B+tree stored in a single file of BufferPool::PAGE_SIZE pages, with
+* the insert, remove, find and iterator interface of BinarySearchTree, so
+* a data set that outgrows memory can move to disk without changing the
+* code that uses it.
+*
+* Page 0 holds the tree's metadata. Inner pages hold separator keys and
+* child page numbers; leaf pages hold items in key order and are linked
+* in both directions, so iterating and scanning read each leaf once.
+* Only poolPages pages are in memory at a time.
+*
+* A leaf is freed only when it becomes empty rather than merged with a
+* neighbour when half empty (free-at-empty; Johnson and Shasha show it
+* costs little space under mixed workloads and saves the restructuring).
+* Freed pages are reused before the file grows.
+*
+* Key and Value must be trivially copyable; they are stored byte for
+* byte, so files are only readable on machines like the one that wrote
+* them. Changes reach the file on flush() and in the destructor, and a
+* crash in between can leave it inconsistent. Not thread-safe.
+*/
+template <typename Key, typename Value>
+class PagedBPlusTree
+{
+public:
+    PagedBPlusTree(const std::string& path, size_t poolPages = 1024);
+    ~PagedBPlusTree();
+
+    /**
+    * Walks the items in key order along the leaf chain. The item is a
+    * copy of what is on the page, so changing it does not change the
+    * tree; use insert. Any change to the tree invalidates iterators.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<Key, Value>& operator*() const;
+        const std::pair<Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class PagedBPlusTree<Key, Value>;
+        iterator(const PagedBPlusTree<Key, Value>* tree, uint32_t page, size_t slot);
+        void load();
+
+        const PagedBPlusTree<Key, Value>* tree_;
+        uint32_t page_;
+        size_t slot_;
+        std::pair<Key, Value> item_;
+    };
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    int height() const;
+    void flush();
+    bool validate() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    template<typename Callback>
+    void scan(const Key& lo, const Key& hi, Callback callback) const;
+
+    const BufferPool::Stats& poolStats() const;
+
+private:
+    PagedBPlusTree(const PagedBPlusTree&);
+    PagedBPlusTree& operator=(const PagedBPlusTree&);
+
+    enum PageKind { FREE_PAGE = 0, LEAF_PAGE = 1, INNER_PAGE = 2 };
+
+    // every page starts with kind, count, next and prev; count is items in
+    // a leaf and keys in an inner page, and next links leaves and free pages
+    static const size_t HEADER = 16;
+    static const size_t LEAF_CAPACITY = (BufferPool::PAGE_SIZE - HEADER) / (sizeof(Key) + sizeof(Value));
+    static const size_t INNER_CAPACITY = (BufferPool::PAGE_SIZE - HEADER - sizeof(uint32_t)) / (sizeof(Key) + sizeof(uint32_t));
+
+    static_assert(std::is_trivially_copyable<Key>::value, "PagedBPlusTree keys are stored byte for byte");
+    static_assert(std::is_trivially_copyable<Value>::value, "PagedBPlusTree values are stored byte for byte");
+    static_assert(LEAF_CAPACITY >= 3 && INNER_CAPACITY >= 3, "Key and Value are too large for a page");
+
+    struct Meta {
+        char magic[8];
+        uint32_t pageSize;
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t root;          // 0 when the tree is empty
+        uint32_t firstLeaf;
+        uint32_t freeHead;
+        uint32_t pageCount;
+        uint32_t height;        // levels, counting the leaves; 0 when empty
+        uint64_t size;
+    };
+
+    /**
+    * A pinned page, unpinned when the handle goes away.
+    */
+    class PageHandle
+    {
+    public:
+        PageHandle(BufferPool& pool, size_t frame);
+        ~PageHandle();
+
+        uint16_t kind() const;
+        uint16_t count() const;
+        uint32_t next() const;
+        uint32_t prev() const;
+        void setKind(uint16_t kind);
+        void setCount(uint16_t count);
+        void setNext(uint32_t page);
+        void setPrev(uint32_t page);
+
+        Key key(size_t i) const;
+        void setKey(size_t i, const Key& key);
+        Value value(size_t i) const;
+        void setValue(size_t i, const Value& value);
+        uint32_t child(size_t i) const;
+        void setChild(size_t i, uint32_t page);
+        void moveKeys(size_t to, size_t from, size_t n);
+        void moveValues(size_t to, size_t from, size_t n);
+        void moveChildren(size_t to, size_t from, size_t n);
+
+        size_t lowerBound(const Key& key) const;
+        size_t upperBound(const Key& key) const;
+
+    private:
+        PageHandle(const PageHandle&);
+        PageHandle& operator=(const PageHandle&);
+
+        char* keyAt(size_t i) const;
+        char* valueAt(size_t i) const;
+        char* childAt(size_t i) const;
+        char* field(size_t offset) const;
+
+        BufferPool& pool_;
+        size_t frame_;
+        char* data_;
+    };
+
+    // a page on the way down and the child taken from it
+    struct PathStep {
+        uint32_t page;
+        size_t child;
+    };
+
+    void readMeta();
+    void writeMeta();
+    uint32_t allocatePage(uint16_t kind);
+    void freePage(uint32_t page);
+    uint32_t descend(const Key& key, std::vector<PathStep>* path) const;
+    void splitLeaf(uint32_t page, size_t pos, const Key& key, const Value& value, std::vector<PathStep>& path);
+    void insertIntoParent(uint32_t left, Key separator, uint32_t right, std::vector<PathStep>& path);
+    void removeFromParent(std::vector<PathStep>& path);
+    bool checkPage(uint32_t page, const Key* lo, const Key* hi, uint32_t depth,
+                   std::vector<uint32_t>& leaves, uint64_t& items) const;
+
+    int fd_;
+    std::string path_;
+    Meta meta_;
+    mutable BufferPool pool_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the BufferPool class.
+  ------------------------------------------------
+*/
+
+inline BufferPool::BufferPool(int fd, size_t frames) :
+    fd_(fd), memory_(std::max<size_t>(frames, 8) * PAGE_SIZE), frames_(std::max<size_t>(frames, 8)), hand_(0)
+{
+    reset();
+}
+
+/**
+* Forgets every cached page without writing any back.
+*/
+inline void BufferPool::reset()
+{
+    for (size_t i = 0; i < frames_.size(); ++i) {
+        Frame empty = { 0, 0, false, false, false };
+        frames_[i] = empty;
+    }
+    table_.clear();
+    hand_ = 0;
+    Stats zero = { 0, 0, 0 };
+    stats_ = zero;
+}
+
+inline size_t BufferPool::frameCount() const
+{
+    return frames_.size();
+}
+
+inline const BufferPool::Stats& BufferPool::stats() const
+{
+    return stats_;
+}
+
+inline char* BufferPool::data(size_t frame)
+{
+    return &memory_[frame * PAGE_SIZE];
+}
+
+inline void BufferPool::markDirty(size_t frame)
+{
+    frames_[frame].dirty = true;
+}
+
+inline void BufferPool::unpin(size_t frame)
+{
+    --frames_[frame].pins;
+}
+
+inline void BufferPool::writeBack(size_t frame)
+{
+    const char* bytes = data(frame);
+    size_t left = PAGE_SIZE;
+    off_t offset = static_cast<off_t>(frames_[frame].page) * static_cast<off_t>(PAGE_SIZE);
+    while (left > 0) {
+        ssize_t wrote = ::pwrite(fd_, bytes, left, offset);
+        if (wrote < 0 && errno == EINTR) {
+            continue;
+        }
+        if (wrote <= 0) {
+            throw std::runtime_error("Cannot write page");
+        }
+        bytes += wrote;
+        left -= static_cast<size_t>(wrote);
+        offset += wrote;
+    }
+    frames_[frame].dirty = false;
+    ++stats_.writes;
+}
+
+/**
+* Picks a frame for a new page, evicting with the clock if none is free.
+*/
+inline size_t BufferPool::victim()
+{
+    // two sweeps clear every reference bit, so a third finds nothing new
+    for (size_t step = 0; step < 3 * frames_.size(); ++step) {
+        size_t frame = hand_;
+        hand_ = (hand_ + 1) % frames_.size();
+        Frame& f = frames_[frame];
+        if (!f.used) {
+            return frame;
+        }
+        if (f.pins > 0) {
+            continue;
+        }
+        if (f.referenced) {
+            f.referenced = false;
+            continue;
+        }
+        if (f.dirty) {
+            writeBack(frame);
+        }
+        table_.erase(f.page);
+        f.used = false;
+        return frame;
+    }
+    throw std::runtime_error("Every buffer pool frame is pinned");
+}
+
+/**
+* Pins page, reading it from the file if it is not cached. Returns its
+* frame.
+*/
+inline size_t BufferPool::pin(uint32_t page)
+{
+    std::unordered_map<uint32_t, size_t>::iterator it = table_.find(page);
+    if (it != table_.end()) {
+        Frame& f = frames_[it -> second];
+        ++f.pins;
+        f.referenced = true;
+        ++stats_.hits;
+        return it -> second;
+    }
+
+    size_t frame = victim();
+    char* bytes = data(frame);
+    size_t got = 0;
+    off_t offset = static_cast<off_t>(page) * static_cast<off_t>(PAGE_SIZE);
+    while (got < PAGE_SIZE) {
+        ssize_t n = ::pread(fd_, bytes + got, PAGE_SIZE - got, offset + static_cast<off_t>(got));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::runtime_error("Cannot read page");
+        }
+        if (n == 0) {
+            // past the end of the file: a page that was never written back
+            std::memset(bytes + got, 0, PAGE_SIZE - got);
+            break;
+        }
+        got += static_cast<size_t>(n);
+    }
+    ++stats_.reads;
+
+    Frame f = { page, 1, true, false, true };
+    frames_[frame] = f;
+    table_[page] = frame;
+    return frame;
+}
+
+/**
+* Pins a zeroed frame for a page whose old contents do not matter.
+*/
+inline size_t BufferPool::pinNew(uint32_t page)
+{
+    std::unordered_map<uint32_t, size_t>::iterator it = table_.find(page);
+    size_t frame;
+    if (it != table_.end()) {
+        frame = it -> second;
+        ++frames_[frame].pins;
+    }
+    else {
+        frame = victim();
+        Frame f = { page, 1, true, false, true };
+        frames_[frame] = f;
+        table_[page] = frame;
+    }
+    std::memset(data(frame), 0, PAGE_SIZE);
+    frames_[frame].dirty = true;
+    return frame;
+}
+
+inline void BufferPool::flushAll()
+{
+    for (size_t i = 0; i < frames_.size(); ++i) {
+        if (frames_[i].used && frames_[i].dirty) {
+            writeBack(i);
+        }
+    }
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the BufferPool class.
+  ----------------------------------------------
+*/
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the PagedBPlusTree class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value>
+const size_t PagedBPlusTree<Key, Value>::HEADER;
+
+template<class Key, class Value>
+const size_t PagedBPlusTree<Key, Value>::LEAF_CAPACITY;
+
+template<class Key, class Value>
+const size_t PagedBPlusTree<Key, Value>::INNER_CAPACITY;
+
+template<class Key, class Value>
+PagedBPlusTree<Key, Value>::PageHandle::PageHandle(BufferPool& pool, size_t frame) :
+    pool_(pool), frame_(frame), data_(pool.data(frame))
+{
+
+}
+
+template<class Key, class Value>
+PagedBPlusTree<Key, Value>::PageHandle::~PageHandle()
+{
+    pool_.unpin(frame_);
+}
+
+template<class Key, class Value>
+char* PagedBPlusTree<Key, Value>::PageHandle::field(size_t offset) const
+{
+    return data_ + offset;
+}
+
+template<class Key, class Value>
+uint16_t PagedBPlusTree<Key, Value>::PageHandle::kind() const
+{
+    uint16_t kind;
+    std::memcpy(&kind, field(0), sizeof(kind));
+    return kind;
+}
+
+template<class Key, class Value>
+uint16_t PagedBPlusTree<Key, Value>::PageHandle::count() const
+{
+    uint16_t count;
+    std::memcpy(&count, field(2), sizeof(count));
+    return count;
+}
+
+template<class Key, class Value>
+uint32_t PagedBPlusTree<Key, Value>::PageHandle::next() const
+{
+    uint32_t page;
+    std::memcpy(&page, field(4), sizeof(page));
+    return page;
+}
+
+template<class Key, class Value>
+uint32_t PagedBPlusTree<Key, Value>::PageHandle::prev() const
+{
+    uint32_t page;
+    std::memcpy(&page, field(8), sizeof(page));
+    return page;
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::setKind(uint16_t kind)
+{
+    std::memcpy(field(0), &kind, sizeof(kind));
+    pool_.markDirty(frame_);
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::setCount(uint16_t count)
+{
+    std::memcpy(field(2), &count, sizeof(count));
+    pool_.markDirty(frame_);
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::setNext(uint32_t page)
+{
+    std::memcpy(field(4), &page, sizeof(page));
+    pool_.markDirty(frame_);
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::setPrev(uint32_t page)
+{
+    std::memcpy(field(8), &page, sizeof(page));
+    pool_.markDirty(frame_);
+}
+
+/**
+* Keys start after the header in both kinds of page. Leaves keep their
+* values after LEAF_CAPACITY keys, inner pages their children after
+* INNER_CAPACITY keys; neither is necessarily aligned, so every access
+* goes through memcpy.
+*/
+template<class Key, class Value>
+char* PagedBPlusTree<Key, Value>::PageHandle::keyAt(size_t i) const
+{
+    return field(HEADER + i * sizeof(Key));
+}
+
+template<class Key, class Value>
+char* PagedBPlusTree<Key, Value>::PageHandle::valueAt(size_t i) const
+{
+    return field(HEADER + LEAF_CAPACITY * sizeof(Key) + i * sizeof(Value));
+}
+
+template<class Key, class Value>
+char* PagedBPlusTree<Key, Value>::PageHandle::childAt(size_t i) const
+{
+    return field(HEADER + INNER_CAPACITY * sizeof(Key) + i * sizeof(uint32_t));
+}
+
+template<class Key, class Value>
+Key PagedBPlusTree<Key, Value>::PageHandle::key(size_t i) const
+{
+    Key key;
+    std::memcpy(&key, keyAt(i), sizeof(Key));
+    return key;
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::setKey(size_t i, const Key& key)
+{
+    std::memcpy(keyAt(i), &key, sizeof(Key));
+    pool_.markDirty(frame_);
+}
+
+template<class Key, class Value>
+Value PagedBPlusTree<Key, Value>::PageHandle::value(size_t i) const
+{
+    Value value;
+    std::memcpy(&value, valueAt(i), sizeof(Value));
+    return value;
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::setValue(size_t i, const Value& value)
+{
+    std::memcpy(valueAt(i), &value, sizeof(Value));
+    pool_.markDirty(frame_);
+}
+
+template<class Key, class Value>
+uint32_t PagedBPlusTree<Key, Value>::PageHandle::child(size_t i) const
+{
+    uint32_t page;
+    std::memcpy(&page, childAt(i), sizeof(page));
+    return page;
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::setChild(size_t i, uint32_t page)
+{
+    std::memcpy(childAt(i), &page, sizeof(page));
+    pool_.markDirty(frame_);
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::moveKeys(size_t to, size_t from, size_t n)
+{
+    std::memmove(keyAt(to), keyAt(from), n * sizeof(Key));
+    pool_.markDirty(frame_);
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::moveValues(size_t to, size_t from, size_t n)
+{
+    std::memmove(valueAt(to), valueAt(from), n * sizeof(Value));
+    pool_.markDirty(frame_);
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::PageHandle::moveChildren(size_t to, size_t from, size_t n)
+{
+    std::memmove(childAt(to), childAt(from), n * sizeof(uint32_t));
+    pool_.markDirty(frame_);
+}
+
+/**
+* Returns the first slot whose key is >= key.
+*/
+template<class Key, class Value>
+size_t PagedBPlusTree<Key, Value>::PageHandle::lowerBound(const Key& key) const
+{
+    size_t lo = 0, hi = count();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (this -> key(mid) < key) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+* Returns the first slot whose key is > key.
+*/
+template<class Key, class Value>
+size_t PagedBPlusTree<Key, Value>::PageHandle::upperBound(const Key& key) const
+{
+    size_t lo = 0, hi = count();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (key < this -> key(mid)) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+* Opens the tree stored at path, creating the file if needed.
+*/
+template<class Key, class Value>
+PagedBPlusTree<Key, Value>::PagedBPlusTree(const std::string& path, size_t poolPages) :
+    fd_(::open(path.c_str(), O_RDWR | O_CREAT, 0644)), path_(path), pool_(fd_, poolPages)
+{
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    try {
+        readMeta();
+    }
+    catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+/**
+* Writes every change back and closes the file.
+*/
+template<class Key, class Value>
+PagedBPlusTree<Key, Value>::~PagedBPlusTree()
+{
+    try {
+        flush();
+    }
+    catch (const std::exception&) {
+        // nothing to report to from a destructor
+    }
+    ::close(fd_);
+}
+
+/**
+* Loads page 0, or sets up an empty tree if the file is new.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::readMeta()
+{
+    static const char MAGIC[8] = { 'B', 'P', 'T', 'R', 'E', 'E', '0', '1' };
+    ssize_t got = ::pread(fd_, &meta_, sizeof(meta_), 0);
+    if (got == 0) {
+        std::memset(&meta_, 0, sizeof(meta_));
+        std::memcpy(meta_.magic, MAGIC, sizeof(MAGIC));
+        meta_.pageSize = BufferPool::PAGE_SIZE;
+        meta_.keySize = sizeof(Key);
+        meta_.valueSize = sizeof(Value);
+        meta_.pageCount = 1;
+        writeMeta();
+        return;
+    }
+    if (got != static_cast<ssize_t>(sizeof(meta_)) || std::memcmp(meta_.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Not a B+tree file: " + path_);
+    }
+    if (meta_.pageSize != BufferPool::PAGE_SIZE || meta_.keySize != sizeof(Key) || meta_.valueSize != sizeof(Value)) {
+        throw std::runtime_error("B+tree file was written with other types: " + path_);
+    }
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::writeMeta()
+{
+    if (::pwrite(fd_, &meta_, sizeof(meta_), 0) != static_cast<ssize_t>(sizeof(meta_))) {
+        throw std::runtime_error("Cannot write " + path_);
+    }
+}
+
+/**
+* Writes back every dirty page and the metadata, then syncs the file.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::flush()
+{
+    pool_.flushAll();
+    writeMeta();
+    if (::fsync(fd_) != 0) {
+        throw std::runtime_error("Cannot sync " + path_);
+    }
+}
+
+/**
+* Takes a page off the free list, or adds one to the end of the file.
+*/
+template<class Key, class Value>
+uint32_t PagedBPlusTree<Key, Value>::allocatePage(uint16_t kind)
+{
+    uint32_t page;
+    if (meta_.freeHead != 0) {
+        page = meta_.freeHead;
+        PageHandle freed(pool_, pool_.pin(page));
+        meta_.freeHead = freed.next();
+    }
+    else {
+        page = meta_.pageCount++;
+    }
+    PageHandle fresh(pool_, pool_.pinNew(page));
+    fresh.setKind(kind);
+    return page;
+}
+
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::freePage(uint32_t page)
+{
+    PageHandle freed(pool_, pool_.pinNew(page));
+    freed.setKind(FREE_PAGE);
+    freed.setNext(meta_.freeHead);
+    meta_.freeHead = page;
+}
+
+/**
+* Returns the leaf that holds or would hold key, recording the inner
+* pages passed on the way if path is given. The tree must not be empty.
+*/
+template<class Key, class Value>
+uint32_t PagedBPlusTree<Key, Value>::descend(const Key& key, std::vector<PathStep>* path) const
+{
+    uint32_t page = meta_.root;
+    for (uint32_t level = 1; level < meta_.height; ++level) {
+        PageHandle inner(pool_, pool_.pin(page));
+        size_t child = inner.upperBound(key);
+        if (path != NULL) {
+            PathStep step = { page, child };
+            path -> push_back(step);
+        }
+        page = inner.child(child);
+    }
+    return page;
+}
+
+/**
+* Inserts the item, replacing the value if the key is already there.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+    const Value& value = keyValuePair.second;
+
+    if (meta_.root == 0) {
+        uint32_t page = allocatePage(LEAF_PAGE);
+        PageHandle leaf(pool_, pool_.pin(page));
+        leaf.setKey(0, key);
+        leaf.setValue(0, value);
+        leaf.setCount(1);
+        meta_.root = meta_.firstLeaf = page;
+        meta_.height = 1;
+        meta_.size = 1;
+        return;
+    }
+
+    std::vector<PathStep> path;
+    uint32_t page = descend(key, &path);
+    size_t pos;
+    {
+        PageHandle leaf(pool_, pool_.pin(page));
+        size_t count = leaf.count();
+        pos = leaf.lowerBound(key);
+        if (pos < count && !(key < leaf.key(pos))) {
+            leaf.setValue(pos, value);
+            return;
+        }
+        ++meta_.size;
+        if (count < LEAF_CAPACITY) {
+            leaf.moveKeys(pos + 1, pos, count - pos);
+            leaf.moveValues(pos + 1, pos, count - pos);
+            leaf.setKey(pos, key);
+            leaf.setValue(pos, value);
+            leaf.setCount(static_cast<uint16_t>(count + 1));
+            return;
+        }
+    }
+    splitLeaf(page, pos, key, value, path);
+}
+
+/**
+* Splits a full leaf in two around the new item, links the new right
+* half into the leaf chain and passes its first key up.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::splitLeaf(uint32_t page, size_t pos, const Key& key, const Value& value,
+                                           std::vector<PathStep>& path)
+{
+    uint32_t rightPage = allocatePage(LEAF_PAGE);
+    PageHandle left(pool_, pool_.pin(page));
+    PageHandle right(pool_, pool_.pin(rightPage));
+
+    size_t total = LEAF_CAPACITY + 1;
+    size_t leftCount = total / 2;
+    size_t rightCount = total - leftCount;
+
+    if (pos < leftCount) {
+        // the new item stays left, and pushes one more of the old ones right
+        size_t moved = LEAF_CAPACITY - (leftCount - 1);
+        for (size_t i = 0; i < moved; ++i) {
+            right.setKey(i, left.key(leftCount - 1 + i));
+            right.setValue(i, left.value(leftCount - 1 + i));
+        }
+        left.moveKeys(pos + 1, pos, leftCount - 1 - pos);
+        left.moveValues(pos + 1, pos, leftCount - 1 - pos);
+        left.setKey(pos, key);
+        left.setValue(pos, value);
+    }
+    else {
+        size_t at = pos - leftCount;
+        for (size_t i = 0, from = leftCount; i < rightCount; ++i) {
+            if (i == at) {
+                right.setKey(i, key);
+                right.setValue(i, value);
+            }
+            else {
+                right.setKey(i, left.key(from));
+                right.setValue(i, left.value(from));
+                ++from;
+            }
+        }
+    }
+    left.setCount(static_cast<uint16_t>(leftCount));
+    right.setCount(static_cast<uint16_t>(rightCount));
+
+    uint32_t after = left.next();
+    right.setNext(after);
+    right.setPrev(page);
+    left.setNext(rightPage);
+    if (after != 0) {
+        PageHandle next(pool_, pool_.pin(after));
+        next.setPrev(rightPage);
+    }
+    insertIntoParent(page, right.key(0), rightPage, path);
+}
+
+/**
+* Adds separator and the page to its right to the parent of left,
+* splitting inner pages on the way up as needed, and growing a new root
+* if the old one splits.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::insertIntoParent(uint32_t left, Key separator, uint32_t right,
+                                                  std::vector<PathStep>& path)
+{
+    while (!path.empty()) {
+        PathStep step = path.back();
+        path.pop_back();
+        PageHandle parent(pool_, pool_.pin(step.page));
+        size_t count = parent.count();
+        size_t at = step.child;
+
+        if (count < INNER_CAPACITY) {
+            parent.moveKeys(at + 1, at, count - at);
+            parent.moveChildren(at + 2, at + 1, count - at);
+            parent.setKey(at, separator);
+            parent.setChild(at + 1, right);
+            parent.setCount(static_cast<uint16_t>(count + 1));
+            return;
+        }
+
+        // lay out all keys and children with the new one, then cut them
+        std::vector<Key> keys(count + 1);
+        std::vector<uint32_t> children(count + 2);
+        for (size_t i = 0, from = 0; i < count + 1; ++i) {
+            keys[i] = (i == at) ? separator : parent.key(from++);
+        }
+        for (size_t i = 0, from = 0; i < count + 2; ++i) {
+            children[i] = (i == at + 1) ? right : parent.child(from++);
+        }
+
+        size_t mid = (count + 1) / 2;
+        uint32_t sibling = allocatePage(INNER_PAGE);
+        PageHandle split(pool_, pool_.pin(sibling));
+        for (size_t i = 0; i < mid; ++i) {
+            parent.setKey(i, keys[i]);
+        }
+        for (size_t i = 0; i <= mid; ++i) {
+            parent.setChild(i, children[i]);
+        }
+        parent.setCount(static_cast<uint16_t>(mid));
+        size_t rightKeys = count - mid;
+        for (size_t i = 0; i < rightKeys; ++i) {
+            split.setKey(i, keys[mid + 1 + i]);
+        }
+        for (size_t i = 0; i <= rightKeys; ++i) {
+            split.setChild(i, children[mid + 1 + i]);
+        }
+        split.setCount(static_cast<uint16_t>(rightKeys));
+
+        left = step.page;
+        separator = keys[mid];
+        right = sibling;
+    }
+
+    uint32_t root = allocatePage(INNER_PAGE);
+    PageHandle top(pool_, pool_.pin(root));
+    top.setKey(0, separator);
+    top.setChild(0, left);
+    top.setChild(1, right);
+    top.setCount(1);
+    meta_.root = root;
+    ++meta_.height;
+}
+
+/**
+* Removes key if it is there. A leaf left empty is unlinked and freed,
+* along with any inner page that loses its last child.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::remove(const Key& key)
+{
+    if (meta_.root == 0) {
+        return;
+    }
+    std::vector<PathStep> path;
+    uint32_t page = descend(key, &path);
+    uint32_t before, after;
+    {
+        PageHandle leaf(pool_, pool_.pin(page));
+        size_t count = leaf.count();
+        size_t pos = leaf.lowerBound(key);
+        if (pos == count || key < leaf.key(pos)) {
+            return;
+        }
+        leaf.moveKeys(pos, pos + 1, count - pos - 1);
+        leaf.moveValues(pos, pos + 1, count - pos - 1);
+        leaf.setCount(static_cast<uint16_t>(count - 1));
+        --meta_.size;
+        if (count > 1) {
+            return;
+        }
+        before = leaf.prev();
+        after = leaf.next();
+    }
+
+    // the leaf is empty: take it out of the chain and its parent
+    if (before != 0) {
+        PageHandle prev(pool_, pool_.pin(before));
+        prev.setNext(after);
+    }
+    else {
+        meta_.firstLeaf = after;
+    }
+    if (after != 0) {
+        PageHandle next(pool_, pool_.pin(after));
+        next.setPrev(before);
+    }
+    freePage(page);
+    if (path.empty()) {
+        meta_.root = 0;
+        meta_.firstLeaf = 0;
+        meta_.height = 0;
+        return;
+    }
+    removeFromParent(path);
+}
+
+/**
+* Removes the child at the end of path from its page, freeing pages that
+* lose their last child, then shortens the tree while the root has a
+* single child.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::removeFromParent(std::vector<PathStep>& path)
+{
+    while (!path.empty()) {
+        PathStep step = path.back();
+        path.pop_back();
+        PageHandle parent(pool_, pool_.pin(step.page));
+        size_t count = parent.count();
+        if (count > 0) {
+            // the child's range joins a neighbour's by dropping the separator between them
+            size_t gone = (step.child == 0) ? 0 : step.child - 1;
+            parent.moveKeys(gone, gone + 1, count - gone - 1);
+            parent.moveChildren(step.child, step.child + 1, count - step.child);
+            parent.setCount(static_cast<uint16_t>(count - 1));
+            break;
+        }
+        freePage(step.page);
+        if (path.empty()) {
+            // only happens when the last item is gone, which remove() handles first
+            meta_.root = 0;
+            meta_.firstLeaf = 0;
+            meta_.height = 0;
+            return;
+        }
+    }
+
+    while (meta_.height > 1) {
+        uint32_t only;
+        {
+            PageHandle root(pool_, pool_.pin(meta_.root));
+            if (root.count() > 0) {
+                break;
+            }
+            only = root.child(0);
+        }
+        freePage(meta_.root);
+        meta_.root = only;
+        --meta_.height;
+    }
+}
+
+/**
+* Empties the tree and truncates its file.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::clear()
+{
+    pool_.reset();
+    meta_.root = 0;
+    meta_.firstLeaf = 0;
+    meta_.freeHead = 0;
+    meta_.pageCount = 1;
+    meta_.height = 0;
+    meta_.size = 0;
+    if (::ftruncate(fd_, static_cast<off_t>(BufferPool::PAGE_SIZE)) != 0) {
+        throw std::runtime_error("Cannot truncate " + path_);
+    }
+    writeMeta();
+}
+
+template<class Key, class Value>
+bool PagedBPlusTree<Key, Value>::empty() const
+{
+    return meta_.size == 0;
+}
+
+template<class Key, class Value>
+size_t PagedBPlusTree<Key, Value>::size() const
+{
+    return static_cast<size_t>(meta_.size);
+}
+
+/**
+* Returns the number of levels, counting the leaves; 0 if empty.
+*/
+template<class Key, class Value>
+int PagedBPlusTree<Key, Value>::height() const
+{
+    return static_cast<int>(meta_.height);
+}
+
+template<class Key, class Value>
+const BufferPool::Stats& PagedBPlusTree<Key, Value>::poolStats() const
+{
+    return pool_.stats();
+}
+
+template<class Key, class Value>
+typename PagedBPlusTree<Key, Value>::iterator PagedBPlusTree<Key, Value>::begin() const
+{
+    return iterator(this, meta_.firstLeaf, 0);
+}
+
+template<class Key, class Value>
+typename PagedBPlusTree<Key, Value>::iterator PagedBPlusTree<Key, Value>::end() const
+{
+    return iterator(this, 0, 0);
+}
+
+template<class Key, class Value>
+typename PagedBPlusTree<Key, Value>::iterator PagedBPlusTree<Key, Value>::find(const Key& key) const
+{
+    if (meta_.root == 0) {
+        return end();
+    }
+    uint32_t page = descend(key, NULL);
+    PageHandle leaf(pool_, pool_.pin(page));
+    size_t pos = leaf.lowerBound(key);
+    if (pos == leaf.count() || key < leaf.key(pos)) {
+        return end();
+    }
+    return iterator(this, page, pos);
+}
+
+/**
+* Calls callback on every item with lo <= key <= hi, in order, following
+* the leaf chain from the leaf that holds lo.
+*/
+template<class Key, class Value>
+template<typename Callback>
+void PagedBPlusTree<Key, Value>::scan(const Key& lo, const Key& hi, Callback callback) const
+{
+    if (meta_.root == 0) {
+        return;
+    }
+    uint32_t page = descend(lo, NULL);
+    bool first = true;
+    std::pair<Key, Value> item;
+    while (page != 0) {
+        PageHandle leaf(pool_, pool_.pin(page));
+        size_t count = leaf.count();
+        for (size_t i = first ? leaf.lowerBound(lo) : 0; i < count; ++i) {
+            item.first = leaf.key(i);
+            if (hi < item.first) {
+                return;
+            }
+            item.second = leaf.value(i);
+            callback(item);
+        }
+        first = false;
+        page = leaf.next();
+    }
+}
+
+/**
+* Checks key order and separator bounds, that every leaf is at the same
+* depth, that the leaf chain visits the leaves in order in both
+* directions, and that the item count matches size().
+*/
+template<class Key, class Value>
+bool PagedBPlusTree<Key, Value>::validate() const
+{
+    if (meta_.root == 0) {
+        return meta_.size == 0 && meta_.height == 0 && meta_.firstLeaf == 0;
+    }
+    std::vector<uint32_t> leaves;
+    uint64_t items = 0;
+    if (!checkPage(meta_.root, NULL, NULL, 1, leaves, items) || items != meta_.size) {
+        return false;
+    }
+    if (leaves.front() != meta_.firstLeaf) {
+        return false;
+    }
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        PageHandle leaf(pool_, pool_.pin(leaves[i]));
+        uint32_t expectPrev = (i == 0) ? 0 : leaves[i - 1];
+        uint32_t expectNext = (i + 1 == leaves.size()) ? 0 : leaves[i + 1];
+        if (leaf.prev() != expectPrev || leaf.next() != expectNext) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Checks one page, whose keys must lie in [lo, hi), and its subtree.
+* Recursive, but only as deep as the tree is tall.
+*/
+template<class Key, class Value>
+bool PagedBPlusTree<Key, Value>::checkPage(uint32_t page, const Key* lo, const Key* hi, uint32_t depth,
+                                           std::vector<uint32_t>& leaves, uint64_t& items) const
+{
+    if (page == 0 || page >= meta_.pageCount) {
+        return false;
+    }
+    std::vector<Key> keys;
+    std::vector<uint32_t> children;
+    {
+        PageHandle node(pool_, pool_.pin(page));
+        bool leaf = (depth == meta_.height);
+        if (node.kind() != (leaf ? LEAF_PAGE : INNER_PAGE)) {
+            return false;
+        }
+        size_t count = node.count();
+        if (count > (leaf ? LEAF_CAPACITY : INNER_CAPACITY) || (leaf && count == 0)) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            keys.push_back(node.key(i));
+            if ((i > 0 && !(keys[i - 1] < keys[i])) ||
+                (lo != NULL && keys[i] < *lo) || (hi != NULL && !(keys[i] < *hi))) {
+                return false;
+            }
+        }
+        if (leaf) {
+            leaves.push_back(page);
+            items += count;
+            return true;
+        }
+        for (size_t i = 0; i <= count; ++i) {
+            children.push_back(node.child(i));
+        }
+    }
+
+    for (size_t i = 0; i < children.size(); ++i) {
+        const Key* childLo = (i == 0) ? lo : &keys[i - 1];
+        const Key* childHi = (i == keys.size()) ? hi : &keys[i];
+        if (!checkPage(children[i], childLo, childHi, depth + 1, leaves, items)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class Key, class Value>
+PagedBPlusTree<Key, Value>::iterator::iterator() :
+    tree_(NULL), page_(0), slot_(0), item_()
+{
+
+}
+
+template<class Key, class Value>
+PagedBPlusTree<Key, Value>::iterator::iterator(const PagedBPlusTree<Key, Value>* tree, uint32_t page, size_t slot) :
+    tree_(tree), page_(page), slot_(slot), item_()
+{
+    load();
+}
+
+/**
+* Copies the item at the current slot, moving along the leaf chain
+* past the end of a leaf.
+*/
+template<class Key, class Value>
+void PagedBPlusTree<Key, Value>::iterator::load()
+{
+    while (page_ != 0) {
+        PageHandle leaf(tree_ -> pool_, tree_ -> pool_.pin(page_));
+        if (slot_ < leaf.count()) {
+            item_.first = leaf.key(slot_);
+            item_.second = leaf.value(slot_);
+            return;
+        }
+        page_ = leaf.next();
+        slot_ = 0;
+    }
+    slot_ = 0;
+}
+
+template<class Key, class Value>
+const std::pair<Key, Value>& PagedBPlusTree<Key, Value>::iterator::operator*() const
+{
+    return item_;
+}
+
+template<class Key, class Value>
+const std::pair<Key, Value>* PagedBPlusTree<Key, Value>::iterator::operator->() const
+{
+    return &item_;
+}
+
+template<class Key, class Value>
+bool PagedBPlusTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return page_ == rhs.page_ && slot_ == rhs.slot_;
+}
+
+template<class Key, class Value>
+bool PagedBPlusTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value>
+typename PagedBPlusTree<Key, Value>::iterator& PagedBPlusTree<Key, Value>::iterator::operator++()
+{
+    ++slot_;
+    load();
+    return *this;
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the PagedBPlusTree class.
+  --------------------------------------------------
+*/
+
+#endif
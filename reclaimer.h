@@ -0,0 +1,148 @@
+#ifndef RECLAIMER_H
+#define RECLAIMER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <cstddef>
+
+/**
+* A shared background thread that frees detached data structures a
+* bounded chunk at a time, so that dropping a large tree does not stall
+* the thread that dropped it.
+*
+* Work is handed over as a step function and an opaque state pointer.
+* Each call to the step function frees at most CHUNK objects and returns
+* the state to resume from, or NULL once everything is freed. Pending
+* jobs take turns a chunk at a time. The thread is started on first use
+* and finishes all pending work before the program exits.
+*/
+class Reclaimer
+{
+public:
+    typedef void* (*Step)(void* state, size_t budget);
+
+    static void defer(void* state, Step step);
+    static void drain();
+
+    // objects freed per step before the worker looks at its queue again
+    static const size_t CHUNK = 4096;
+
+private:
+    struct Job {
+        void* state;
+        Step step;
+    };
+
+    /**
+    * The queue and the thread that works through it.
+    */
+    struct Worker {
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        std::deque<Job> jobs;
+        bool busy;
+        bool stopping;
+        std::thread thread;
+
+        Worker();
+        ~Worker();
+        void run();
+    };
+
+    static Worker& worker();
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the Reclaimer class.
+  ---------------------------------------------
+*/
+
+inline Reclaimer::Worker::Worker() :
+    busy(false), stopping(false), thread(&Worker::run, this)
+{
+
+}
+
+/**
+* Lets the thread finish the queue, then joins it.
+*/
+inline Reclaimer::Worker::~Worker()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+inline void Reclaimer::Worker::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+            break;
+        }
+
+        Job job = jobs.front();
+        jobs.pop_front();
+        busy = true;
+
+        // free one chunk without holding the lock, so defer() never waits on it
+        guard.unlock();
+        job.state = job.step(job.state, CHUNK);
+        guard.lock();
+
+        busy = false;
+        if (job.state != NULL) {
+            jobs.push_back(job);
+        }
+        else if (jobs.empty()) {
+            idle.notify_all();
+        }
+    }
+}
+
+inline Reclaimer::Worker& Reclaimer::worker()
+{
+    static Worker instance;
+    return instance;
+}
+
+/**
+* Queues state to be freed by repeated calls to step on the background
+* thread. The caller must not touch anything reachable from state again.
+*/
+inline void Reclaimer::defer(void* state, Step step)
+{
+    Worker& w = worker();
+    Job job = { state, step };
+    {
+        std::lock_guard<std::mutex> guard(w.lock);
+        w.jobs.push_back(job);
+    }
+    w.wake.notify_one();
+}
+
+/**
+* Blocks until everything deferred so far has been freed.
+*/
+inline void Reclaimer::drain()
+{
+    Worker& w = worker();
+    std::unique_lock<std::mutex> guard(w.lock);
+    w.idle.wait(guard, [&w]() { return w.jobs.empty() && !w.busy; });
+}
+
+/*
+  -------------------------------------------
+  End implementations for the Reclaimer class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RUN_CODEC_H
+#define RUN_CODEC_H
+
+#include <stdint.h>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/**
+* How keys and values are written to run, log and checkpoint files.
+* Trivially copyable types are copied byte for byte in host order, so the
+* files are not portable between machines of different endianness;
+* std::string is written with a length. Specialize RunCodec for any other
+* type.
+*/
+template <typename T, bool Raw = std::is_trivially_copyable<T>::value>
+struct RunCodec;
+
+template <typename T>
+struct RunCodec<T, true> {
+    static void encode(std::string& out, const T& item)
+    {
+        out.append(reinterpret_cast<const char*>(&item), sizeof(T));
+    }
+    static const char* decode(const char* p, const char* end, T& item)
+    {
+        if (static_cast<size_t>(end - p) < sizeof(T)) {
+            throw std::runtime_error("Corrupt record");
+        }
+        std::memcpy(&item, p, sizeof(T));
+        return p + sizeof(T);
+    }
+};
+
+template <>
+struct RunCodec<std::string, false> {
+    static void encode(std::string& out, const std::string& item)
+    {
+        RunCodec<uint32_t>::encode(out, static_cast<uint32_t>(item.size()));
+        out.append(item);
+    }
+    static const char* decode(const char* p, const char* end, std::string& item)
+    {
+        uint32_t length;
+        p = RunCodec<uint32_t>::decode(p, end, length);
+        if (static_cast<size_t>(end - p) < length) {
+            throw std::runtime_error("Corrupt record");
+        }
+        item.assign(p, length);
+        return p + length;
+    }
+};
+
+#endif
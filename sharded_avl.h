@@ -0,0 +1,561 @@
+#ifndef SHARDED_AVL_H
+#define SHARDED_AVL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* A thin wrapper around a pthread reader-writer lock. C++11 has no
+* shared mutex, and the trees in this directory are built as C++11.
+*/
+class RWLock
+{
+public:
+    RWLock();
+    ~RWLock();
+
+    void lockShared();
+    void unlockShared();
+    void lock();
+    void unlock();
+
+private:
+    RWLock(const RWLock&);
+    RWLock& operator=(const RWLock&);
+
+    pthread_rwlock_t lock_;
+};
+
+inline RWLock::RWLock()
+{
+    pthread_rwlock_init(&lock_, NULL);
+}
+
+inline RWLock::~RWLock()
+{
+    pthread_rwlock_destroy(&lock_);
+}
+
+inline void RWLock::lockShared()
+{
+    pthread_rwlock_rdlock(&lock_);
+}
+
+inline void RWLock::unlockShared()
+{
+    pthread_rwlock_unlock(&lock_);
+}
+
+inline void RWLock::lock()
+{
+    pthread_rwlock_wrlock(&lock_);
+}
+
+inline void RWLock::unlock()
+{
+    pthread_rwlock_unlock(&lock_);
+}
+
+/**
+* A thread-safe ordered map that partitions its keys across several
+* AVLTree shards, each guarded by its own reader-writer lock.
+*
+* Keys are either hash partitioned (the default) or range partitioned
+* by a sorted list of split keys. Single-key operations lock exactly one
+* shard; the batch operations group their keys by shard so each shard's
+* lock is taken once per batch. Iteration merges the per-shard iterators
+* into one ordered sequence.
+*/
+template <typename Key, typename Value, typename Hash = std::hash<Key> >
+class ShardedAVLMap
+{
+public:
+    explicit ShardedAVLMap(size_t numShards = 16);
+    explicit ShardedAVLMap(const std::vector<Key>& splitKeys);
+    ~ShardedAVLMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value get(const Key& key) const;
+    bool empty() const;
+    void clear();
+
+    void insertBatch(const std::vector<std::pair<Key, Value> >& items);
+    void removeBatch(const std::vector<Key>& keys);
+    void findBatch(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found) const;
+
+    size_t shardCount() const;
+    size_t shardOf(const Key& key) const;
+
+    /**
+    * Holds every shard's read lock (taken in shard order) for its
+    * lifetime, so that iteration sees a consistent snapshot.
+    */
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const ShardedAVLMap<Key, Value, Hash>& map);
+        ~ReadGuard();
+
+    private:
+        ReadGuard(const ReadGuard&);
+        ReadGuard& operator=(const ReadGuard&);
+
+        const ShardedAVLMap<Key, Value, Hash>& map_;
+    };
+
+    /**
+    * An in-order iterator that merges the shards' iterators through a
+    * small min-heap keyed on each shard's current item. Iterators do not
+    * lock anything; hold a ReadGuard (or otherwise stop writers) while
+    * iterating.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ShardedAVLMap<Key, Value, Hash>;
+        typedef typename AVLTree<Key, Value>::iterator ShardIterator;
+
+        explicit iterator(const ShardedAVLMap<Key, Value, Hash>* map);
+        bool laterThan(size_t a, size_t b) const;
+
+        std::vector<ShardIterator> cursors_;
+        std::vector<size_t> heap_;      // shards with items left, smallest key on top
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+protected:
+    /**
+    * A shard pairs a tree with its lock. The padding keeps neighbouring
+    * shards' locks off the same cache line.
+    */
+    struct Shard {
+        RWLock lock;
+        AVLTree<Key, Value> tree;
+        char padding[64];
+    };
+
+    void groupByShard(const std::vector<Key>& keys, std::vector<size_t>& order, std::vector<size_t>& starts) const;
+
+    Shard* shards_;
+    size_t numShards_;
+    std::vector<Key> splitKeys_;    // empty when hash partitioned
+    Hash hash_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the ShardedAVLMap class.
+  ---------------------------------------------------
+*/
+
+/**
+* Creates a hash partitioned map with numShards shards.
+*/
+template <typename Key, typename Value, typename Hash>
+ShardedAVLMap<Key, Value, Hash>::ShardedAVLMap(size_t numShards) :
+    shards_(NULL), numShards_(numShards == 0 ? 1 : numShards)
+{
+    shards_ = new Shard[numShards_];
+}
+
+/**
+* Creates a range partitioned map. splitKeys must be sorted; shard i
+* holds the keys k with splitKeys[i-1] <= k < splitKeys[i].
+*/
+template <typename Key, typename Value, typename Hash>
+ShardedAVLMap<Key, Value, Hash>::ShardedAVLMap(const std::vector<Key>& splitKeys) :
+    shards_(NULL), numShards_(splitKeys.size() + 1), splitKeys_(splitKeys)
+{
+    shards_ = new Shard[numShards_];
+}
+
+template <typename Key, typename Value, typename Hash>
+ShardedAVLMap<Key, Value, Hash>::~ShardedAVLMap()
+{
+    delete [] shards_;
+}
+
+template <typename Key, typename Value, typename Hash>
+size_t ShardedAVLMap<Key, Value, Hash>::shardCount() const
+{
+    return numShards_;
+}
+
+/**
+* Returns the index of the shard responsible for key.
+*/
+template <typename Key, typename Value, typename Hash>
+size_t ShardedAVLMap<Key, Value, Hash>::shardOf(const Key& key) const
+{
+    if (!splitKeys_.empty()) {
+        return std::upper_bound(splitKeys_.begin(), splitKeys_.end(), key) - splitKeys_.begin();
+    }
+
+    // mix the hash so that identity hashes of sequential keys still spread out
+    uint64_t h = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>((h >> 32) % numShards_);
+}
+
+template <typename Key, typename Value, typename Hash>
+void ShardedAVLMap<Key, Value, Hash>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Shard& shard = shards_[shardOf(keyValuePair.first)];
+    shard.lock.lock();
+    shard.tree.insert(keyValuePair);
+    shard.lock.unlock();
+}
+
+template <typename Key, typename Value, typename Hash>
+void ShardedAVLMap<Key, Value, Hash>::remove(const Key& key)
+{
+    Shard& shard = shards_[shardOf(key)];
+    shard.lock.lock();
+    shard.tree.remove(key);
+    shard.lock.unlock();
+}
+
+/**
+* Copies the value for key into value and returns true, or returns
+* false if key is not present. The value is copied out because a
+* reference into a shard would outlive the shard's lock.
+*/
+template <typename Key, typename Value, typename Hash>
+bool ShardedAVLMap<Key, Value, Hash>::find(const Key& key, Value& value) const
+{
+    Shard& shard = shards_[shardOf(key)];
+    shard.lock.lockShared();
+    typename AVLTree<Key, Value>::iterator it = shard.tree.find(key);
+    bool found = (it != shard.tree.end());
+    if (found) {
+        value = it -> second;
+    }
+    shard.lock.unlockShared();
+    return found;
+}
+
+template <typename Key, typename Value, typename Hash>
+bool ShardedAVLMap<Key, Value, Hash>::contains(const Key& key) const
+{
+    Shard& shard = shards_[shardOf(key)];
+    shard.lock.lockShared();
+    bool found = (shard.tree.find(key) != shard.tree.end());
+    shard.lock.unlockShared();
+    return found;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns a copy of the value associated with the key
+ */
+template <typename Key, typename Value, typename Hash>
+Value ShardedAVLMap<Key, Value, Hash>::get(const Key& key) const
+{
+    Value value;
+    if (!find(key, value)) throw std::out_of_range("Invalid key");
+    return value;
+}
+
+template <typename Key, typename Value, typename Hash>
+bool ShardedAVLMap<Key, Value, Hash>::empty() const
+{
+    for (size_t i = 0; i < numShards_; ++i) {
+        shards_[i].lock.lockShared();
+        bool shardEmpty = shards_[i].tree.empty();
+        shards_[i].lock.unlockShared();
+        if (!shardEmpty) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Key, typename Value, typename Hash>
+void ShardedAVLMap<Key, Value, Hash>::clear()
+{
+    for (size_t i = 0; i < numShards_; ++i) {
+        shards_[i].lock.lock();
+        shards_[i].tree.clear();
+        shards_[i].lock.unlock();
+    }
+}
+
+/**
+* Computes a permutation of keys' indices grouped by shard (a counting
+* sort, so each shard keeps the batch's original order). The keys of
+* shard s are order[starts[s]] .. order[starts[s + 1] - 1].
+*/
+template <typename Key, typename Value, typename Hash>
+void ShardedAVLMap<Key, Value, Hash>::groupByShard(const std::vector<Key>& keys,
+    std::vector<size_t>& order, std::vector<size_t>& starts) const
+{
+    std::vector<size_t> shardIds(keys.size());
+    starts.assign(numShards_ + 1, 0);
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        shardIds[i] = shardOf(keys[i]);
+        ++starts[shardIds[i] + 1];
+    }
+    for (size_t s = 0; s < numShards_; ++s) {
+        starts[s + 1] += starts[s];
+    }
+
+    std::vector<size_t> fill(starts.begin(), starts.end() - 1);
+    order.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        order[fill[shardIds[i]]++] = i;
+    }
+}
+
+/**
+* Inserts every item, taking each affected shard's write lock once.
+* Items with the same key are applied in batch order.
+*/
+template <typename Key, typename Value, typename Hash>
+void ShardedAVLMap<Key, Value, Hash>::insertBatch(const std::vector<std::pair<Key, Value> >& items)
+{
+    std::vector<Key> keys;
+    keys.reserve(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        keys.push_back(items[i].first);
+    }
+
+    std::vector<size_t> order, starts;
+    groupByShard(keys, order, starts);
+
+    for (size_t s = 0; s < numShards_; ++s) {
+        if (starts[s] == starts[s + 1]) {
+            continue;
+        }
+        shards_[s].lock.lock();
+        for (size_t j = starts[s]; j < starts[s + 1]; ++j) {
+            shards_[s].tree.insert(items[order[j]]);
+        }
+        shards_[s].lock.unlock();
+    }
+}
+
+/**
+* Removes every key, taking each affected shard's write lock once.
+*/
+template <typename Key, typename Value, typename Hash>
+void ShardedAVLMap<Key, Value, Hash>::removeBatch(const std::vector<Key>& keys)
+{
+    std::vector<size_t> order, starts;
+    groupByShard(keys, order, starts);
+
+    for (size_t s = 0; s < numShards_; ++s) {
+        if (starts[s] == starts[s + 1]) {
+            continue;
+        }
+        shards_[s].lock.lock();
+        for (size_t j = starts[s]; j < starts[s + 1]; ++j) {
+            shards_[s].tree.remove(keys[order[j]]);
+        }
+        shards_[s].lock.unlock();
+    }
+}
+
+/**
+* Looks up every key, taking each affected shard's read lock once and
+* resolving that shard's keys with AVLTree::findBatch. found[i] tells
+* whether values[i] holds the value for keys[i].
+*/
+template <typename Key, typename Value, typename Hash>
+void ShardedAVLMap<Key, Value, Hash>::findBatch(const std::vector<Key>& keys,
+    std::vector<Value>& values, std::vector<bool>& found) const
+{
+    std::vector<size_t> order, starts;
+    groupByShard(keys, order, starts);
+
+    values.assign(keys.size(), Value());
+    found.assign(keys.size(), false);
+
+    std::vector<Key> shardKeys;
+    std::vector<typename AVLTree<Key, Value>::iterator> results;
+
+    for (size_t s = 0; s < numShards_; ++s) {
+        if (starts[s] == starts[s + 1]) {
+            continue;
+        }
+        shardKeys.clear();
+        for (size_t j = starts[s]; j < starts[s + 1]; ++j) {
+            shardKeys.push_back(keys[order[j]]);
+        }
+
+        shards_[s].lock.lockShared();
+        shards_[s].tree.findBatch(shardKeys, results);
+        for (size_t j = 0; j < results.size(); ++j) {
+            if (results[j] != shards_[s].tree.end()) {
+                values[order[starts[s] + j]] = results[j] -> second;
+                found[order[starts[s] + j]] = true;
+            }
+        }
+        shards_[s].lock.unlockShared();
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+typename ShardedAVLMap<Key, Value, Hash>::iterator
+ShardedAVLMap<Key, Value, Hash>::begin() const
+{
+    return iterator(this);
+}
+
+template <typename Key, typename Value, typename Hash>
+typename ShardedAVLMap<Key, Value, Hash>::iterator
+ShardedAVLMap<Key, Value, Hash>::end() const
+{
+    return iterator();
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the ShardedAVLMap class.
+  -------------------------------------------------
+*/
+
+/*
+  --------------------------------------------------------------
+  Begin implementations for the ShardedAVLMap helper classes.
+  --------------------------------------------------------------
+*/
+
+/**
+* Takes every shard's read lock, always in shard order.
+*/
+template <typename Key, typename Value, typename Hash>
+ShardedAVLMap<Key, Value, Hash>::ReadGuard::ReadGuard(const ShardedAVLMap<Key, Value, Hash>& map) :
+    map_(map)
+{
+    for (size_t i = 0; i < map_.numShards_; ++i) {
+        map_.shards_[i].lock.lockShared();
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+ShardedAVLMap<Key, Value, Hash>::ReadGuard::~ReadGuard()
+{
+    for (size_t i = map_.numShards_; i > 0; --i) {
+        map_.shards_[i - 1].lock.unlockShared();
+    }
+}
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template <typename Key, typename Value, typename Hash>
+ShardedAVLMap<Key, Value, Hash>::iterator::iterator()
+{
+
+}
+
+/**
+* Positions one cursor on the smallest item of every shard and
+* heapifies the non-empty ones.
+*/
+template <typename Key, typename Value, typename Hash>
+ShardedAVLMap<Key, Value, Hash>::iterator::iterator(const ShardedAVLMap<Key, Value, Hash>* map)
+{
+    cursors_.reserve(map -> numShards_);
+    for (size_t i = 0; i < map -> numShards_; ++i) {
+        cursors_.push_back(map -> shards_[i].tree.begin());
+        if (cursors_[i] != map -> shards_[i].tree.end()) {
+            heap_.push_back(i);
+        }
+    }
+
+    std::make_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return laterThan(a, b); });
+}
+
+/**
+* Heap ordering: shard a sorts after shard b if its current key is larger.
+*/
+template <typename Key, typename Value, typename Hash>
+bool ShardedAVLMap<Key, Value, Hash>::iterator::laterThan(size_t a, size_t b) const
+{
+    return cursors_[b] -> first < cursors_[a] -> first;
+}
+
+template <typename Key, typename Value, typename Hash>
+std::pair<const Key, Value>&
+ShardedAVLMap<Key, Value, Hash>::iterator::operator*() const
+{
+    return *cursors_[heap_.front()];
+}
+
+template <typename Key, typename Value, typename Hash>
+std::pair<const Key, Value>*
+ShardedAVLMap<Key, Value, Hash>::iterator::operator->() const
+{
+    return &(*cursors_[heap_.front()]);
+}
+
+/**
+* Two iterators are equal if both are exhausted or both refer to the
+* same item.
+*/
+template <typename Key, typename Value, typename Hash>
+bool ShardedAVLMap<Key, Value, Hash>::iterator::operator==(const iterator& rhs) const
+{
+    if (heap_.empty() || rhs.heap_.empty()) {
+        return heap_.empty() && rhs.heap_.empty();
+    }
+    return &(**this) == &(*rhs);
+}
+
+template <typename Key, typename Value, typename Hash>
+bool ShardedAVLMap<Key, Value, Hash>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the shard that produced the current item and restores
+* the heap.
+*/
+template <typename Key, typename Value, typename Hash>
+typename ShardedAVLMap<Key, Value, Hash>::iterator&
+ShardedAVLMap<Key, Value, Hash>::iterator::operator++()
+{
+    std::pop_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return laterThan(a, b); });
+    size_t shard = heap_.back();
+
+    ++cursors_[shard];
+    if (cursors_[shard] == ShardIterator()) {
+        heap_.pop_back();
+    }
+    else {
+        std::push_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return laterThan(a, b); });
+    }
+
+    return *this;
+}
+
+/*
+  ------------------------------------------------------------
+  End implementations for the ShardedAVLMap helper classes.
+  ------------------------------------------------------------
+*/
+
+#endif
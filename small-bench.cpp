@@ -0,0 +1,91 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <stdint.h>
+#include "avlbst.h"
+#include "small_avl.h"
+
+using namespace std;
+
+// Heap allocations and requested bytes since the program started.
+static uint64_t allocations = 0;
+static uint64_t allocatedBytes = 0;
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    allocatedBytes += size;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// not inlined, so the compiler does not pair this free() with a new expression
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/**
+* Fills maps of entries items each, then looks every item up once.
+* Reports the heap allocations and bytes per map (the map objects
+* themselves included, heap headers not) and the time per lookup.
+*/
+template<typename Map>
+void mapPass(const char* name, int maps, int entries)
+{
+    uint64_t startAllocations = allocations;
+    uint64_t startBytes = allocatedBytes;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Map* all = new Map[maps];
+    for (int m = 0; m < maps; ++m) {
+        for (int i = 0; i < entries; ++i) {
+            all[m].insert(std::make_pair(i * 7 % entries, m + i));
+        }
+    }
+    double buildSeconds = secondsSince(begin);
+    // the array of maps is one allocation shared by all of them
+    double perMapAllocations = static_cast<double>(allocations - startAllocations - 1) / maps;
+    double perMapBytes = static_cast<double>(allocatedBytes - startBytes) / maps;
+
+    begin = std::chrono::steady_clock::now();
+    uint64_t found = 0;
+    for (int m = 0; m < maps; ++m) {
+        for (int i = 0; i < entries; ++i) {
+            found += (all[m].find(i) != all[m].end());
+        }
+    }
+    double findSeconds = secondsSince(begin);
+    if (found != static_cast<uint64_t>(maps) * entries) {
+        cout << "lookup missed keys" << endl;
+        exit(1);
+    }
+    delete[] all;
+
+    cout << setw(20) << name << fixed << setprecision(2)
+         << setw(14) << perMapAllocations << setw(14) << setprecision(0) << perMapBytes
+         << setw(14) << setprecision(1) << buildSeconds * 1e9 / (static_cast<double>(maps) * entries)
+         << setw(14) << findSeconds * 1e9 / (static_cast<double>(maps) * entries) << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int maps = (argc > 1) ? atoi(argv[1]) : 100000;
+    int entries = (argc > 2) ? atoi(argv[2]) : 10;
+
+    cout << maps << " maps of " << entries << " int/int entries:" << endl;
+    cout << "                 map   allocs/map     bytes/map   insert (ns)     find (ns)" << endl;
+    mapPass<SmallAVLMap<int, int> >("SmallAVLMap<16>", maps, entries);
+    mapPass<AVLTree<int, int> >("AVLTree", maps, entries);
+    return 0;
+}
@@ -0,0 +1,420 @@
+#ifndef SMALL_AVL_H
+#define SMALL_AVL_H
+
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* An ordered map that keeps up to N items in a sorted array stored inside
+* the object itself, and only switches to a heap-allocated AVLTree once
+* it grows past N. A small map therefore costs no allocations and no
+* per-item node overhead.
+*
+* The map promotes to a tree (with AVLTree::buildFromSorted) when the
+* (N+1)th key is inserted, and demotes back to the array once it has
+* shrunk to N/2 items, so a map that hovers around N does not convert on
+* every operation.
+*
+* The API follows AVLTree: insert, remove, clear, empty, find,
+* operator[] and in-order iterators, which are invalidated by any
+* modification.
+*/
+template <typename Key, typename Value, size_t N = 16>
+class SmallAVLMap
+{
+    static_assert(N >= 2, "SmallAVLMap needs room for at least two inline items");
+
+public:
+    typedef AVLTree<Key, Value> Tree;
+
+    SmallAVLMap();
+    ~SmallAVLMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    bool isInline() const;
+
+    /**
+    * Walks the inline array directly, or wraps an AVLTree iterator once
+    * the map has been promoted.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class SmallAVLMap<Key, Value, N>;
+        iterator(std::pair<const Key, Value>* item, std::pair<const Key, Value>* last);
+        explicit iterator(typename Tree::iterator treeIt);
+        static std::pair<const Key, Value>* itemOf(const typename Tree::iterator& treeIt);
+
+        std::pair<const Key, Value>* item_;
+        std::pair<const Key, Value>* last_;
+        typename Tree::iterator treeIt_;
+        bool inTree_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    typedef std::pair<const Key, Value> Item;
+
+    Item* items() const;
+    size_t position(const Key& key) const;
+    void promote();
+    void demote();
+
+    // inline items in key order; only the first size_ slots are constructed
+    typename std::aligned_storage<sizeof(Item), alignof(Item)>::type storage_[N];
+    size_t size_;
+    Tree* tree_;
+
+private:
+    SmallAVLMap(const SmallAVLMap&);
+    SmallAVLMap& operator=(const SmallAVLMap&);
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the SmallAVLMap class.
+  ---------------------------------------------------
+*/
+
+template<typename Key, typename Value, size_t N>
+SmallAVLMap<Key, Value, N>::SmallAVLMap() : size_(0), tree_(NULL)
+{
+
+}
+
+template<typename Key, typename Value, size_t N>
+SmallAVLMap<Key, Value, N>::~SmallAVLMap()
+{
+    clear();
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::Item* SmallAVLMap<Key, Value, N>::items() const
+{
+    return reinterpret_cast<Item*>(const_cast<typename std::aligned_storage<sizeof(Item), alignof(Item)>::type*>(storage_));
+}
+
+/**
+* Returns the index of the first inline item whose key is >= key. A
+* linear scan beats binary search at these sizes.
+*/
+template<typename Key, typename Value, size_t N>
+size_t SmallAVLMap<Key, Value, N>::position(const Key& key) const
+{
+    Item* array = items();
+    size_t i = 0;
+    while (i < size_ && array[i].first < key) {
+        ++i;
+    }
+    return i;
+}
+
+/**
+* Moves the inline items into a freshly built AVLTree.
+*/
+template<typename Key, typename Value, size_t N>
+void SmallAVLMap<Key, Value, N>::promote()
+{
+    Item* array = items();
+    tree_ = new Tree();
+    tree_ -> buildFromSorted(array, array + size_);
+    for (size_t i = 0; i < size_; ++i) {
+        array[i].~Item();
+    }
+}
+
+/**
+* Copies the tree's items back into the inline array and frees the tree.
+*/
+template<typename Key, typename Value, size_t N>
+void SmallAVLMap<Key, Value, N>::demote()
+{
+    Item* array = items();
+    size_t i = 0;
+    for (typename Tree::iterator it = tree_ -> begin(); it != tree_ -> end(); ++it) {
+        new (&array[i++]) Item(*it);
+    }
+    delete tree_;
+    tree_ = NULL;
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+*/
+template<typename Key, typename Value, size_t N>
+void SmallAVLMap<Key, Value, N>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+
+    if (tree_ != NULL) {
+        typename Tree::iterator it = tree_ -> find(key);
+        if (it != tree_ -> end()) {
+            it -> second = keyValuePair.second;
+            return;
+        }
+        tree_ -> insert(keyValuePair);
+        ++size_;
+        return;
+    }
+
+    Item* array = items();
+    size_t pos = position(key);
+    if (pos < size_ && array[pos].first == key) {
+        array[pos].second = keyValuePair.second;
+        return;
+    }
+
+    if (size_ == N) {
+        promote();
+        tree_ -> insert(keyValuePair);
+        ++size_;
+        return;
+    }
+
+    // shift the tail up one slot; keys are const, so move-construct each item
+    for (size_t i = size_; i > pos; --i) {
+        new (&array[i]) Item(std::move(array[i - 1]));
+        array[i - 1].~Item();
+    }
+    new (&array[pos]) Item(keyValuePair);
+    ++size_;
+}
+
+/**
+* Removes the key if it is present.
+*/
+template<typename Key, typename Value, size_t N>
+void SmallAVLMap<Key, Value, N>::remove(const Key& key)
+{
+    if (tree_ != NULL) {
+        if (tree_ -> find(key) == tree_ -> end()) {
+            return;
+        }
+        tree_ -> remove(key);
+        if (--size_ <= N / 2) {
+            demote();
+        }
+        return;
+    }
+
+    Item* array = items();
+    size_t pos = position(key);
+    if (pos == size_ || !(array[pos].first == key)) {
+        return;
+    }
+    array[pos].~Item();
+    for (size_t i = pos + 1; i < size_; ++i) {
+        new (&array[i - 1]) Item(std::move(array[i]));
+        array[i].~Item();
+    }
+    --size_;
+}
+
+template<typename Key, typename Value, size_t N>
+void SmallAVLMap<Key, Value, N>::clear()
+{
+    if (tree_ != NULL) {
+        delete tree_;
+        tree_ = NULL;
+    }
+    else {
+        Item* array = items();
+        for (size_t i = 0; i < size_; ++i) {
+            array[i].~Item();
+        }
+    }
+    size_ = 0;
+}
+
+template<typename Key, typename Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::empty() const
+{
+    return size_ == 0;
+}
+
+template<typename Key, typename Value, size_t N>
+size_t SmallAVLMap<Key, Value, N>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns true while the items are stored in the inline array.
+*/
+template<typename Key, typename Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::isInline() const
+{
+    return tree_ == NULL;
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::begin() const
+{
+    if (tree_ != NULL) {
+        return iterator(tree_ -> begin());
+    }
+    return iterator(size_ > 0 ? items() : NULL, items() + size_);
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::find(const Key& key) const
+{
+    if (tree_ != NULL) {
+        typename Tree::iterator it = tree_ -> find(key);
+        return (it == tree_ -> end()) ? end() : iterator(it);
+    }
+    size_t pos = position(key);
+    if (pos < size_ && items()[pos].first == key) {
+        return iterator(items() + pos, items() + size_);
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, size_t N>
+Value& SmallAVLMap<Key, Value, N>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+template<typename Key, typename Value, size_t N>
+Value const & SmallAVLMap<Key, Value, N>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the SmallAVLMap class.
+  -------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the SmallAVLMap::iterator class.
+  -------------------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to end().
+*/
+template<typename Key, typename Value, size_t N>
+SmallAVLMap<Key, Value, N>::iterator::iterator() :
+    item_(NULL), last_(NULL), inTree_(false)
+{
+
+}
+
+/**
+* Iterator over the inline array; last is one past the final item. Like
+* end(), an exhausted iterator holds NULL so that the two compare equal.
+*/
+template<typename Key, typename Value, size_t N>
+SmallAVLMap<Key, Value, N>::iterator::iterator(std::pair<const Key, Value>* item, std::pair<const Key, Value>* last) :
+    item_(item), last_(last), inTree_(false)
+{
+
+}
+
+template<typename Key, typename Value, size_t N>
+SmallAVLMap<Key, Value, N>::iterator::iterator(typename Tree::iterator treeIt) :
+    item_(itemOf(treeIt)), last_(NULL), treeIt_(treeIt), inTree_(true)
+{
+
+}
+
+/**
+* Returns the item a tree iterator refers to, or NULL at the tree's end.
+*/
+template<typename Key, typename Value, size_t N>
+std::pair<const Key, Value>* SmallAVLMap<Key, Value, N>::iterator::itemOf(const typename Tree::iterator& treeIt)
+{
+    if (treeIt == typename Tree::iterator()) {
+        return NULL;
+    }
+    return treeIt.operator->();
+}
+
+template<typename Key, typename Value, size_t N>
+std::pair<const Key, Value>& SmallAVLMap<Key, Value, N>::iterator::operator*() const
+{
+    return *item_;
+}
+
+template<typename Key, typename Value, size_t N>
+std::pair<const Key, Value>* SmallAVLMap<Key, Value, N>::iterator::operator->() const
+{
+    return item_;
+}
+
+template<typename Key, typename Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::iterator::operator==(const iterator& rhs) const
+{
+    return item_ == rhs.item_;
+}
+
+template<typename Key, typename Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::iterator::operator!=(const iterator& rhs) const
+{
+    return item_ != rhs.item_;
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator& SmallAVLMap<Key, Value, N>::iterator::operator++()
+{
+    if (inTree_) {
+        ++treeIt_;
+        item_ = itemOf(treeIt_);
+    }
+    else if (++item_ == last_) {
+        item_ = NULL;
+    }
+    return *this;
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the SmallAVLMap::iterator class.
+  -----------------------------------------------------------
+*/
+
+#endif
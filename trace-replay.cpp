@@ -0,0 +1,670 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "hashed_avl.h"
+#include "leaf_depth_avl.h"
+#include "merkle_avl.h"
+#include "small_avl.h"
+#include "art_map.h"
+#include "sharded_avl.h"
+#include "avl_cache.h"
+#include "trace_recorder.h"
+
+using namespace std;
+
+// Key comparisons made by the replay in progress.
+static uint64_t comparisons = 0;
+
+/**
+* A replayed key. Every comparison bumps the counter, which costs the
+* same for every tree and so leaves their ranking alone.
+*/
+template <typename T>
+struct CountedKey {
+    T key;
+
+    CountedKey() : key() { }
+    explicit CountedKey(const T& k) : key(k) { }
+};
+
+template <typename T>
+bool operator<(const CountedKey<T>& a, const CountedKey<T>& b) { ++comparisons; return a.key < b.key; }
+template <typename T>
+bool operator>(const CountedKey<T>& a, const CountedKey<T>& b) { ++comparisons; return b.key < a.key; }
+template <typename T>
+bool operator<=(const CountedKey<T>& a, const CountedKey<T>& b) { ++comparisons; return !(b.key < a.key); }
+template <typename T>
+bool operator>=(const CountedKey<T>& a, const CountedKey<T>& b) { ++comparisons; return !(a.key < b.key); }
+template <typename T>
+bool operator==(const CountedKey<T>& a, const CountedKey<T>& b) { ++comparisons; return a.key == b.key; }
+template <typename T>
+bool operator!=(const CountedKey<T>& a, const CountedKey<T>& b) { ++comparisons; return !(a.key == b.key); }
+
+template <typename T>
+std::ostream& operator<<(std::ostream& out, const CountedKey<T>& k)
+{
+    return out << k.key;
+}
+
+namespace std {
+template <typename T>
+struct hash<CountedKey<T> > {
+    size_t operator()(const CountedKey<T>& k) const { return std::hash<T>()(k.key); }
+};
+}
+
+/**
+* One decoded trace record.
+*/
+template <typename Key, typename Value>
+struct ReplayOp {
+    uint8_t op;
+    Key key;
+    Value value;
+};
+
+/**
+* What one replay of the trace did to a tree.
+*/
+struct ReplayCounters {
+    uint64_t comparisons;
+    uint64_t hits;          // finds and operator[] that found their key
+    uint64_t misses;
+    uint64_t steps;         // iterator steps taken
+    size_t size;
+    int height;
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/**
+* Decodes a recorded integer of any width into an int64_t. Unsigned
+* integers have their top bit flipped so they keep their order.
+*/
+static const char* decodeField(const char* p, const char* end, uint8_t code, uint8_t size, int64_t& out)
+{
+    if (size == 0 || size > 8 || static_cast<size_t>(end - p) < size) {
+        throw std::runtime_error("Corrupt trace");
+    }
+    uint64_t raw = 0;
+    std::memcpy(&raw, p, size);
+    if (code == TRACE_SIGNED) {
+        int shift = 64 - 8 * size;
+        out = static_cast<int64_t>(raw << shift) >> shift;
+    }
+    else {
+        out = static_cast<int64_t>(raw ^ (1ULL << 63));
+    }
+    return p + size;
+}
+
+/**
+* Decodes a recorded string, or the bytes of any other recorded type.
+*/
+static const char* decodeField(const char* p, const char* end, uint8_t code, uint8_t size, std::string& out)
+{
+    if (code == TRACE_STRING) {
+        return RunCodec<std::string>::decode(p, end, out);
+    }
+    if (static_cast<size_t>(end - p) < size) {
+        throw std::runtime_error("Corrupt trace");
+    }
+    out.assign(p, size);
+    return p + size;
+}
+
+template <typename T>
+static const char* decodeField(const char* p, const char* end, uint8_t code, uint8_t size, CountedKey<T>& out)
+{
+    return decodeField(p, end, code, size, out.key);
+}
+
+template <typename T>
+const T& rawKey(const CountedKey<T>& k)
+{
+    return k.key;
+}
+
+inline int64_t rawKey(int64_t k)
+{
+    return k;
+}
+
+/**
+* An ArtMap that takes the replay's counted keys. Its lookups compare
+* key bytes rather than keys, so it adds nothing to the comparison count.
+*/
+template <typename Value>
+class CountedArtMap : public ArtMap<int64_t, Value>
+{
+public:
+    typedef typename ArtMap<int64_t, Value>::iterator iterator;
+
+    void insert(const std::pair<const CountedKey<int64_t>, Value>& keyValuePair)
+    {
+        ArtMap<int64_t, Value>::insert(std::make_pair(keyValuePair.first.key, keyValuePair.second));
+    }
+    void remove(const CountedKey<int64_t>& key) { ArtMap<int64_t, Value>::remove(key.key); }
+    iterator find(const CountedKey<int64_t>& key) const { return ArtMap<int64_t, Value>::find(key.key); }
+    Value& operator[](const CountedKey<int64_t>& key) { return ArtMap<int64_t, Value>::operator[](key.key); }
+
+    /**
+    * Counts the items by walking them; only called once a replay is done.
+    */
+    size_t size() const
+    {
+        size_t count = 0;
+        for (iterator it = this -> begin(); it != this -> end(); ++it) {
+            ++count;
+        }
+        return count;
+    }
+};
+
+/**
+* Replays onto a BinarySearchTree or one of its subclasses, following
+* one cursor. TRACE_BEGIN and TRACE_FIND move it and TRACE_NEXT advances
+* it, which is what the recorded program did unless it interleaved
+* several iterators. capacity is unused.
+*/
+template <typename Tree, typename Key, typename Value>
+class TreeTarget
+{
+public:
+    explicit TreeTarget(size_t capacity) : cursor_(tree_.end()) { }
+
+    void insert(const Key& key, const Value& value)
+    {
+        tree_.insert(std::make_pair(key, value));
+    }
+
+    void remove(const Key& key)
+    {
+        // do not leave the cursor on a freed item
+        if (cursor_ != tree_.end() && rawKey(cursor_ -> first) == rawKey(key)) {
+            cursor_ = tree_.end();
+        }
+        tree_.remove(key);
+    }
+
+    bool find(const Key& key)
+    {
+        cursor_ = tree_.find(key);
+        return cursor_ != tree_.end();
+    }
+
+    bool index(const Key& key)
+    {
+        try {
+            tree_[key];
+            return true;
+        }
+        catch (const std::out_of_range&) {
+            return false;
+        }
+    }
+
+    void begin() { cursor_ = tree_.begin(); }
+
+    bool next()
+    {
+        if (cursor_ == tree_.end()) {
+            return false;
+        }
+        ++cursor_;
+        return true;
+    }
+
+    size_t size() const { return tree_.size(); }
+    int height() const { return tree_.height(); }
+
+protected:
+    Tree tree_;
+    typename Tree::iterator cursor_;
+};
+
+/**
+* Replays onto a map whose inserts and removes can move the cursor's
+* item (SmallAVLMap's inline array) or free the nodes its path runs
+* through (ArtMap's growing inner nodes). The cursor is found again by
+* key after each of them; that lookup is timed with the op but its
+* comparisons are not counted. Neither map reports a height.
+*/
+template <typename Map, typename Key, typename Value>
+class MovingTarget : public TreeTarget<Map, Key, Value>
+{
+public:
+    explicit MovingTarget(size_t capacity) : TreeTarget<Map, Key, Value>(capacity) { }
+
+    void insert(const Key& key, const Value& value)
+    {
+        bool held = (this -> cursor_ != this -> tree_.end());
+        Key at = held ? Key(rawKey(this -> cursor_ -> first)) : Key();
+        TreeTarget<Map, Key, Value>::insert(key, value);
+        if (held) {
+            reseek(at);
+        }
+    }
+
+    void remove(const Key& key)
+    {
+        bool held = (this -> cursor_ != this -> tree_.end() && !(rawKey(this -> cursor_ -> first) == rawKey(key)));
+        Key at = held ? Key(rawKey(this -> cursor_ -> first)) : Key();
+        TreeTarget<Map, Key, Value>::remove(key);
+        if (held) {
+            reseek(at);
+        }
+    }
+
+    int height() const { return -1; }
+
+protected:
+    void reseek(const Key& at)
+    {
+        uint64_t counted = comparisons;
+        this -> cursor_ = this -> tree_.find(at);
+        comparisons = counted;
+    }
+};
+
+/**
+* Replays onto a BoundedAVLCache holding capacity entries. Evictions
+* show up as misses. An insert can evict the cursor's item, so the
+* cursor is checked with peek() (timed, not counted, and not a use)
+* after each insert.
+*/
+template <typename Key, typename Value>
+class CacheTarget
+{
+public:
+    explicit CacheTarget(size_t capacity) : cache_(capacity), cursor_(cache_.end()) { }
+
+    void insert(const Key& key, const Value& value)
+    {
+        bool held = (cursor_ != cache_.end());
+        Key at = held ? cursor_ -> first : Key();
+        cache_.insert(std::make_pair(key, value));
+        if (held) {
+            uint64_t counted = comparisons;
+            if (cache_.peek(at) == cache_.end()) {
+                cursor_ = cache_.end();
+            }
+            comparisons = counted;
+        }
+    }
+
+    void remove(const Key& key)
+    {
+        if (cursor_ != cache_.end() && cursor_ -> first.key == key.key) {
+            cursor_ = cache_.end();
+        }
+        cache_.remove(key);
+    }
+
+    bool find(const Key& key)
+    {
+        cursor_ = cache_.find(key);
+        return cursor_ != cache_.end();
+    }
+
+    bool index(const Key& key)
+    {
+        try {
+            cache_[key];
+            return true;
+        }
+        catch (const std::out_of_range&) {
+            return false;
+        }
+    }
+
+    void begin() { cursor_ = cache_.begin(); }
+
+    bool next()
+    {
+        if (cursor_ == cache_.end()) {
+            return false;
+        }
+        ++cursor_;
+        return true;
+    }
+
+    size_t size() const { return cache_.size(); }
+    int height() const { return cache_.height(); }
+
+protected:
+    BoundedAVLCache<Key, Value> cache_;
+    typename BoundedAVLCache<Key, Value>::iterator cursor_;
+};
+
+/**
+* Replays onto a ShardedAVLMap. Its iterators can only start at begin(),
+* so TRACE_FIND looks the key up and leaves the cursor at the end, and
+* the TRACE_NEXT steps after a find are not taken. It reports no height.
+*/
+template <typename Key, typename Value>
+class ShardedTarget
+{
+public:
+    explicit ShardedTarget(size_t capacity) : cursor_(map_.end()) { }
+
+    void insert(const Key& key, const Value& value)
+    {
+        map_.insert(std::make_pair(key, value));
+    }
+
+    void remove(const Key& key)
+    {
+        if (cursor_ != map_.end() && cursor_ -> first.key == key.key) {
+            cursor_ = map_.end();
+        }
+        map_.remove(key);
+    }
+
+    bool find(const Key& key)
+    {
+        cursor_ = map_.end();
+        Value value;
+        return map_.find(key, value);
+    }
+
+    bool index(const Key& key)
+    {
+        Value value;
+        return map_.find(key, value);
+    }
+
+    void begin() { cursor_ = map_.begin(); }
+
+    bool next()
+    {
+        if (cursor_ == map_.end()) {
+            return false;
+        }
+        ++cursor_;
+        return true;
+    }
+
+    size_t size() const
+    {
+        size_t count = 0;
+        for (typename ShardedAVLMap<Key, Value>::iterator it = map_.begin(); it != map_.end(); ++it) {
+            ++count;
+        }
+        return count;
+    }
+
+    int height() const { return -1; }
+
+protected:
+    ShardedAVLMap<Key, Value> map_;
+    typename ShardedAVLMap<Key, Value>::iterator cursor_;
+};
+
+/**
+* Runs every op against a fresh Target. Times each op into latencies
+* when it is not NULL.
+*/
+template <typename Target, typename Key, typename Value>
+void replayOnce(const vector<ReplayOp<Key, Value> >& ops, size_t capacity, ReplayCounters& counters,
+                vector<double>* latencies)
+{
+    Target target(capacity);
+    comparisons = 0;
+    counters.hits = counters.misses = counters.steps = 0;
+
+    std::chrono::steady_clock::time_point start;
+    for (size_t i = 0; i < ops.size(); ++i) {
+        const ReplayOp<Key, Value>& op = ops[i];
+        if (latencies != NULL) {
+            start = std::chrono::steady_clock::now();
+        }
+        switch (op.op) {
+        case TRACE_INSERT:
+            target.insert(op.key, op.value);
+            break;
+        case TRACE_REMOVE:
+            target.remove(op.key);
+            break;
+        case TRACE_FIND:
+            if (target.find(op.key)) {
+                ++counters.hits;
+            }
+            else {
+                ++counters.misses;
+            }
+            break;
+        case TRACE_INDEX:
+            if (target.index(op.key)) {
+                ++counters.hits;
+            }
+            else {
+                ++counters.misses;
+            }
+            break;
+        case TRACE_BEGIN:
+            target.begin();
+            break;
+        case TRACE_NEXT:
+            if (target.next()) {
+                ++counters.steps;
+            }
+            break;
+        }
+        if (latencies != NULL) {
+            latencies -> push_back(std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    counters.comparisons = comparisons;
+    counters.size = target.size();
+    counters.height = target.height();
+}
+
+/**
+* Replays the trace on Target twice: untimed for throughput and
+* counters, then with every op timed for its latency percentiles. Skips
+* targets whose name does not contain only, returning false.
+*/
+template <typename Target, typename Key, typename Value>
+bool replayOn(const string& name, const string& only, const vector<ReplayOp<Key, Value> >& ops,
+              size_t capacity, ReplayCounters& counters)
+{
+    if (!only.empty() && name.find(only) == string::npos) {
+        return false;
+    }
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    replayOnce<Target>(ops, capacity, counters, NULL);
+    double seconds = secondsSince(begin);
+
+    vector<double> latencies;
+    latencies.reserve(ops.size());
+    ReplayCounters timed;
+    replayOnce<Target>(ops, capacity, timed, &latencies);
+    sort(latencies.begin(), latencies.end());
+
+    cout << setw(22) << name << fixed << setprecision(2)
+         << setw(9) << ops.size() / seconds / 1e6
+         << setprecision(0)
+         << setw(10) << latencies[latencies.size() / 2]
+         << setw(10) << latencies[latencies.size() * 99 / 100]
+         << setw(11) << latencies[latencies.size() * 999 / 1000]
+         << setprecision(1)
+         << setw(10) << static_cast<double>(counters.comparisons) / ops.size();
+    if (counters.height < 0) {
+        cout << setw(8) << "-";
+    }
+    else {
+        cout << setw(8) << counters.height;
+    }
+    cout << setw(10) << counters.size << endl;
+    return true;
+}
+
+/**
+* ArtMap only holds integer keys, so only integer traces replay on it.
+*/
+template <typename Key, typename Value>
+bool replayOnArt(const string& only, const vector<ReplayOp<Key, Value> >& ops, ReplayCounters& counters)
+{
+    return false;
+}
+
+template <typename Value>
+bool replayOnArt(const string& only, const vector<ReplayOp<CountedKey<int64_t>, Value> >& ops,
+                 ReplayCounters& counters)
+{
+    return replayOn<MovingTarget<CountedArtMap<Value>, CountedKey<int64_t>, Value> >("ArtMap", only, ops, 0, counters);
+}
+
+/**
+* Decodes the trace's records, then replays them on every tree and map.
+*/
+template <typename Key, typename Value>
+void replayTrace(const string& data, const string& only)
+{
+    uint8_t keyCode = data[8], keySize = data[9], valueCode = data[10], valueSize = data[11];
+    const char* p = data.data() + TRACE_HEADER_SIZE;
+    const char* end = data.data() + data.size();
+
+    vector<ReplayOp<Key, Value> > ops;
+    vector<Key> inserted;
+    uint64_t counts[TRACE_NEXT + 1] = { 0 };
+    while (p < end) {
+        ReplayOp<Key, Value> op;
+        op.op = static_cast<uint8_t>(*p++);
+        if (op.op < TRACE_INSERT || op.op > TRACE_NEXT) {
+            throw std::runtime_error("Corrupt trace");
+        }
+        if (op.op <= TRACE_INDEX) {
+            p = decodeField(p, end, keyCode, keySize, op.key);
+        }
+        if (op.op == TRACE_INSERT) {
+            p = decodeField(p, end, valueCode, valueSize, op.value);
+            inserted.push_back(op.key);
+        }
+        ++counts[op.op];
+        ops.push_back(op);
+    }
+    if (ops.empty()) {
+        throw std::runtime_error("Trace holds no operations");
+    }
+    sort(inserted.begin(), inserted.end());
+    size_t distinct = unique(inserted.begin(), inserted.end()) - inserted.begin();
+
+    cout << "Trace: " << ops.size() << " ops: " << counts[TRACE_INSERT] << " insert, "
+         << counts[TRACE_REMOVE] << " remove, " << counts[TRACE_FIND] << " find, "
+         << counts[TRACE_INDEX] << " operator[], " << counts[TRACE_BEGIN] << " begin, "
+         << counts[TRACE_NEXT] << " ++; " << distinct << " keys inserted" << endl;
+    cout << "\nLatencies are in ns and include reading the clock." << endl;
+    cout << "                  tree   Mops/s   p50 (ns)  p99 (ns)  p99.9 (ns)  cmp/op  height     items" << endl;
+
+    // every uncapped tree sees the same hits, misses and steps
+    ReplayCounters counters, other;
+    bool ran = false;
+    ran |= replayOn<TreeTarget<BinarySearchTree<Key, Value>, Key, Value> >("BinarySearchTree", only, ops, 0, counters);
+    ran |= replayOn<TreeTarget<AVLTree<Key, Value>, Key, Value> >("AVLTree", only, ops, 0, counters);
+    ran |= replayOn<TreeTarget<HashedAVLTree<Key, Value>, Key, Value> >("HashedAVLTree", only, ops, 0, counters);
+    ran |= replayOn<TreeTarget<LeafDepthAVLTree<Key, Value>, Key, Value> >("LeafDepthAVLTree", only, ops, 0, counters);
+    ran |= replayOn<TreeTarget<MerkleAVLTree<Key, Value>, Key, Value> >("MerkleAVLTree", only, ops, 0, counters);
+    ran |= replayOn<MovingTarget<SmallAVLMap<Key, Value>, Key, Value> >("SmallAVLMap", only, ops, 0, counters);
+    ran |= replayOnArt(only, ops, counters);
+    replayOn<ShardedTarget<Key, Value> >("ShardedAVLMap", only, ops, 0, other);
+    const size_t fractions[] = { 2, 8, 32 };
+    for (size_t i = 0; i < sizeof(fractions) / sizeof(fractions[0]); ++i) {
+        size_t capacity = std::max<size_t>(distinct / fractions[i], 1);
+        replayOn<CacheTarget<Key, Value> >("BoundedAVLCache 1/" + std::to_string(fractions[i]),
+                                           only, ops, capacity, other);
+    }
+    if (ran) {
+        cout << "\nLookups: " << counters.hits << " found, " << counters.misses << " missing; "
+             << counters.steps << " iterator steps" << endl;
+    }
+    cout << "SmallAVLMap and ArtMap find their cursor again after each update. ShardedAVLMap\n"
+         << "cannot start an iterator at a key, so it skips the steps after a find. The\n"
+         << "caches hold that fraction of the inserted keys and miss what they evicted." << endl;
+}
+
+/**
+* Picks the replay's value type from the header: integers replay as
+* int64_t, everything else as a string of its bytes.
+*/
+template <typename Key>
+void replayWithKey(const string& data, const string& only)
+{
+    uint8_t valueCode = data[10];
+    if (valueCode == TRACE_SIGNED || valueCode == TRACE_UNSIGNED) {
+        replayTrace<Key, int64_t>(data, only);
+    }
+    else {
+        replayTrace<Key, std::string>(data, only);
+    }
+}
+
+static string readTrace(const char* path)
+{
+    int fd = ::open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || ::fstat(fd, &info) != 0) {
+        throw std::runtime_error(string("Cannot open trace ") + path);
+    }
+    string data(static_cast<size_t>(info.st_size), '\0');
+    size_t got = 0;
+    while (got < data.size()) {
+        ssize_t n = ::read(fd, &data[got], data.size() - got);
+        if (n <= 0) {
+            break;
+        }
+        got += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    data.resize(got);
+    if (data.size() < TRACE_HEADER_SIZE || std::memcmp(data.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        throw std::runtime_error(string("Not a trace: ") + path);
+    }
+    return data;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        cout << "usage: " << argv[0] << " trace [tree name filter]" << endl;
+        return 1;
+    }
+    string only = (argc > 2) ? argv[2] : "";
+
+    try {
+        string data = readTrace(argv[1]);
+        uint8_t keyCode = data[8];
+        if (keyCode == TRACE_SIGNED || keyCode == TRACE_UNSIGNED) {
+            replayWithKey<CountedKey<int64_t> >(data, only);
+        }
+        else if (keyCode == TRACE_STRING) {
+            replayWithKey<CountedKey<std::string> >(data, only);
+        }
+        else {
+            throw std::runtime_error("Only integer and string keys can be replayed");
+        }
+    }
+    catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
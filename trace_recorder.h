@@ -0,0 +1,397 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "avlbst.h"
+#include "run_codec.h"
+
+/**
+* The operation trace format written by TracedTree and read by
+* trace-replay.
+*
+* A trace is a 16 byte header, then one record per operation: an op
+* byte, then the key for TRACE_INSERT, TRACE_REMOVE, TRACE_FIND and
+* TRACE_INDEX, then the value for TRACE_INSERT. TRACE_BEGIN and
+* TRACE_NEXT are the op byte alone. Keys and values use RunCodec. The
+* header is the magic, then the type code and size of the key and of
+* the value, then padding.
+*/
+enum TraceOp {
+    TRACE_INSERT = 1,
+    TRACE_REMOVE = 2,
+    TRACE_FIND = 3,
+    TRACE_INDEX = 4,        // operator[]
+    TRACE_BEGIN = 5,
+    TRACE_NEXT = 6          // ++ on an iterator
+};
+
+enum TraceTypeCode { TRACE_SIGNED = 1, TRACE_UNSIGNED = 2, TRACE_STRING = 3, TRACE_RAW = 4 };
+
+static const char TRACE_MAGIC[8] = { 'B', 'S', 'T', 'T', 'R', 'A', 'C', 'E' };
+static const size_t TRACE_HEADER_SIZE = 16;
+
+/**
+* The header's type code for T, so a replay can decode keys and values
+* without being compiled for the recorded types.
+*/
+template <typename T>
+struct TraceType {
+    static const uint8_t code = std::is_integral<T>::value ?
+        (std::is_signed<T>::value ? TRACE_SIGNED : TRACE_UNSIGNED) : TRACE_RAW;
+    static const uint8_t size = sizeof(T);
+};
+
+template <>
+struct TraceType<std::string> {
+    static const uint8_t code = TRACE_STRING;
+    static const uint8_t size = 0;
+};
+
+/**
+* Appends trace records to a file through a buffer.
+*/
+class TraceWriter
+{
+public:
+    TraceWriter(const std::string& path, uint8_t keyCode, uint8_t keySize, uint8_t valueCode, uint8_t valueSize);
+    ~TraceWriter();
+
+    std::string& buffer();
+    void recorded();
+    void flush();
+    uint64_t records() const;
+
+private:
+    TraceWriter(const TraceWriter&);
+    TraceWriter& operator=(const TraceWriter&);
+
+    static const size_t FLUSH_BYTES = 1 << 20;
+
+    std::string path_;
+    int fd_;
+    std::string buffer_;
+    uint64_t records_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the TraceWriter class.
+  -------------------------------------------------
+*/
+
+/**
+* Creates path, replacing any earlier trace, and writes the header.
+*/
+inline TraceWriter::TraceWriter(const std::string& path, uint8_t keyCode, uint8_t keySize,
+                                uint8_t valueCode, uint8_t valueSize) :
+    path_(path), fd_(-1), records_(0)
+{
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot create trace " + path);
+    }
+    buffer_.assign(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    buffer_.push_back(static_cast<char>(keyCode));
+    buffer_.push_back(static_cast<char>(keySize));
+    buffer_.push_back(static_cast<char>(valueCode));
+    buffer_.push_back(static_cast<char>(valueSize));
+    buffer_.resize(TRACE_HEADER_SIZE, '\0');
+}
+
+inline TraceWriter::~TraceWriter()
+{
+    try {
+        flush();
+    }
+    catch (const std::runtime_error&) {
+        // nothing to report to from a destructor; call flush() to see errors
+    }
+    ::close(fd_);
+}
+
+/**
+* The buffer a record is encoded onto; call recorded() once it is.
+*/
+inline std::string& TraceWriter::buffer()
+{
+    return buffer_;
+}
+
+inline void TraceWriter::recorded()
+{
+    ++records_;
+    if (buffer_.size() >= FLUSH_BYTES) {
+        flush();
+    }
+}
+
+/**
+* Writes the buffered records to the file.
+*/
+inline void TraceWriter::flush()
+{
+    size_t written = 0;
+    while (written < buffer_.size()) {
+        ssize_t n = ::write(fd_, buffer_.data() + written, buffer_.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            buffer_.erase(0, written);
+            throw std::runtime_error("Cannot write trace " + path_);
+        }
+        written += static_cast<size_t>(n);
+    }
+    buffer_.clear();
+}
+
+inline uint64_t TraceWriter::records() const
+{
+    return records_;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the TraceWriter class.
+  -----------------------------------------------
+*/
+
+/**
+* A tree that can record the operations made on it to a trace file.
+*
+* Tree is BinarySearchTree<Key, Value>, AVLTree<Key, Value> or a tree
+* derived from them. Recording is off until startTrace(); while it is
+* on, insert, remove, find, operator[], begin() and ++ on the iterators
+* this tree returns each append one record. Calls made through a
+* pointer or reference to the base tree reach only the virtual insert
+* and remove, so keep the TracedTree type where operations should be
+* seen.
+*
+* Key and Value must be strings or trivially copyable. trace-replay
+* replays integer and string keys.
+*/
+template <typename Key, typename Value, typename Tree = AVLTree<Key, Value> >
+class TracedTree : public Tree
+{
+public:
+    typedef typename Tree::iterator BaseIterator;
+
+    /**
+    * The tree's iterator, recording TRACE_NEXT on ++ when it came from
+    * a tree that was recording. It only watches that trace, so once the
+    * trace is stopped or replaced, or the tree is gone, ++ records
+    * nothing.
+    */
+    class iterator : public BaseIterator
+    {
+    public:
+        iterator();
+        iterator& operator++();
+
+    protected:
+        friend class TracedTree<Key, Value, Tree>;
+        iterator(const BaseIterator& position, const std::shared_ptr<TraceWriter>& writer);
+
+        std::weak_ptr<TraceWriter> writer_;
+    };
+
+    TracedTree();
+    virtual ~TracedTree();
+
+    void startTrace(const std::string& path);
+    void stopTrace();
+    bool tracing() const;
+    uint64_t tracedOperations() const;
+
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair) override;
+    virtual void remove(const Key& key) override;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    iterator begin() const;
+    iterator end() const;
+
+private:
+    TracedTree(const TracedTree&);
+    TracedTree& operator=(const TracedTree&);
+
+    void record(TraceOp op, const Key* key, const Value* value) const;
+
+    std::shared_ptr<TraceWriter> writer_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the TracedTree class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Tree>
+TracedTree<Key, Value, Tree>::iterator::iterator()
+{
+}
+
+template<class Key, class Value, class Tree>
+TracedTree<Key, Value, Tree>::iterator::iterator(const BaseIterator& position,
+                                                 const std::shared_ptr<TraceWriter>& writer) :
+    BaseIterator(position), writer_(writer)
+{
+}
+
+template<class Key, class Value, class Tree>
+typename TracedTree<Key, Value, Tree>::iterator&
+TracedTree<Key, Value, Tree>::iterator::operator++()
+{
+    std::shared_ptr<TraceWriter> writer = writer_.lock();
+    if (writer) {
+        writer -> buffer().push_back(static_cast<char>(TRACE_NEXT));
+        writer -> recorded();
+    }
+    BaseIterator::operator++();
+    return *this;
+}
+
+template<class Key, class Value, class Tree>
+TracedTree<Key, Value, Tree>::TracedTree() :
+    Tree()
+{
+}
+
+template<class Key, class Value, class Tree>
+TracedTree<Key, Value, Tree>::~TracedTree()
+{
+    stopTrace();
+}
+
+/**
+* Starts recording to path, replacing a trace already there.
+*/
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::startTrace(const std::string& path)
+{
+    static_assert(std::is_same<Key, std::string>::value || std::is_trivially_copyable<Key>::value,
+                  "TracedTree keys must be strings or trivially copyable");
+    static_assert(std::is_same<Value, std::string>::value || std::is_trivially_copyable<Value>::value,
+                  "TracedTree values must be strings or trivially copyable");
+    stopTrace();
+    writer_.reset(new TraceWriter(path, TraceType<Key>::code, TraceType<Key>::size,
+                                  TraceType<Value>::code, TraceType<Value>::size));
+}
+
+/**
+* Stops recording and writes out the rest of the trace.
+*/
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::stopTrace()
+{
+    writer_.reset();
+}
+
+template<class Key, class Value, class Tree>
+bool TracedTree<Key, Value, Tree>::tracing() const
+{
+    return writer_ != NULL;
+}
+
+/**
+* Returns how many records the current trace holds.
+*/
+template<class Key, class Value, class Tree>
+uint64_t TracedTree<Key, Value, Tree>::tracedOperations() const
+{
+    return writer_ == NULL ? 0 : writer_ -> records();
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::record(TraceOp op, const Key* key, const Value* value) const
+{
+    std::string& out = writer_ -> buffer();
+    out.push_back(static_cast<char>(op));
+    if (key != NULL) {
+        RunCodec<Key>::encode(out, *key);
+    }
+    if (value != NULL) {
+        RunCodec<Value>::encode(out, *value);
+    }
+    writer_ -> recorded();
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    if (writer_ != NULL) {
+        record(TRACE_INSERT, &keyValuePair.first, &keyValuePair.second);
+    }
+    Tree::insert(keyValuePair);
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::remove(const Key& key)
+{
+    if (writer_ != NULL) {
+        record(TRACE_REMOVE, &key, NULL);
+    }
+    Tree::remove(key);
+}
+
+template<class Key, class Value, class Tree>
+typename TracedTree<Key, Value, Tree>::iterator
+TracedTree<Key, Value, Tree>::find(const Key& key) const
+{
+    if (writer_ != NULL) {
+        record(TRACE_FIND, &key, NULL);
+    }
+    return iterator(Tree::find(key), writer_);
+}
+
+template<class Key, class Value, class Tree>
+Value& TracedTree<Key, Value, Tree>::operator[](const Key& key)
+{
+    if (writer_ != NULL) {
+        record(TRACE_INDEX, &key, NULL);
+    }
+    return Tree::operator[](key);
+}
+
+template<class Key, class Value, class Tree>
+Value const & TracedTree<Key, Value, Tree>::operator[](const Key& key) const
+{
+    if (writer_ != NULL) {
+        record(TRACE_INDEX, &key, NULL);
+    }
+    return Tree::operator[](key);
+}
+
+template<class Key, class Value, class Tree>
+typename TracedTree<Key, Value, Tree>::iterator
+TracedTree<Key, Value, Tree>::begin() const
+{
+    if (writer_ != NULL) {
+        record(TRACE_BEGIN, NULL, NULL);
+    }
+    return iterator(Tree::begin(), writer_);
+}
+
+template<class Key, class Value, class Tree>
+typename TracedTree<Key, Value, Tree>::iterator
+TracedTree<Key, Value, Tree>::end() const
+{
+    return iterator(Tree::end(), std::shared_ptr<TraceWriter>());
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the TracedTree class.
+  -----------------------------------------------
+*/
+
+#endif
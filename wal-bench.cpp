@@ -0,0 +1,129 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <stdint.h>
+#include "wal_avl.h"
+
+using namespace std;
+
+// Concurrent writer counts compared.
+static const int WRITERS[] = { 1, 4, 16 };
+static const int NUM_WRITER_COUNTS = sizeof(WRITERS) / sizeof(WRITERS[0]);
+
+static double secondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void removeDirectory(const string& directory)
+{
+    string command = "rm -rf '" + directory + "'";
+    if (system(command.c_str()) != 0) {
+        cout << "could not remove " << directory << endl;
+    }
+}
+
+/**
+* Has each of writers commit perWriter inserts of distinct keys, recording
+* every commit's latency in microseconds.
+*/
+static void commitPass(const string& directory, int writers, int perWriter)
+{
+    removeDirectory(directory);
+    WALOptions options;
+    options.checkpointBytes = 0;
+    DurableAVLTree<uint64_t, uint64_t> tree(directory, options);
+
+    vector<vector<double> > latencies(writers);
+    vector<thread> threads;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (int w = 0; w < writers; ++w) {
+        threads.push_back(thread([&tree, &latencies, w, perWriter]() {
+            latencies[w].reserve(perWriter);
+            for (int i = 0; i < perWriter; ++i) {
+                uint64_t key = static_cast<uint64_t>(w) * perWriter + i;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                tree.insert(std::make_pair(key, key));
+                latencies[w].push_back(secondsSince(start) * 1e6);
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    double seconds = secondsSince(begin);
+
+    vector<double> all;
+    for (int w = 0; w < writers; ++w) {
+        all.insert(all.end(), latencies[w].begin(), latencies[w].end());
+    }
+    sort(all.begin(), all.end());
+    WALStats stats = tree.stats();
+    cout << setw(7) << writers << fixed << setprecision(1)
+         << setw(14) << all[all.size() / 2] << setw(14) << all[all.size() * 99 / 100]
+         << setw(16) << stats.commits / seconds
+         << setw(18) << setprecision(2) << static_cast<double>(stats.commits) / stats.syncs << endl;
+}
+
+/**
+* Opens the directory and reports how long recovery took.
+*/
+static void recoveryPass(const string& directory, const char* label)
+{
+    DurableAVLTree<uint64_t, uint64_t> tree(directory);
+    WALStats stats = tree.stats();
+    cout << setw(22) << label << setw(12) << tree.size() << setw(12) << stats.replayed
+         << fixed << setprecision(3) << setw(14) << stats.recoverySeconds << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int commits = (argc > 1) ? atoi(argv[1]) : 4000;
+    int recoverKeys = (argc > 2) ? atoi(argv[2]) : 1000000;
+    string directory = (argc > 3) ? argv[3] : "wal-bench.wal";
+
+    cout << commits << " durable inserts per row:" << endl;
+    cout << "writers   p50 (us)      p99 (us)      commits/s      commits/fsync" << endl;
+    for (int i = 0; i < NUM_WRITER_COUNTS; ++i) {
+        commitPass(directory, WRITERS[i], commits / WRITERS[i]);
+    }
+
+    // one log of recoverKeys records, with every tenth key overwritten
+    removeDirectory(directory);
+    {
+        WALOptions options;
+        options.checkpointBytes = 0;
+        DurableAVLTree<uint64_t, uint64_t> tree(directory, options);
+        vector<thread> threads;
+        for (int w = 0; w < 16; ++w) {
+            threads.push_back(thread([&tree, w, recoverKeys]() {
+                for (int i = w; i < recoverKeys; i += 16) {
+                    uint64_t key = (static_cast<uint64_t>(i) * 0x9E3779B97F4A7C15ULL) >> 20;
+                    tree.insert(std::make_pair(key, key));
+                    if (i % 10 == 0) {
+                        tree.insert(std::make_pair(key, key + 1));
+                    }
+                }
+            }));
+        }
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+    }
+
+    cout << "\nRecovery:" << endl;
+    cout << "                 state       items    replayed   seconds" << endl;
+    recoveryPass(directory, "log only");
+    {
+        DurableAVLTree<uint64_t, uint64_t> tree(directory);
+        tree.checkpoint();
+    }
+    recoveryPass(directory, "checkpoint");
+
+    removeDirectory(directory);
+    return 0;
+}
@@ -0,0 +1,800 @@
+#ifndef WAL_AVL_H
+#define WAL_AVL_H
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+#include "run_codec.h"
+
+/**
+* Tuning knobs for a DurableAVLTree.
+*/
+struct WALOptions {
+    size_t checkpointBytes;     // log size that triggers a background checkpoint; 0 for none
+
+    WALOptions() :
+        checkpointBytes(64 << 20)
+    {}
+};
+
+/**
+* Counters for a DurableAVLTree, for benchmarks.
+*/
+struct WALStats {
+    uint64_t commits;
+    uint64_t syncs;             // fewer than commits when writers share an fsync
+    uint64_t checkpoints;
+    uint64_t replayed;          // log records applied by recovery
+    double recoverySeconds;
+};
+
+/**
+* Returns the CRC-32 (IEEE) of the bytes, for spotting torn log records.
+*/
+inline uint32_t walCrc32(const char* data, size_t length)
+{
+    static const struct Table {
+        uint32_t entries[256];
+        Table()
+        {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+                }
+                entries[i] = c;
+            }
+        }
+    } table;
+
+    uint32_t crc = 0xFFFFFFFFU;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table.entries[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFU;
+}
+
+/**
+* An AVLTree whose updates survive a crash, kept in a directory of a
+* checkpoint and write-ahead log files.
+*
+* insert and remove append a record to the current log and return once
+* the record is on disk and applied to the tree. Writers that arrive
+* while an fsync is running queue their records, and the first of them
+* writes and syncs the whole batch when it finishes, then applies it to
+* the tree in log order (group commit), so concurrent writers share
+* fsyncs instead of taking turns. Readers therefore only see durable
+* updates. They share the tree's lock with writers but never wait for a
+* disk write.
+*
+* Once the log passes checkpointBytes a background thread checkpoints:
+* writers pause while the tree is cloned and a new log file is started,
+* then the clone is written to the checkpoint file and the logs it covers
+* are deleted. The clone briefly doubles the tree's memory.
+*
+* Opening the directory recovers: the checkpoint's items and every later
+* log record are sorted together, the newest record for each key wins,
+* and the tree is built from the result with buildFromSorted in O(n)
+* rather than replayed one insert at a time. A record cut short by a
+* crash, which was never acknowledged, ends its log file.
+*/
+template <typename Key, typename Value>
+class DurableAVLTree
+{
+public:
+    explicit DurableAVLTree(const std::string& directory, const WALOptions& options = WALOptions());
+    ~DurableAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value get(const Key& key) const;
+    size_t size() const;
+    template<typename Callback>
+    void scan(const Key& lo, const Key& hi, Callback callback) const;
+
+    void checkpoint();
+    WALStats stats() const;
+
+private:
+    DurableAVLTree(const DurableAVLTree&);
+    DurableAVLTree& operator=(const DurableAVLTree&);
+
+    enum RecordType { PUT_RECORD = 1, REMOVE_RECORD = 2 };
+
+    // a decoded log record; value is unset for removes
+    struct LogRecord {
+        Key key;
+        Value value;
+        bool live;
+    };
+
+    static const char CHECKPOINT_MAGIC[8];
+
+    static void appendRecord(std::string& out, RecordType type, const Key& key, const Value* value);
+    static const char* nextRecord(const char* p, const char* end, LogRecord& record);
+    static bool readFile(const std::string& path, std::string& data);
+    static void writeAll(int fd, const std::string& data);
+
+    std::string pathOf(const std::string& name) const;
+    std::string logName(uint64_t generation) const;
+    void listLogs(std::vector<uint64_t>& generations) const;
+    void recover();
+    void openLog(uint64_t generation);
+    void syncDirectory() const;
+    void checkError() const;
+    bool present(const Key& key) const;
+    void commit(std::unique_lock<std::mutex>& guard, RecordType type, const Key& key, const Value* value);
+    void writeCheckpoint(const AVLTree<Key, Value>& snapshot, uint64_t firstLog);
+    void checkpointLoop();
+
+    std::string directory_;
+    WALOptions options_;
+    mutable std::mutex lock_;
+    std::mutex checkpointLock_;                 // one checkpoint at a time
+    std::condition_variable committed_;         // an fsync or a log rotation finished
+    std::condition_variable checkpointWake_;
+    AVLTree<Key, Value> tree_;
+    std::string pending_;       // records not yet written
+    std::deque<LogRecord> unapplied_;   // records not yet in tree_, oldest first
+    uint64_t lastLsn_;          // records appended, and records known to be on disk
+    uint64_t durableLsn_;
+    bool syncing_;
+    bool rotating_;
+    bool stopping_;
+    int logFd_;
+    uint64_t logGeneration_;
+    uint64_t logBytes_;
+    uint64_t nextCheckpointAt_;
+    std::string error_;         // set once a log write fails; later updates are refused
+    WALStats stats_;
+    std::thread checkpointer_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the DurableAVLTree class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+const char DurableAVLTree<Key, Value>::CHECKPOINT_MAGIC[8] = { 'A', 'V', 'L', 'C', 'K', 'P', 'T', '1' };
+
+/**
+* Opens, or creates, the tree stored in directory, recovering its
+* contents.
+*/
+template<class Key, class Value>
+DurableAVLTree<Key, Value>::DurableAVLTree(const std::string& directory, const WALOptions& options) :
+    directory_(directory), options_(options), lastLsn_(0), durableLsn_(0), syncing_(false),
+    rotating_(false), stopping_(false), logFd_(-1), logGeneration_(0), logBytes_(0),
+    nextCheckpointAt_(options.checkpointBytes)
+{
+    WALStats zero = { 0, 0, 0, 0, 0.0 };
+    stats_ = zero;
+    if (::mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Cannot create log directory " + directory_);
+    }
+    recover();
+    if (options_.checkpointBytes > 0) {
+        checkpointer_ = std::thread(&DurableAVLTree::checkpointLoop, this);
+    }
+}
+
+/**
+* Every acknowledged update is already on disk, so this only stops the
+* checkpoint thread and closes the log.
+*/
+template<class Key, class Value>
+DurableAVLTree<Key, Value>::~DurableAVLTree()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stopping_ = true;
+    }
+    checkpointWake_.notify_all();
+    if (checkpointer_.joinable()) {
+        checkpointer_.join();
+    }
+    if (logFd_ >= 0) {
+        ::close(logFd_);
+    }
+}
+
+template<class Key, class Value>
+std::string DurableAVLTree<Key, Value>::pathOf(const std::string& name) const
+{
+    return directory_ + "/" + name;
+}
+
+template<class Key, class Value>
+std::string DurableAVLTree<Key, Value>::logName(uint64_t generation) const
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "wal-%020llu.log", static_cast<unsigned long long>(generation));
+    return name;
+}
+
+/**
+* Collects the generations of the log files in the directory, oldest
+* first.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::listLogs(std::vector<uint64_t>& generations) const
+{
+    generations.clear();
+    DIR* dir = ::opendir(directory_.c_str());
+    if (dir == NULL) {
+        throw std::runtime_error("Cannot read log directory " + directory_);
+    }
+    while (struct dirent* item = ::readdir(dir)) {
+        unsigned long long generation;
+        char tail;
+        if (std::sscanf(item -> d_name, "wal-%llu.lo%c", &generation, &tail) == 2 && tail == 'g' &&
+            logName(generation) == item -> d_name) {
+            generations.push_back(generation);
+        }
+    }
+    ::closedir(dir);
+    std::sort(generations.begin(), generations.end());
+}
+
+/**
+* A record is its body length, the body's CRC and the body: a type byte,
+* the key and, for a put, the value.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::appendRecord(std::string& out, RecordType type, const Key& key, const Value* value)
+{
+    size_t start = out.size();
+    RunCodec<uint32_t>::encode(out, 0);
+    RunCodec<uint32_t>::encode(out, 0);
+    out.push_back(static_cast<char>(type));
+    RunCodec<Key>::encode(out, key);
+    if (value != NULL) {
+        RunCodec<Value>::encode(out, *value);
+    }
+    size_t bodyStart = start + 2 * sizeof(uint32_t);
+    uint32_t length = static_cast<uint32_t>(out.size() - bodyStart);
+    uint32_t crc = walCrc32(out.data() + bodyStart, length);
+    std::memcpy(&out[start], &length, sizeof(length));
+    std::memcpy(&out[start + sizeof(length)], &crc, sizeof(crc));
+}
+
+/**
+* Decodes the record at p. Returns the position after it, or NULL if the
+* record is cut short or does not match its CRC.
+*/
+template<class Key, class Value>
+const char* DurableAVLTree<Key, Value>::nextRecord(const char* p, const char* end, LogRecord& record)
+{
+    uint32_t length, crc;
+    if (static_cast<size_t>(end - p) < 2 * sizeof(uint32_t)) {
+        return NULL;
+    }
+    std::memcpy(&length, p, sizeof(length));
+    std::memcpy(&crc, p + sizeof(length), sizeof(crc));
+    p += 2 * sizeof(uint32_t);
+    if (static_cast<size_t>(end - p) < length || length == 0 || walCrc32(p, length) != crc) {
+        return NULL;
+    }
+
+    const char* body = p;
+    const char* bodyEnd = p + length;
+    char type = *body++;
+    if (type != PUT_RECORD && type != REMOVE_RECORD) {
+        return NULL;
+    }
+    try {
+        body = RunCodec<Key>::decode(body, bodyEnd, record.key);
+        record.live = (type == PUT_RECORD);
+        if (record.live) {
+            body = RunCodec<Value>::decode(body, bodyEnd, record.value);
+        }
+    }
+    catch (const std::runtime_error&) {
+        return NULL;
+    }
+    return (body == bodyEnd) ? bodyEnd : NULL;
+}
+
+/**
+* Reads a whole file. Returns false if it does not exist.
+*/
+template<class Key, class Value>
+bool DurableAVLTree<Key, Value>::readFile(const std::string& path, std::string& data)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return false;
+        }
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot read " + path);
+    }
+    data.resize(static_cast<size_t>(info.st_size));
+    size_t got = 0;
+    while (got < data.size()) {
+        ssize_t n = ::read(fd, &data[got], data.size() - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        got += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    data.resize(got);
+    return true;
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::writeAll(int fd, const std::string& data)
+{
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t wrote = ::write(fd, p, left);
+        if (wrote < 0 && errno == EINTR) {
+            continue;
+        }
+        if (wrote <= 0) {
+            throw std::runtime_error("Cannot write log");
+        }
+        p += wrote;
+        left -= static_cast<size_t>(wrote);
+    }
+}
+
+/**
+* Loads the checkpoint and the logs after it into the tree, removes logs
+* the checkpoint already covers, and starts a new log.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::recover()
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<std::pair<Key, Value> > items;
+    uint64_t firstLog = 0;
+    std::string data;
+
+    if (readFile(pathOf("checkpoint"), data)) {
+        const char* p = data.data();
+        const char* end = p + data.size();
+        uint64_t count;
+        if (data.size() < sizeof(CHECKPOINT_MAGIC) + 2 * sizeof(uint64_t) ||
+            std::memcmp(p, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+            throw std::runtime_error("Corrupt checkpoint in " + directory_);
+        }
+        p = RunCodec<uint64_t>::decode(p + sizeof(CHECKPOINT_MAGIC), end, firstLog);
+        p = RunCodec<uint64_t>::decode(p, end, count);
+        items.reserve(static_cast<size_t>(count));
+        LogRecord record;
+        for (uint64_t i = 0; i < count; ++i) {
+            p = nextRecord(p, end, record);
+            if (p == NULL || !record.live) {
+                throw std::runtime_error("Corrupt checkpoint in " + directory_);
+            }
+            items.push_back(std::make_pair(record.key, record.value));
+        }
+    }
+
+    std::vector<uint64_t> generations;
+    listLogs(generations);
+    std::vector<LogRecord> records;
+    uint64_t lastGeneration = firstLog;
+    for (size_t i = 0; i < generations.size(); ++i) {
+        std::string path = pathOf(logName(generations[i]));
+        if (generations[i] < firstLog) {
+            // left behind by a crash after its checkpoint was in place
+            ::unlink(path.c_str());
+            continue;
+        }
+        lastGeneration = generations[i];
+        readFile(path, data);
+        const char* p = data.data();
+        const char* end = p + data.size();
+        LogRecord record;
+        while (p != NULL && p < end) {
+            p = nextRecord(p, end, record);
+            if (p != NULL) {
+                records.push_back(record);
+            }
+        }
+    }
+
+    // newest record per key, merged into the checkpoint's items
+    std::stable_sort(records.begin(), records.end(),
+                     [](const LogRecord& a, const LogRecord& b) { return a.key < b.key; });
+    std::vector<std::pair<Key, Value> > merged;
+    merged.reserve(items.size() + records.size());
+    size_t i = 0;
+    for (size_t j = 0; j < records.size(); ) {
+        size_t last = j;
+        while (last + 1 < records.size() && !(records[j].key < records[last + 1].key)) {
+            ++last;
+        }
+        while (i < items.size() && items[i].first < records[j].key) {
+            merged.push_back(items[i++]);
+        }
+        if (i < items.size() && !(records[j].key < items[i].first)) {
+            ++i;
+        }
+        if (records[last].live) {
+            merged.push_back(std::make_pair(records[last].key, records[last].value));
+        }
+        j = last + 1;
+    }
+    merged.insert(merged.end(), items.begin() + i, items.end());
+    std::vector<std::pair<Key, Value> >().swap(items);
+
+    tree_.buildFromSorted(merged.begin(), merged.end());
+    stats_.replayed = records.size();
+    openLog(std::max<uint64_t>(lastGeneration + 1, 1));
+    logBytes_ = 0;
+    stats_.recoverySeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/**
+* Starts a new, empty log file and makes it the one appended to.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::openLog(uint64_t generation)
+{
+    std::string path = pathOf(logName(generation));
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create log " + path);
+    }
+    syncDirectory();
+    if (logFd_ >= 0) {
+        ::close(logFd_);
+    }
+    logFd_ = fd;
+    logGeneration_ = generation;
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::syncDirectory() const
+{
+    int fd = ::open(directory_.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::checkError() const
+{
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+}
+
+/**
+* Whether key is in the tree once every queued record is applied.
+*/
+template<class Key, class Value>
+bool DurableAVLTree<Key, Value>::present(const Key& key) const
+{
+    for (typename std::deque<LogRecord>::const_reverse_iterator it = unapplied_.rbegin();
+         it != unapplied_.rend(); ++it) {
+        if (!(it -> key < key) && !(key < it -> key)) {
+            return it -> live;
+        }
+    }
+    return tree_.find(key) != tree_.end();
+}
+
+/**
+* Queues a record and waits until it is on disk and in the tree. If no
+* fsync is running this writer writes and syncs everything queued so far,
+* its own record and any others, applies them to the tree in log order
+* and wakes the writers it covered. A failed write or sync leaves the
+* tree as it was.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::commit(std::unique_lock<std::mutex>& guard, RecordType type,
+                                        const Key& key, const Value* value)
+{
+    appendRecord(pending_, type, key, value);
+    LogRecord record;
+    record.key = key;
+    if (value != NULL) {
+        record.value = *value;
+    }
+    record.live = (type == PUT_RECORD);
+    unapplied_.push_back(record);
+    uint64_t lsn = ++lastLsn_;
+    ++stats_.commits;
+
+    while (durableLsn_ < lsn) {
+        checkError();
+        if (syncing_) {
+            committed_.wait(guard);
+            continue;
+        }
+
+        syncing_ = true;
+        std::string batch;
+        batch.swap(pending_);
+        uint64_t upto = lastLsn_;
+        int fd = logFd_;
+
+        guard.unlock();
+        std::string failure;
+        try {
+            writeAll(fd, batch);
+            if (::fdatasync(fd) != 0) {
+                throw std::runtime_error("Cannot sync log");
+            }
+        }
+        catch (const std::exception& e) {
+            failure = e.what();
+        }
+        guard.lock();
+
+        syncing_ = false;
+        if (!failure.empty()) {
+            error_ = failure;
+        }
+        else {
+            // records past upto were queued during the sync and stay queued
+            for (; durableLsn_ < upto; ++durableLsn_) {
+                LogRecord& applied = unapplied_.front();
+                if (applied.live) {
+                    tree_.insert(std::make_pair(applied.key, applied.value));
+                }
+                else {
+                    tree_.remove(applied.key);
+                }
+                unapplied_.pop_front();
+            }
+            logBytes_ += batch.size();
+            ++stats_.syncs;
+        }
+        committed_.notify_all();
+        if (options_.checkpointBytes > 0 && logBytes_ >= nextCheckpointAt_) {
+            checkpointWake_.notify_one();
+        }
+    }
+}
+
+/**
+* Inserts or overwrites the item and returns once the change is durable.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    committed_.wait(guard, [this]() { return !rotating_ || !error_.empty(); });
+    checkError();
+    commit(guard, PUT_RECORD, keyValuePair.first, &keyValuePair.second);
+}
+
+/**
+* Removes key and returns once the change is durable. Removing a missing
+* key writes nothing.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::remove(const Key& key)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    committed_.wait(guard, [this]() { return !rotating_ || !error_.empty(); });
+    checkError();
+    if (!present(key)) {
+        return;
+    }
+    commit(guard, REMOVE_RECORD, key, NULL);
+}
+
+template<class Key, class Value>
+bool DurableAVLTree<Key, Value>::find(const Key& key, Value& value) const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    typename AVLTree<Key, Value>::iterator it = tree_.find(key);
+    if (it == tree_.end()) {
+        return false;
+    }
+    value = it -> second;
+    return true;
+}
+
+template<class Key, class Value>
+bool DurableAVLTree<Key, Value>::contains(const Key& key) const
+{
+    Value value;
+    return find(key, value);
+}
+
+/**
+ * @precondition The key exists in the tree
+ * Returns a copy of the value associated with the key
+ */
+template<class Key, class Value>
+Value DurableAVLTree<Key, Value>::get(const Key& key) const
+{
+    Value value;
+    if (!find(key, value)) throw std::out_of_range("Invalid key");
+    return value;
+}
+
+template<class Key, class Value>
+size_t DurableAVLTree<Key, Value>::size() const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return tree_.size();
+}
+
+/**
+* Calls callback on every item with lo <= key <= hi, in order, holding
+* the lock throughout.
+*/
+template<class Key, class Value>
+template<typename Callback>
+void DurableAVLTree<Key, Value>::scan(const Key& lo, const Key& hi, Callback callback) const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    tree_.scan(lo, hi, callback);
+}
+
+template<class Key, class Value>
+WALStats DurableAVLTree<Key, Value>::stats() const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+/**
+* Writes the tree to the checkpoint file and deletes the logs it makes
+* unnecessary. Writers wait only while the tree is cloned.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::checkpoint()
+{
+    std::lock_guard<std::mutex> single(checkpointLock_);
+    AVLTree<Key, Value> snapshot;
+    uint64_t firstLog;
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        checkError();
+        // new writers wait, and the ones already queued finish their batch
+        rotating_ = true;
+        committed_.wait(guard, [this]() { return (!syncing_ && pending_.empty()) || !error_.empty(); });
+        try {
+            checkError();
+            snapshot = tree_;
+            openLog(logGeneration_ + 1);
+        }
+        catch (...) {
+            rotating_ = false;
+            committed_.notify_all();
+            throw;
+        }
+        firstLog = logGeneration_;
+        logBytes_ = 0;
+        nextCheckpointAt_ = options_.checkpointBytes;
+        rotating_ = false;
+        committed_.notify_all();
+    }
+
+    writeCheckpoint(snapshot, firstLog);
+
+    std::vector<uint64_t> generations;
+    listLogs(generations);
+    for (size_t i = 0; i < generations.size() && generations[i] < firstLog; ++i) {
+        ::unlink(pathOf(logName(generations[i])).c_str());
+    }
+    syncDirectory();
+
+    std::lock_guard<std::mutex> guard(lock_);
+    ++stats_.checkpoints;
+}
+
+/**
+* Writes snapshot under a temporary name, syncs it and renames it over
+* the old checkpoint, so a crash leaves one whole checkpoint or the other.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::writeCheckpoint(const AVLTree<Key, Value>& snapshot, uint64_t firstLog)
+{
+    std::string temp = pathOf("checkpoint.tmp");
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create " + temp);
+    }
+    try {
+        std::string out(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        RunCodec<uint64_t>::encode(out, firstLog);
+        RunCodec<uint64_t>::encode(out, static_cast<uint64_t>(snapshot.size()));
+
+        std::vector<std::pair<Key, Value> > chunk(4096);
+        typename AVLTree<Key, Value>::exporter cursor = snapshot.beginExport();
+        while (!cursor.done()) {
+            size_t count = cursor.next(chunk.data(), chunk.size());
+            for (size_t i = 0; i < count; ++i) {
+                appendRecord(out, PUT_RECORD, chunk[i].first, &chunk[i].second);
+            }
+            if (out.size() >= (1 << 20)) {
+                writeAll(fd, out);
+                out.clear();
+            }
+        }
+        writeAll(fd, out);
+        if (::fsync(fd) != 0) {
+            throw std::runtime_error("Cannot sync " + temp);
+        }
+    }
+    catch (...) {
+        ::close(fd);
+        ::unlink(temp.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (::rename(temp.c_str(), pathOf("checkpoint").c_str()) != 0) {
+        ::unlink(temp.c_str());
+        throw std::runtime_error("Cannot rename " + temp);
+    }
+    syncDirectory();
+}
+
+/**
+* Checkpoints whenever the log grows past checkpointBytes. After a failed
+* checkpoint it waits for another checkpointBytes of log before trying
+* again; the log still holds everything.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::checkpointLoop()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    while (true) {
+        checkpointWake_.wait(guard, [this]() { return stopping_ || logBytes_ >= nextCheckpointAt_; });
+        if (stopping_) {
+            break;
+        }
+        guard.unlock();
+        bool failed = false;
+        try {
+            checkpoint();
+        }
+        catch (const std::exception&) {
+            failed = true;
+        }
+        guard.lock();
+        if (failed) {
+            nextCheckpointAt_ = logBytes_ + options_.checkpointBytes;
+        }
+    }
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the DurableAVLTree class.
+  -----------------------------------------------
+*/
+
+#endif